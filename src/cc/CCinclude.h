@@ -234,9 +234,6 @@ extern CWallet* pwalletMain;  //!< global wallet object pointer to access wallet
 #endif
 //extern CCoinsViewCache *pcoinsTip;
 
-/// @private seems old-style
-bool GetAddressUnspent(uint160 addressHash, int type,std::vector<std::pair<CAddressUnspentKey,CAddressUnspentValue> > &unspentOutputs);
-
 /// CCgetspenttxid finds the txid of the transaction which spends a transaction output. The function does this without loading transactions from the chain, by using spent index
 /// @param[out] spenttxid transaction id of the spending transaction
 /// @param[out] vini order number of input of the spending transaction
@@ -84,6 +84,7 @@ bool CCoinsView::BatchWrite(CCoinsMap &mapCoins,
                             CProofHashMap &mapZkOutputProofHash,
                             CProofHashMap &mapZkSpendProofHash) { return false; }
 bool CCoinsView::GetStats(CCoinsStats &stats) const { return false; }
+bool CCoinsView::GetStatsParallel(CCoinsStats &stats, int nThreads) const { return false; }
 
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
@@ -111,6 +112,7 @@ bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
                                   CProofHashMap &mapZkOutputProofHash,
                                   CProofHashMap &mapZkSpendProofHash) { return base->BatchWrite(mapCoins, hashBlock, hashSproutAnchor, hashSaplingAnchor, hashSaplingFontierAnchor, mapSproutAnchors, mapSaplingAnchors, mapSaplingFrontierAnchors, mapSproutNullifiers, mapSaplingNullifiers, mapZkOutputProofHash, mapZkSpendProofHash); }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStats(stats); }
+bool CCoinsViewBacked::GetStatsParallel(CCoinsStats &stats, int nThreads) const { return base->GetStatsParallel(stats, nThreads); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
@@ -394,10 +394,12 @@ struct CCoinsStats
     uint64_t nTransactions;
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
+    uint64_t nBogoSize;
     uint256 hashSerialized;
+    uint256 hashMuHash;
     CAmount nTotalAmount;
 
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nBogoSize(0), nTotalAmount(0) {}
 };
 
 
@@ -451,6 +453,9 @@ public:
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats &stats) const;
 
+    //! Calculate statistics about the unspent transaction output set with a parallel MuHash scan
+    virtual bool GetStatsParallel(CCoinsStats &stats, int nThreads) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -487,6 +492,7 @@ public:
                     CProofHashMap &mapZkOutputProofHash,
                     CProofHashMap &mapZkSpendProofHash);
     bool GetStats(CCoinsStats &stats) const;
+    bool GetStatsParallel(CCoinsStats &stats, int nThreads) const;
 };
 
 
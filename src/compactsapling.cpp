@@ -0,0 +1,45 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "compactsapling.h"
+
+#include "chain.h"
+
+#include <algorithm>
+
+void BuildCompactSaplingBlock(const CBlock& block, const CBlockIndex* pindex, CCompactSaplingBlock& compact)
+{
+    compact.nHeight = pindex->nHeight;
+    compact.hash = pindex->GetBlockHash();
+    compact.hashPrevBlock = block.hashPrevBlock;
+    compact.nTime = block.nTime;
+    compact.hashFinalSaplingRoot = block.hashFinalSaplingRoot;
+    compact.nTx = block.vtx.size();
+    compact.vtx.clear();
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        if (tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty())
+            continue;
+
+        compact.vtx.push_back(CCompactSaplingTx());
+        CCompactSaplingTx& ctx = compact.vtx.back();
+        ctx.nIndex = i;
+        ctx.txid = tx.GetHash();
+
+        ctx.vNullifiers.reserve(tx.vShieldedSpend.size());
+        for (const SpendDescription& spend : tx.vShieldedSpend)
+            ctx.vNullifiers.push_back(spend.nullifier);
+
+        ctx.vOutputs.resize(tx.vShieldedOutput.size());
+        for (size_t j = 0; j < tx.vShieldedOutput.size(); j++) {
+            const OutputDescription& output = tx.vShieldedOutput[j];
+            CCompactSaplingOutput& coutput = ctx.vOutputs[j];
+            coutput.cmu = output.cmu;
+            coutput.ephemeralKey = output.ephemeralKey;
+            std::copy(output.encCiphertext.begin(), output.encCiphertext.begin() + COMPACT_SAPLING_CIPHERTEXT_SIZE,
+                      coutput.ciphertext.begin());
+        }
+    }
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COMPACTSAPLING_H
+#define BITCOIN_COMPACTSAPLING_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+#include "zcash/Zcash.h"
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * Bytes of a note ciphertext a light client needs to trial-decrypt an output:
+ * the lead byte, diversifier, value and rcm of the note plaintext, without the
+ * memo and authentication tag (ZIP 307).
+ */
+static const size_t COMPACT_SAPLING_CIPHERTEXT_SIZE = ZC_NOTEPLAINTEXT_LEADING + ZC_DIVERSIFIER_SIZE + ZC_V_SIZE + ZC_R_SIZE;
+
+/** A Sapling output reduced to what a light client needs to detect and track its own notes. */
+class CCompactSaplingOutput
+{
+public:
+    uint256 cmu;
+    uint256 ephemeralKey;
+    std::array<unsigned char, COMPACT_SAPLING_CIPHERTEXT_SIZE> ciphertext;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(cmu);
+        READWRITE(ephemeralKey);
+        READWRITE(ciphertext);
+    }
+};
+
+/** The Sapling part of a transaction: its index in the block, txid, spent nullifiers and compact outputs. */
+class CCompactSaplingTx
+{
+public:
+    uint32_t nIndex;
+    uint256 txid;
+    std::vector<uint256> vNullifiers;
+    std::vector<CCompactSaplingOutput> vOutputs;
+
+    CCompactSaplingTx() : nIndex(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nIndex);
+        READWRITE(txid);
+        READWRITE(vNullifiers);
+        READWRITE(vOutputs);
+    }
+};
+
+/**
+ * A block reduced to its Sapling transactions, in the order they appear.
+ * Transactions without Sapling spends or outputs are left out; nTx keeps the
+ * count of all of them so clients can tell.
+ */
+class CCompactSaplingBlock
+{
+public:
+    int32_t nHeight;
+    uint256 hash;
+    uint256 hashPrevBlock;
+    uint32_t nTime;
+    uint256 hashFinalSaplingRoot;
+    uint32_t nTx;
+    std::vector<CCompactSaplingTx> vtx;
+
+    CCompactSaplingBlock() : nHeight(0), nTime(0), nTx(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nHeight);
+        READWRITE(hash);
+        READWRITE(hashPrevBlock);
+        READWRITE(nTime);
+        READWRITE(hashFinalSaplingRoot);
+        READWRITE(nTx);
+        READWRITE(vtx);
+    }
+};
+
+/** Reduce a block at the position pindex in the chain to its compact Sapling form. */
+void BuildCompactSaplingBlock(const CBlock& block, const CBlockIndex* pindex, CCompactSaplingBlock& compact);
+
+#endif // BITCOIN_COMPACTSAPLING_H
@@ -0,0 +1,285 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/blake2b.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__amd64__)) && defined(__GNUC__) && !defined(_WIN32)
+#define BLAKE2B_X86_LANES
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal BLAKE2b implementation.
+namespace blake2b
+{
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+};
+
+const uint8_t SIGMA[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}
+};
+
+/** The most lanes any multi-lane implementation compresses per call. */
+const size_t MAX_LANES = 8;
+
+uint64_t inline Rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+/** The mixing function G on LANES independent states at once. */
+template<size_t LANES>
+void inline __attribute__((always_inline)) G(uint64_t (&a)[LANES], uint64_t (&b)[LANES], uint64_t (&c)[LANES], uint64_t (&d)[LANES], const uint64_t (&x)[LANES], const uint64_t (&y)[LANES])
+{
+    for (size_t l = 0; l < LANES; l++) {
+        a[l] = a[l] + b[l] + x[l];
+        d[l] = Rotr(d[l] ^ a[l], 32);
+        c[l] = c[l] + d[l];
+        b[l] = Rotr(b[l] ^ c[l], 24);
+        a[l] = a[l] + b[l] + y[l];
+        d[l] = Rotr(d[l] ^ a[l], 16);
+        c[l] = c[l] + d[l];
+        b[l] = Rotr(b[l] ^ c[l], 63);
+    }
+}
+
+/**
+ * Compress one block per lane, all lanes starting from the same chaining
+ * value h with the same byte counter t. Lane l of message word w is
+ * m[w][l] and of output word w is out[w][l]. Written as plain loops over
+ * the lanes so the compiler can keep each row of state in a vector register.
+ */
+template<size_t LANES>
+void inline __attribute__((always_inline)) Compress(const uint64_t* h, uint64_t t, bool fLast, const uint64_t (&m)[16][LANES], uint64_t (&out)[8][LANES])
+{
+    uint64_t v[16][LANES];
+    for (int i = 0; i < 8; i++) {
+        for (size_t l = 0; l < LANES; l++) {
+            v[i][l] = h[i];
+            v[i + 8][l] = IV[i];
+        }
+    }
+    for (size_t l = 0; l < LANES; l++) {
+        v[12][l] ^= t;
+        if (fLast)
+            v[14][l] = ~v[14][l];
+    }
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G<LANES>(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G<LANES>(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G<LANES>(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G<LANES>(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G<LANES>(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G<LANES>(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G<LANES>(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G<LANES>(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; i++) {
+        for (size_t l = 0; l < LANES; l++)
+            out[i][l] = h[i] ^ v[i][l] ^ v[i + 8][l];
+    }
+}
+
+/** Compress a single 128-byte block into h. */
+void Transform(uint64_t* h, const unsigned char* block, uint64_t t, bool fLast)
+{
+    uint64_t m[16][1], out[8][1];
+    for (int w = 0; w < 16; w++)
+        m[w][0] = ReadLE64(block + 8 * w);
+    Compress<1>(h, t, fLast, m, out);
+    for (int i = 0; i < 8; i++)
+        h[i] = out[i][0];
+}
+
+/**
+ * Compress the last block of each lane. m holds 16 words for each of
+ * MAX_LANES lanes, word w of lane l at m[w * MAX_LANES + l], of which the
+ * first lane count are used; out is laid out the same way with 8 words.
+ */
+typedef void (*TransformLanesType)(const uint64_t* h, uint64_t t, const uint64_t* m, uint64_t* out);
+
+template<size_t LANES>
+void inline __attribute__((always_inline)) TransformLanesImpl(const uint64_t* h, uint64_t t, const uint64_t* m, uint64_t* out)
+{
+    uint64_t mLanes[16][LANES], outLanes[8][LANES];
+    for (int w = 0; w < 16; w++)
+        memcpy(mLanes[w], m + w * MAX_LANES, sizeof(mLanes[w]));
+    Compress<LANES>(h, t, true, mLanes, outLanes);
+    for (int w = 0; w < 8; w++)
+        memcpy(out + w * MAX_LANES, outLanes[w], sizeof(outLanes[w]));
+}
+
+void TransformLanes4(const uint64_t* h, uint64_t t, const uint64_t* m, uint64_t* out) { TransformLanesImpl<4>(h, t, m, out); }
+
+#if defined(BLAKE2B_X86_LANES)
+__attribute__((target("avx2")))
+void TransformLanes4AVX2(const uint64_t* h, uint64_t t, const uint64_t* m, uint64_t* out) { TransformLanesImpl<4>(h, t, m, out); }
+
+__attribute__((target("avx512f")))
+void TransformLanes8AVX512(const uint64_t* h, uint64_t t, const uint64_t* m, uint64_t* out) { TransformLanesImpl<8>(h, t, m, out); }
+#endif
+
+} // namespace blake2b
+
+blake2b::TransformLanesType TransformLanes = blake2b::TransformLanes4;
+size_t nLanes = 4;
+
+bool SelfTest()
+{
+    // Finish a 140-byte prefix (one compressed block plus a partial one,
+    // like an Equihash header and nonce) with more indices than lanes, and
+    // compare against finishing each copy on its own.
+    static const unsigned char personal[CBlake2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's', 'h', 'P', 'o', 'W', 200, 0, 0, 0, 9, 0, 0, 0};
+    unsigned char prefix[140];
+    for (size_t i = 0; i < sizeof(prefix); i++)
+        prefix[i] = (unsigned char)(i * 7 + 1);
+    CBlake2b hasher(50, personal);
+    hasher.Write(prefix, sizeof(prefix));
+
+    const uint32_t indices[11] = {0, 1, 2, 0xffffffff, 5, 1u << 20, 77, 3, 0x01020304, 9, 10};
+    unsigned char batched[11 * 50], single[50];
+    hasher.FinalizeIndices(indices, 11, batched);
+    for (size_t i = 0; i < 11; i++) {
+        unsigned char le[4];
+        WriteLE32(le, indices[i]);
+        CBlake2b(hasher).Write(le, 4).Finalize(single);
+        if (memcmp(single, batched + i * 50, 50)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::string Blake2bAutoDetect()
+{
+#if defined(BLAKE2B_X86_LANES)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        TransformLanes = blake2b::TransformLanes8AVX512;
+        nLanes = 8;
+        assert(SelfTest());
+        return "avx512f (8 lanes)";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        TransformLanes = blake2b::TransformLanes4AVX2;
+        nLanes = 4;
+        assert(SelfTest());
+        return "avx2 (4 lanes)";
+    }
+#endif
+
+    assert(SelfTest());
+    return "standard";
+}
+
+////// BLAKE2b
+
+CBlake2b::CBlake2b(size_t outlenIn, const unsigned char* personal) : buflen(0), bytes(0), outlen(outlenIn)
+{
+    assert(outlen > 0 && outlen <= OUTPUT_SIZE);
+    memcpy(h, blake2b::IV, sizeof(h));
+    // Parameter block: digest length, no key, fanout 1, depth 1
+    h[0] ^= 0x01010000ull ^ outlen;
+    if (personal) {
+        h[6] ^= ReadLE64(personal);
+        h[7] ^= ReadLE64(personal + 8);
+    }
+}
+
+CBlake2b& CBlake2b::Write(const unsigned char* data, size_t len)
+{
+    const unsigned char* end = data + len;
+    // The last block is compressed with a flag set, so a full block is
+    // only processed once more input is known to follow it.
+    if (buflen && buflen + len > 128) {
+        // Fill the buffer, and process it.
+        memcpy(buf + buflen, data, 128 - buflen);
+        data += 128 - buflen;
+        bytes += 128;
+        blake2b::Transform(h, buf, bytes, false);
+        buflen = 0;
+    }
+    while (end - data > 128) {
+        // Process full chunks directly from the source.
+        bytes += 128;
+        blake2b::Transform(h, data, bytes, false);
+        data += 128;
+    }
+    if (end > data) {
+        // Fill the buffer with what remains.
+        memcpy(buf + buflen, data, end - data);
+        buflen += end - data;
+    }
+    return *this;
+}
+
+void CBlake2b::Finalize(unsigned char* hash)
+{
+    memset(buf + buflen, 0, 128 - buflen);
+    bytes += buflen;
+    blake2b::Transform(h, buf, bytes, true);
+    unsigned char digest[OUTPUT_SIZE];
+    for (int i = 0; i < 8; i++)
+        WriteLE64(digest + 8 * i, h[i]);
+    memcpy(hash, digest, outlen);
+}
+
+void CBlake2b::FinalizeIndices(const uint32_t* indices, size_t count, unsigned char* out) const
+{
+    if (buflen + 4 > 128) {
+        // The index would spill into a block of its own; finish each copy separately.
+        for (size_t i = 0; i < count; i++) {
+            unsigned char le[4];
+            WriteLE32(le, indices[i]);
+            CBlake2b(*this).Write(le, 4).Finalize(out + i * outlen);
+        }
+        return;
+    }
+
+    unsigned char block[128];
+    memcpy(block, buf, buflen);
+    memset(block + buflen, 0, 128 - buflen);
+    uint64_t m[16 * blake2b::MAX_LANES], digest[8 * blake2b::MAX_LANES];
+    unsigned char digestBytes[OUTPUT_SIZE];
+    // Only the words the index lands in differ between lanes
+    const size_t wFirst = buflen / 8, wLast = (buflen + 3) / 8;
+    for (int w = 0; w < 16; w++) {
+        uint64_t word = ReadLE64(block + 8 * w);
+        for (size_t l = 0; l < blake2b::MAX_LANES; l++)
+            m[w * blake2b::MAX_LANES + l] = word;
+    }
+
+    for (size_t i = 0; i < count; i += nLanes) {
+        size_t n = std::min(nLanes, count - i);
+        for (size_t l = 0; l < n; l++) {
+            WriteLE32(block + buflen, indices[i + l]);
+            for (size_t w = wFirst; w <= wLast; w++)
+                m[w * blake2b::MAX_LANES + l] = ReadLE64(block + 8 * w);
+        }
+        TransformLanes(h, bytes + buflen + 4, m, digest);
+        for (size_t l = 0; l < n; l++) {
+            for (int w = 0; w < 8; w++)
+                WriteLE64(digestBytes + 8 * w, digest[w * blake2b::MAX_LANES + l]);
+            memcpy(out + (i + l) * outlen, digestBytes, outlen);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_BLAKE2B_H
+#define BITCOIN_CRYPTO_BLAKE2B_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** A hasher class for BLAKE2b, unkeyed, with an optional personalization. */
+class CBlake2b
+{
+private:
+    uint64_t h[8];
+    unsigned char buf[128];
+    size_t buflen;
+    uint64_t bytes; //!< bytes compressed so far
+    size_t outlen;
+
+public:
+    static const size_t OUTPUT_SIZE = 64;
+    static const size_t PERSONAL_SIZE = 16;
+
+    explicit CBlake2b(size_t outlenIn = OUTPUT_SIZE, const unsigned char* personal = nullptr);
+    CBlake2b& Write(const unsigned char* data, size_t len);
+    /** Write the outlen byte digest to hash */
+    void Finalize(unsigned char* hash);
+
+    /**
+     * For each of count indices, the digest of everything written so far
+     * followed by the index as a little-endian 32-bit word, written to
+     * consecutive outlen byte slots of out. When the index fits in the last
+     * block the copies share the compressed prefix and their last blocks
+     * are compressed side by side, several lanes per call.
+     */
+    void FinalizeIndices(const uint32_t* indices, size_t count, unsigned char* out) const;
+};
+
+/** Autodetect the best available multi-lane BLAKE2b implementation.
+ *  Returns the name of the implementation.
+ */
+std::string Blake2bAutoDetect();
+
+#endif // BITCOIN_CRYPTO_BLAKE2B_H
@@ -74,19 +74,25 @@ int8_t ZeroizeUnusedBits(size_t N, unsigned char* hash, size_t hLen)
 }
 
 
-template<unsigned int N, unsigned int K>
-int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
+static void GetPersonalization(unsigned int N, unsigned int K, unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES])
 {
     uint32_t le_N = htole32(N);
     uint32_t le_K = htole32(K);
 
-    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES] = {};
+    memset(personalization, 0, crypto_generichash_blake2b_PERSONALBYTES);
     if ( ASSETCHAINS_NK[0] == 0 && ASSETCHAINS_NK[1] == 0 )
         memcpy(personalization, "ZcashPoW", 8);
     else 
         memcpy(personalization, "NandKPoW", 8);
     memcpy(personalization+8,  &le_N, 4);
     memcpy(personalization+12, &le_K, 4);
+}
+
+template<unsigned int N, unsigned int K>
+int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
+{
+    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES];
+    GetPersonalization(N, K, personalization);
 
     const uint8_t outlen = (512 / N) * GetSizeInBytes(N);
 
@@ -822,7 +828,51 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
         X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * GetSizeInBytes(N)),
                        GetSizeInBytes(N), HashLength, CollisionBitLength, i);
     }
+    return IsValidTree(X);
+}
 
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const unsigned char* input, size_t inputLen, std::vector<unsigned char> soln)
+{
+    if ( ASSETCHAINS_NK[0] != 0 || ASSETCHAINS_NK[1] != 0 )
+    {
+        // Leaf hashes here sum several BLAKE2b outputs, see GenerateHash
+        eh_HashState state;
+        InitialiseState(state);
+        crypto_generichash_blake2b_update(&state, input, inputLen);
+        return IsValidSolution(state, soln);
+    }
+
+    if (soln.size() != SolutionWidth) {
+        LogPrint("pow", "Invalid solution length: %d (expected %d)\n",
+                 soln.size(), SolutionWidth);
+        return false;
+    }
+
+    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES];
+    GetPersonalization(N, K, personalization);
+    CBlake2b midstate(HashOutput, personalization);
+    midstate.Write(input, inputLen);
+
+    std::vector<eh_index> indices = GetIndicesFromMinimal(soln, CollisionBitLength);
+    std::vector<uint32_t> blocks(indices.size());
+    for (size_t j = 0; j < indices.size(); j++)
+        blocks[j] = indices[j] / IndicesPerHashOutput;
+    std::vector<unsigned char> hashes(indices.size() * HashOutput);
+    midstate.FinalizeIndices(blocks.data(), blocks.size(), hashes.data());
+
+    std::vector<FullStepRow<FinalFullWidth>> X;
+    X.reserve(1 << K);
+    for (size_t j = 0; j < indices.size(); j++) {
+        X.emplace_back(&hashes[j * HashOutput] + ((indices[j] % IndicesPerHashOutput) * GetSizeInBytes(N)),
+                       GetSizeInBytes(N), HashLength, CollisionBitLength, indices[j]);
+    }
+    return IsValidTree(X);
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidTree(std::vector<FullStepRow<FinalFullWidth>>& X)
+{
     size_t hashLen = HashLength;
     size_t lenIndices = sizeof(eh_index);
     while (X.size() > 1) {
@@ -864,6 +914,7 @@ template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<200,9>::IsValidSolution(const unsigned char* input, size_t inputLen, std::vector<unsigned char> soln);
                                               
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<150,5>::InitialiseState(eh_HashState& base_state);
@@ -876,6 +927,7 @@ template bool Equihash<150,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<150,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<150,5>::IsValidSolution(const unsigned char* input, size_t inputLen, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<144,5>::InitialiseState(eh_HashState& base_state);
@@ -888,6 +940,7 @@ template bool Equihash<144,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<144,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<144,5>::IsValidSolution(const unsigned char* input, size_t inputLen, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<ASSETCHAINS_N,ASSETCHAINS_K>::InitialiseState(eh_HashState& base_state);
@@ -900,6 +953,7 @@ template bool Equihash<ASSETCHAINS_N,ASSETCHAINS_K>::OptimisedSolve(const eh_Has
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<ASSETCHAINS_N,ASSETCHAINS_K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<ASSETCHAINS_N,ASSETCHAINS_K>::IsValidSolution(const unsigned char* input, size_t inputLen, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state);
@@ -912,6 +966,7 @@ template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<48,5>::IsValidSolution(const unsigned char* input, size_t inputLen, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<210,9>::InitialiseState(eh_HashState& base_state);
@@ -924,3 +979,4 @@ template bool Equihash<210,9>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<210,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<210,9>::IsValidSolution(const unsigned char* input, size_t inputLen, std::vector<unsigned char> soln);
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_EQUIHASH_H
 #define BITCOIN_EQUIHASH_H
 
+#include "crypto/blake2b.h"
 #include "crypto/sha256.h"
 #include "util/strencodings.h"
 
@@ -202,6 +203,15 @@ public:
                         const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
     bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+    /**
+     * Check soln against the header input I||V. The input is hashed once
+     * and the leaf hashes of all the solution's indices are finished from
+     * that midstate in batches.
+     */
+    bool IsValidSolution(const unsigned char* input, size_t inputLen, std::vector<unsigned char> soln);
+
+private:
+    bool IsValidTree(std::vector<FullStepRow<FinalFullWidth>>& X);
 };
 
 #include "equihash.tcc"
@@ -312,4 +322,21 @@ inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const
         throw std::invalid_argument("Unsupported Equihash parameters"); \
     }
 
+#define EhIsValidSolutionForInput(n, k, input, inputLen, soln, ret)   \
+    if (n == 200 && k == 9) {                             \
+        ret = Eh200_9.IsValidSolution(input, inputLen, soln);  \
+    } else if (n == 150 && k == 5) {                     \
+        ret = Eh150_5.IsValidSolution(input, inputLen, soln); \
+    } else if (n == 144 && k == 5) {                      \
+        ret = Eh144_5.IsValidSolution(input, inputLen, soln);  \
+    } else if (n == ASSETCHAINS_N && k == ASSETCHAINS_K) { \
+        ret = Eh96_5.IsValidSolution(input, inputLen, soln);  \
+    } else if (n == 48 && k == 5) {                      \
+        ret = Eh48_5.IsValidSolution(input, inputLen, soln);  \
+    } else if (n == 210 && k == 9) {                    \
+        ret = Eh210_9.IsValidSolution(input, inputLen, soln);  \
+    } else {                                             \
+        throw std::invalid_argument("Unsupported Equihash parameters"); \
+    }
+
 #endif // BITCOIN_EQUIHASH_H
@@ -0,0 +1,184 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "crypto/sha512.h"
+
+#include <string.h>
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (size_t i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLE32(data + 4 * i);
+    }
+    // The largest 3072-bit numbers are not valid group elements; reduce them.
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (size_t i = 1; i < LIMBS; ++i) limbs[i] = 0;
+}
+
+/** Whether this number is >= 2^3072 - MAX_PRIME_DIFF. */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= 0xFFFFFFFFUL - MAX_PRIME_DIFF) return false;
+    for (size_t i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != 0xFFFFFFFFUL) return false;
+    }
+    return true;
+}
+
+/** Subtract the modulus, assuming IsOverflow(). Adding MAX_PRIME_DIFF and dropping the 2^3072 bit is equivalent. */
+void Num3072::FullReduce()
+{
+    uint64_t c = MAX_PRIME_DIFF;
+    for (size_t i = 0; i < LIMBS && c; ++i) {
+        c += limbs[i];
+        limbs[i] = (uint32_t)c;
+        c >>= 32;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook product into 6144 bits. Every intermediate fits in 64 bits:
+    // (2^32-1)^2 + 2 * (2^32-1) == 2^64-1.
+    uint32_t tmp[2 * LIMBS];
+    memset(tmp, 0, sizeof(tmp));
+    for (size_t i = 0; i < LIMBS; ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < LIMBS; ++j) {
+            uint64_t t = (uint64_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        tmp[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // Fold the upper half back in, using 2^3072 == MAX_PRIME_DIFF (mod p).
+    uint64_t carry = 0;
+    for (size_t i = 0; i < LIMBS; ++i) {
+        uint64_t t = (uint64_t)tmp[i] + (uint64_t)tmp[i + LIMBS] * MAX_PRIME_DIFF + carry;
+        limbs[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    while (carry) {
+        uint64_t c = carry * MAX_PRIME_DIFF;
+        carry = 0;
+        for (size_t i = 0; i < LIMBS && c; ++i) {
+            c += limbs[i];
+            limbs[i] = (uint32_t)c;
+            c >>= 32;
+        }
+        carry = c;
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: a^(p-2) == a^-1 (mod p). p - 2 has every bit set except in the
+    // lowest limb, which is 2^32 - MAX_PRIME_DIFF - 2.
+    Num3072 result;
+    for (size_t i = LIMBS; i-- > 0; ) {
+        uint32_t e = (i == 0) ? (uint32_t)(0xFFFFFFFFUL - MAX_PRIME_DIFF - 1) : 0xFFFFFFFFUL;
+        for (int bit = 31; bit >= 0; --bit) {
+            result.Multiply(result);
+            if ((e >> bit) & 1) result.Multiply(*this);
+        }
+    }
+    return result;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (size_t i = 0; i < LIMBS; ++i) {
+        WriteLE32(out + 4 * i, limbs[i]);
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hashed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hashed);
+
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    for (uint32_t i = 0; i < Num3072::BYTE_SIZE / CSHA512::OUTPUT_SIZE; ++i) {
+        unsigned char counter[4];
+        WriteLE32(counter, i);
+        CSHA512().Write(hashed, sizeof(hashed)).Write(counter, sizeof(counter)).Finalize(expanded + i * CSHA512::OUTPUT_SIZE);
+    }
+    return Num3072(expanded);
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len)
+{
+    numerator = ToNum3072(data, len);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char out[32])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
+
+void MuHash3072::ToBytes(unsigned char (&out)[SERIALIZED_SIZE]) const
+{
+    unsigned char num[Num3072::BYTE_SIZE], den[Num3072::BYTE_SIZE];
+    numerator.ToBytes(num);
+    denominator.ToBytes(den);
+    memcpy(out, num, sizeof(num));
+    memcpy(out + sizeof(num), den, sizeof(den));
+}
+
+void MuHash3072::FromBytes(const unsigned char (&in)[SERIALIZED_SIZE])
+{
+    unsigned char num[Num3072::BYTE_SIZE], den[Num3072::BYTE_SIZE];
+    memcpy(num, in, sizeof(num));
+    memcpy(den, in + sizeof(num), sizeof(den));
+    numerator = Num3072(num);
+    denominator = Num3072(den);
+}
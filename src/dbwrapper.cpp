@@ -5,21 +5,151 @@
 #include "dbwrapper.h"
 
 #include "util.h"
+#include "util/strencodings.h"
 
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
+#include <atomic>
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
+#include <mutex>
+#include <set>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles)
+/** An LRU block cache that counts lookups, so hit rates can be reported. */
+class CCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache* base;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    CCountingCache(size_t capacity) : base(leveldb::NewLRUCache(capacity)), nHits(0), nMisses(0) {}
+    ~CCountingCache() { delete base; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge,
+                   void (*deleter)(const leveldb::Slice& key, void* value)) { return base->Insert(key, value, charge, deleter); }
+    Handle* Lookup(const leveldb::Slice& key)
+    {
+        Handle* handle = base->Lookup(key);
+        if (handle != NULL)
+            nHits++;
+        else
+            nMisses++;
+        return handle;
+    }
+    void Release(Handle* handle) { base->Release(handle); }
+    void* Value(Handle* handle) { return base->Value(handle); }
+    void Erase(const leveldb::Slice& key) { base->Erase(key); }
+    uint64_t NewId() { return base->NewId(); }
+    void Prune() { base->Prune(); }
+    size_t TotalCharge() const { return base->TotalCharge(); }
+};
+
+//! every open database, for GetAllDBStats()
+static std::mutex csOpenDatabases;
+static std::set<const CDBWrapper*> setOpenDatabases;
+
+bool ParseDBProfileOptions(const std::string& strOptions, CDBProfile& profile, std::string& strError)
+{
+    std::vector<std::string> vOptions;
+    boost::split(vOptions, strOptions, boost::is_any_of(","));
+    for (const std::string& strOption : vOptions) {
+        size_t pos = strOption.find('=');
+        int64_t nValue = 0;
+        if (pos == std::string::npos || !ParseInt64(strOption.substr(pos + 1), &nValue) || nValue < 0) {
+            strError = strprintf("expected option=<non-negative number>, got '%s'", strOption);
+            return false;
+        }
+        std::string strKey = strOption.substr(0, pos);
+        if (strKey == "blocksize" && nValue >= 1024 && nValue <= (4 << 20)) {
+            profile.nBlockSize = nValue;
+        } else if (strKey == "bloombits" && nValue <= 64) {
+            profile.nBloomBits = nValue;
+        } else if (strKey == "maxfilesize" && nValue >= (1 << 20) && nValue <= (1 << 30)) {
+            profile.nMaxFileSize = nValue;
+        } else if (strKey == "cachepercent" && nValue >= 10 && nValue <= 90) {
+            profile.nCachePercent = nValue;
+        } else if (strKey == "scanfillcache" && nValue <= 1) {
+            profile.fScanFillCache = nValue != 0;
+        } else {
+            strError = strprintf("unknown option or value out of range '%s'", strOption);
+            return false;
+        }
+    }
+    return true;
+}
+
+static CDBProfile GetBuiltinDBProfile(const std::string& strName)
+{
+    CDBProfile profile;
+    if (strName == "blockindex") {
+        // the address, spent and timestamp indexes are mostly read as ranges of one address or height span
+        profile.nBlockSize = 16 * 1024;
+        profile.nMaxFileSize = 8 << 20;
+    } else if (strName == "notarisations") {
+        // small, and scanned backwards from the tip over and over
+        profile.fScanFillCache = true;
+    }
+    return profile;
+}
+
+CDBProfile GetDBProfile(const std::string& strName)
+{
+    CDBProfile profile = GetBuiltinDBProfile(strName);
+    const std::string strPrefix = strName + ":";
+    for (const std::string& strArg : mapMultiArgs["-dbprofile"]) {
+        if (!boost::starts_with(strArg, strPrefix))
+            continue;
+        std::string strError;
+        if (!ParseDBProfileOptions(strArg.substr(strPrefix.size()), profile, strError))
+            LogPrintf("Ignoring -dbprofile=%s: %s\n", strArg, strError);
+    }
+    return profile;
+}
+
+bool CheckDBProfileArgs(std::string& strError)
+{
+    for (const std::string& strArg : mapMultiArgs["-dbprofile"]) {
+        size_t pos = strArg.find(':');
+        std::string strName = strArg.substr(0, pos);
+        CDBProfile profile;
+        if (pos == std::string::npos || (strName != "chainstate" && strName != "blockindex" && strName != "notarisations")) {
+            strError = strprintf("-dbprofile=%s: expected chainstate, blockindex or notarisations followed by ':'", strArg);
+            return false;
+        }
+        if (!ParseDBProfileOptions(strArg.substr(pos + 1), profile, strError)) {
+            strError = strprintf("-dbprofile=%s: %s", strArg, strError);
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<CDBStats> GetAllDBStats()
+{
+    std::vector<CDBStats> vStats;
+    std::lock_guard<std::mutex> lock(csOpenDatabases);
+    for (const CDBWrapper* pdbw : setOpenDatabases)
+        vStats.push_back(pdbw->GetStats());
+    return vStats;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxOpenFiles, const CDBProfile& profile, CCountingCache*& pcache)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    size_t nBlockCache = nCacheSize * profile.nCachePercent / 100;
+    pcache = new CCountingCache(nBlockCache);
+    options.block_cache = pcache;
+    options.write_buffer_size = (nCacheSize - nBlockCache) / 2; // up to two write buffers may be held in memory simultaneously
+    options.filter_policy = profile.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
+    options.block_size = profile.nBlockSize;
+    options.max_file_size = profile.nMaxFileSize;
     options.compression = compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     options.max_open_files = maxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -30,14 +160,17 @@ static leveldb::Options GetOptions(size_t nCacheSize, bool compression, int maxO
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles, const std::string& strProfile)
 {
     penv = NULL;
+    strName = strProfile;
+    strPath = path.string();
+    profile = GetDBProfile(strProfile);
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
-    iteroptions.fill_cache = false;
+    iteroptions.fill_cache = profile.fScanFillCache;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize, compression, maxOpenFiles);
+    options = GetOptions(nCacheSize, compression, maxOpenFiles, profile, pcache);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -53,11 +186,19 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
-    LogPrintf("Opened LevelDB successfully\n");
+    LogPrintf("Opened LevelDB successfully (profile %s: block size %u, bloom bits %d, file size %u, block cache %d%%)\n",
+        strName, profile.nBlockSize, profile.nBloomBits, profile.nMaxFileSize, profile.nCachePercent);
+
+    std::lock_guard<std::mutex> lock(csOpenDatabases);
+    setOpenDatabases.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        std::lock_guard<std::mutex> lock(csOpenDatabases);
+        setOpenDatabases.erase(this);
+    }
     //Test if object was created before deinitialising it now
     if (pdb!=NULL)
     {
@@ -88,6 +229,29 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
     return true;
 }
 
+CDBStats CDBWrapper::GetStats() const
+{
+    CDBStats stats;
+    stats.strName = strName;
+    stats.strPath = strPath;
+    stats.profile = profile;
+    stats.nApproximateMemory = 0;
+    stats.nCacheHits = pcache->nHits;
+    stats.nCacheMisses = pcache->nMisses;
+
+    std::string strValue;
+    for (int level = 0; level < 7; level++) {
+        if (!pdb->GetProperty(strprintf("leveldb.num-files-at-level%d", level), &strValue))
+            break;
+        stats.vFilesPerLevel.push_back(atoi(strValue));
+    }
+    if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+        stats.nApproximateMemory = atoi64(strValue);
+    if (pdb->GetProperty("leveldb.stats", &strValue))
+        stats.strCompactionStats = strValue;
+    return stats;
+}
+
 bool CDBWrapper::IsEmpty()
 {
     boost::scoped_ptr<CDBIterator> it(NewIterator());
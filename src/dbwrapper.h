@@ -16,9 +16,47 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <string>
+#include <vector>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+/** LevelDB tuning for one kind of database. Each database starts from a built-in profile that -dbprofile can adjust. */
+struct CDBProfile
+{
+    size_t nBlockSize;      //!< uncompressed bytes per table block; larger blocks favour range scans
+    int nBloomBits;         //!< bloom filter bits per key, 0 disables the filter
+    size_t nMaxFileSize;    //!< table file size; larger files mean fewer, bigger compactions
+    int nCachePercent;      //!< share of the cache used as block cache, the rest is split between the two write buffers
+    bool fScanFillCache;    //!< whether blocks read by iterators are kept in the block cache
+
+    CDBProfile() : nBlockSize(4 * 1024), nBloomBits(10), nMaxFileSize(2 << 20), nCachePercent(50), fScanFillCache(false) {}
+};
+
+/** The profile of a database ("chainstate", "blockindex", "notarisations"), with any -dbprofile options applied. */
+CDBProfile GetDBProfile(const std::string& strName);
+/** Apply comma separated option=value pairs to a profile. */
+bool ParseDBProfileOptions(const std::string& strOptions, CDBProfile& profile, std::string& strError);
+/** Validate every -dbprofile argument. */
+bool CheckDBProfileArgs(std::string& strError);
+
+/** Instrumentation snapshot of an open database. */
+struct CDBStats
+{
+    std::string strName;
+    std::string strPath;
+    CDBProfile profile;
+    std::vector<int> vFilesPerLevel;
+    uint64_t nApproximateMemory;
+    uint64_t nCacheHits;
+    uint64_t nCacheMisses;
+    std::string strCompactionStats;
+};
+
+/** Stats of every database currently open. */
+std::vector<CDBStats> GetAllDBStats();
+
 class dbwrapper_error : public std::runtime_error
 {
 public:
@@ -26,6 +64,7 @@ public:
 };
 
 class CDBWrapper;
+class CCountingCache;
 
 /** These should be considered an implementation detail of the specific database.
  */
@@ -181,6 +220,14 @@ private:
     //! the database itself
     leveldb::DB* pdb=NULL;
 
+    //! profile name and tuning the database was opened with
+    std::string strName;
+    CDBProfile profile;
+    std::string strPath;
+
+    //! the block cache, which counts hits and misses
+    CCountingCache* pcache=NULL;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -189,11 +236,18 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] compression
      * @param[in] maxOpenFiles
+     * @param[in] strProfile  Name of the tuning profile, see GetDBProfile().
      */
     CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, 
-            bool fWipe = false, bool compression = false, int maxOpenFiles = 64);
+            bool fWipe = false, bool compression = false, int maxOpenFiles = 64, const std::string& strProfile = "default");
     ~CDBWrapper();
 
+    /****
+     * Collect LevelDB statistics for this database
+     * @returns the stats
+     */
+    CDBStats GetStats() const;
+
     /****
      * Retrieve the value for the given key
      * @param key the key
@@ -18,6 +18,7 @@
 #include "chainparams.h"
 #include "httpserver.h"
 #include "key_io.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -151,10 +152,38 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
                 return false;
             }
 
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            // Send reply, with chunked encoding once it outgrows one chunk
+            bool fStarted = false;
+            JSONStreamWriter writer([req, &fStarted](const std::string& strChunk) {
+                if (!fStarted) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    fStarted = true;
+                }
+                return req->WriteReplyChunk(HTTP_OK, strChunk);
+            });
+            try {
+                writer.BeginObject();
+                writer.Key("result");
+                tableRPC.executeStreamed(jreq.strMethod, jreq.params, writer);
+                writer.PushKV("error", NullUniValue);
+                writer.PushKV("id", jreq.id);
+                writer.EndObject();
+                writer.Raw("\n");
+                if (writer.HasFlushed())
+                    writer.Flush();
+            } catch (...) {
+                if (!writer.HasFlushed())
+                    throw;
+                // The status was sent with the first chunk, so all that is left is to cut the reply short
+                LogPrintf("ThreadRPCServer %s failed after part of its reply was sent\n", jreq.strMethod);
+                req->EndReply();
+                return false;
+            }
+            if (writer.HasFlushed()) {
+                req->EndReply();
+                return true;
+            }
+            strReply = writer.GetBuffer();
 
         // array of requests
         } else if (valRequest.isArray())
@@ -174,6 +203,44 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+/** Largest request body inspected to pick a worker pool; larger requests go to the quick pool. */
+static const size_t MAX_CLASSIFIED_BODY_SIZE = 64 * 1024;
+
+static RPCWorkClass JSONRPCWorkClass(const UniValue& req)
+{
+    if (!req.isObject())
+        return RPC_WORK_QUICK;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    if (!method.isStr())
+        return RPC_WORK_QUICK;
+    return tableRPC.workClass(method.get_str());
+}
+
+/** Queue requests on the pool of their method; a batch goes to the heavy pool if any entry belongs there. */
+static HTTPWorkClass HTTPReq_JSONRPC_Class(HTTPRequest* req, const std::string &)
+{
+    UniValue valRequest;
+    if (!valRequest.read(req->PeekBody(MAX_CLASSIFIED_BODY_SIZE)))
+        return HTTP_WORK_QUICK;
+
+    RPCWorkClass workClass = RPC_WORK_QUICK;
+    if (valRequest.isArray()) {
+        for (size_t i = 0; i < valRequest.size() && workClass != RPC_WORK_HEAVY; i++) {
+            RPCWorkClass entryClass = JSONRPCWorkClass(valRequest[i]);
+            if (entryClass != RPC_WORK_QUICK)
+                workClass = entryClass;
+        }
+    } else {
+        workClass = JSONRPCWorkClass(valRequest);
+    }
+
+    switch (workClass) {
+    case RPC_WORK_HEAVY: return HTTP_WORK_HEAVY;
+    case RPC_WORK_ADMIN: return HTTP_WORK_ADMIN;
+    default: return HTTP_WORK_QUICK;
+    }
+}
+
 static bool InitRPCAuthentication()
 {
     if (mapArgs["-rpcpassword"] == "")
@@ -197,7 +264,7 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, HTTPReq_JSONRPC_Class);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -167,13 +167,14 @@ public:
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler, HTTPRequestClassifier classifier):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), classifier(classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestClassifier classifier;
 };
 
 /** HTTP module state */
@@ -184,12 +185,14 @@ static struct event_base* eventBase = 0;
 struct evhttp* eventHTTP = 0;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Work queues for handling longer requests off the event loop thread, one per HTTPWorkClass
+static WorkQueue<HTTPClosure>* workQueues[HTTP_WORK_CLASSES] = {};
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
 std::vector<evhttp_bound_socket *> boundSockets;
+//! Seconds a streamed reply waits for a client that does not read (-rpcservertimeout)
+static int httpServerTimeout = DEFAULT_HTTP_SERVER_TIMEOUT;
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -307,6 +310,8 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPWorkClass workClass = i->classifier ? i->classifier(hreq.get(), path) : HTTP_WORK_QUICK;
+        WorkQueue<HTTPClosure>* workQueue = workQueues[workClass];
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
         assert(workQueue);
         if (workQueue->Enqueue(item.get()))
@@ -375,9 +380,9 @@ static bool HTTPBindAddresses(struct evhttp* http)
 }
 
 /** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
+static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue, const char* name)
 {
-    RenameThread("zcash-httpworker");
+    RenameThread(name);
     queue->Run();
 }
 
@@ -439,7 +444,8 @@ bool InitHTTPServer()
         return false;
     }
 
-    evhttp_set_timeout(http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+    httpServerTimeout = GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    evhttp_set_timeout(http, httpServerTimeout);
     evhttp_set_max_body_size(http, MAX_SIZE);
     evhttp_set_gencb(http, http_request_cb, NULL);
 
@@ -454,7 +460,8 @@ bool InitHTTPServer()
     int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    for (int i = 0; i < HTTP_WORK_CLASSES; i++)
+        workQueues[i] = new WorkQueue<HTTPClosure>(workQueueDepth);
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -465,13 +472,20 @@ boost::thread threadHTTP;
 bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
-    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    int rpcThreads[HTTP_WORK_CLASSES];
+    rpcThreads[HTTP_WORK_QUICK] = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    rpcThreads[HTTP_WORK_HEAVY] = std::max((long)GetArg("-rpcheavythreads", DEFAULT_HTTP_HEAVY_THREADS), 1L);
+    rpcThreads[HTTP_WORK_ADMIN] = std::max((long)GetArg("-rpcadminthreads", DEFAULT_HTTP_ADMIN_THREADS), 1L);
+    static const char* const threadNames[HTTP_WORK_CLASSES] = {"zcash-httpworker", "zcash-httpheavy", "zcash-httpadmin"};
+    LogPrintf("HTTP: starting %d quick, %d heavy and %d admin worker threads\n",
+              rpcThreads[HTTP_WORK_QUICK], rpcThreads[HTTP_WORK_HEAVY], rpcThreads[HTTP_WORK_ADMIN]);
     threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase, eventHTTP));
 
-    for (int i = 0; i < rpcThreads; i++) {
-        boost::thread rpc_worker(HTTPWorkQueueRun, workQueue);
-        rpc_worker.detach();
+    for (int c = 0; c < HTTP_WORK_CLASSES; c++) {
+        for (int i = 0; i < rpcThreads[c]; i++) {
+            boost::thread rpc_worker(HTTPWorkQueueRun, workQueues[c], threadNames[c]);
+            rpc_worker.detach();
+        }
     }
     return true;
 }
@@ -487,17 +501,22 @@ void InterruptHTTPServer()
         // Reject requests on current connections
         evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    for (int i = 0; i < HTTP_WORK_CLASSES; i++) {
+        if (workQueues[i])
+            workQueues[i]->Interrupt();
+    }
 }
 
 void StopHTTPServer()
 {
     LogPrint("http", "Stopping HTTP server\n");
-    if (workQueue) {
-        LogPrint("http", "Waiting for HTTP worker threads to exit\n");
-        workQueue->WaitExit();
-        delete workQueue;
+    for (int i = 0; i < HTTP_WORK_CLASSES; i++) {
+        if (workQueues[i]) {
+            LogPrint("http", "Waiting for HTTP worker threads to exit\n");
+            workQueues[i]->WaitExit();
+            delete workQueues[i];
+            workQueues[i] = 0;
+        }
     }
     if (eventBase) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
@@ -563,7 +582,11 @@ HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (!replySent && stream) {
+        // The client gets a truncated reply
+        LogPrintf("%s: Unfinished streamed reply\n", __func__);
+        EndReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -602,6 +625,20 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+std::string HTTPRequest::PeekBody(size_t nMaxSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    size_t size = evbuffer_get_length(buf);
+    if (size == 0 || size > nMaxSize)
+        return "";
+    std::string rv(size, '\0');
+    if (evbuffer_copyout(buf, &rv[0], size) != (ev_ssize_t)size)
+        return "";
+    return rv;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -614,9 +651,24 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
+/** Re-enable reading from the socket. This is the second part of the libevent
+ * workaround in http_request_cb. */
+static void http_reenable_read(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && req && !stream);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -624,17 +676,98 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, (const char*)NULL, (struct evbuffer *)NULL);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
+        http_reenable_read(req_copy);
+    });
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+/** Flow control of a streamed reply, shared by the worker thread and the event loop thread. */
+struct HTTPReplyStream
+{
+    boost::mutex cs;
+    boost::condition_variable cond;
+    //! Bytes queued by the worker that have not been written to the socket yet
+    size_t nUnsent;
+    //! Of those, bytes the event loop thread already gave to libevent
+    size_t nHanded;
+    //! The connection is gone, or the client stopped reading
+    bool fClosed;
+
+    HTTPReplyStream() : nUnsent(0), nHanded(0), fClosed(false) {}
+};
+
+/** Called by libevent once the connection's output buffer has drained. */
+static void http_reply_chunk_sent_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyStream* stream = (HTTPReplyStream*)arg;
+    boost::lock_guard<boost::mutex> lock(stream->cs);
+    stream->nUnsent -= stream->nHanded;
+    stream->nHanded = 0;
+    stream->cond.notify_all();
+}
+
+bool HTTPRequest::WriteReplyChunk(int nStatus, const std::string& strChunk)
+{
+    assert(!replySent && req);
+    auto req_copy = req;
+    if (!stream) {
+        stream = std::make_shared<HTTPReplyStream>();
+        HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+            evhttp_send_reply_start(req_copy, nStatus, (const char*)NULL);
+        });
+        ev->trigger(0);
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(stream->cs);
+        boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(httpServerTimeout);
+        while (!stream->fClosed && stream->nUnsent > MAX_HTTP_REPLY_UNSENT) {
+            if (stream->cond.wait_until(lock, deadline) == boost::cv_status::timeout) {
+                LogPrint("http", "Client stopped reading a streamed reply\n");
+                stream->fClosed = true;
             }
         }
+        if (stream->fClosed)
+            return false;
+        stream->nUnsent += strChunk.size();
+    }
+
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    auto stream_copy = stream;
+    size_t nSize = strChunk.size();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, stream_copy, evb, nSize]{
+        // libevent detaches the request from a connection that failed
+        if (evhttp_request_get_connection(req_copy)) {
+            {
+                boost::lock_guard<boost::mutex> lock(stream_copy->cs);
+                stream_copy->nHanded += nSize;
+            }
+            evhttp_send_reply_chunk_with_cb(req_copy, evb, http_reply_chunk_sent_cb, stream_copy.get());
+        } else {
+            boost::lock_guard<boost::mutex> lock(stream_copy->cs);
+            stream_copy->fClosed = true;
+            stream_copy->cond.notify_all();
+        }
+        evbuffer_free(evb);
+    });
+    ev->trigger(0);
+    return true;
+}
+
+void HTTPRequest::EndReply()
+{
+    assert(!replySent && req && stream);
+    auto req_copy = req;
+    // Keep the stream alive until libevent no longer calls back into it
+    auto stream_copy = stream;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, stream_copy]{
+        // evhttp_send_reply_end may free the request right away, so re-enable reading first
+        http_reenable_read(req_copy);
+        evhttp_send_reply_end(req_copy);
     });
     ev->trigger(0);
     replySent = true;
@@ -681,10 +814,11 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPRequestClassifier &classifier)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
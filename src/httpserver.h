@@ -5,6 +5,7 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <memory>
 #include <string>
 #include <stdint.h>
 #ifdef _WIN32
@@ -15,13 +16,18 @@
 #include <boost/function.hpp>
 
 static const int DEFAULT_HTTP_THREADS=4;
+static const int DEFAULT_HTTP_HEAVY_THREADS=2;
+static const int DEFAULT_HTTP_ADMIN_THREADS=1;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Bytes of a streamed reply that may wait to be written to the socket before the writer blocks. */
+static const size_t MAX_HTTP_REPLY_UNSENT=1024*1024;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyStream;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -37,13 +43,24 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Worker pools requests are queued on, so that slow requests cannot starve quick ones. */
+enum HTTPWorkClass {
+    HTTP_WORK_QUICK,    //!< everything else (-rpcthreads)
+    HTTP_WORK_HEAVY,    //!< wallet and whole chain state scans (-rpcheavythreads)
+    HTTP_WORK_ADMIN,    //!< node control (-rpcadminthreads)
+    HTTP_WORK_CLASSES
+};
+
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Picks the worker pool for a request. Called on the event loop thread, so it must be cheap. */
+typedef boost::function<HTTPWorkClass(HTTPRequest* req, const std::string &)> HTTPRequestClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Without a classifier requests go to the quick pool.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPRequestClassifier &classifier = HTTPRequestClassifier());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -59,6 +76,8 @@ class HTTPRequest
 {
 private:
     struct evhttp_request* req;
+    //! Set once a reply is being streamed with WriteReplyChunk
+    std::shared_ptr<HTTPReplyStream> stream;
 
     // For test access
 protected:
@@ -102,6 +121,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Return the request body without consuming it, or an empty string if it
+     * is larger than nMaxSize.
+     */
+    std::string PeekBody(size_t nMaxSize);
+
     /**
      * Write output header.
      *
@@ -118,6 +143,19 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     virtual void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Send the next part of a reply with chunked transfer encoding; the first
+     * call sends the status and headers. Blocks while more than
+     * MAX_HTTP_REPLY_UNSENT bytes wait to be written to a slow client.
+     * Returns false if the client went away or stopped reading.
+     *
+     * @note Finish with EndReply instead of WriteReply.
+     */
+    bool WriteReplyChunk(int nStatus, const std::string& strChunk);
+
+    /** Finish a reply sent with WriteReplyChunk. Same caveats as WriteReply. */
+    void EndReply();
 };
 
 /** Event handler closure.
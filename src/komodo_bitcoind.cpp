@@ -20,6 +20,9 @@
 #include "komodo.h"
 #include "rpc/net.h"
 #include "init.h"
+#include "txdb.h"
+#include "undo.h"
+#include "wallet/stakingindex.h"
 
 
 /************************************************************************
@@ -1370,8 +1373,15 @@ arith_uint256 komodo_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t he
 
 uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr,int32_t PoSperc)
 {
-    bool fNegative,fOverflow; uint8_t hashbuf[256]; char address[64]; bits256 addrhash; arith_uint256 hashval,mindiff,ratio,coinage256; uint256 hash,pasthash; int32_t segid,minage,i,iter=0; int64_t diff=0; uint32_t txtime,segid32,winner = 0 ; uint64_t value,coinage;
+    uint8_t hashbuf[256]; char address[64]; uint32_t txtime; uint64_t value;
     txtime = komodo_txtime2(&value,txid,vout,address);
+    komodo_segids(hashbuf,nHeight-101,100);
+    return(komodo_stake_utxo(validateflag,bnTarget,nHeight,txid,vout,blocktime,prevtime,txtime,value,address,hashbuf));
+}
+
+uint32_t komodo_stake_utxo(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,uint32_t txtime,uint64_t value,char *address,uint8_t *hashbuf)
+{
+    bool fNegative,fOverflow; arith_uint256 hashval,mindiff,ratio,coinage256; uint256 hash; int32_t segid,minage,i,iter=0; int64_t diff=0; uint32_t segid32,winner = 0 ; uint64_t coinage;
     if ( validateflag == 0 )
     {
         //fprintf(stderr,"blocktime.%u -> ",blocktime);
@@ -1393,7 +1403,6 @@ uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeigh
     ratio = (mindiff / bnTarget);
     if ( (minage= nHeight*3) > 6000 ) // about 100 blocks
         minage = 6000;
-    komodo_segids(hashbuf,nHeight-101,100);
     segid32 = komodo_stakehash(&hash,address,hashbuf,txid,vout);
     segid = ((nHeight + segid32) & 0x3f);
     for (iter=0; iter<600; iter++)
@@ -2088,7 +2097,7 @@ int32_t komodo_acpublic(uint32_t tiptime)
     return(acpublic);
 }
 
-int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock)
+int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock,const CBlockUndo *pundo)
 {
     CTxDestination address; int32_t i,j,m,n,vout; uint8_t *script; uint256 txid,hashBlock; int64_t zfunds=0,vinsum=0,voutsum=0,sproutfunds=0;
     n = pblock->vtx.size();
@@ -2101,6 +2110,16 @@ int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,C
             {
                 if ( i == 0 )
                     continue;
+                if ( pundo != 0 )
+                {
+                    if ( (size_t)(i-1) >= pundo->vtxundo.size() || (size_t)j >= pundo->vtxundo[i-1].vprevout.size() )
+                    {
+                        fprintf(stderr,"ERROR: ht.%d tx.%d vin.%d missing undo data\n",nHeight,i,j);
+                        return(0);
+                    }
+                    vinsum += pundo->vtxundo[i-1].vprevout[j].txout.nValue;
+                    continue;
+                }
                 txid = tx.vin[j].prevout.hash;
                 vout = tx.vin[j].prevout.n;
                 if ( !GetTransaction(txid,vintx,hashBlock, false) || vout >= vintx.vout.size() )
@@ -2149,6 +2168,16 @@ int64_t komodo_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height)
     CBlockIndex *pindex; CBlock block; int64_t zfunds=0,sproutfunds=0,supply = 0;
     //fprintf(stderr,"coinsupply %d\n",height);
     *zfundsp = *sproutfundsp = 0;
+    if ( fUTXOStatsIndex && (pindex= komodo_chainactive(height)) != 0 && pindex->nHeight > 0 )
+    {
+        CUTXOStats utxostats;
+        if ( pblocktree->ReadUTXOStats(pindex->GetBlockHash(),utxostats) != 0 )
+        {
+            *zfundsp = utxostats.nChainZFunds;
+            *sproutfundsp = utxostats.nChainSproutFunds;
+            return(utxostats.nChainSupply);
+        }
+    }
     if ( (pindex= komodo_chainactive(height)) != 0 )
     {
         while ( pindex != 0 && pindex->nHeight > 0 )
@@ -2201,16 +2230,17 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
 {
     // use thread_local to prevent crash in case of accidental thread overlapping
     thread_local std::vector<komodo_staking> array;
-    thread_local uint32_t lasttime;
 
     int32_t PoSperc = 0, newStakerActive;
-    std::set<CBitcoinAddress> setAddress; int32_t winners,segid,minage,nHeight,counter=0,i,m,siglen=0,nMinDepth = 1,nMaxDepth = 99999999; std::vector<COutput> vecOutputs; uint32_t block_from_future_rejecttime,besttime,eligible,earliest = 0; CScript best_scriptPubKey; arith_uint256 mindiff,ratio,bnTarget,tmpTarget; CBlockIndex *pindex; CTxDestination address; bool fNegative,fOverflow; uint8_t hashbuf[256]; CTransaction tx; uint256 hashBlock;
+    int32_t winners,minage,nHeight,i,siglen=0; uint32_t prevtime,starttime,eligible,earliest = 0; CScript best_scriptPubKey; arith_uint256 bnTarget; bool fNegative,fOverflow; uint8_t hashbuf[256];
+    std::vector<std::pair<COutPoint,CStakingCandidate> > vCandidates;
     uint64_t cbPerc = *utxovaluep, tocoinbase = 0;
     if (!EnsureWalletIsAvailable(0))
         return 0;
 
     bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
     assert(pwalletMain != NULL);
+    assert(pstakingindex != NULL);
     *utxovaluep = 0;
     memset(utxotxidp,0,sizeof(*utxotxidp));
     memset(utxovoutp,0,sizeof(*utxovoutp));
@@ -2230,60 +2260,40 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
     komodo_segids(hashbuf,nHeight-101,100);
     // this was for VerusHash PoS64
     //tmpTarget = komodo_PoWtarget(&PoSperc,bnTarget,nHeight,ASSETCHAINS_STAKED);
-    bool resetstaker = false;
-    if ( array.size() != 0 )
-    {
-        LOCK(cs_main);
-        CBlockIndex* pblockindex = chainActive[tipindex->nHeight];
-        CBlock block; CTxDestination addressout;
-        if ( ReadBlockFromDisk(block, pblockindex, 1) && komodo_isPoS(&block, nHeight, &addressout) != 0 && IsMine(*pwalletMain,addressout) != 0 )
-        {
-              resetstaker = true;
-              fprintf(stderr, "[%s:%d] Reset ram staker after mining a block!\n",chainName.symbol().c_str(),nHeight);
-        }
-    }
 
-    if ( resetstaker || array.size() == 0 || time(NULL) > lasttime+600 )
+    // komodo_stake starts no earlier than prevtime+3, or now+30 when that is in the past.
+    // Allow another minute for the round, coins that cannot win before then are skipped.
+    prevtime = (uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF;
+    starttime = std::max(prevtime+3,(uint32_t)GetTime()+30) + 60;
     {
         LOCK2(cs_main, pwalletMain->cs_wallet);
-        pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
-        if ( array.size() != 0 )
+        if ( (tipindex= chainActive.Tip()) == 0 || tipindex->nHeight+1 > nHeight )
         {
-            array.clear();
-            lasttime = 0;
+            fprintf(stderr,"[%s:%d] chain tip changed during staking loop t.%u\n",chainName.symbol().c_str(),nHeight,(uint32_t)time(NULL));
+            return(0);
         }
-        BOOST_FOREACH(const COutput& out, vecOutputs)
+        pstakingindex->Update();
+        pstakingindex->GetCandidates(nHeight,starttime,minage,vCandidates);
+        array.clear();
+        array.reserve(vCandidates.size());
+        for (i=0; i<vCandidates.size(); i++)
         {
-            if ( (tipindex= chainActive.Tip()) == 0 || tipindex->nHeight+1 > nHeight )
-            {
-                fprintf(stderr,"[%s:%d] chain tip changed during staking loop t.%u counter.%d\n",chainName.symbol().c_str(),nHeight,(uint32_t)time(NULL),counter);
-                return(0);
-            }
-            counter++;
-            if ( out.nDepth < nMinDepth || out.nDepth > nMaxDepth )
-            {
-                //fprintf(stderr,"komodo_staked invalid depth %d\n",(int32_t)out.nDepth);
+            const COutPoint &outpoint = vCandidates[i].first;
+            const CStakingCandidate &candidate = vCandidates[i].second;
+            if ( !pstakingindex->IsAvailable(outpoint) || candidate.address.size() >= sizeof(array[0].address) )
                 continue;
-            }
-            CAmount nValue = out.tx->vout[out.i].nValue;
-            if ( nValue < COIN  || !out.fSpendable )
-                continue;
-            const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-            if ( ExtractDestination(pk,address) != 0 )
-            {
-                if ( IsMine(*pwalletMain,address) == 0 )
-                    continue;
-                if ( myGetTransaction(out.tx->GetHash(),tx,hashBlock) != 0 && (pindex= komodo_getblockindex(hashBlock)) != 0 )
-                {
-                    komodo_addutxo(array,(uint32_t)pindex->nTime,(uint64_t)nValue,out.tx->GetHash(),out.i,(char *)CBitcoinAddress(address).ToString().c_str(),hashbuf,(CScript)pk);
-                    //fprintf(stderr,"%s array.size().%d vs array.capacity().%d\n", __func__,array.size(),array.capacity());
-                }
-            }
-        }
-        lasttime = (uint32_t)time(NULL);
-        //fprintf(stderr,"%s finished kp data of utxo for staking %u ht.%d array.size().%d array.capacity().%d\n", __func__,(uint32_t)time(NULL),nHeight,array.size(),array.capacity());
-    }
-    block_from_future_rejecttime = (uint32_t)GetTime() + ASSETCHAINS_STAKED_BLOCK_FUTURE_MAX;
+            komodo_staking kp;
+            strcpy(kp.address,candidate.address.c_str());
+            kp.txid = outpoint.hash;
+            kp.vout = outpoint.n;
+            kp.txtime = candidate.nTime;
+            kp.segid32 = candidate.segid32;
+            kp.nValue = candidate.nValue;
+            kp.scriptPubKey = candidate.scriptPubKey;
+            array.push_back(kp);
+        }
+    }
+    //fprintf(stderr,"%s %d of %d staking utxos can be eligible ht.%d\n", __func__,(int32_t)array.size(),(int32_t)pstakingindex->Size(),nHeight);
     for (i=winners=0; i<array.size(); i++)
     {
         if ( ShutdownRequested() || !GetBoolArg("-gen",false) )
@@ -2298,10 +2308,9 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
             return 0;
         }
         komodo_staking &kp = array[i];
-        eligible = komodo_stake(0,bnTarget,nHeight,kp.txid,kp.vout,0,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,kp.address,PoSperc);
+        eligible = komodo_stake_utxo(0,bnTarget,nHeight,kp.txid,kp.vout,0,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,kp.txtime,kp.nValue,kp.address,hashbuf);
         if ( eligible > 0 )
         {
-            besttime = 0;
             if ( eligible == komodo_stake(1,bnTarget,nHeight,kp.txid,kp.vout,eligible,(uint32_t)tipindex->nTime+ASSETCHAINS_STAKED_BLOCK_FUTURE_HALF,kp.address,PoSperc) )
             {
                 // have elegible utxo to stake with.
@@ -2315,20 +2324,9 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
                     *utxovoutp = kp.vout;
                     *txtimep = kp.txtime;
                 }
-                /*if ( eligible < block_from_future_rejecttime )
-                {
-                    // better to scan all and choose earliest!
-                    fprintf(stderr, "block_from_future_rejecttime.%u vs eligible.%u \n", block_from_future_rejecttime, eligible);
-                    break;
-                } */
             }
         }
     }
-    if ( array.size() < 500 && array.size() != 0 )
-    {
-        array.clear();
-        lasttime = 0;
-    }
     if ( earliest != 0 )
     {
         bool signSuccess; SignatureData sigdata; uint64_t txfee; uint8_t *ptr; uint256 revtxid,utxotxid;
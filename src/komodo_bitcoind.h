@@ -194,6 +194,12 @@ arith_uint256 komodo_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t he
 
 uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr,int32_t PoSperc);
 
+/****
+ * @brief komodo_stake for a utxo whose block time, value and address the caller already has
+ * @param hashbuf 256 bytes, the first 100 filled in by komodo_segids(hashbuf,nHeight-101,100)
+ */
+uint32_t komodo_stake_utxo(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,uint32_t txtime,uint64_t value,char *address,uint8_t *hashbuf);
+
 int32_t komodo_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arith_uint256 bnTarget,arith_uint256 bhash);
 
 // for now, we will ignore slowFlag in the interest of keeping success/fail simpler for security purposes
@@ -218,7 +224,14 @@ int32_t komodo_checkPOW(int64_t stakeTxValue, int32_t slowflag,CBlock *pblock,in
 
 int32_t komodo_acpublic(uint32_t tiptime);
 
-int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock);
+class CBlockUndo;
+
+/****
+ * @param pundo if not null, spent amounts are taken from the block's undo data instead of GetTransaction();
+ *        it must cover every input of the block (CUTXOStats::ApplyBlock checks this), 0 is returned otherwise
+ * @returns the transparent coins created by the block (vouts minus vins)
+ */
+int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock,const CBlockUndo *pundo = nullptr);
 
 int64_t komodo_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height);
 
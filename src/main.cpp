@@ -29,6 +29,7 @@
 #include "importcoin.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "blockencodings.h"
 #include "checkqueue.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
@@ -43,6 +44,7 @@
 #include "script/interpreter.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txreconciliation.h"
 #include "ui_interface.h"
 #include "undo.h"
 #include "util.h"
@@ -66,6 +68,10 @@
 #include <cstring>
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <sstream>
 #include <map>
 #include <unordered_map>
@@ -111,6 +117,7 @@ bool fProof = true;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fUTXOStatsIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
@@ -275,9 +282,17 @@ namespace {
         int64_t nTime;  //! Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //! Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //! The timeout for this block request (for disconnecting a slow peer)
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;  //! Optional, used for CMPCTBLOCK downloads
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+    /**
+     * Blocks holding back the download window that were requested a second
+     * time from a faster peer, and the peer they were asked from. At most
+     * one duplicate request per block. Protected by cs_main.
+     */
+    map<uint256, NodeId> mapBlocksDuplicated;
+
     /** Number of blocks in flight with validated headers. */
     int nQueuedValidatedHeaders = 0;
 
@@ -336,8 +351,24 @@ namespace {
         list<QueuedBlock> vBlocksInFlight;
         int nBlocksInFlight;
         int nBlocksInFlightValidHeaders;
+        //! Number of blocks we are willing to have in flight from this peer, adapted to its throughput.
+        int nBlockWindow;
+        //! Moving averages of the time this peer needs per requested block (its share of the queue),
+        //! of the time from request to arrival (both in microseconds), and of its block throughput.
+        int64_t nAvgBlockServiceTime;
+        int64_t nAvgBlockLatency;
+        int64_t nAvgBlockBytesPerSec;
+        //! When the last requested block arrived from this peer (in microseconds).
+        int64_t nLastBlockReceived;
+        int nBlocksReceived;
+        //! Number of duplicate requests this peer answered before the peer first asked.
+        int nDuplicatesWon;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
+        //! Whether this peer wants invs or cmpctblocks (when possible) for block announcements.
+        bool fPreferHeaderAndIDs;
+        //! Whether this peer will send us cmpctblocks if we request them.
+        bool fProvidesHeaderAndIDs;
 
         CNodeState() {
             fCurrentlyConnected = false;
@@ -350,13 +381,32 @@ namespace {
             nStallingSince = 0;
             nBlocksInFlight = 0;
             nBlocksInFlightValidHeaders = 0;
+            nBlockWindow = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+            nAvgBlockServiceTime = 0;
+            nAvgBlockLatency = 0;
+            nAvgBlockBytesPerSec = 0;
+            nLastBlockReceived = 0;
+            nBlocksReceived = 0;
+            nDuplicatesWon = 0;
             fPreferredDownload = false;
+            fPreferHeaderAndIDs = false;
+            fProvidesHeaderAndIDs = false;
         }
     };
 
     /** Map maintaining per-node state. Requires cs_main. */
     map<NodeId, CNodeState> mapNodeState;
 
+    /**
+     * Peers that most recently handed us a new tip first, oldest first. They
+     * are asked to push new blocks to us as cmpctblock messages instead of
+     * announcing them with an inv. Requires cs_main.
+     */
+    list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+    /** Per-peer state of transaction relay by set reconciliation (-txreconciliation). */
+    TxReconciliationTracker txreconciliation;
+
     // Requires cs_main.
     CNodeState *State(NodeId pnode) {
         map<NodeId, CNodeState>::iterator it = mapNodeState.find(pnode);
@@ -413,8 +463,16 @@ namespace {
 
         BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
+        for (map<uint256, NodeId>::iterator it = mapBlocksDuplicated.begin(); it != mapBlocksDuplicated.end(); ) {
+            if (it->second == nodeid)
+                mapBlocksDuplicated.erase(it++);
+            else
+                ++it;
+        }
         EraseOrphansFor(nodeid);
         nPreferredDownload -= state->fPreferredDownload;
+        lNodesAnnouncingHeaderAndIDs.remove(nodeid);
+        txreconciliation.ForgetPeer(nodeid);
 
         mapNodeState.erase(nodeid);
     }
@@ -431,12 +489,42 @@ namespace {
          pcoinsTip->Uncache(removed);*/
     }
 
+    // Moving average giving each new sample a weight of 1/8; the first sample is taken as is.
+    void UpdateBlockDownloadAverage(int64_t& nAverage, int64_t nSample) {
+        nAverage = (nAverage == 0) ? nSample : nAverage + (nSample - nAverage) / 8;
+    }
+
+    void UpdateBlockDownloadWindow(CNodeState *state) {
+        state->nBlockWindow = GetBlockDownloadWindow(state->nAvgBlockServiceTime, state->nBlockWindow);
+    }
+
     // Requires cs_main.
     // Returns a bool indicating whether we requested this block.
-    bool MarkBlockAsReceived(const uint256& hash) {
+    // nodeFrom and nBlockSize, when given, feed the download statistics of the peer the block was requested from.
+    bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1, size_t nBlockSize = 0) {
         map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
         if (itInFlight != mapBlocksInFlight.end()) {
             CNodeState *state = State(itInFlight->second.first);
+            map<uint256, NodeId>::iterator itDuplicate = mapBlocksDuplicated.find(hash);
+            if (nodeFrom == itInFlight->second.first) {
+                int64_t nNow = GetTimeMicros();
+                const QueuedBlock& queued = *itInFlight->second.second;
+                int64_t nServiceTime = std::max<int64_t>(1, nNow - std::max(queued.nTime, state->nLastBlockReceived));
+                UpdateBlockDownloadAverage(state->nAvgBlockServiceTime, nServiceTime);
+                UpdateBlockDownloadAverage(state->nAvgBlockLatency, nNow - queued.nTime);
+                UpdateBlockDownloadAverage(state->nAvgBlockBytesPerSec, nBlockSize * 1000000 / nServiceTime);
+                state->nLastBlockReceived = nNow;
+                state->nBlocksReceived++;
+                UpdateBlockDownloadWindow(state);
+            } else if (itDuplicate != mapBlocksDuplicated.end() && itDuplicate->second == nodeFrom) {
+                // The duplicate request won the race; the peer we asked first gets a minimal window
+                // until its own deliveries show it can do better.
+                State(nodeFrom)->nDuplicatesWon++;
+                state->nBlockWindow = MIN_BLOCK_WINDOW_PER_PEER;
+                LogPrint("net", "Block %s arrived first from duplicate request to peer=%d (asked peer=%d first)\n", hash.ToString(), nodeFrom, itInFlight->second.first);
+            }
+            if (itDuplicate != mapBlocksDuplicated.end())
+                mapBlocksDuplicated.erase(itDuplicate);
             nQueuedValidatedHeaders -= itInFlight->second.second->fValidatedHeaders;
             state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
             state->vBlocksInFlight.erase(itInFlight->second.second);
@@ -449,20 +537,66 @@ namespace {
     }
 
     // Requires cs_main.
-    void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
+    // Returns false, still setting pit, if the block was already in flight from the same peer.
+    // pit will only be valid as long as the same cs_main lock is being held.
+    bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL, list<QueuedBlock>::iterator **pit = NULL) {
         CNodeState *state = State(nodeid);
         assert(state != NULL);
 
+        // Short-circuit most stuff in case it's from the same node.
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+        if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == nodeid) {
+            if (pit)
+                *pit = &itInFlight->second.second;
+            return false;
+        }
+
         // Make sure it's not listed somewhere already.
         MarkBlockAsReceived(hash);
 
         int64_t nNow = GetTimeMicros();
-        QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams)};
+        QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams),
+                                std::shared_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL)};
         nQueuedValidatedHeaders += newentry.fValidatedHeaders;
         list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
         state->nBlocksInFlight++;
         state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
-        mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+        itInFlight = mapBlocksInFlight.insert(std::make_pair(hash, std::make_pair(nodeid, it))).first;
+        if (pit)
+            *pit = &itInFlight->second.second;
+        return true;
+    }
+
+    // Requires cs_main.
+    void MaybeSetPeerAsAnnouncingHeaderAndIDs(const CNodeState* nodestate, CNode* pfrom) {
+        if (nodestate->fProvidesHeaderAndIDs) {
+            BOOST_FOREACH(const NodeId nodeid, lNodesAnnouncingHeaderAndIDs)
+                if (nodeid == pfrom->GetId())
+                    return;
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            uint64_t nCMPCTBLOCKVersion = 1;
+            if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_ANNOUNCERS) {
+                // As per BIP152, we only get 3 of our peers to announce
+                // blocks using compact encodings.
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes) {
+                    if (pnode->GetId() == lNodesAnnouncingHeaderAndIDs.front()) {
+                        pnode->PushMessage(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+                        break;
+                    }
+                }
+                lNodesAnnouncingHeaderAndIDs.pop_front();
+            }
+            fAnnounceUsingCMPCTBLOCK = true;
+            pfrom->PushMessage(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+            lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+        }
+    }
+
+    // Requires cs_main.
+    bool CanDirectFetch(const Consensus::Params &consensusParams)
+    {
+        return chainActive.Tip()->GetBlockTime() > GetTime() - consensusParams.nPowTargetSpacing * 20;
     }
 
     /** Check whether the last unknown block a peer advertized is not yet known. */
@@ -520,8 +654,9 @@ namespace {
     }
 
     /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
-     *  at most count entries. */
-    void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller) {
+     *  at most count entries. If nothing can be fetched because of the download window, nodeStaller and
+     *  pindexStaller are set to the peer and the in-flight block that hold it back. */
+    void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, CBlockIndex** pindexStaller = NULL) {
         if (count == 0)
             return;
 
@@ -557,6 +692,7 @@ namespace {
         int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
         int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
         NodeId waitingfor = -1;
+        CBlockIndex *pindexWaitingFor = NULL;
         while (pindexWalk->nHeight < nMaxHeight) {
             // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
             // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -588,6 +724,8 @@ namespace {
                         if (vBlocks.size() == 0 && waitingfor != nodeid) {
                             // We aren't able to fetch anything, but we would be if the download window was one larger.
                             nodeStaller = waitingfor;
+                            if (pindexStaller)
+                                *pindexStaller = pindexWaitingFor;
                         }
                         return;
                     }
@@ -598,6 +736,7 @@ namespace {
                 } else if (waitingfor == -1) {
                     // This is the first already-in-flight block.
                     waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                    pindexWaitingFor = pindex;
                 }
             }
         }
@@ -617,9 +756,32 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlockWindow = state->nBlockWindow;
+    stats.nAvgBlockServiceTime = state->nAvgBlockServiceTime;
+    stats.nAvgBlockLatency = state->nAvgBlockLatency;
+    stats.nAvgBlockBytesPerSec = state->nAvgBlockBytesPerSec;
+    stats.nBlocksReceived = state->nBlocksReceived;
+    stats.nDuplicatesWon = state->nDuplicatesWon;
+    stats.fStalling = state->nStallingSince != 0;
     return true;
 }
 
+// Size a peer's block download window so that it drains in about BLOCK_WINDOW_TARGET_TIME:
+// fast peers get deep queues, slow (Tor, I2P, congested) peers only hold a few blocks and
+// so cannot hold back the global download window for long.
+int GetBlockDownloadWindow(int64_t nAvgBlockServiceTime, int nWindow) {
+    if (nAvgBlockServiceTime <= 0)
+        return nWindow;
+    int64_t nTargetWindow = 1000000 * (int64_t)BLOCK_WINDOW_TARGET_TIME / nAvgBlockServiceTime;
+    return std::max<int64_t>(MIN_BLOCK_WINDOW_PER_PEER, std::min<int64_t>(MAX_BLOCK_WINDOW_PER_PEER, nTargetWindow));
+}
+
+void GetBlockDownloadStats(int& nInFlight, int& nDuplicates) {
+    LOCK(cs_main);
+    nInFlight = mapBlocksInFlight.size();
+    nDuplicates = mapBlocksDuplicated.size();
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.connect(&GetHeight);
@@ -681,15 +843,6 @@ UniValue komodo_snapshot(int top)
     return(result);
 }
 
-bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts)
-{
-    if ( fAddressIndex && pblocktree != nullptr )
-    {
-		return pblocktree->Snapshot2(addressAmounts, 0);
-    }
-    else return false;
-}
-
 int32_t lastSnapShotHeight = 0;
 std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
@@ -722,9 +875,17 @@ bool komodo_dailysnapshot(int32_t height)
     // if we already did this height dont bother doing it again, this is just a reorg. The actual snapshot height cannot be reorged.
     if ( undo_height == lastSnapShotHeight )
         return true;
-    std::map <std::string, int64_t> addressAmounts;
-    if ( !komodo_snapshot2(addressAmounts) )
+    if ( !fAddressIndex || pblocktree == nullptr )
         return false;
+    // Only the addresses touched by the undone blocks can differ from the address balance table,
+    // so track those by address as they are met and merge them with the table afterwards.
+    std::map <std::string, int64_t> addressAmounts;
+    std::set <std::string> touchedAddresses;
+    auto touchAddress = [&](const std::string &address) {
+        CAmount amount;
+        if ( touchedAddresses.insert(address).second && pblocktree->ReadSnapshotBalance(DecodeDestination(address), amount) )
+            addressAmounts[address] = amount;
+    };
 
     // undo blocks in reverse order
     for (int32_t n = height; n > undo_height; n--)
@@ -743,9 +904,11 @@ bool komodo_dailysnapshot(int32_t height)
                 const CTxOut &out = tx.vout[k];
                 if ( ExtractDestination(out.scriptPubKey, vDest) )
                 {
-                    addressAmounts[CBitcoinAddress(vDest).ToString()] -= out.nValue;
-                    if ( addressAmounts[CBitcoinAddress(vDest).ToString()] < 1 )
-                        addressAmounts.erase(CBitcoinAddress(vDest).ToString());
+                    std::string address = CBitcoinAddress(vDest).ToString();
+                    touchAddress(address);
+                    addressAmounts[address] -= out.nValue;
+                    if ( addressAmounts[address] < 1 )
+                        addressAmounts.erase(address);
                 }
             }
             // loop vins in reverse order, get prevout and return the sent balance.
@@ -757,13 +920,22 @@ bool komodo_dailysnapshot(int32_t height)
                     int vout = tx.vin[j].prevout.n;
                     if ( ExtractDestination(txin.vout[vout].scriptPubKey, vDest) )
                     {
-                        addressAmounts[CBitcoinAddress(vDest).ToString()] += txin.vout[vout].nValue;
+                        std::string address = CBitcoinAddress(vDest).ToString();
+                        touchAddress(address);
+                        addressAmounts[address] += txin.vout[vout].nValue;
                     }
                 }
             }
         }
     }
-    vAddressSnapshot.clear(); // clear existing snapshot
+    // the untouched part of the snapshot comes straight from the table, already cut to the top 3999
+    std::set <CTxDestination> touchedDestinations;
+    for ( auto &address : touchedAddresses )
+        touchedDestinations.insert(DecodeDestination(address));
+    std::vector <std::pair<CAmount, CTxDestination>> vTop;
+    if ( !pblocktree->SnapshotDestinations(vTop, 3999, touchedDestinations) )
+        return false;
+    vAddressSnapshot.swap(vTop); // replace existing snapshot
     // convert address string to destination for easier conversion to what ever is required, eg, scriptPubKey.
     for ( auto element : addressAmounts)
         vAddressSnapshot.push_back(make_pair(element.second, DecodeDestination(element.first)));
@@ -1467,7 +1639,7 @@ bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector
         CValidationState &state,
         const int nHeight,
         const int dosLevel,
-        bool (*isInitBlockDownload)(),int32_t validateprices) {
+        bool (*isInitBlockDownload)(),int32_t validateprices, bool fCheckSaplingProofs) {
 
       //Create a Vector of futures to be collected later
       std::vector<std::future<CheckTransationResults>> vFutures;
@@ -1546,8 +1718,8 @@ bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector
             return state.DoS(singleResults.dosLevel, error(singleResults.errorString.c_str()), REJECT_INVALID, singleResults.reasonString);
           }
 
-          //Skip costly sapling checks on intial download below the hardcoded checkpoints
-          if (!fCheckpointsEnabled || nHeight >= Checkpoints::GetTotalBlocksEstimate(Params().Checkpoints())) {
+          //Skip costly sapling checks on intial download below the hardcoded checkpoints, or when the caller has done them
+          if (fCheckSaplingProofs && (!fCheckpointsEnabled || nHeight >= Checkpoints::GetTotalBlocksEstimate(Params().Checkpoints()))) {
               //Verify Sapling
               if (!tx->vShieldedSpend.empty() || !tx->vShieldedOutput.empty()) {
                   //Push tx to thread vector
@@ -1859,12 +2031,14 @@ bool CheckTransaction(uint32_t tiptime,const CTransaction& tx, CValidationState
 {
     if (chainName.isKMD())
     {
-        // check for banned transaction ids
+        // check for banned transaction ids; filled once, as the mempool precheck calls this without cs_main
         static uint256 array[64];
         static int32_t numbanned;
         static int32_t indallvouts;
-        if ( *(int32_t *)&array[0] == 0 )
+        static std::once_flag bannedFilled;
+        std::call_once(bannedFilled, []() {
             numbanned = komodo_bannedset(&indallvouts,array,(int32_t)(sizeof(array)/sizeof(*array)));
+        });
 
         for (size_t j=0; j< tx.vin.size(); j++) // for every tx.vin
         {
@@ -1873,9 +2047,9 @@ bool CheckTransaction(uint32_t tiptime,const CTransaction& tx, CValidationState
                 if ( tx.vin[j].prevout.hash == array[k] && komodo_checkvout(tx.vin[j].prevout.n,k,indallvouts) )
                 {
                     // hash matches and the vout.n matches
-                    static uint32_t counter;
+                    static std::atomic<uint32_t> counter(0);
                     if ( counter++ < 100 )
-                        printf("MEMPOOL: banned tx.%d being used at ht.%d vout.%ld\n",k,(int32_t)chainActive.Tip()->nHeight,j);
+                        printf("MEMPOOL: banned tx.%d being used in vin.%ld\n",k,j);
                     return false;
                 }
             }
@@ -2256,6 +2430,40 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
     return nMinFee;
 }
 
+/**
+ * Height of the next block (high word) and time of the tip (low word), for
+ * PreCheckTransactionForMempool to read without cs_main. One word, so the
+ * two are always read from the same tip. Written under cs_main whenever the
+ * tip changes.
+ */
+static std::atomic<uint64_t> nPrecheckTip(0);
+
+static void SetPrecheckTip(const CBlockIndex *pindex)
+{
+    if (pindex == 0)
+        nPrecheckTip = 0;
+    else
+        nPrecheckTip = ((uint64_t)(pindex->nHeight + 1) << 32) | pindex->nTime;
+}
+
+bool PreCheckTransactionForMempool(const CTransaction &tx, CValidationState &state, uint32_t &nBranchId, int dosLevel)
+{
+    uint64_t nTip = nPrecheckTip;
+    int nextBlockHeight = (int)(nTip >> 32);
+    uint32_t tiptime = nextBlockHeight <= 1 ? (uint32_t)time(NULL) : (uint32_t)nTip;
+    nBranchId = CurrentEpochBranchId(nextBlockHeight, Params().GetConsensus());
+
+    auto verifier = ProofVerifier::Strict();
+    if (!CheckTransaction(tiptime, tx, state, verifier, 0, 0))
+        return error("PreCheckTransactionForMempool: CheckTransaction failed");
+
+    std::vector<const CTransaction*> vptx;
+    vptx.emplace_back(&tx);
+    if (!ContextualCheckTransactionMultithreaded(0, vptx, 0, state, nextBlockHeight, (dosLevel == -1) ? 10 : dosLevel))
+        return error("PreCheckTransactionForMempool: ContextualCheckTransaction failed");
+    return true;
+}
+
 /*****
  * @brief Try to add transaction to memory pool
  * @param pool
@@ -2265,9 +2473,10 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
  * @param pfMissingInputs
  * @param fRejectAbsurdFee
  * @param dosLevel
+ * @param fProofsVerified skip the Sprout and Sapling proof checks, already done by the caller
  * @returns true on success
  */
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,bool* pfMissingInputs, bool fRejectAbsurdFee, int dosLevel)
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,bool* pfMissingInputs, bool fRejectAbsurdFee, int dosLevel, bool fProofsVerified)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs != nullptr)
@@ -2293,7 +2502,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
             return false;
         }
     }
-    auto verifier = ProofVerifier::Strict();
+    auto verifier = fProofsVerified ? ProofVerifier::Disabled() : ProofVerifier::Strict();
     if (chainName.isKMD() && chainActive.Tip() != nullptr
             && !komodo_validate_interest(tx, chainActive.Tip()->nHeight + 1, chainActive.Tip()->GetMedianTimePast() + 777))
     {
@@ -2333,7 +2542,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
     std::vector<const CTransaction*> vptx;
     vptx.emplace_back(&tx);
-    if (!ContextualCheckTransactionMultithreaded(0, vptx, 0, state, nextBlockHeight, (dosLevel == -1) ? 10 : dosLevel))
+    if (!ContextualCheckTransactionMultithreaded(0, vptx, 0, state, nextBlockHeight, (dosLevel == -1) ? 10 : dosLevel, IsInitialBlockDownload, 1, !fProofsVerified))
     {
         return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
     }
@@ -2507,6 +2716,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         auto consensusBranchId = CurrentEpochBranchId(chainActive.Height() + 1, Params().GetConsensus());
 
         CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx), fSpendsCoinbase, consensusBranchId);
+        // Sapling proofs are not checked below the checkpoints, here or by the caller
+        entry.SetProofsVerified(!fCheckpointsEnabled || nextBlockHeight >= Checkpoints::GetTotalBlocksEstimate(Params().Checkpoints()));
         unsigned int nSize = entry.GetTxSize();
 
         // Accept a tx if it contains joinsplits and has at least the default fee specified by z_sendmany.
@@ -2522,6 +2733,29 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
             }
         }
 
+        // Once the pool has been full, require what the evicted packages paid
+        if (fLimitFree && !tx.IsCoinImport())
+        {
+            CAmount nModifiedFees = nFees;
+            double dPriorityDelta = 0;
+            pool.ApplyDeltas(hash, dPriorityDelta, nModifiedFees);
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee)
+                return state.DoS(0, error("AcceptToMemoryPool: mempool min fee not met %s, %d < %d", hash.ToString(), nModifiedFees, mempoolRejectFee), REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+        }
+
+        // Calculate in-mempool ancestors, up to a limit.
+        CTxMemPool::setEntries setAncestors;
+        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+        size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+        size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+        std::string errString;
+        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString))
+        {
+            return state.DoS(0, error("AcceptToMemoryPool: %s %s", hash.ToString(), errString), REJECT_NONSTANDARD, "too-long-mempool-chain");
+        }
+
         // Require that free transactions have sufficient priority to be mined in the next block.
         if (GetBoolArg("-relaypriority", false) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
             fprintf(stderr,"accept failure.6\n");
@@ -2602,7 +2836,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         {
             LOCK(pool.cs);
             // Store transaction in memory
-            pool.addUnchecked(hash, entry, !IsInitialBlockDownload());
+            pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
             if (!tx.IsCoinImport())
             {
                 // Add memory address index
@@ -2615,6 +2849,15 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                     pool.addSpentIndex(entry, view);
                 }
             }
+
+            // Keep the pool within -maxmempool; the new transaction may be
+            // the one that pays least
+            if (fLimitFree)
+            {
+                pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+                if (!pool.exists(hash))
+                    return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+            }
         }
     }
     return true;
@@ -2662,24 +2905,26 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 }
 
 bool GetAddressIndex(uint160 addressHash, int type,
-                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end,
+                     size_t limit, const CAddressIndexKey *after)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end, limit, after))
         return error("unable to get txids for address");
 
     return true;
 }
 
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       size_t limit, const CAddressUnspentKey *after)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, limit, after))
         return error("unable to get txids for address");
 
     return true;
@@ -3121,6 +3366,8 @@ void Misbehaving(NodeId pnode, int howmuch)
     if (howmuch == 0)
         return;
 
+    // Message handlers call this from several threads, some without cs_main
+    LOCK(cs_main);
     CNodeState *state = State(pnode);
     if (state == NULL)
         return;
@@ -3704,6 +3951,16 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+        if (!pblocktree->UpdateAddressBalanceIndex(addressIndex, true, pindex)) {
+            return AbortNode(state, "Failed to write address balance index");
+        }
+    }
+
+    if (fUTXOStatsIndex) {
+        // the parent's entry is still in place, so dropping this one rolls the stats back
+        if (!pblocktree->EraseUTXOStats(pindex->GetBlockHash())) {
+            return AbortNode(state, "Failed to delete utxo stats index");
+        }
     }
 
     return fClean;
@@ -3824,6 +4081,39 @@ CCriticalSection& get_cs_main()
     return cs_main;
 }
 
+/** Whether every transaction of block with Sprout or Sapling parts is in setVerified */
+static bool ShieldedTxsVerified(const CBlock& block, const std::set<uint256>& setVerified)
+{
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.vjoinsplit.empty() && tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty())
+            continue;
+        if (!setVerified.count(tx.GetHash()))
+            return false;
+    }
+    return true;
+}
+
+bool GetMempoolVerifiedTxs(const CTxMemPool& pool, const CBlock& block, uint32_t nBranchId, std::set<uint256>& setVerified)
+{
+    LOCK(pool.cs);
+    for (const CTransaction& tx : block.vtx) {
+        CTxMemPool::txiter it = pool.mapTx.find(tx.GetHash());
+        if (it != pool.mapTx.end() && it->GetProofsVerified() && it->GetValidatedBranchId() == nBranchId)
+            setVerified.insert(tx.GetHash());
+    }
+    return ShieldedTxsVerified(block, setVerified);
+}
+
+/** Whether tx spends a crypto-condition output; its eval depends on chain state, so it is never taken as verified */
+static bool SpendsCryptoCondition(const CTransaction& tx, const CCoinsViewCache& view)
+{
+    for (const CTxIn& txin : tx.vin) {
+        if (view.GetOutputFor(txin).scriptPubKey.IsPayToCryptoCondition())
+            return true;
+    }
+    return false;
+}
+
 /*****
  * @brief Apply the effects of this block (with given index) on the UTXO set represented by coins
  * @param block the block to add
@@ -3834,7 +4124,8 @@ CCriticalSection& get_cs_main()
  * @param fcheckPOW
  * @returns true on success
  */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck,bool fCheckPOW)
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck,bool fCheckPOW,
+                  const std::set<uint256>* pVerifiedTxs)
 {
     CDiskBlockPos blockPos;
     const CChainParams& chainparams = Params();
@@ -3851,13 +4142,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             fExpensiveChecks = false;
         }
     }
+    if (!fJustCheck)
+        pVerifiedTxs = NULL;
     auto verifier = ProofVerifier::Strict();
     auto disabledVerifier = ProofVerifier::Disabled();
+    bool fProofChecks = fExpensiveChecks && !(pVerifiedTxs && ShieldedTxsVerified(block, *pVerifiedTxs));
     int32_t futureblock;
     CAmount blockReward = GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
     uint64_t notarypaycheque = 0;
     // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in
-    if ( !CheckBlock(&futureblock,pindex->nHeight,pindex,block, state, fExpensiveChecks ? verifier : disabledVerifier, fCheckPOW, !fJustCheck) || futureblock != 0 )
+    if ( !CheckBlock(&futureblock,pindex->nHeight,pindex,block, state, fProofChecks ? verifier : disabledVerifier, fCheckPOW, !fJustCheck) || futureblock != 0 )
     {
         return false;
     }
@@ -4115,8 +4409,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             sum += interest;
 
+            // Scripts the mempool already ran need not run again, unless they eval a crypto-condition
+            bool fTxScriptChecks = fExpensiveChecks &&
+                !(pVerifiedTxs && pVerifiedTxs->count(txhash) && !SpendsCryptoCondition(tx, view));
             std::vector<CScriptCheck> vChecks;
-            if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks, flags, false, txdata[i], chainparams.GetConsensus(), consensusBranchId, nScriptCheckThreads ? &vChecks : NULL))
+            if (!ContextualCheckInputs(tx, state, view, fTxScriptChecks, flags, false, txdata[i], chainparams.GetConsensus(), consensusBranchId, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
             control.Add(vChecks);
         }
@@ -4329,12 +4626,32 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+
+        if (!pblocktree->UpdateAddressBalanceIndex(addressIndex, false, pindex)) {
+            return AbortNode(state, "Failed to write address balance index");
+        }
     }
 
     if (fSpentIndex)
         if (!pblocktree->UpdateSpentIndex(spentIndex))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fUTXOStatsIndex)
+    {
+        // entries are only missing below the first block connected with the index enabled
+        CUTXOStats utxostats;
+        if (pindex->pprev->pprev == NULL || pblocktree->ReadUTXOStats(pindex->pprev->GetBlockHash(), utxostats))
+        {
+            // without an entry for this block, coinsupply falls back to the block scan
+            if (!utxostats.ApplyBlock(block, blockundo, pindex->nHeight))
+                LogPrintf("%s: unable to compute utxo stats for %s, reindex to rebuild the utxo stats index\n", __func__, pindex->GetBlockHash().ToString());
+            else if (!pblocktree->WriteUTXOStats(pindex->GetBlockHash(), utxostats))
+                return AbortNode(state, "Failed to write utxo stats index");
+        }
+        else
+            LogPrintf("%s: no utxo stats for %s, reindex to rebuild the utxo stats index\n", __func__, pindex->pprev->GetBlockHash().ToString());
+    }
+
     if (fTimestampIndex)
     {
         unsigned int logicalTS = pindex->nTime;
@@ -4513,6 +4830,7 @@ void PruneAndFlush() {
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
     chainActive.SetTip(pindexNew);
+    SetPrecheckTip(pindexNew);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -4614,6 +4932,7 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
 
     if (!fBare) {
         // resurrect mempool transactions from the disconnected block.
+        std::vector<uint256> vHashUpdate;
         for (int i = 0; i < block.vtx.size(); i++)
         {
             // ignore validation errors in resurrected transactions
@@ -4626,7 +4945,14 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
             {
                 mempool.remove(tx, removed, true);
             }
+            else if (mempool.exists(tx.GetHash()))
+            {
+                vHashUpdate.push_back(tx.GetHash());
+            }
         }
+        // Children of the resurrected transactions may already be in the pool
+        mempool.UpdateTransactionsFromBlock(vHashUpdate);
+        mempool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
         if (sproutAnchorBeforeDisconnect != sproutAnchorAfterDisconnect) {
             // The anchor may not change between block disconnects,
             // in which case we don't want to evict from the mempool yet!
@@ -5186,6 +5512,34 @@ static void NotifyHeaderTip() {
     }
 }
 
+/**
+ * The block most recently connected as our tip, serialized once as a block
+ * and as a cmpctblock message. Every peer fetching it at the tip gets the same
+ * buffers instead of a disk read and a serialization of its own.
+ */
+static CCriticalSection cs_mostRecentBlock;
+static uint256 hashMostRecentBlock;
+static CSendBuffer msgMostRecentBlock;
+static CSendBuffer msgMostRecentCmpctBlock;
+
+static void SetMostRecentBlock(const CBlock& block, const CBlockHeaderAndShortTxIDs& cmpctblock, CSendBuffer& msgCmpctBlock)
+{
+    CSendBuffer msgBlock = MakeSendBuffer(NetMsgType::BLOCK, block);
+    msgCmpctBlock = MakeSendBuffer(NetMsgType::CMPCTBLOCK, cmpctblock);
+    LOCK(cs_mostRecentBlock);
+    hashMostRecentBlock = block.GetHash();
+    msgMostRecentBlock = msgBlock;
+    msgMostRecentCmpctBlock = msgCmpctBlock;
+}
+
+static CSendBuffer GetMostRecentBlockMessage(const uint256& hash, bool fCompact)
+{
+    LOCK(cs_mostRecentBlock);
+    if (hash != hashMostRecentBlock)
+        return CSendBuffer();
+    return fCompact ? msgMostRecentCmpctBlock : msgMostRecentBlock;
+}
+
 /**
  * Make the best chain active, in multiple steps. The result is either failure
  * or an activated best chain. pblock is either NULL or a pointer to a block
@@ -5239,14 +5593,38 @@ bool ActivateBestChain(bool fSkipdpow, CValidationState &state, bool fNotifyUI,
             if (nLocalServices & NODE_NETWORK)
             {
                 int ht = 0;
+                // Peers that asked for high-bandwidth relay get a cmpctblock
+                // straight away when the new tip is the block we were handed.
+                std::set<NodeId> setPreferHeaderAndIDs;
                 {
                     LOCK(cs_main);
                     ht = chainActive.Height();
+                    if (pblock != NULL && pblock->GetHash() == hashNewTip) {
+                        for (map<NodeId, CNodeState>::const_iterator it = mapNodeState.begin(); it != mapNodeState.end(); ++it)
+                            if (it->second.fPreferHeaderAndIDs)
+                                setPreferHeaderAndIDs.insert(it->first);
+                    }
                 }
+                // Serialize the new tip once for every peer that will fetch it.
+                CSendBuffer msgCmpctBlock;
+                if (pblock != NULL && pblock->GetHash() == hashNewTip)
+                    SetMostRecentBlock(*pblock, CBlockHeaderAndShortTxIDs(*pblock), msgCmpctBlock);
+                CInv inv(MSG_BLOCK, hashNewTip);
                 LOCK(cs_vNodes);
                 for(CNode* pnode : vNodes)
-                    if (ht > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                    if (ht > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate)) {
+                        if (msgCmpctBlock && setPreferHeaderAndIDs.count(pnode->GetId())) {
+                            bool fKnown;
+                            {
+                                LOCK(pnode->cs_inventory);
+                                fKnown = pnode->setInventoryKnown.count(inv) != 0;
+                                pnode->setInventoryKnown.insert(inv);
+                            }
+                            if (!fKnown)
+                                pnode->PushSendBuffer(msgCmpctBlock);
+                        } else
+                            pnode->PushInventory(inv);
+                    }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -5892,15 +6270,17 @@ bool CheckBlock(int32_t *futureblockp, int32_t height, CBlockIndex *pindex, cons
         // be tx in local mempool that make the block invalid.
         LOCK2(cs_main,mempool.cs);
         list<CTransaction> transactionsToRemove;
+        std::vector<CTxMemPoolEntry> vEntries;
         for(const CTxMemPoolEntry& e : mempool.mapTx)
         {
             const CTransaction &tx = e.GetTx();
             if ( tx.vjoinsplit.empty() && tx.vShieldedSpend.empty())
             {
                 transactionsToRemove.push_back(tx);
-                tmpmempool.addUnchecked(tx.GetHash(),e,true);
+                vEntries.push_back(e);
             }
         }
+        tmpmempool.addUncheckedEntries(vEntries);
         for(const CTransaction& tx : transactionsToRemove) {
             list<CTransaction> removed;
             mempool.remove(tx, removed, false);
@@ -5962,12 +6342,8 @@ bool CheckBlock(int32_t *futureblockp, int32_t height, CBlockIndex *pindex, cons
     {
         LOCK2(cs_main,mempool.cs);
         // here we add back all txs from the temp mempool to the main mempool.
-        for(const CTxMemPoolEntry& e : tmpmempool.mapTx)
-        {
-            const CTransaction &tx = e.GetTx();
-            const uint256 &hash = tx.GetHash();
-            mempool.addUnchecked(hash,e,true);
-        }
+        std::vector<CTxMemPoolEntry> vEntries(tmpmempool.mapTx.begin(), tmpmempool.mapTx.end());
+        mempool.addUncheckedEntries(vEntries);
         // empty the temp mempool for next time.
         tmpmempool.clear();
     }
@@ -6063,7 +6439,7 @@ bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& sta
     return true;
 }
 
-bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState& state, CBlockIndex * const pindexPrev)
+bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState& state, CBlockIndex * const pindexPrev, bool fCheckSaplingProofs)
 {
     const int nHeight = pindexPrev == NULL ? 0 : pindexPrev->nHeight + 1;
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -6109,7 +6485,7 @@ bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState
     }
 
     // Check transaction contextually against consensus rules at block height
-    if (!ContextualCheckTransactionMultithreaded(slowflag,vptx,pindexPrev, state, nHeight, 100)) {
+    if (!ContextualCheckTransactionMultithreaded(slowflag,vptx,pindexPrev, state, nHeight, 100, IsInitialBlockDownload, 1, fCheckSaplingProofs)) {
         return false; // Failure reason has been set in validation state object
     }
 
@@ -6462,7 +6838,8 @@ bool ProcessNewBlock(bool from_miner, int32_t height, CValidationState &state, C
         if ( chainActive.Tip() != 0 )
             komodo_currentheight_set(chainActive.Tip()->nHeight);
         checked = CheckBlock(&futureblock,height!=0?height:komodo_block2height(pblock),0,*pblock, state, verifier,0);
-        bool fRequested = MarkBlockAsReceived(hash);
+        bool fRequested = pfrom != nullptr ? MarkBlockAsReceived(hash, pfrom->GetId(), ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION))
+                                           : MarkBlockAsReceived(hash);
         fRequested |= fForceProcessing;
         if ( checked && komodo_checkPOW(0,0,pblock,height) < 0 )
         {
@@ -6499,7 +6876,8 @@ bool ProcessNewBlock(bool from_miner, int32_t height, CValidationState &state, C
     return true;
 }
 
-bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex * const pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot)
+bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex * const pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot,
+                       bool fTrustMempool)
 {
     AssertLockHeld(cs_main);
     assert(pindexPrev == chainActive.Tip());
@@ -6508,6 +6886,10 @@ bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex
     CBlockIndex indexDummy(block);
     indexDummy.pprev = pindexPrev;
     indexDummy.nHeight = pindexPrev->nHeight + 1;
+
+    std::set<uint256> setVerifiedTxs;
+    bool fCheckSaplingProofs = !fTrustMempool ||
+        !GetMempoolVerifiedTxs(mempool, block, CurrentEpochBranchId(indexDummy.nHeight, Params().GetConsensus()), setVerifiedTxs);
     // JoinSplit proofs are verified in ConnectBlock
     auto verifier = ProofVerifier::Disabled();
     // NOTE: CheckBlockHeader is called by CheckBlock
@@ -6520,11 +6902,11 @@ bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex
     {
         return false;
     }
-    if (!ContextualCheckBlock(0,block, state, pindexPrev))
+    if (!ContextualCheckBlock(0,block, state, pindexPrev, fCheckSaplingProofs))
     {
         return false;
     }
-    if (!ConnectBlock(block, state, &indexDummy, viewNew, true,fCheckPOW))
+    if (!ConnectBlock(block, state, &indexDummy, viewNew, true,fCheckPOW, fTrustMempool ? &setVerifiedTxs : NULL))
     {
         return false;
     }
@@ -6950,6 +7332,17 @@ bool static LoadBlockIndexDB()
     // Check whether we have an address index
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+    // Databases created before the address balance table need it built once from the unspent index
+    if (fAddressIndex) {
+        bool fAddressBalances = false;
+        pblocktree->ReadFlag("addressbalanceindex", fAddressBalances);
+        if (!fAddressBalances) {
+            LogPrintf("%s: building address balance index\n", __func__);
+            if (!pblocktree->RebuildAddressBalanceIndex())
+                return error("LoadBlockIndexDB(): failed to build address balance index");
+            pblocktree->WriteFlag("addressbalanceindex", true);
+        }
+    }
 
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
@@ -6959,6 +7352,10 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Check whether we have a utxo stats index
+    pblocktree->ReadFlag("utxostatsindex", fUTXOStatsIndex);
+    LogPrintf("%s: utxo stats index %s\n", __func__, fUTXOStatsIndex ? "enabled" : "disabled");
+
     // Fill in-memory data
     for(const auto& item : mapBlockIndex)
     {
@@ -6980,6 +7377,7 @@ bool static LoadBlockIndexDB()
 
     LOCK(cs_main);
     chainActive.SetTip(it->second);
+    SetPrecheckTip(it->second);
 
     // Set hashFinalSproutRoot for the end of best chain
     it->second->hashFinalSproutRoot = pcoinsTip->GetBestAnchor(SPROUT);
@@ -7276,6 +7674,7 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    SetPrecheckTip(NULL);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
@@ -7349,6 +7748,7 @@ bool InitBlockIndex()
         // Use the provided setting for -addressindex in the new database
         fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
         pblocktree->WriteFlag("addressindex", fAddressIndex);
+        pblocktree->WriteFlag("addressbalanceindex", fAddressIndex);
 
         // Use the provided setting for -timestampindex in the new database
         fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -7356,6 +7756,9 @@ bool InitBlockIndex()
 
         fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
         pblocktree->WriteFlag("spentindex", fSpentIndex);
+
+        fUTXOStatsIndex = GetBoolArg("-utxostatsindex", DEFAULT_UTXOSTATSINDEX);
+        pblocktree->WriteFlag("utxostatsindex", fUTXOStatsIndex);
         fprintf(stderr,"fAddressIndex.%d/%d fSpentIndex.%d/%d\n",fAddressIndex,DEFAULT_ADDRESSINDEX,fSpentIndex,DEFAULT_SPENTINDEX);
         LogPrintf("Initializing databases...\n");
     }
@@ -7390,11 +7793,64 @@ bool InitBlockIndex()
     return true;
 }
 
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/**
+ * Hand a block read from a block file to ProcessNewBlock, then recursively
+ * process earlier encountered successors that were waiting for it.
+ * Returns false if validation hit a system error.
+ */
+static bool ProcessImportedBlock(CBlock& block, CDiskBlockPos *dbp, int& nLoaded)
+{
+    const CChainParams& chainparams = Params();
+    uint256 hash = block.GetHash();
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        CValidationState state;
+        if (ProcessNewBlock(0,0,state, NULL, &block, true, dbp))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && komodo_blockheight(hash) % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), komodo_blockheight(hash));
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+
+            if (ReadBlockFromDisk(mapBlockIndex.count(hash)!=0?mapBlockIndex[hash]->nHeight:0,block, it->second,1))
+            {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                          head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(0,0,dummy, NULL, &block, true, &it->second))
+                {
+                    nLoaded++;
+                    queue.push_back(block.GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
 {
     const CChainParams& chainparams = Params();
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
@@ -7447,45 +7903,8 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
                     continue;
                 }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(0,0,state, NULL, &block, true, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && komodo_blockheight(hash) % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), komodo_blockheight(hash));
-                }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-
-                        if (ReadBlockFromDisk(mapBlockIndex.count(hash)!=0?mapBlockIndex[hash]->nHeight:0,block, it->second,1))
-                        {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                      head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(0,0,dummy, NULL, &block, true, &it->second))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
+                if (!ProcessImportedBlock(block, dbp, nLoaded))
+                    break;
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
@@ -7498,73 +7917,469 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp)
     return nLoaded > 0;
 }
 
-void static CheckBlockIndex()
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+/**
+ * The secret mempool.dat is keyed with, so that a file written by anyone
+ * without it cannot have its proofs trusted. It lives in its own file, which
+ * is created on the first dump.
+ */
+static bool GetMempoolDumpKey(uint256& key, bool fCreate)
 {
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    if (!fCheckBlockIndex) {
-        return;
+    boost::filesystem::path pathKey = GetDataDir() / "mempool.key";
+    FILE *file = fopen(pathKey.string().c_str(), "rb");
+    if (file) {
+        bool fRead = fread(key.begin(), 1, key.size(), file) == key.size();
+        fclose(file);
+        if (fRead || !fCreate)
+            return fRead;
+    }
+    if (!fCreate)
+        return false;
+    GetRandBytes(key.begin(), key.size());
+    file = fopen(pathKey.string().c_str(), "wb");
+    if (!file)
+        return error("%s: Failed to open file %s", __func__, pathKey.string());
+    bool fWritten = fwrite(key.begin(), 1, key.size(), file) == key.size();
+    FileCommit(file);
+    fclose(file);
+    return fWritten;
+}
+
+/** Digest of the mempool.dat contents hashed to hashContents, keyed with the node's secret */
+static uint256 MempoolDumpDigest(const uint256& key, const uint256& hashContents)
+{
+    return Hash(key.begin(), key.end(), hashContents.begin(), hashContents.end());
+}
+
+bool DumpMempool()
+{
+    static CCriticalSection cs_dump;
+    LOCK(cs_dump);
+    int64_t nStart = GetTimeMillis();
+
+    uint256 key;
+    if (!GetMempoolDumpKey(key, true))
+        return error("%s: no mempool.dat key", __func__);
+
+    // Copy the entries out, so the pool is only locked for the copy and
+    // not for the serialization. Parents are written before their children,
+    // so LoadMempool can accept the transactions in file order.
+    struct CDumpEntry {
+        CTransaction tx;
+        uint64_t nCountWithAncestors;
+        uint32_t nBranchId;
+        bool fProofsVerified;
+    };
+    std::vector<CDumpEntry> vEntries;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    {
+        LOCK(mempool.cs);
+        vEntries.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); it++)
+            vEntries.push_back({it->GetTx(), it->GetCountWithAncestors(), it->GetValidatedBranchId(), it->GetProofsVerified()});
+        mapDeltas = mempool.mapDeltas;
+    }
+    std::stable_sort(vEntries.begin(), vEntries.end(), [](const CDumpEntry& a, const CDumpEntry& b) {
+        return a.nCountWithAncestors < b.nCountWithAncestors;
+    });
+
+    // Every entry records the branch it was validated against and whether
+    // its proofs were checked on the way in.
+    CDataStream ssMempool(SER_DISK, CLIENT_VERSION);
+    ssMempool << MEMPOOL_DUMP_VERSION;
+    ssMempool << FLATDATA(Params().MessageStart());
+    uint64_t nCount = vEntries.size();
+    ssMempool << nCount;
+    for (const CDumpEntry& entry : vEntries) {
+        ssMempool << entry.tx;
+        ssMempool << entry.nBranchId;
+        ssMempool << entry.fProofsVerified;
+    }
+    ssMempool << mapDeltas;
+    uint256 hash = MempoolDumpDigest(key, Hash(ssMempool.begin(), ssMempool.end()));
+    ssMempool << hash;
+
+    boost::filesystem::path pathMempool = GetDataDir() / "mempool.dat";
+    boost::filesystem::path pathTmp = GetDataDir() / "mempool.dat.new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+    try {
+        fileout << ssMempool;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
     }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+    if (!RenameOver(pathTmp, pathMempool))
+        return error("%s: Rename-into-place failed", __func__);
 
-    LOCK(cs_main);
+    LogPrint("mempool", "Dumped %u mempool transactions to disk in %dms\n", nCount, GetTimeMillis() - nStart);
+    return true;
+}
 
-    // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
-    // so we have the genesis block in mapBlockIndex but no active chain.  (A few of the tests when
-    // iterating the block tree require that chainActive has been initialized.)
-    if (chainActive.Height() < 0) {
-        assert(mapBlockIndex.size() <= 1);
-        return;
+bool ReadMempoolFile(uint32_t nBranchId, std::vector<CTransaction>& vtx, std::vector<bool>& vProofsVerified,
+                     std::map<uint256, std::pair<double, CAmount> >& mapDeltas)
+{
+    boost::filesystem::path pathMempool = GetDataDir() / "mempool.dat";
+    FILE *file = fopen(pathMempool.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
     }
 
-    // Build forward-pointing map of the entire block tree.
-    std::multimap<CBlockIndex*,CBlockIndex*> forward;
-    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); it++) {
-        if ( it->second != 0 )
-            forward.insert(std::make_pair(it->second->pprev, it->second));
+    // Proofs checked before the dump still hold as long as the signature hash
+    // they were checked against commits to the branch we are on now.
+    try {
+        CHashVerifier<CAutoFile> verifier(&filein);
+        uint64_t nVersion;
+        verifier >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s: unknown mempool file version %d", __func__, nVersion);
+        unsigned char pchMsgTmp[4];
+        verifier >> FLATDATA(pchMsgTmp);
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return error("%s: mempool file is for a different network", __func__);
+        uint64_t nCount;
+        verifier >> nCount;
+        for (uint64_t i = 0; i < nCount; i++) {
+            CTransaction tx;
+            uint32_t nTxBranchId;
+            bool fVerified;
+            verifier >> tx >> nTxBranchId >> fVerified;
+            vtx.push_back(tx);
+            vProofsVerified.push_back(fVerified && nTxBranchId == nBranchId);
+        }
+        verifier >> mapDeltas;
+
+        // A damaged file, or one written without our key, must not have its proofs trusted
+        uint256 hashIn, key;
+        filein >> hashIn;
+        if (!GetMempoolDumpKey(key, false) || hashIn != MempoolDumpDigest(key, verifier.GetHash())) {
+            LogPrintf("%s: mempool file digest mismatch, checking all proofs\n", __func__);
+            vProofsVerified.assign(vtx.size(), false);
+        }
     }
-    if ( Params().NetworkIDString() != "regtest" )
-        assert(forward.size() == mapBlockIndex.size());
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
 
-    std::pair<std::multimap<CBlockIndex*,CBlockIndex*>::iterator,std::multimap<CBlockIndex*,CBlockIndex*>::iterator> rangeGenesis = forward.equal_range(NULL);
-    CBlockIndex *pindex = rangeGenesis.first->second;
-    rangeGenesis.first++;
-    assert(rangeGenesis.first == rangeGenesis.second); // There is only one index entry with parent NULL.
+bool LoadMempool()
+{
+    int64_t nStart = GetTimeMillis();
+    int nHeight;
+    uint32_t nBranchId;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height() + 1;
+        nBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+    }
 
-    // Iterate over the entire block tree, using depth-first search.
-    // Along the way, remember whether there are blocks on the path from genesis
-    // block being explored which are the first to have certain properties.
-    size_t nNodes = 0;
-    int nHeight = 0;
-    CBlockIndex* pindexFirstInvalid = NULL; // Oldest ancestor of pindex which is invalid.
-    CBlockIndex* pindexFirstMissing = NULL; // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
-    CBlockIndex* pindexFirstNeverProcessed = NULL; // Oldest ancestor of pindex for which nTx == 0.
-    CBlockIndex* pindexFirstNotTreeValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
-    CBlockIndex* pindexFirstNotTransactionsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TRANSACTIONS (regardless of being valid or not).
-    CBlockIndex* pindexFirstNotChainValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
-    CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
-    while (pindex != NULL) {
-        nNodes++;
-        if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
-        if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
-        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotTransactionsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TRANSACTIONS) pindexFirstNotTransactionsValid = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
-        if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
+    std::vector<CTransaction> vtx;
+    std::vector<bool> vProofsVerified;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    if (!ReadMempoolFile(nBranchId, vtx, vProofsVerified, mapDeltas))
+        return false;
 
-        // Begin: actual consistency checks.
-        if (pindex->pprev == NULL) {
-            // Genesis block checks.
-            assert(pindex->GetBlockHash() == consensusParams.hashGenesisBlock); // Genesis block's hash must match.
-            assert(pindex == chainActive.Genesis()); // The current active chain's genesis block must be this block.
+    for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); it++)
+        mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+
+    // Check the Sapling proofs of everything else in one pass spread over
+    // all the verification threads. If any of them fails, those transactions
+    // get the full checks below, which tell the bad ones apart.
+    std::vector<const CTransaction*> vptxCheck;
+    std::vector<size_t> vCheckIndex;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (!vProofsVerified[i] && !IsExpiredTx(vtx[i], nHeight)) {
+            vptxCheck.push_back(&vtx[i]);
+            vCheckIndex.push_back(i);
         }
-        if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0);  // nSequenceId can't be set for blocks that aren't linked
-        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
-        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
-        if (!fHavePruned) {
-            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
-            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-            assert(pindexFirstMissing == pindexFirstNeverProcessed);
-        } else {
+    }
+    if (!vptxCheck.empty()) {
+        CValidationState state;
+        if (ContextualCheckTransactionMultithreaded(0, vptxCheck, 0, state, nHeight, 0)) {
+            // Sprout proofs are only checked by CheckTransaction
+            for (size_t i : vCheckIndex)
+                vProofsVerified[i] = vtx[i].vjoinsplit.empty();
+        }
+    }
+
+    int64_t nImported = 0, nFailed = 0, nAlreadyThere = 0;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (ShutdownRequested())
+            return false;
+        CValidationState state;
+        LOCK(cs_main);
+        if (AcceptToMemoryPool(mempool, state, vtx[i], true, nullptr, false, -1, vProofsVerified[i]))
+            nImported++;
+        else if (mempool.exists(vtx[i].GetHash()))
+            nAlreadyThere++;
+        else
+            nFailed++;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i already there, %u proof checks batched, %dms\n",
+              nImported, nFailed, nAlreadyThere, vptxCheck.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+/** A block located by a -reindex file scanner, in file order. */
+struct CReindexBlockEntry
+{
+    uint256 hash;
+    uint256 hashPrev;
+    CDiskBlockPos pos;
+};
+
+/**
+ * Locate every block in blk?????.dat file nFile using the same framing as
+ * LoadExternalBlockFile, reading only the headers. Headers whose Equihash
+ * solution is valid are recorded with AddVerifiedEquihashSolution so the
+ * ordered connection pass does not verify them again.
+ */
+static void ScanReindexBlockFile(int nFile, std::vector<CReindexBlockEntry>& vEntries, const std::atomic<bool>& fInterrupt)
+{
+    const CChainParams& chainparams = Params();
+    CDiskBlockPos pos(nFile, 0);
+    FILE *file = OpenBlockFile(pos, true);
+    if (!file)
+        return; // This error is logged in OpenBlockFile
+
+    try {
+        CBufferedFile blkdat(file, 2*MAX_BLOCK_SIZE(10000000), MAX_BLOCK_SIZE(10000000)+8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        while (!blkdat.eof() && !fInterrupt) {
+            blkdat.SetPos(nRewind);
+            nRewind++; // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            try {
+                unsigned char buf[MESSAGE_START_SIZE];
+                blkdat.FindByte(chainparams.MessageStart()[0]);
+                nRewind = blkdat.GetPos()+1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, chainparams.MessageStart(), MESSAGE_START_SIZE))
+                    continue;
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCK_SIZE(10000000))
+                    continue;
+            } catch (const std::exception&) {
+                break;
+            }
+            try {
+                CBlockHeader header;
+                uint64_t nBlockPos = blkdat.GetPos();
+                blkdat.SetLimit(nBlockPos + nSize);
+                blkdat >> header;
+
+                CReindexBlockEntry entry;
+                entry.hash = header.GetHash();
+                entry.hashPrev = header.hashPrevBlock;
+                entry.pos = CDiskBlockPos(nFile, nBlockPos);
+                if (CheckEquihashSolution(&header, chainparams, false))
+                    AddVerifiedEquihashSolution(entry.hash);
+                vEntries.push_back(entry);
+
+                // skip the transactions; the connection pass reads them with ReadBlockFromDisk
+                blkdat.SetLimit();
+                if (!blkdat.SetPos(nBlockPos + nSize))
+                    blkdat.Seek(nBlockPos + nSize);
+                nRewind = nBlockPos + nSize;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: blk%05u.dat: %s\n", __func__, (unsigned int)nFile, e.what());
+    }
+}
+
+bool ReindexBlockFiles(int nThreads)
+{
+    const CChainParams& chainparams = Params();
+    int64_t nStart = GetTimeMillis();
+
+    int nFiles = 0;
+    while (boost::filesystem::exists(GetBlockPosFilename(CDiskBlockPos(nFiles, 0), "blk")))
+        nFiles++;
+    if (nFiles == 0)
+        return false;
+    nThreads = std::max(1, std::min(nThreads, nFiles));
+    // Scanners stay at most this many files ahead of the connection pass, which
+    // bounds both the entry lists and the verified-solution set.
+    const int nWindow = 2 * nThreads;
+    LogPrintf("Reindexing %d block files with %d scanner threads\n", nFiles, nThreads);
+
+    std::mutex csScan;
+    std::condition_variable condScan;
+    std::vector<std::vector<CReindexBlockEntry> > vScanned(nFiles);
+    std::vector<bool> vDone(nFiles, false);
+    int nNextScan = 0, nConnected = 0;
+    std::atomic<bool> fInterrupt(false);
+
+    std::vector<std::thread> vScanners;
+    for (int i = 0; i < nThreads; i++) {
+        vScanners.push_back(std::thread([&, i]() {
+            RenameThread(strprintf("zcash-reindex.%d", i).c_str());
+            while (true) {
+                int nFile;
+                {
+                    std::unique_lock<std::mutex> lock(csScan);
+                    condScan.wait(lock, [&]() { return fInterrupt || nNextScan >= nFiles || nNextScan < nConnected + nWindow; });
+                    if (fInterrupt || nNextScan >= nFiles)
+                        return;
+                    nFile = nNextScan++;
+                }
+                std::vector<CReindexBlockEntry> vEntries;
+                ScanReindexBlockFile(nFile, vEntries, fInterrupt);
+                {
+                    std::lock_guard<std::mutex> lock(csScan);
+                    vScanned[nFile].swap(vEntries);
+                    vDone[nFile] = true;
+                }
+                condScan.notify_all();
+            }
+        }));
+    }
+    // Stop and join the scanners however the connection pass exits, including
+    // through boost::thread_interrupted at shutdown.
+    struct CScannerGuard {
+        std::mutex& cs;
+        std::condition_variable& cond;
+        std::atomic<bool>& fInterrupt;
+        std::vector<std::thread>& vThreads;
+        ~CScannerGuard() {
+            {
+                std::lock_guard<std::mutex> lock(cs);
+                fInterrupt = true;
+            }
+            cond.notify_all();
+            for (std::thread& t : vThreads)
+                t.join();
+        }
+    } guard = {csScan, condScan, fInterrupt, vScanners};
+
+    int nLoaded = 0;
+    for (int nFile = 0; nFile < nFiles; nFile++) {
+        std::vector<CReindexBlockEntry> vEntries;
+        {
+            std::unique_lock<std::mutex> lock(csScan);
+            while (!vDone[nFile]) {
+                condScan.wait_for(lock, std::chrono::milliseconds(100));
+                lock.unlock();
+                boost::this_thread::interruption_point();
+                lock.lock();
+            }
+            vEntries.swap(vScanned[nFile]);
+        }
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+
+        try {
+            for (size_t i = 0; i < vEntries.size(); i++) {
+                boost::this_thread::interruption_point();
+                CReindexBlockEntry& entry = vEntries[i];
+                // detect out of order blocks, and store them for later
+                if (entry.hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(entry.hashPrev) == mapBlockIndex.end()) {
+                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, entry.hash.ToString(),
+                             entry.hashPrev.ToString());
+                    mapBlocksUnknownParent.insert(std::make_pair(entry.hashPrev, entry.pos));
+                    continue;
+                }
+                CBlock block;
+                if (!ReadBlockFromDisk(0, block, entry.pos, false))
+                    continue;
+                if (!ProcessImportedBlock(block, &entry.pos, nLoaded))
+                    break;
+            }
+        } catch (const std::runtime_error& e) {
+            AbortNode(std::string("System error: ") + e.what());
+        }
+
+        for (size_t i = 0; i < vEntries.size(); i++)
+            ForgetVerifiedEquihashSolution(vEntries[i].hash);
+        {
+            std::lock_guard<std::mutex> lock(csScan);
+            nConnected = nFile + 1;
+        }
+        condScan.notify_all();
+    }
+    LogPrintf("Reindexed %i blocks in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
+
+void static CheckBlockIndex()
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    if (!fCheckBlockIndex) {
+        return;
+    }
+
+    LOCK(cs_main);
+
+    // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
+    // so we have the genesis block in mapBlockIndex but no active chain.  (A few of the tests when
+    // iterating the block tree require that chainActive has been initialized.)
+    if (chainActive.Height() < 0) {
+        assert(mapBlockIndex.size() <= 1);
+        return;
+    }
+
+    // Build forward-pointing map of the entire block tree.
+    std::multimap<CBlockIndex*,CBlockIndex*> forward;
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); it++) {
+        if ( it->second != 0 )
+            forward.insert(std::make_pair(it->second->pprev, it->second));
+    }
+    if ( Params().NetworkIDString() != "regtest" )
+        assert(forward.size() == mapBlockIndex.size());
+
+    std::pair<std::multimap<CBlockIndex*,CBlockIndex*>::iterator,std::multimap<CBlockIndex*,CBlockIndex*>::iterator> rangeGenesis = forward.equal_range(NULL);
+    CBlockIndex *pindex = rangeGenesis.first->second;
+    rangeGenesis.first++;
+    assert(rangeGenesis.first == rangeGenesis.second); // There is only one index entry with parent NULL.
+
+    // Iterate over the entire block tree, using depth-first search.
+    // Along the way, remember whether there are blocks on the path from genesis
+    // block being explored which are the first to have certain properties.
+    size_t nNodes = 0;
+    int nHeight = 0;
+    CBlockIndex* pindexFirstInvalid = NULL; // Oldest ancestor of pindex which is invalid.
+    CBlockIndex* pindexFirstMissing = NULL; // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL; // Oldest ancestor of pindex for which nTx == 0.
+    CBlockIndex* pindexFirstNotTreeValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
+    CBlockIndex* pindexFirstNotTransactionsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_TRANSACTIONS (regardless of being valid or not).
+    CBlockIndex* pindexFirstNotChainValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
+    CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
+    while (pindex != NULL) {
+        nNodes++;
+        if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
+        if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
+        if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
+        if (pindex->pprev != NULL && pindexFirstNotTransactionsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TRANSACTIONS) pindexFirstNotTransactionsValid = pindex;
+        if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
+        if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
+
+        // Begin: actual consistency checks.
+        if (pindex->pprev == NULL) {
+            // Genesis block checks.
+            assert(pindex->GetBlockHash() == consensusParams.hashGenesisBlock); // Genesis block's hash must match.
+            assert(pindex == chainActive.Genesis()); // The current active chain's genesis block must be this block.
+        }
+        if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0);  // nSequenceId can't be set for blocks that aren't linked
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
             // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
             if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
         }
@@ -7799,14 +8614,43 @@ bool static AlreadyHave(const CInv& inv) REQUIRES(cs_main)
     return true;
 }
 
+bool GetBlockToServe(const uint256& hash, NodeId nodeid, CDiskBlockPos& blockPos, bool& fRecent)
+{
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+        return false;
+    bool send = false;
+    if (chainActive.Contains(mi->second)) {
+        send = true;
+    } else {
+        static const int nOneMonth = 30 * 24 * 60 * 60;
+        // To prevent fingerprinting attacks, only send blocks outside of the active
+        // chain if they are valid, and no more than a month older (both in time, and in
+        // best equivalent proof of work) than the best header chain we know about.
+        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+        (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+        (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
+        if (!send) {
+            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, nodeid);
+        }
+    }
+    // Pruned nodes may have deleted the block, so check whether
+    // it's available before trying to send.
+    send = send && (mi->second->nStatus & BLOCK_HAVE_DATA);
+    if (send) {
+        blockPos = mi->second->GetBlockPos();
+        fRecent = mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+    }
+    return send;
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -7817,36 +8661,28 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
-                {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                        (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                        (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-                        }
-                    }
-                }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                // cs_main is only held while deciding whether to serve the
+                // block; reading and sending it must not stall other peers.
+                bool fRecent = false;
+                CDiskBlockPos blockPos;
+                bool send = GetBlockToServe(inv.hash, pfrom->GetId(), blockPos, fRecent);
+                if (send)
                 {
                     // Send block from disk
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second,1))
+                    CSendBuffer msgCached = inv.type == MSG_FILTERED_BLOCK ? CSendBuffer() : GetMostRecentBlockMessage(inv.hash, inv.type == MSG_CMPCT_BLOCK && fRecent);
+                    if (msgCached)
+                    {
+                        pfrom->PushSendBuffer(msgCached);
+                    }
+                    else if (!ReadBlockFromDisk(0, block, blockPos, 1) || block.GetHash() != inv.hash)
                     {
-                        assert(!"cannot load block from disk");
+                        // the block file may have been pruned since cs_main was released
+                        if (!fPruneMode)
+                            assert(!"cannot load block from disk");
+                        LogPrintf("%s: block %s is no longer available\n", __func__, inv.hash.ToString());
                     }
                     else
                     {
@@ -7859,6 +8695,18 @@ void static ProcessGetData(CNode* pfrom)
                             //fprintf(stderr," send block %d\n",komodo_block2height(&block));
                             pfrom->PushMessage(NetMsgType::BLOCK, block);
                         }
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // If a peer is asking for old blocks, we're almost guaranteed
+                            // they won't have a useful mempool to match against a compact block,
+                            // and we don't feel like constructing the object for them, so
+                            // instead we respond with the full, non-compact block.
+                            if (fRecent) {
+                                CBlockHeaderAndShortTxIDs cmpctblock(block);
+                                pfrom->PushMessage(NetMsgType::CMPCTBLOCK, cmpctblock);
+                            } else
+                                pfrom->PushMessage(NetMsgType::BLOCK, block);
+                        }
                         else // MSG_FILTERED_BLOCK)
                         {
                             LOCK(pfrom->cs_filter);
@@ -7888,7 +8736,10 @@ void static ProcessGetData(CNode* pfrom)
                         // and we want it right after the last block so they don't
                         // wait for other stuff first.
                         vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        {
+                            LOCK(cs_main);
+                            vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        }
                         pfrom->PushMessage(NetMsgType::INV, vInv);
                         pfrom->hashContinue.SetNull();
                     }
@@ -7900,9 +8751,9 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSendBuffer>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushSendBuffer((*mi).second);
                         pushed = true;
                     }
                 }
@@ -7940,6 +8791,59 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/**
+ * Validate a block a peer delivered (as a block, or rebuilt from a cmpctblock)
+ * and answer with a reject if it is invalid. A peer that hands us a new tip
+ * becomes one of our compact block announcers.
+ */
+static void ProcessBlockFromPeer(CNode* pfrom, CBlock& block, bool fForceProcessing, const std::string& strCommand)
+{
+    uint256 hash = block.GetHash();
+    CValidationState state;
+    ProcessNewBlock(0,0,state, pfrom, &block, fForceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), hash);
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+        return;
+    }
+
+    LOCK(cs_main);
+    CNodeState *nodestate = State(pfrom->GetId());
+    if (nodestate != NULL && chainActive.Tip()->GetBlockHash() == hash && !IsInitialBlockDownload())
+        MaybeSetPeerAsAnnouncingHeaderAndIDs(nodestate, pfrom);
+}
+
+/**
+ * Announce the transactions a reconciliation found the peer to be missing,
+ * skipping those that left the mempool since they were queued.
+ */
+static void AnnounceReconciledTransactions(CNode* pnode, const std::vector<uint256>& vTxid)
+{
+    std::vector<CInv> vInv;
+    BOOST_FOREACH(const uint256& txid, vTxid) {
+        if (mempool.exists(txid))
+            vInv.push_back(CInv(MSG_TX, txid));
+    }
+
+    std::vector<CInv> vToSend;
+    {
+        LOCK(pnode->cs_inventory);
+        BOOST_FOREACH(const CInv& inv, vInv) {
+            if (pnode->setInventoryKnown.insert(inv).second)
+                vToSend.push_back(inv);
+        }
+    }
+    for (size_t i = 0; i < vToSend.size(); i += MAX_INV_SZ) {
+        std::vector<CInv> vChunk(vToSend.begin() + i, vToSend.begin() + std::min(vToSend.size(), i + MAX_INV_SZ));
+        pnode->PushMessage(NetMsgType::INV, vChunk);
+    }
+}
+
 #include "komodo_nSPV_defs.h"
 #include "komodo_nSPV.h"            // shared defines, structs, serdes, purge functions
 #include "komodo_nSPV_fullnode.h"   // nSPV fullnode handling of the getnSPV request messages
@@ -8044,11 +8948,21 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
 
         // Potentially mark this peer as a preferred download peer.
-        UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+        {
+            LOCK(cs_main);
+            UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+        }
 
         //Ask for Address Format Version 2
         pfrom->PushMessage(NetMsgType::SENDADDRV2);
 
+        // Offer transaction relay by set reconciliation to peers that advertise it
+        if ((nLocalServices & NODE_TXRECONCILIATION) && (pfrom->nServices & NODE_TXRECONCILIATION) && pfrom->fRelayTxes)
+        {
+            uint64_t nReconSalt = txreconciliation.PreRegisterPeer(pfrom->GetId());
+            pfrom->PushMessage(NetMsgType::SENDTXRCNCL, TXRECONCILIATION_VERSION, nReconSalt);
+        }
+
         // Change version
         pfrom->PushMessage(NetMsgType::VERACK);
         pfrom->ssSend.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
@@ -8125,12 +9039,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         std::vector<uint8_t> payload;
         vRecv >> payload;
+        LOCK(cs_main);
         komodo_netevent(payload);
         return(true);
     }
     else if (strCommand == NetMsgType::VERACK)
     {
         pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+        // fSuccessfullyConnected is set on version, so verack is what closes the sendtxrcncl window
+        txreconciliation.PeerVerack(pfrom->GetId());
 
         if ( KOMODO_NSPV_SUPERLITE )
         {
@@ -8147,6 +9064,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             State(pfrom->GetId())->fCurrentlyConnected = true;
             AddressCurrentlyConnected(State(pfrom->GetId())->address);
         }
+
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we are willing to provide version-1 cmpctblocks.
+            // However, we do not request new block announcements using
+            // cmpctblock messages; that is done for the peers that deliver
+            // new tips to us first (see MaybeSetPeerAsAnnouncingHeaderAndIDs).
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            uint64_t nCMPCTBLOCKVersion = 1;
+            pfrom->PushMessage(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
     }
 
 
@@ -8382,7 +9309,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr(pfrom->m_wants_addrv2);
         BOOST_FOREACH(const CAddress &addr, vAddr)
         pfrom->PushAddress(addr);
@@ -8394,6 +9324,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         std::vector<uint8_t> payload;
         vRecv >> payload;
 
+        // nSPV requests read and update chain state without their own locking
+        LOCK(cs_main);
         if (strCommand == NetMsgType::GETNSPV && KOMODO_NSPV == 0) {
             komodo_nSPVreq(pfrom, payload);
         } else if (strCommand == NetMsgType::NSPV && KOMODO_NSPV_SUPERLITE) {
@@ -8423,6 +9355,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             boost::this_thread::interruption_point();
             pfrom->AddInventoryKnown(inv);
+            if (inv.type == MSG_TX)
+                txreconciliation.RemoveFromSet(pfrom->GetId(), inv.hash);
 
             bool fAlreadyHave = AlreadyHave(inv);
             LogPrint("net", "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
@@ -8443,9 +9377,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     // not a direct successor.
                     pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
-                    if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().nPowTargetSpacing * 20 &&
-                        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                    if (CanDirectFetch(chainparams.GetConsensus()) &&
+                        nodestate->nBlocksInFlight < nodestate->nBlockWindow) {
+                        // A peer that serves compact blocks sends the header with
+                        // short ids; the transactions mostly come from our mempool.
+                        if (nodestate->fProvidesHeaderAndIDs)
+                            vToFetch.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                        else
+                            vToFetch.push_back(inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -8589,6 +9528,26 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // Check the proofs and signatures of shielded transactions before
+        // taking cs_main, so handler threads verify transactions from
+        // different peers at once and only the checks against the current
+        // view and mempool are serialized.
+        bool fPrecheckRun = false, fPrechecked = false;
+        uint32_t nPrecheckBranchId = 0;
+        CValidationState statePrecheck;
+        if (!tx.vjoinsplit.empty() || !tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty()) {
+            // Transactions we have or recently rejected are not worth the proof checks
+            bool fAlreadyHave;
+            {
+                LOCK(cs_main);
+                fAlreadyHave = AlreadyHave(inv);
+            }
+            if (!fAlreadyHave) {
+                fPrecheckRun = true;
+                fPrechecked = PreCheckTransactionForMempool(tx, statePrecheck, nPrecheckBranchId);
+            }
+        }
+
         LOCK(cs_main);
 
         bool fMissingInputs = false;
@@ -8597,7 +9556,17 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         pfrom->setAskFor.erase(inv.hash);
         mapAlreadyAskedFor.erase(inv);
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs))
+        // The precheck only holds if the next block is still on the same branch
+        bool fPrecheckValid = fPrecheckRun && nPrecheckBranchId == CurrentEpochBranchId(chainActive.Height() + 1, Params().GetConsensus());
+        bool fAccepted = false;
+        if (!AlreadyHave(inv)) {
+            if (fPrecheckValid && !fPrechecked)
+                state = statePrecheck;
+            else
+                fAccepted = AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, -1, fPrecheckValid);
+        }
+
+        if (fAccepted)
         {
             mempool.check(pcoinsTip);
             RelayTransaction(tx);
@@ -8808,6 +9777,280 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CheckBlockIndex();
     }
 
+    else if (strCommand == NetMsgType::SENDCMPCT)
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 1;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == 1) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesHeaderAndIDs = true;
+            State(pfrom->GetId())->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::SENDTXRCNCL)
+    {
+        uint32_t nPeerVersion = 0;
+        uint64_t nPeerSalt = 0;
+        vRecv >> nPeerVersion >> nPeerSalt;
+        if (txreconciliation.RegisterPeer(pfrom->GetId(), pfrom->fInbound, nPeerVersion, nPeerSalt))
+            LogPrint("net", "reconciling transactions with peer=%d (%s)\n", pfrom->id,
+                     txreconciliation.ShouldFloodTo(pfrom->GetId()) ? "and flooding to it" : "no flooding");
+        else
+            LogPrint("net", "ignoring sendtxrcncl from peer=%d\n", pfrom->id);
+    }
+
+
+    else if (strCommand == NetMsgType::REQTXRCNCL)
+    {
+        uint16_t nPeerSetSize = 0, nPeerQ = 0;
+        vRecv >> nPeerSetSize >> nPeerQ;
+        std::vector<unsigned char> vSketch;
+        if (txreconciliation.RespondToRequest(pfrom->GetId(), nPeerSetSize, nPeerQ, vSketch))
+            pfrom->PushMessage(NetMsgType::SKETCH, vSketch);
+    }
+
+
+    else if (strCommand == NetMsgType::SKETCH)
+    {
+        std::vector<unsigned char> vSketch;
+        vRecv >> vSketch;
+        bool fSuccess = false;
+        std::vector<uint256> vAnnounce;
+        std::vector<uint32_t> vAskShortIds;
+        if (txreconciliation.HandleSketch(pfrom->GetId(), vSketch, fSuccess, vAnnounce, vAskShortIds)) {
+            LogPrint("net", "reconciliation with peer=%d %s: announcing %u, asking for %u\n", pfrom->id,
+                     fSuccess ? "succeeded" : "failed", vAnnounce.size(), vAskShortIds.size());
+            pfrom->PushMessage(NetMsgType::RECONCILDIFF, fSuccess, vAskShortIds);
+            AnnounceReconciledTransactions(pfrom, vAnnounce);
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::RECONCILDIFF)
+    {
+        bool fSuccess = false;
+        std::vector<uint32_t> vAskShortIds;
+        vRecv >> fSuccess >> vAskShortIds;
+        std::vector<uint256> vAnnounce;
+        if (txreconciliation.HandleReconcilDiff(pfrom->GetId(), fSuccess, vAskShortIds, vAnnounce))
+            AnnounceReconciledTransactions(pfrom, vAnnounce);
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN)
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        CDiskBlockPos blockPos;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+            if (it == mapBlockIndex.end() || it->second == NULL || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrint("net", "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+                return true;
+            }
+
+            if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                // If an older block is requested (should never happen in practice,
+                // but can happen in tests) send a block response instead of a
+                // blocktxn response. Sending a full block response instead of a
+                // small blocktxn response is preferable in the case where a peer
+                // might maliciously send lots of getblocktxn requests to trigger
+                // expensive disk reads, because it will require the peer to
+                // actually receive all the data read from disk over the network.
+                LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+                pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+                ProcessGetData(pfrom);
+                return true;
+            }
+            blockPos = it->second->GetBlockPos();
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(0, block, blockPos, false) || block.GetHash() != req.blockhash) {
+            LogPrintf("%s: block %s is no longer available\n", __func__, req.blockhash.ToString());
+            return true;
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->id);
+                return true;
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage(NetMsgType::BLOCKTXN, resp);
+    }
+
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+            LOCK(cs_main);
+
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect (or is genesis), instead of DoSing in AcceptBlockHeader, request deeper headers
+                if (!IsInitialBlockDownload())
+                    pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256());
+                return true;
+            }
+
+            CBlockIndex *pindex = NULL;
+            CValidationState state;
+            int32_t futureblock = 0;
+            if (!AcceptBlockHeader(&futureblock, cmpctblock.header, state, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && futureblock == 0) {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS/nDoS);
+                    return error("invalid header received via cmpctblock");
+                }
+            }
+            if (pindex == NULL)
+                return true;
+
+            UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+            pfrom->AddInventoryKnown(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+            CNodeState *nodestate = State(pfrom->GetId());
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator blockInFlightIt = mapBlocksInFlight.find(pindex->GetBlockHash());
+            bool fAlreadyInFlight = blockInFlightIt != mapBlocksInFlight.end();
+
+            if (pindex->nStatus & BLOCK_HAVE_DATA) // Nothing to do here
+                return true;
+
+            if (pindex->nChainWork <= chainActive.Tip()->nChainWork || // We know something better
+                    pindex->nTx != 0) { // We had this block at some point, but pruned it
+                if (fAlreadyInFlight) {
+                    // We requested this block for some reason, but our mempool will probably be useless
+                    // so we just grab the block via normal getdata
+                    std::vector<CInv> vInv(1, CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                    pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                }
+                return true;
+            }
+
+            // If we're not close to tip yet, give up and let parallel block fetch work its magic
+            if (!fAlreadyInFlight && !CanDirectFetch(chainparams.GetConsensus()))
+                return true;
+
+            // We want to be a bit conservative just to be extra careful about DoS
+            // possibilities in compact block processing...
+            if (pindex->nHeight <= chainActive.Height() + 2) {
+                if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < nodestate->nBlockWindow) ||
+                     (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
+                    list<QueuedBlock>::iterator *queuedBlockIt = NULL;
+                    if (!MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex, &queuedBlockIt)) {
+                        if (!(*queuedBlockIt)->partialBlock)
+                            (*queuedBlockIt)->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+                        else {
+                            // The block was already in flight using compact blocks from the same peer
+                            LogPrint("net", "Peer sent us compact block we were already syncing!\n");
+                            return true;
+                        }
+                    }
+
+                    PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
+                    ReadStatus status = partialBlock.InitData(cmpctblock);
+                    if (status == READ_STATUS_INVALID) {
+                        MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
+                        Misbehaving(pfrom->GetId(), 100);
+                        LogPrintf("Peer %d sent us invalid compact block\n", pfrom->id);
+                        return true;
+                    }
+
+                    BlockTransactionsRequest req;
+                    if (status == READ_STATUS_OK) {
+                        for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                            if (!partialBlock.IsTxAvailable(i))
+                                req.indexes.push_back(i);
+                        }
+                        if (req.indexes.empty()) {
+                            std::vector<CTransaction> vtxMissing;
+                            status = partialBlock.FillBlock(block, vtxMissing);
+                            fBlockReconstructed = (status == READ_STATUS_OK);
+                        }
+                    }
+
+                    if (status == READ_STATUS_FAILED) {
+                        // Short id collision; the block is now in-flight, so just request it
+                        std::vector<CInv> vInv(1, CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                        pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                        return true;
+                    }
+                    if (!req.indexes.empty()) {
+                        req.blockhash = pindex->GetBlockHash();
+                        pfrom->PushMessage(NetMsgType::GETBLOCKTXN, req);
+                    }
+                }
+            } else if (fAlreadyInFlight) {
+                // We requested this block, but it is far ahead of our tip, so our
+                // mempool will probably be useless - request the block normally
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                return true;
+            } else {
+                // An unsolicited announcement this far ahead gets the same treatment as a headers message
+                std::vector<CBlock> headers(1, CBlock(cmpctblock.header));
+                CDataStream vHeadersMsg(SER_NETWORK, PROTOCOL_VERSION);
+                vHeadersMsg << headers;
+                return ProcessMessage(pfrom, NetMsgType::HEADERS, vHeadersMsg, nTimeReceived);
+            }
+        }
+
+        if (fBlockReconstructed)
+            ProcessBlockFromPeer(pfrom, block, true, strCommand);
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(resp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                    it->second.first != pfrom->GetId()) {
+                LogPrint("net", "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
+            ReadStatus status = partialBlock.FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->id);
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now :(
+                std::vector<CInv> invs(1, CInv(MSG_BLOCK, resp.blockhash));
+                pfrom->PushMessage(NetMsgType::GETDATA, invs);
+                return true;
+            }
+        }
+
+        // The block was requested, so process it even though it came in pieces.
+        ProcessBlockFromPeer(pfrom, block, true, strCommand);
+    }
+
+
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         CBlock block;
@@ -8818,22 +10061,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         pfrom->AddInventoryKnown(inv);
 
-        CValidationState state;
         // Process all blocks from whitelisted peers, even if not requested,
         // unless we're still syncing with the network.
         // Such an unrequested block may still be processed, subject to the
         // conditions in AcceptBlock().
         bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload();
-        ProcessNewBlock(0,0,state, pfrom, &block, forceProcessing, NULL);
-        int nDoS;
-        if (state.IsInvalid(nDoS)) {
-            pfrom->PushMessage(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0) {
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), nDoS);
-            }
-        }
+        ProcessBlockFromPeer(pfrom, block, forceProcessing, strCommand);
 
     }
 
@@ -9153,33 +10386,12 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             }
         }
 
-        TRY_LOCK(cs_main, lockMain); // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
-        if (!lockMain)
-            return true;
-
-        // Address refresh broadcast
-        static int64_t nLastRebroadcast;
-        if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60))
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                // Periodically clear addrKnown to allow refresh broadcasts
-                if (nLastRebroadcast)
-                    pnode->addrKnown.reset();
-
-                // Rebroadcast our address
-                AdvertizeLocal(pnode);
-            }
-            if (!vNodes.empty())
-                nLastRebroadcast = GetTime();
-        }
-
         //
         // Message: addr
         //
         if (fSendTrickle)
         {
+            LOCK(pto->cs_addrToSend);
             vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
@@ -9213,6 +10425,92 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vAddr.clear();
         }
 
+        //
+        // Message: inventory
+        //
+        // superlite nodes only talk nSPV to their peers
+        if (!KOMODO_NSPV_SUPERLITE) {
+            vector<CInv> vInv;
+            vector<CInv> vInvWait;
+            bool fReconcile = !txreconciliation.ShouldFloodTo(pto->GetId());
+            {
+                LOCK(pto->cs_inventory);
+                vInv.reserve(pto->vInventoryToSend.size());
+                vInvWait.reserve(pto->vInventoryToSend.size());
+                BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
+                {
+                    if (pto->setInventoryKnown.count(inv))
+                        continue;
+
+                    // Peers we reconcile with learn about transactions in the next reconciliation round
+                    if (inv.type == MSG_TX && fReconcile && txreconciliation.AddToSet(pto->GetId(), inv.hash))
+                        continue;
+
+                    // trickle out tx inv to protect privacy
+                    if (inv.type == MSG_TX && !fSendTrickle)
+                    {
+                        // 1/4 of tx invs blast to all immediately
+                        static const uint256 hashSalt = GetRandHash();
+                        uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
+                        hashRand = Hash(BEGIN(hashRand), END(hashRand));
+                        bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
+
+                        if (fTrickleWait)
+                        {
+                            vInvWait.push_back(inv);
+                            continue;
+                        }
+                    }
+
+                    // returns true if wasn't already contained in the set
+                    if (pto->setInventoryKnown.insert(inv).second)
+                    {
+                        vInv.push_back(inv);
+                        if (vInv.size() >= 1000)
+                        {
+                            pto->PushMessage(NetMsgType::INV, vInv);
+                            vInv.clear();
+                        }
+                    }
+                }
+                pto->vInventoryToSend = vInvWait;
+            }
+            if (!vInv.empty())
+                pto->PushMessage(NetMsgType::INV, vInv);
+
+            // Reconciliation rounds are started by the side that opened the connection
+            uint16_t nReconSetSize = 0, nReconQ = 0;
+            if (txreconciliation.InitiateReconciliation(pto->GetId(), GetTimeMicros(), nReconSetSize, nReconQ))
+                pto->PushMessage(NetMsgType::REQTXRCNCL, nReconSetSize, nReconQ);
+        }
+
+        // Everything below needs cs_main. With several message handlers a busy cs_main skips
+        // more of these passes, so only block sync, rejects and getdata wait for the next one;
+        // pings, addr and inventory above are sent regardless.
+        TRY_LOCK(cs_main, lockMain); // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
+        if (!lockMain)
+            return true;
+
+        // Address refresh broadcast
+        static int64_t nLastRebroadcast;
+        if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60))
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes)
+            {
+                // Periodically clear addrKnown to allow refresh broadcasts
+                if (nLastRebroadcast) {
+                    LOCK(pnode->cs_addrToSend);
+                    pnode->addrKnown.reset();
+                }
+
+                // Rebroadcast our address
+                AdvertizeLocal(pnode);
+            }
+            if (!vNodes.empty())
+                nLastRebroadcast = GetTime();
+        }
+
         CNodeState &state = *State(pto->GetId());
         if (state.fShouldBan) {
             if (pto->fWhitelisted)
@@ -9260,54 +10558,6 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             GetMainSignals().Broadcast(nTimeBestReceived);
         }
 
-        //
-        // Message: inventory
-        //
-        vector<CInv> vInv;
-        vector<CInv> vInvWait;
-        {
-            LOCK(pto->cs_inventory);
-            vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
-            BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
-            {
-                if (pto->setInventoryKnown.count(inv))
-                    continue;
-
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle)
-                {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
-
-                    if (fTrickleWait)
-                    {
-                        vInvWait.push_back(inv);
-                        continue;
-                    }
-                }
-
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
-                {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage(NetMsgType::INV, vInv);
-                        vInv.clear();
-                    }
-                }
-            }
-            pto->vInventoryToSend = vInvWait;
-        }
-        if (!vInv.empty())
-            pto->PushMessage(NetMsgType::INV, vInv);
-
         // Detect whether we're stalling
         int64_t nNow = GetTimeMicros();
         if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -9345,21 +10595,37 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         static uint256 zero;
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < state.nBlockWindow) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            CBlockIndex *pindexStaller = NULL;
+            FindNextBlocksToDownload(pto->GetId(), state.nBlockWindow - state.nBlocksInFlight, vToDownload, staller, &pindexStaller);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
                 LogPrint("net", "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                          pindex->nHeight, pto->id);
             }
-            if (state.nBlocksInFlight == 0 && staller != -1) {
-                if (State(staller)->nStallingSince == 0) {
-                    State(staller)->nStallingSince = nNow;
+            if (staller != -1) {
+                CNodeState *stateStaller = State(staller);
+                if (state.nBlocksInFlight == 0 && stateStaller->nStallingSince == 0) {
+                    stateStaller->nStallingSince = nNow;
+                    stateStaller->nBlockWindow = std::max(MIN_BLOCK_WINDOW_PER_PEER, stateStaller->nBlockWindow / 2);
                     LogPrint("net", "Stall started peer=%d\n", staller);
                 }
+                // Everything else waits for the block at the front of the window. Ask this peer for it as
+                // well if it has proven faster than the staller and the block is overdue by its standards.
+                if (pindexStaller != NULL && mapBlocksDuplicated.count(pindexStaller->GetBlockHash()) == 0 &&
+                    state.nAvgBlockServiceTime > 0 &&
+                    (stateStaller->nAvgBlockServiceTime == 0 || state.nAvgBlockServiceTime < stateStaller->nAvgBlockServiceTime)) {
+                    const QueuedBlock &queuedStaller = *mapBlocksInFlight[pindexStaller->GetBlockHash()].second;
+                    if (nNow - queuedStaller.nTime > 2 * state.nAvgBlockServiceTime) {
+                        vGetData.push_back(CInv(MSG_BLOCK, pindexStaller->GetBlockHash()));
+                        mapBlocksDuplicated[pindexStaller->GetBlockHash()] = pto->GetId();
+                        LogPrint("net", "Requesting block %s (%d) peer=%d, duplicating the request to stalling peer=%d\n",
+                                 pindexStaller->GetBlockHash().ToString(), pindexStaller->nHeight, pto->id, staller);
+                    }
+                }
             }
         }
         /*CBlockIndex *pindex;
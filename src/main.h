@@ -60,6 +60,7 @@ class CBlockTreeDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CTxUndo;
 class CValidationInterface;
 class CValidationState;
 class PrecomputedTransactionData;
@@ -84,6 +85,20 @@ static const unsigned int MAX_P2SH_SIGOPS = 15;
 static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 100;
+/** Default for -limitancestorcount, max number of in-mempool ancestors */
+static const unsigned int DEFAULT_ANCESTOR_LIMIT = 25;
+/** Default for -limitancestorsize, maximum kilobytes of tx + all in-mempool ancestors, room for two of the largest Sapling transactions */
+static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 401;
+/** Default for -limitdescendantcount, max number of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
+/** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
+static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 401;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Seconds between writes of mempool.dat while running */
+static const int64_t DUMP_MEMPOOL_INTERVAL = 15 * 60;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 /** Default for -txexpirydelta, in number of blocks */
@@ -99,8 +114,22 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** -reindexthreads default (number of block file scanner threads, 0 = auto) */
+static const int DEFAULT_REINDEX_THREADS = 0;
+/** Number of blocks that can be requested at any given time from a single peer, until its download window adapts. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the adaptive per-peer block download window. */
+static const int MIN_BLOCK_WINDOW_PER_PEER = 2;
+static const int MAX_BLOCK_WINDOW_PER_PEER = 64;
+/** A peer's block download window is sized so that it can deliver its whole queue in about this many seconds. */
+static const unsigned int BLOCK_WINDOW_TARGET_TIME = 4;
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers
+ *  when requested. For older blocks, a regular BLOCK response will be sent. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Number of peers we ask to announce new blocks to us with cmpctblock instead of inv. */
+static const unsigned int MAX_CMPCTBLOCK_ANNOUNCERS = 3;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -131,6 +160,7 @@ static const bool DEFAULT_NSPV_PROCESSING = false;
 #define DEFAULT_ADDRESSINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_SPENTINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 static const bool DEFAULT_TIMESTAMPINDEX = false;
+static const bool DEFAULT_UTXOSTATSINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 
@@ -164,6 +194,7 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fUTXOStatsIndex;
 extern bool fArchive;
 extern bool fProof;
 extern bool fIsBareMultisigStd;
@@ -236,6 +267,12 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp = NULL);
+/**
+ * Rebuild the block index from the blk?????.dat files (-reindex). nThreads
+ * scanners locate blocks and check their Equihash solutions ahead of a single
+ * ordered connection pass.
+ */
+bool ReindexBlockFiles(int nThreads);
 /**
  * Initialize a new block tree database + block data on disk
  * @returns true on success
@@ -251,6 +288,22 @@ bool LoadBlockIndex(bool reindex);
  * Clear all values related to the block index
  */
 void UnloadBlockIndex();
+/** Write the mempool and its fee deltas to mempool.dat */
+bool DumpMempool();
+/**
+ * Read the transactions and fee deltas in mempool.dat. vProofsVerified tells,
+ * per transaction, whether its proofs were checked before the dump against
+ * nBranchId and the file's digest is keyed with this node's mempool.key.
+ */
+bool ReadMempoolFile(uint32_t nBranchId, std::vector<CTransaction>& vtx, std::vector<bool>& vProofsVerified,
+                     std::map<uint256, std::pair<double, CAmount> >& mapDeltas);
+/**
+ * Reload the transactions and fee deltas saved by DumpMempool. Proofs that
+ * were checked before the dump are not checked again, provided the file's
+ * digest is keyed with this node's mempool.key; the rest are verified
+ * together across the proof verification threads.
+ */
+bool LoadMempool();
 /** Process protocol messages received from a given node */
 bool ProcessMessages(CNode* pfrom);
 /**
@@ -311,6 +364,18 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/**
+ * The block download window of a peer whose average per-block service time is
+ * nAvgBlockServiceTime microseconds; nWindow, the current one, until it is measured.
+ */
+int GetBlockDownloadWindow(int64_t nAvgBlockServiceTime, int nWindow);
+/** Get the number of blocks in flight and of outstanding duplicate requests for window-blocking blocks. */
+void GetBlockDownloadStats(int& nInFlight, int& nDuplicates);
+/**
+ * Decide whether a block a peer asked for may be served and, if so, where it is on disk.
+ * cs_main is held only for the decision, so the caller reads the block without it.
+ */
+bool GetBlockToServe(const uint256& hash, NodeId nodeid, CDiskBlockPos& blockPos, bool& fRecent);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
@@ -329,10 +394,20 @@ void PruneAndFlush();
  * @param pfMissingInputs
  * @param fRejectAbsurdFee
  * @param dosLevel
+ * @param fProofsVerified skip the Sprout and Sapling proof checks, already done by the caller
  * @returns true on success
  */
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, int dosLevel=-1);
+                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, int dosLevel=-1, bool fProofsVerified=false);
+/**
+ * The expensive, context-free half of AcceptToMemoryPool: the transaction
+ * checks and the Sprout and Sapling proof and signature checks for the next
+ * block. It does not take cs_main, so message handlers run it for different
+ * peers at once; AcceptToMemoryPool is then called with fProofsVerified,
+ * provided nBranchId is still the branch of the next block.
+ * @param[out] nBranchId the consensus branch the transaction was checked against
+ */
+bool PreCheckTransactionForMempool(const CTransaction &tx, CValidationState &state, uint32_t &nBranchId, int dosLevel=-1);
 
 
 struct CNodeStateStats {
@@ -340,6 +415,13 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlockWindow;
+    int64_t nAvgBlockServiceTime;
+    int64_t nAvgBlockLatency;
+    int64_t nAvgBlockBytesPerSec;
+    int nBlocksReceived;
+    int nDuplicatesWon;
+    bool fStalling;
 };
 
 struct CTimestampIndexIteratorKey {
@@ -540,6 +622,38 @@ struct  CAddressUnspentValue {
     }
 };
 
+/** Running total of an address's unspent outputs, keyed by CAddressIndexIteratorKey. */
+struct CAddressBalanceValue {
+    CAmount balance;
+    int64_t utxos; // unspent outputs with a nonzero value
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(utxos);
+    }
+
+    CAddressBalanceValue(CAmount amount, int64_t count) {
+        balance = amount;
+        utxos = count;
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        utxos = 0;
+    }
+
+    bool IsNull() const {
+        return (balance == 0 && utxos == 0);
+    }
+};
+
 struct CAddressIndexKey {
     unsigned int type;
     uint160 hashBytes;
@@ -768,11 +882,13 @@ CheckTransationResults ContextualCheckTransactionSaplingSpendWorker(const std::v
 CheckTransationResults ContextualCheckTransactionSaplingOutputWorker(const std::vector<const OutputDescription*> vOutput, const uint32_t threadNumber);
 /** Check a transaction contextually against a set of consensus rules */
 bool ContextualCheckTransactionMultithreaded(int32_t slowflag, const std::vector<const CTransaction*> vptx, CBlockIndex * const pindexPrev, CValidationState &state, int nHeight, int dosLevel,
-                                bool (*isInitBlockDownload)() = IsInitialBlockDownload,int32_t validateprices=1);
+                                bool (*isInitBlockDownload)() = IsInitialBlockDownload,int32_t validateprices=1, bool fCheckSaplingProofs=true);
 
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
+/** Apply the effects of this transaction on the UTXO set and record the spent outputs in txundo */
+void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight);
 
 /** Transaction validation functions */
 
@@ -864,13 +980,15 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0, size_t limit = 0, const CAddressIndexKey *after = NULL);
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       size_t limit = 0, const CAddressUnspentKey *after = NULL);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos,bool checkPOW);
+bool ReadBlockFromDisk(int32_t height,CBlock& block, const CDiskBlockPos& pos,bool checkPOW);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW);
 bool PruneOneBlockFile(bool tempfile, const int fileNumber);
 
@@ -890,9 +1008,11 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
  * @param view the chain
  * @param fJustCheck do not actually modify, only do checks
  * @param fcheckPOW
+ * @param pVerifiedTxs with fJustCheck, txids whose proofs and scripts are already verified for this block's branch
  * @returns true on success
  */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false,bool fCheckPOW = false);
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck = false,bool fCheckPOW = false,
+                  const std::set<uint256>* pVerifiedTxs = NULL);
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
@@ -902,10 +1022,21 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex *pindexPrev);
-bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState& state, CBlockIndex *pindexPrev);
+bool ContextualCheckBlock(int32_t slowflag,const CBlock& block, CValidationState& state, CBlockIndex *pindexPrev, bool fCheckSaplingProofs = true);
+
+/**
+ * Collect the transactions of block whose entries in pool had their proofs,
+ * signatures and scripts checked on admission, for consensus branch nBranchId.
+ * Returns whether that covers every transaction with Sprout or Sapling parts,
+ * so the block's proofs need not be checked again.
+ */
+bool GetMempoolVerifiedTxs(const CTxMemPool& pool, const CBlock& block, uint32_t nBranchId, std::set<uint256>& setVerified);
 
-/** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
-bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex *pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+/** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held).
+ *  With fTrustMempool the proofs, signatures and scripts of transactions the mempool verified for the block's branch
+ *  are not checked again; block-level rules, crypto-condition evals and the rest of the transactions still are. */
+bool TestBlockValidity(CValidationState &state, const CBlock& block, CBlockIndex *pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true,
+                       bool fTrustMempool = false);
 
 /**
  * Store block on disk.
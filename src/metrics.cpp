@@ -22,6 +22,7 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "main.h"
+#include "miner.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utiltime.h"
@@ -139,6 +140,12 @@ double GetLocalSolPS()
     return miningTimer.rate(solutionTargetChecks);
 }
 
+double GetLocalSolPSPerThread()
+{
+    uint64_t nThreads = miningTimer.threadCount();
+    return nThreads > 0 ? GetLocalSolPS() / nThreads : 0;
+}
+
 int EstimateNetHeightInner(int height, int64_t tipmediantime,
                            int heightLastCheckpoint, int64_t timeLastCheckpoint,
                            int64_t genesisTime, int64_t targetSpacing)
@@ -258,7 +265,8 @@ int printStats(bool mining)
     std::cout << "  " << _("Network solution rate") << " | " << netsolps << " Sol/s" << std::endl;
     if (mining && miningTimer.running()) {
         std::cout << "    " << _("Local solution rate") << " | " << strprintf("%.4f Sol/s", localsolps) << std::endl;
-        lines++;
+        std::cout << "             " << _("Per thread") << " | " << strprintf("%.4f Sol/s", GetLocalSolPSPerThread()) << std::endl;
+        lines += 2;
     }
     std::cout << std::endl;
 
@@ -275,7 +283,7 @@ int printMiningStatus(bool mining)
         auto nThreads = miningTimer.threadCount();
         if (nThreads > 0) {
             std::cout << strprintf(_("You are mining with the %s solver on %d threads."),
-                                   GetArg("-equihashsolver", "default"), nThreads) << std::endl;
+                                   GetEquihashSolverName(), nThreads) << std::endl;
         } else {
             bool fvNodesEmpty;
             {
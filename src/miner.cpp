@@ -105,6 +105,35 @@ public:
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
+//
+// The transactions picked for the last block template, with the coins view and
+// Sapling tree they leave behind. As long as the tip is the same and the mempool
+// has only gained transactions since (see CTxMemPool::GetOrderChanges), the next
+// template starts from this selection and only considers the newer entries.
+//
+struct CTemplateSelection
+{
+    uint256 hashPrevBlock;
+    unsigned int nBlockMaxSize;
+    uint64_t nEntrySequence;
+    uint64_t nOrderChanges;
+
+    std::shared_ptr<CCoinsViewCache> pview;
+    SaplingMerkleTree sapling_tree;
+    std::vector<CTransaction> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    uint64_t nBlockSize;
+    int nBlockSigOps;
+    CAmount nFees;
+    bool fSortedByFee;
+    int qtyLargeTx;
+    int qtyMediumTx;
+    // Whether transactions were left out that the next template could take
+    bool fIncomplete;
+};
+static std::unique_ptr<CTemplateSelection> pLastSelection; // guarded by cs_main
+
 // We want to sort transactions by priority and fee rate, so:
 typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
 class TxPriorityCompare
@@ -287,38 +316,104 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
             numSN = komodo_notaries(notarypubkeys, nHeight, pblock->nTime);
         }
 
-        CCoinsViewCache view(pcoinsTip);
-
+        // Transactions picked for the block so far, applied on top of the chain state
+        std::shared_ptr<CCoinsViewCache> pview;
         SaplingMerkleTree sapling_tree;
-        assert(view.GetSaplingAnchorAt(view.GetBestAnchor(SAPLING), sapling_tree));
+        uint64_t nBlockSize = 1000;
+        uint64_t nBlockTx = 0;
+        int nBlockSigOps = 100;
+        bool fSortedByFee = (nBlockPrioritySize <= 0);
+        int qtyLargeTx = 0;
+        int qtyMediumTx = 0;
+        // Set when transactions were left out for room or finality that a later template might take
+        bool fIncomplete = false;
+        const uint64_t nEntrySequence = mempool.GetEntrySequence();
+        const uint64_t nOrderChanges = mempool.GetOrderChanges();
+
+        // If the mempool only gained transactions since the last template on this tip, and
+        // that template took everything it was offered, start from its selection and only
+        // consider the transactions added since. Anything else rebuilds from the whole pool.
+        // A new transaction that no longer fits is left out of this template, which marks
+        // it incomplete so the next one is built from scratch.
+        uint64_t nFirstSequence = 0;
+        bool fExtending = numSN == 0 && !isStake && !chainName.isKMD() && pLastSelection &&
+                          pLastSelection->hashPrevBlock == pindexPrev->GetBlockHash() &&
+                          pLastSelection->nBlockMaxSize == nBlockMaxSize &&
+                          pLastSelection->nOrderChanges == nOrderChanges &&
+                          !pLastSelection->fIncomplete;
+        if (fExtending)
+        {
+            const CTemplateSelection& last = *pLastSelection;
+            pview = last.pview;
+            sapling_tree = last.sapling_tree;
+            pblock->vtx.insert(pblock->vtx.end(), last.vtx.begin(), last.vtx.end());
+            pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), last.vTxFees.begin(), last.vTxFees.end());
+            pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), last.vTxSigOps.begin(), last.vTxSigOps.end());
+            nBlockSize = last.nBlockSize;
+            nBlockTx = last.vtx.size();
+            nBlockSigOps = last.nBlockSigOps;
+            nFees = last.nFees;
+            fSortedByFee = last.fSortedByFee;
+            qtyLargeTx = last.qtyLargeTx;
+            qtyMediumTx = last.qtyMediumTx;
+            nFirstSequence = last.nEntrySequence;
+        }
+        else
+        {
+            pview.reset(new CCoinsViewCache(pcoinsTip));
+            assert(pview->GetSaplingAnchorAt(pview->GetBestAnchor(SAPLING), sapling_tree));
+        }
+        // The cached view is extended in place, so it is only handed on again at the end
+        pLastSelection.reset();
+
+        CCoinsViewCache& view = *pview;
 
         // Priority order to process transactions
         list<COrphan> vOrphan; // list memory doesn't move
         map<uint256, vector<COrphan*> > mapDependers;
+
+        // Candidates: the whole pool, or the entries added since the selection we extend
+        vector<const CTxMemPoolEntry*> vCandidates;
+        if (fExtending)
+        {
+            const CTxMemPool::indexed_transaction_set::nth_index<2>::type& bySequence = mempool.mapTx.get<2>();
+            for (CTxMemPool::indexed_transaction_set::nth_index<2>::type::const_iterator it = bySequence.upper_bound(nFirstSequence);
+                 it != bySequence.end(); ++it)
+                vCandidates.push_back(&*it);
+        }
+        else
+        {
+            vCandidates.reserve(mempool.mapTx.size());
+            for (CTxMemPool::indexed_transaction_set::const_iterator mi = mempool.mapTx.begin();
+                 mi != mempool.mapTx.end(); ++mi)
+                vCandidates.push_back(&*mi);
+        }
+
         bool fPrintPriority = GetBoolArg("-printpriority", false);
 
         // This vector will be sorted into a priority queue:
         vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size() + 1);
+        vecPriority.reserve(vCandidates.size() + 1);
 
         // now add transactions from the mem pool
         int32_t Notarisations = 0;
         uint64_t txvalue;
-        int qtyLargeTx = 0;
-        int qtyMediumTx = 0;
-
-        for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi)
+        BOOST_FOREACH(const CTxMemPoolEntry* pentry, vCandidates)
         {
             //break; // dont add any tx to block.. debug for KMD fix. Disabled.
-            const CTransaction& tx = mi->GetTx();
+            const CTransaction& tx = pentry->GetTx();
 
             int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
             ? nMedianTimePast
             : pblock->GetBlockTime();
 
-            if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight, nLockTimeCutoff) || IsExpiredTx(tx, nHeight))
+            if (tx.IsCoinBase() || IsExpiredTx(tx, nHeight))
+            {
+                continue;
+            }
+            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
             {
+                fIncomplete = true;
                 continue;
             }
             txvalue = tx.GetValueOut();
@@ -348,12 +443,33 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
             CAmount nTotalIn = 0;
             bool fMissingInputs = false;
             bool fNotarisation = false;
+            bool fEntryPriority = false;
             std::vector<int8_t> TMP_NotarisationNotaries;
             if (tx.IsCoinImport())
             {
                 CAmount nValueIn = GetCoinImportValue(tx); // burn amount
                 nTotalIn += nValueIn;
                 dPriority += (double)nValueIn * 1000;  // flat multiplier... max = 1e16.
+            } else if (numSN == 0) {
+                // Without notary pay there is nothing to learn from the inputs' coins: the
+                // entry already carries its fee and priority, so only in-pool parents matter.
+                fEntryPriority = true;
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                {
+                    if (!mempool.mapTx.count(txin.prevout.hash) || (fExtending && view.HaveCoins(txin.prevout.hash)))
+                        continue;
+                    // Has to wait for dependencies
+                    if (!porphan)
+                    {
+                        // Use list for automatic deletion
+                        vOrphan.push_back(COrphan(&tx));
+                        porphan = &vOrphan.back();
+                    }
+                    mapDependers[txin.prevout.hash].push_back(porphan);
+                    porphan->setDependsOn.insert(txin.prevout.hash);
+                }
+                dPriority = pentry->GetPriority(nHeight);
+                nTotalIn = pentry->GetFee() + tx.GetValueOut();
             } else {
                 TMP_NotarisationNotaries.clear();
                 bool fToCryptoAddress = false;
@@ -430,13 +546,17 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
             if (fMissingInputs) continue;
 
             // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
+            unsigned int nTxSize = pentry->GetTxSize();
+            if (!fEntryPriority)
+                dPriority = tx.ComputePriority(dPriority, nTxSize);
 
             uint256 hash = tx.GetHash();
             mempool.ApplyDeltas(hash, dPriority, nTotalIn);
 
             CFeeRate feeRate(nTotalIn-tx.GetValueOut(), nTxSize);
+            // A parent is worth what its package pays, so children can pay for it (CPFP)
+            if (fEntryPriority)
+                feeRate = std::max(feeRate, CFeeRate(pentry->GetFeesWithDescendants(), pentry->GetSizeWithDescendants()));
 
             if ( fNotarisation )
             {
@@ -478,15 +598,11 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
                 porphan->feeRate = feeRate;
             }
             else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &(mi->GetTx())));
+                vecPriority.push_back(TxPriority(dPriority, feeRate, &tx));
         }
 
         // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
         int64_t interest;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
 
         TxPriorityCompare comparer(fSortedByFee);
         std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
@@ -504,11 +620,13 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
             if (GetBoolArg("-largetxthrottle", true)) {
                 if (tx.vShieldedOutput.size() >= 50 && qtyLargeTx >= 1) {
                     LogPrintf("Large transaction rate limited\n");
+                    fIncomplete = true;
                     continue;
                 }
 
                 if (tx.vShieldedOutput.size() >= 10 && tx.vShieldedOutput.size() < 50 && qtyMediumTx >= 5) {
                     LogPrintf("Medium transaction rate limited\n");
+                    fIncomplete = true;
                     continue;
                 }
             }
@@ -552,6 +670,7 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
             if (nBlockSize + nTxSize >= nBlockMaxSize-512) // room for extra autotx
             {
                 //fprintf(stderr,"nBlockSize %d + %d nTxSize >= %d nBlockMaxSize\n",(int32_t)nBlockSize,(int32_t)nTxSize,(int32_t)nBlockMaxSize);
+                fIncomplete = true;
                 continue;
             }
 
@@ -560,6 +679,7 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS-1)
             {
                 //fprintf(stderr,"A nBlockSigOps %d + %d nTxSigOps >= %d MAX_BLOCK_SIGOPS-1\n",(int32_t)nBlockSigOps,(int32_t)nTxSigOps,(int32_t)MAX_BLOCK_SIGOPS);
+                fIncomplete = true;
                 continue;
             }
             // Skip free transactions if we're past the minimum block size:
@@ -593,6 +713,7 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
             if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS-1)
             {
                 //fprintf(stderr,"B nBlockSigOps %d + %d nTxSigOps >= %d MAX_BLOCK_SIGOPS-1\n",(int32_t)nBlockSigOps,(int32_t)nTxSigOps,(int32_t)MAX_BLOCK_SIGOPS);
+                fIncomplete = true;
                 continue;
             }
             // Note that flags: we don't want to set mempool/IsStandard()
@@ -655,6 +776,29 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
 
         nLastBlockTx = nBlockTx;
         nLastBlockSize = nBlockSize;
+
+        // Keep the selection for the next template on this tip
+        std::unique_ptr<CTemplateSelection> pSelection;
+        if (numSN == 0 && !isStake && !chainName.isKMD())
+        {
+            pSelection.reset(new CTemplateSelection());
+            pSelection->hashPrevBlock = pindexPrev->GetBlockHash();
+            pSelection->nBlockMaxSize = nBlockMaxSize;
+            pSelection->nEntrySequence = nEntrySequence;
+            pSelection->nOrderChanges = nOrderChanges;
+            pSelection->pview = pview;
+            pSelection->sapling_tree = sapling_tree;
+            pSelection->vtx.assign(pblock->vtx.begin() + 1, pblock->vtx.end());
+            pSelection->vTxFees.assign(pblocktemplate->vTxFees.begin() + 1, pblocktemplate->vTxFees.end());
+            pSelection->vTxSigOps.assign(pblocktemplate->vTxSigOps.begin() + 1, pblocktemplate->vTxSigOps.end());
+            pSelection->nBlockSize = nBlockSize;
+            pSelection->nBlockSigOps = nBlockSigOps;
+            pSelection->nFees = nFees;
+            pSelection->fSortedByFee = fSortedByFee;
+            pSelection->qtyLargeTx = qtyLargeTx;
+            pSelection->qtyMediumTx = qtyMediumTx;
+            pSelection->fIncomplete = fIncomplete;
+        }
         if ( ASSETCHAINS_ADAPTIVEPOW <= 0 )
             blocktime = 1 + std::max(pindexPrev->GetMedianTimePast()+1, GetTime());
         else blocktime = 1 + std::max((int64_t)(pindexPrev->nTime+1), GetTime());
@@ -899,7 +1043,7 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
         else if ( ASSETCHAINS_CC == 0 && pindexPrev != 0 && ASSETCHAINS_STAKED == 0 && (!chainName.isKMD() || !IS_KOMODO_NOTARY || My_notaryid < 0) )
         {
             CValidationState state;
-            if ( !TestBlockValidity(state, *pblock, pindexPrev, false, false)) // invokes CC checks
+            if ( !TestBlockValidity(state, *pblock, pindexPrev, false, false, true)) // invokes CC checks
             {
                 if ( chainName.isKMD() || (!chainName.isKMD() && !isStake) )
                 {
@@ -909,6 +1053,8 @@ CBlockTemplate* CreateNewBlock(const CPubKey _pk, const CScript& _scriptPubKeyIn
                 return(0);
             }
         }
+        if (pSelection)
+            pLastSelection = std::move(pSelection);
     }
     if ( chainName.isKMD() || ( !chainName.isKMD() && !isStake) )
     {
@@ -1183,6 +1329,124 @@ bool check_tromp_solution(equi &eq, std::function<bool(std::vector<unsigned char
     return false;
 }
 
+/****
+ * Run the tromp solver over curr_state and pass its solutions to validBlock.
+ * It is compiled for a single n, k (WN, WK) and cannot be cancelled midway.
+ */
+static bool TrompSolve(const crypto_generichash_blake2b_state& curr_state, std::function<bool(std::vector<unsigned char>)> validBlock)
+{
+    // Create solver and initialize it.
+    equi eq(1);
+    eq.setstate(&curr_state);
+
+    // Initialization done, start algo driver.
+    eq.digit0(0);
+    eq.xfull = eq.bfull = eq.hfull = 0;
+    eq.showbsizes(0);
+    for (u32 r = 1; r < WK; r++) {
+        (r&1) ? eq.digitodd(r, 0) : eq.digiteven(r, 0);
+        eq.xfull = eq.bfull = eq.hfull = 0;
+        eq.showbsizes(r);
+    }
+    eq.digitK(0);
+
+    return check_tromp_solution(eq, validBlock);
+}
+
+static bool TrompSolverAvailable(unsigned int n, unsigned int k)
+{
+    // -ac_nk chains hash with their own personalization, even at the default n, k
+    return n == WN && k == WK && ASSETCHAINS_NK[0] == 0 && ASSETCHAINS_NK[1] == 0;
+}
+
+/****
+ * Time one run of solver over an empty header with a random nonce.
+ * @returns the run time in seconds, or -1 if cancelled stopped the default solver
+ */
+static double TimeEquihashSolveCancellable(const std::string& solver, unsigned int n, unsigned int k,
+                                           const std::function<bool(EhSolverCancelCheck)>& cancelled)
+{
+    CBlock block;
+    crypto_generichash_blake2b_state state;
+    EhInitialiseState(n, k, state);
+    CEquihashInput I{block};
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << I;
+    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+    uint256 nonce = GetRandHash();
+    crypto_generichash_blake2b_update(&state, nonce.begin(), nonce.size());
+
+    std::function<bool(std::vector<unsigned char>)> noBlock = [](std::vector<unsigned char>) { return false; };
+    int64_t nStart = GetTimeMicros();
+    if (solver == "tromp") {
+        TrompSolve(state, noBlock);
+    } else {
+        try {
+            EhOptimisedSolve(n, k, state, noBlock, cancelled);
+        } catch (EhSolverCancelledException&) {
+            return -1;
+        }
+    }
+    return (GetTimeMicros() - nStart) * 0.000001;
+}
+
+double TimeEquihashSolve(const std::string& solver, unsigned int n, unsigned int k)
+{
+    if (solver == "tromp" && !TrompSolverAvailable(n, k))
+        throw std::runtime_error(strprintf("The tromp solver only supports n = %u, k = %u without -ac_nk", WN, WK));
+    return TimeEquihashSolveCancellable(solver, n, k, [](EhSolverCancelCheck pos) { return false; });
+}
+
+static std::mutex cs_equihashSolver;
+static std::string strEquihashSolver;
+static std::once_flag equihashSolverSelected;
+
+std::string GetEquihashSolverName()
+{
+    std::lock_guard<std::mutex> lock(cs_equihashSolver);
+    return strEquihashSolver;
+}
+
+std::string GetEquihashSolverChoice(const std::string& requested, unsigned int n, unsigned int k)
+{
+    std::string solver = requested;
+    if (solver != "auto" && solver != "tromp" && solver != "default") {
+        LogPrintf("Unknown Equihash solver \"%s\", selecting one automatically\n", solver);
+        solver = "auto";
+    }
+    if (solver != "default" && !TrompSolverAvailable(n, k)) {
+        if (solver == "tromp")
+            LogPrintf("The tromp solver only supports n = %u, k = %u without -ac_nk, using the default solver\n", WN, WK);
+        solver = "default";
+    }
+    return solver;
+}
+
+/****
+ * Pick the solver the miner threads run, from -equihashsolver. With "auto"
+ * both solvers are timed on this machine and the faster one is kept. The
+ * default solver is cut off once it has run longer than tromp took, so the
+ * benchmark costs at most about two tromp runs.
+ */
+static void SelectEquihashSolver(unsigned int n, unsigned int k)
+{
+    std::string solver = GetEquihashSolverChoice(GetArg("-equihashsolver", "auto"), n, k);
+    if (solver == "auto") {
+        double nTromp = TimeEquihashSolve("tromp", n, k);
+        boost::this_thread::interruption_point();
+        int64_t nDeadline = GetTimeMicros() + (int64_t)(nTromp * 1000000);
+        double nDefault = TimeEquihashSolveCancellable("default", n, k, [nDeadline](EhSolverCancelCheck pos) {
+            boost::this_thread::interruption_point();
+            return GetTimeMicros() > nDeadline;
+        });
+        solver = (nDefault >= 0 && nDefault < nTromp) ? "default" : "tromp";
+        LogPrintf("Equihash solver benchmark: tromp %.3fs, default %s, using \"%s\"\n", nTromp,
+                  nDefault >= 0 ? strprintf("%.3fs", nDefault) : "slower", solver);
+    }
+    std::lock_guard<std::mutex> lock(cs_equihashSolver);
+    strEquihashSolver = solver;
+}
+
 #ifdef ENABLE_WALLET
 void static BitcoinMiner(CWallet *pwallet)
 #else
@@ -1225,11 +1489,9 @@ void static BitcoinMiner()
     }
     if ( notaryid != My_notaryid )
         My_notaryid = notaryid;
-    std::string solver;
-    if ( ASSETCHAINS_NK[0] == 0 && ASSETCHAINS_NK[1] == 0 )
-        solver = "tromp";
-    else
-        solver = "default";
+    // The first miner thread benchmarks the solvers if asked to; the others wait for its pick
+    std::call_once(equihashSolverSelected, SelectEquihashSolver, n, k);
+    std::string solver = GetEquihashSolverName();
     assert(solver == "tromp" || solver == "default");
     LogPrint("pow", "Using Equihash solver \"%s\" with n = %u, k = %u\n", solver, n, k);
     if ( chainName.isKMD() )
@@ -1589,26 +1851,9 @@ void static BitcoinMiner()
                         std::lock_guard<std::mutex> lock{m_cs};
                         return cancelSolver;
                     };
-                    // TODO: factor this out into a function with the same API for each solver.
                     if (solver == "tromp" ) { //&& notaryid >= 0 ) {
-                        // Create solver and initialize it.
-                        equi eq(1);
-                        eq.setstate(&curr_state);
-
-                        // Initialization done, start algo driver.
-                        eq.digit0(0);
-                        eq.xfull = eq.bfull = eq.hfull = 0;
-                        eq.showbsizes(0);
-                        for (u32 r = 1; r < WK; r++) {
-                            (r&1) ? eq.digitodd(r, 0) : eq.digiteven(r, 0);
-                            eq.xfull = eq.bfull = eq.hfull = 0;
-                            eq.showbsizes(r);
-                        }
-                        eq.digitK(0);
+                        TrompSolve(curr_state, validBlock);
                         ehSolverRuns.increment();
-
-                        check_tromp_solution(eq, validBlock);
-
                     } else {
                         try {
                             // If we find a valid block, we rebuild
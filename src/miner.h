@@ -25,6 +25,7 @@
 
 #include <boost/optional.hpp>
 #include <stdint.h>
+#include <string>
 
 class CBlockIndex;
 class CScript;
@@ -71,6 +72,15 @@ void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
  #else
 void GenerateBitcoins(bool fGenerate, int nThreads);
  #endif
+/** The Equihash solver the miner threads run ("tromp" or "default"), empty until they first start */
+std::string GetEquihashSolverName();
+/**
+ * The solver -equihashsolver=requested runs for n, k: "tromp", "default", or
+ * "auto" when both can and the faster one is to be timed
+ */
+std::string GetEquihashSolverChoice(const std::string& requested, unsigned int n, unsigned int k);
+/** Time one run of the named Equihash solver for n, k on a random nonce, in seconds */
+double TimeEquihashSolve(const std::string& solver, unsigned int n, unsigned int k);
 #endif
 
 void UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
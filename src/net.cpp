@@ -42,6 +42,11 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
 #endif
 
 #include <boost/filesystem.hpp>
@@ -121,11 +126,42 @@ std::unique_ptr<i2p::sam::Session> m_i2p_sam_session;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CSendBuffer> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
+/** Most queued messages handed to the kernel in one sendmsg() call. */
+static const int MAX_SEND_IOV = 64;
+/** Largest TLS record payload; runs of small messages are packed up to this size. */
+static const size_t TLS_RECORD_SIZE = 16384;
+
+#ifdef USE_EPOLL
+/** Maximum number of socket events handled per wakeup of the socket thread. */
+static const int MAX_SOCKET_EVENTS = 512;
+/** epoll instance watching the listen sockets (level-triggered) and node sockets (edge-triggered). */
+static int hEpoll = -1;
+/** Nodes with socket readiness not yet drained. Only used by ThreadSocketHandler. */
+static std::set<CNode*> setNodesReady;
+#endif
+
+/** Start watching a node's socket in the socket event loop. */
+static void WatchNodeSocket(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    LOCK(pnode->cs_hSocket);
+    if (hEpoll == -1 || pnode->hSocket == INVALID_SOCKET)
+        return;
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) == SOCKET_ERROR) {
+        LogPrintf("epoll_ctl() for peer=%d failed: %s\n", pnode->id, NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
 static deque<string> vOneShots;
 static CCriticalSection cs_vOneShots;
 
@@ -140,6 +176,8 @@ CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
 static boost::condition_variable messageHandlerCondition;
+/** Number of ThreadMessageHandler workers, set by StartNode. */
+static int nMessageHandlers = 1;
 
 // Denial-of-service detection/prevention
 // Key is IP address, value is banned-until-time
@@ -581,6 +619,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
         }
+        WatchNodeSocket(pnode);
 
         pnode->nTimeConnected = GetTime();
 
@@ -890,7 +929,10 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
         LOCK(cs_hSocket);
         stats.fTLSEstablished = (ssl != NULL) && (SSL_get_state(ssl) == TLS_ST_OK);
         stats.fTLSVerified = (ssl != NULL) && ValidatePeerCertificate(ssl);
+        TLSManager::getConnectionStats(ssl, stats);
     }
+    stats.nTLSWrites = nTLSWrites;
+    stats.nTLSReads = nTLSReads;
 
     stats.m_wants_addrv2 = m_wants_addrv2;
 }
@@ -1000,12 +1042,11 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSendBuffer>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end())
     {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
 
         bool bIsSSL = false;
         int nBytes = 0, nRet = 0;
@@ -1020,15 +1061,62 @@ void SocketSendData(CNode *pnode)
 
             bIsSSL = (pnode->ssl != NULL);
 
+            // Cleared before writing so a writable edge reported while we
+            // write is not lost; set again below if the socket took everything.
+            pnode->fSendReady = false;
+
             if (bIsSSL)
             {
+                const CSerializeData &data = **it;
+                size_t nRemaining = data.size() - pnode->nSendOffset;
+
+                // Pack a run of small messages into one TLS record instead of
+                // one record per message. A retried SSL_write must be repeated
+                // with the same arguments, so only pack on a fresh write.
+                if (!pnode->fSendRetry && pnode->vSendCoalesced.empty() && nRemaining < TLS_RECORD_SIZE &&
+                    std::next(it) != pnode->vSendMsg.end() && (*std::next(it))->size() + nRemaining <= TLS_RECORD_SIZE)
+                {
+                    pnode->vSendCoalesced.insert(pnode->vSendCoalesced.end(), data.begin() + pnode->nSendOffset, data.end());
+                    for (std::deque<CSendBuffer>::iterator itNext = std::next(it); itNext != pnode->vSendMsg.end(); ++itNext)
+                    {
+                        if (pnode->vSendCoalesced.size() + (*itNext)->size() > TLS_RECORD_SIZE)
+                            break;
+                        pnode->vSendCoalesced.insert(pnode->vSendCoalesced.end(), (*itNext)->begin(), (*itNext)->end());
+                    }
+                }
+
                 ERR_clear_error(); // clear the error queue, otherwise we may be reading an old error that occurred previously in the current thread
-                nBytes = SSL_write(pnode->ssl, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset);
+                if (!pnode->vSendCoalesced.empty())
+                    nBytes = SSL_write(pnode->ssl, &pnode->vSendCoalesced[0], pnode->vSendCoalesced.size());
+                else
+                    nBytes = SSL_write(pnode->ssl, &data[pnode->nSendOffset], nRemaining);
                 nRet = SSL_get_error(pnode->ssl, nBytes);
+                pnode->fSendRetry = (nBytes <= 0);
+                if (nBytes > 0) {
+                    pnode->vSendCoalesced.clear();
+                    pnode->nTLSWrites++;
+                }
             }
             else
             {
-                nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef _WIN32
+                nBytes = send(pnode->hSocket, &(**it)[pnode->nSendOffset], (*it)->size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+                // Hand the kernel as much of the queue as fits in one call.
+                struct iovec iov[MAX_SEND_IOV];
+                int nIov = 0;
+                for (std::deque<CSendBuffer>::iterator itNext = it; itNext != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV; ++itNext, ++nIov)
+                {
+                    size_t nOffset = (itNext == it) ? pnode->nSendOffset : 0;
+                    iov[nIov].iov_base = (void*)&(**itNext)[nOffset];
+                    iov[nIov].iov_len = (*itNext)->size() - nOffset;
+                }
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = iov;
+                msg.msg_iovlen = nIov;
+                nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
                 nRet = WSAGetLastError();
             }
         }
@@ -1036,20 +1124,30 @@ void SocketSendData(CNode *pnode)
         {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
 
-            if (pnode->nSendOffset == data.size())
+            // Retire every message the write completed
+            size_t nLeft = nBytes;
+            while (nLeft > 0)
             {
+                size_t nRemaining = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nRemaining)
+                {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= (*it)->size();
                 it++;
             }
-            else
+
+            if (pnode->nSendOffset != 0)
             {
                 // could not send full message; stop sending more
                 break;
             }
+            pnode->fSendReady = true;
         }
         else
         {
@@ -1478,6 +1576,7 @@ SetSocketNonBlocking(hSocket, true);
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    WatchNodeSocket(pnode);
 }
 
 #if defined(USE_TLS)
@@ -1493,9 +1592,91 @@ void ThreadNonTLSPoolsCleaner()
 
 #endif // USE_TLS
 
+/** Disconnect a node that has stopped sending, receiving or answering pings. */
+static void CheckNodeInactivity(CNode* pnode, int64_t nTime)
+{
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingRetry > MAX_PING_RETRY)
+        {
+            LogPrintf("ping max retry exceeded, disconnecting node %i\n", pnode->id);
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+#ifdef USE_EPOLL
+/**
+ * Drain the readiness the event loop has recorded for a node: read until the
+ * socket would block or the receive buffer is full, and flush queued data
+ * while the socket stays writable. Returns true if the node still has
+ * readiness that could not be used yet (a full receive buffer or a busy
+ * lock), so it is serviced again on the next pass without a new event.
+ */
+static bool ServiceNodeSocket(CNode* pnode)
+{
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return false;
+    }
+
+    bool fPending = false;
+    if (pnode->fRecvReady) {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (!lockRecv) {
+            fPending = true;
+        } else {
+            while (pnode->fRecvReady) {
+                // see the select() loop below for why a full buffer is not read into
+                if (!pnode->vRecvMsg.empty() && pnode->vRecvMsg.front().complete() &&
+                    pnode->GetTotalRecvSize() > ReceiveFloodSize()) {
+                    fPending = true;
+                    break;
+                }
+                pnode->fRecvReady = false;
+                int nBytes = tlsmanager.socketRecvData(pnode, false);
+                if (nBytes < 0)
+                    return false;
+                if (nBytes > 0)
+                    pnode->fRecvReady = true;
+            }
+        }
+    }
+
+    if (pnode->fSendReady) {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (!lockSend)
+            fPending = true;
+        else if (!pnode->vSendMsg.empty())
+            SocketSendData(pnode);
+    }
+    return fPending;
+}
+#endif
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+#ifdef USE_EPOLL
+    std::vector<struct epoll_event> vEvents(MAX_SOCKET_EVENTS);
+    int64_t nLastInactivityCheck = 0;
+#endif
     while (true)
     {
         //
@@ -1551,6 +1732,9 @@ void ThreadSocketHandler()
                     if (fDelete)
                     {
                         vNodesDisconnected.remove(pnode);
+#ifdef USE_EPOLL
+                        setNodesReady.erase(pnode);
+#endif
                         delete pnode;
                     }
                 }
@@ -1561,6 +1745,95 @@ void ThreadSocketHandler()
             uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
+#ifdef USE_EPOLL
+        //
+        // Wait for socket events
+        //
+        int nEvents = epoll_wait(hEpoll, &vEvents[0], vEvents.size(), 50); // frequency to check timeouts and full receive buffers
+        boost::this_thread::interruption_point();
+
+        if (nEvents == SOCKET_ERROR)
+        {
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEINTR)
+            {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+                MilliSleep(50);
+            }
+            nEvents = 0;
+        }
+
+        for (int i = 0; i < nEvents; i++)
+        {
+            const struct epoll_event& event = vEvents[i];
+
+            //
+            // Accept new connections
+            //
+            bool fListenSocket = false;
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+            {
+                if (event.data.ptr == &hListenSocket)
+                {
+                    if (hListenSocket.socket != INVALID_SOCKET)
+                        AcceptConnection(hListenSocket);
+                    fListenSocket = true;
+                    break;
+                }
+            }
+            if (fListenSocket)
+                continue;
+
+            // Node sockets leave the epoll set when they are closed, which
+            // always happens before the node is deleted by this thread.
+            CNode* pnode = (CNode*)event.data.ptr;
+            if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                pnode->fRecvReady = true;
+            if (event.events & EPOLLOUT)
+                pnode->fSendReady = true;
+            setNodesReady.insert(pnode);
+        }
+
+        //
+        // Service each ready socket
+        //
+        std::vector<CNode*> vNodesReady(setNodesReady.begin(), setNodesReady.end());
+        BOOST_FOREACH(CNode* pnode, vNodesReady)
+        {
+            boost::this_thread::interruption_point();
+            if (!ServiceNodeSocket(pnode))
+                setNodesReady.erase(pnode);
+        }
+
+        //
+        // Inactivity checking, once a second
+        //
+        int64_t nTime = GetTime();
+        if (nTime != nLastInactivityCheck)
+        {
+            nLastInactivityCheck = nTime;
+            vector<CNode*> vNodesCopy;
+            {
+                LOCK(cs_vNodes);
+                vNodesCopy = vNodes;
+                BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                    pnode->AddRef();
+            }
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            {
+                CheckNodeInactivity(pnode, nTime);
+                // data queued by a write that did not report blocking (e.g. an
+                // SSL write waiting for a read) would otherwise wait for an event
+                if (pnode->nSendSize > 0 && pnode->fSendReady)
+                    setNodesReady.insert(pnode);
+            }
+            {
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodesCopy)
+                    pnode->Release();
+            }
+        }
+#else
         //
         // Find which sockets have data to receive
         //
@@ -1678,36 +1951,14 @@ void ThreadSocketHandler()
             //
             // Inactivity checking
             //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingRetry > MAX_PING_RETRY)
-                {
-                    LogPrintf("ping max retry exceeded, disconnecting node %i\n", pnode->id);
-                    pnode->fDisconnect = true;
-                }
-            }
+            CheckNodeInactivity(pnode, GetTime());
         }
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->Release();
         }
+#endif
     }
 }
 
@@ -2043,7 +2294,7 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+void ThreadMessageHandler(int nHandler)
 {
     boost::mutex condition_mutex;
     boost::unique_lock<boost::mutex> lock(condition_mutex);
@@ -2060,18 +2311,27 @@ void ThreadMessageHandler()
             }
         }
 
-        // Poll the connected nodes for messages
+        // Poll the connected nodes for messages. Only the first handler picks
+        // a trickle node, so the trickle rate does not grow with the pool.
         CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
+        if (nHandler == 0 && !vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
         bool fSleep = true;
 
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        // Handlers start at different offsets so they spread over the nodes
+        // instead of contending for the same ones.
+        size_t nStart = vNodesCopy.empty() ? 0 : (nHandler * vNodesCopy.size()) / nMessageHandlers;
+        for (size_t i = 0; i < vNodesCopy.size(); i++)
         {
+            CNode* pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
             if (pnode->fDisconnect)
                 continue;
 
+            // Another handler is busy with this node; its messages must stay in order
+            if (pnode->fInMessageHandler.exchange(true))
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -2089,7 +2349,6 @@ void ThreadMessageHandler()
                     }
                 }
             }
-            boost::this_thread::interruption_point();
 
             // Send messages
             {
@@ -2097,6 +2356,7 @@ void ThreadMessageHandler()
                 if (lockSend)
                     g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
             }
+            pnode->fInMessageHandler = false;
             boost::this_thread::interruption_point();
         }
 
@@ -2382,6 +2642,23 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("TLS is not used!\n");
 #endif
 
+#ifdef USE_EPOLL
+    hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpoll == -1)
+    {
+        LogPrintf("%s: epoll_create1() failed: %s. Node can't be started.\n", __func__, NetworkErrorString(WSAGetLastError()));
+        return;
+    }
+    BOOST_FOREACH(ListenSocket& hListenSocket, vhListenSocket)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) == SOCKET_ERROR)
+            LogPrintf("%s: epoll_ctl() for listen socket failed: %s\n", __func__, NetworkErrorString(WSAGetLastError()));
+    }
+#endif
+
     // skip DNS seeds for staked chains.
     if ( is_STAKED(chainName.symbol()) != 0 )
         SoftSetBoolArg("-dnsseed", false);
@@ -2413,7 +2690,9 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    nMessageHandlers = std::max(1, std::min((int)GetArg("-msghandlers", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+    for (int i = 0; i < nMessageHandlers; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i))));
 
     #if defined(USE_TLS)
         if (CNode::GetTlsFallbackNonTls())
@@ -2439,6 +2718,7 @@ bool StopNode()
         DumpAddresses();
         fAddressesInitialized = false;
     }
+    tlsmanager.cleanup();
 
     return true;
 }
@@ -2467,6 +2747,11 @@ public:
         vNodes.clear();
         vNodesDisconnected.clear();
         vhListenSocket.clear();
+#ifdef USE_EPOLL
+        setNodesReady.clear();
+        if (hEpoll != -1)
+            close(hEpoll);
+#endif
         delete semOutbound;
         semOutbound = NULL;
         delete pnodeLocalHost;
@@ -2491,6 +2776,8 @@ void RelayTransaction(const CTransaction& tx)
 void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
 {
     CInv inv(MSG_TX, tx.GetHash());
+    // Frame the message once; every peer that asks for it gets the same buffer.
+    CSendBuffer msg = MakeSendBuffer(NetMsgType::TX, ss);
     {
         LOCK(cs_mapRelay);
         // Expire old relay messages
@@ -2501,7 +2788,7 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
         }
 
         // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        mapRelay.insert(std::make_pair(inv, msg));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -2694,6 +2981,8 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nLastRecv = 0;
     nSendBytes = 0;
     nRecvBytes = 0;
+    nTLSWrites = 0;
+    nTLSReads = 0;
     nTimeConnected = GetTime();
     nTimeOffset = 0;
     addr = addrIn;
@@ -2707,9 +2996,13 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fRecvReady = true;
+    fSendReady = true;
+    fInMessageHandler = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fSendRetry = false;
     hashContinue = uint256();
     nStartingHeight = -1;
     fGetAddr = false;
@@ -2843,11 +3136,40 @@ void CNode::AskFor(const CInv& inv)
     mapAskFor.insert(std::make_pair(nRequestTime, inv));
 }
 
+void BeginSendBuffer(CDataStream& ss, const char* pszCommand)
+{
+    ss << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+}
+
+/** Fill in the payload size and checksum in the header at the start of ss. */
+static unsigned int FrameMessage(CDataStream& ss)
+{
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    WriteLE32((uint8_t*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
+
+    // Set the checksum
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ss.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    return nSize;
+}
+
+CSendBuffer FinishSendBuffer(CDataStream& ss)
+{
+    FrameMessage(ss);
+    std::shared_ptr<CSerializeData> buffer = std::make_shared<CSerializeData>();
+    ss.GetAndClear(*buffer);
+    return buffer;
+}
+
 void CNode::BeginMessage(const char* pszCommand) ACQUIRE(cs_vSend)
 {
     ENTER_CRITICAL_SECTION(cs_vSend);
     assert(ssSend.size() == 0);
-    ssSend << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+    BeginSendBuffer(ssSend, pszCommand);
     LogPrint("net", "sending: %s ", SanitizeString(pszCommand));
 }
 
@@ -2879,30 +3201,35 @@ void CNode::EndMessage() RELEASE(cs_vSend)
         LEAVE_CRITICAL_SECTION(cs_vSend);
         return;
     }
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    WriteLE32((uint8_t*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
-
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    unsigned int nSize = FrameMessage(ssSend);
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    std::shared_ptr<CSerializeData> buffer = std::make_shared<CSerializeData>();
+    ssSend.GetAndClear(*buffer);
+    vSendMsg.push_back(buffer);
+    nSendSize += buffer->size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushSendBuffer(const CSendBuffer& buffer)
+{
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: shared message (%d bytes) peer=%d\n", buffer->size() - CMessageHeader::HEADER_SIZE, id);
+
+    vSendMsg.push_back(buffer);
+    nSendSize += buffer->size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
 void CNode::PushAddrMessage(CSerializedNetMsg&& msg)
 {
     size_t nMessageSize = msg.data.size();
@@ -2921,8 +3248,9 @@ void CNode::PushAddrMessage(CSerializedNetMsg&& msg)
         // if (nSendSize > nSendBufferMaxSize) fPauseSend = true;
 
         //Add Header
-        std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-        CSerializeData &d = *it;
+        std::shared_ptr<CSerializeData> buffer = std::make_shared<CSerializeData>();
+        CSerializeData &d = *buffer;
+        d.reserve(nTotalSize);
         d.insert(d.end(), serializedHeader.begin(), serializedHeader.end());
 
         //Add Message
@@ -2930,7 +3258,8 @@ void CNode::PushAddrMessage(CSerializedNetMsg&& msg)
           d.insert(d.end(), msg.data.begin(), msg.data.end());
         }
 
-        if (it == vSendMsg.begin())
+        vSendMsg.push_back(buffer);
+        if (vSendMsg.size() == 1)
             SocketSendData(this);
     }
 }
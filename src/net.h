@@ -38,6 +38,7 @@
 #include "util.h"
 
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef _WIN32
@@ -90,6 +91,14 @@ static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 384;
+/** -msghandlers default (number of message handler threads) */
+static const int DEFAULT_MSGHANDLER_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** -tlssessioncache default (number of TLS sessions kept for resumption, 0 disables resumption) */
+static const unsigned int DEFAULT_TLS_SESSION_CACHE = 1000;
+/** -tlsktls default (let OpenSSL hand record encryption to the kernel where supported) */
+static const bool DEFAULT_TLS_KTLS = false;
 /** The period before a network upgrade activates, where connections to upgrading peers are preferred (in blocks). */
 static const int NETWORK_UPGRADE_PEER_PREFERENCE_BLOCK_PERIOD = 24 * 24 * 3;
 
@@ -112,6 +121,32 @@ void LoadPeers();
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+
+/**
+ * A framed message (header and payload) ready to go on the wire. Queued
+ * buffers are never modified, so one serialization of a block or transaction
+ * can be queued to every peer that asks for it.
+ */
+typedef std::shared_ptr<const CSerializeData> CSendBuffer;
+
+/** Start a message in ss by writing its header; the payload follows. */
+void BeginSendBuffer(CDataStream& ss, const char* pszCommand);
+/** Fill in the size and checksum of the message in ss and move it into a shareable buffer. */
+CSendBuffer FinishSendBuffer(CDataStream& ss);
+
+/**
+ * Serialize a message once for any number of peers. The payload is encoded
+ * at PROTOCOL_VERSION, so only use this for messages whose encoding does not
+ * depend on the peer's version (tx, block, cmpctblock).
+ */
+template<typename... Args>
+CSendBuffer MakeSendBuffer(const char* pszCommand, const Args&... args)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    BeginSendBuffer(ss, pszCommand);
+    ::SerializeMany(ss, args...);
+    return FinishSendBuffer(ss);
+}
 SSL_CTX* create_context(bool server_side);
 EVP_PKEY *generate_key();
 X509 *generate_x509(EVP_PKEY *pkey);
@@ -239,7 +274,7 @@ extern bool bOverrideMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CSendBuffer> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -275,6 +310,14 @@ public:
     uint64_t nServices;
     bool fTLSEstablished;
     bool fTLSVerified;
+    std::string strTLSVersion;
+    std::string strTLSCipher;
+    int64_t nTLSHandshakeTime; // microseconds
+    bool fTLSResumed;
+    bool fTLSKernelSend;
+    bool fTLSKernelRecv;
+    uint64_t nTLSWrites;
+    uint64_t nTLSReads;
     int64_t nLastSend;
     int64_t nLastRecv;
     int64_t nTimeConnected;
@@ -381,13 +424,17 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSendBuffer> vSendMsg;
+    CSerializeData vSendCoalesced; // small messages packed into one TLS record, pending SSL_write
+    bool fSendRetry; // the last SSL_write wants to be repeated with the same arguments
+    uint64_t nTLSWrites; // successful SSL_write calls
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
+    uint64_t nTLSReads; // successful SSL_read calls
     int nRecvVersion;
 
     int64_t nLastSend;
@@ -415,6 +462,13 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     bool fDisconnect;
+    // Socket readiness last reported by the event loop; with edge-triggered
+    // epoll it stays set until a read or write would block.
+    std::atomic<bool> fRecvReady;
+    std::atomic<bool> fSendReady;
+    // Claimed by the message handler thread currently processing this node,
+    // which keeps its messages in order across the handler pool
+    std::atomic<bool> fInMessageHandler;
     // We use fRelayTxes for two purposes -
     // a) it allows us to not relay tx invs before receiving the peer's version message
     // b) the peer may tell us in its version message that we should not relay tx invs
@@ -460,7 +514,9 @@ public:
     uint256 hashContinue;
     int nStartingHeight;
 
-    // flood relay
+    // flood relay; other peers' handlers push addresses here, so both are
+    // guarded by cs_addrToSend
+    CCriticalSection cs_addrToSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -559,6 +615,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -569,6 +626,7 @@ public:
         // because they require ADDRv2 (BIP155) encoding.
         const bool addr_format_supported = m_wants_addrv2 || _addr.IsAddrV1Compatible();
 
+        LOCK(cs_addrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -612,6 +670,9 @@ public:
 
     void PushAddrMessage(CSerializedNetMsg&& msg);
 
+    /** Queue a message built with MakeSendBuffer; the buffer is shared, not copied. */
+    void PushSendBuffer(const CSendBuffer& buffer);
+
     void PushVersion();
 
 
@@ -84,6 +84,11 @@ bool ConnectSocket(const CService &addr, SOCKET& hSocketRet, int nTimeout, bool
 bool ConnectSocketByName(CService &addr, SOCKET& hSocketRet, const char *pszDest, int portDefault, int nTimeout, bool *outProxyConnectionFailed = 0);
 
 bool SetSocketNonBlocking(SOCKET& hSocket, bool fNonBlocking);
+/**
+ * Wait up to nTimeout milliseconds for a socket to become readable (or
+ * writable if fWrite). Returns >0 when ready, 0 on timeout, SOCKET_ERROR on error.
+ */
+int WaitForSocket(const SOCKET& hSocket, bool fWrite, int64_t nTimeout);
 /** Set the TCP_NODELAY flag on a socket */
 bool SetSocketNoDelay(const SOCKET& hSocket);
 
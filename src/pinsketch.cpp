@@ -0,0 +1,272 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pinsketch.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+
+namespace {
+
+/** GF(2^32) is represented modulo the irreducible polynomial x^32 + x^7 + x^3 + x^2 + 1. */
+uint32_t GFMul(uint32_t a, uint32_t b)
+{
+    // Carry-less multiply four bits of b at a time, then fold the top 31 bits back in.
+    uint64_t table[16];
+    table[0] = 0;
+    for (int i = 1; i < 16; i++)
+        table[i] = (i & 1 ? (uint64_t)a : 0) ^ (table[i >> 1] << 1);
+    uint64_t r = 0;
+    for (int i = 28; i >= 0; i -= 4)
+        r = (r << 4) ^ table[(b >> i) & 0xF];
+    // x^32 = x^7 + x^3 + x^2 + 1; the first fold leaves at most 7 bits above x^32.
+    uint64_t hi = r >> 32;
+    uint64_t fold = hi ^ (hi << 2) ^ (hi << 3) ^ (hi << 7);
+    uint64_t hi2 = fold >> 32;
+    return (uint32_t)(r ^ fold ^ hi2 ^ (hi2 << 2) ^ (hi2 << 3) ^ (hi2 << 7));
+}
+
+uint32_t GFSqr(uint32_t a)
+{
+    return GFMul(a, a);
+}
+
+/** a^(2^32 - 2), the multiplicative inverse of a non-zero a. */
+uint32_t GFInv(uint32_t a)
+{
+    uint32_t r = 1;
+    uint32_t x = a;
+    for (uint32_t e = 0xFFFFFFFEU; e != 0; e >>= 1) {
+        if (e & 1)
+            r = GFMul(r, x);
+        x = GFSqr(x);
+    }
+    return r;
+}
+
+/** Polynomials over GF(2^32), lowest degree coefficient first, without leading zeroes. */
+typedef std::vector<uint32_t> Poly;
+
+void Trim(Poly& p)
+{
+    while (!p.empty() && p.back() == 0)
+        p.pop_back();
+}
+
+int Degree(const Poly& p)
+{
+    return (int)p.size() - 1;
+}
+
+/** Reduce a modulo the monic polynomial m, in place. */
+void ModMonic(Poly& a, const Poly& m)
+{
+    int dm = Degree(m);
+    Trim(a);
+    while (Degree(a) >= dm) {
+        uint32_t lead = a.back();
+        int shift = Degree(a) - dm;
+        for (int i = 0; i < dm; i++)
+            a[shift + i] ^= GFMul(lead, m[i]);
+        a.pop_back();
+        Trim(a);
+    }
+}
+
+void MakeMonic(Poly& p)
+{
+    uint32_t inv = GFInv(p.back());
+    for (size_t i = 0; i < p.size(); i++)
+        p[i] = GFMul(p[i], inv);
+}
+
+/** Squaring is linear in characteristic 2: (sum a_i x^i)^2 = sum a_i^2 x^2i. */
+Poly SqrMod(const Poly& a, const Poly& m)
+{
+    if (a.empty())
+        return Poly();
+    Poly r(2 * a.size() - 1, 0);
+    for (size_t i = 0; i < a.size(); i++)
+        r[2 * i] = GFSqr(a[i]);
+    ModMonic(r, m);
+    return r;
+}
+
+/** Monic greatest common divisor. */
+Poly Gcd(Poly a, Poly b)
+{
+    Trim(a);
+    Trim(b);
+    while (!b.empty()) {
+        MakeMonic(b);
+        ModMonic(a, b);
+        std::swap(a, b);
+    }
+    if (!a.empty())
+        MakeMonic(a);
+    return a;
+}
+
+/** Quotient of a by the monic polynomial m, which must divide it. */
+Poly DivExact(Poly a, const Poly& m)
+{
+    int dm = Degree(m);
+    Poly q(Degree(a) - dm + 1, 0);
+    while (Degree(a) >= dm) {
+        uint32_t lead = a.back();
+        int shift = Degree(a) - dm;
+        q[shift] = lead;
+        for (int i = 0; i < dm; i++)
+            a[shift + i] ^= GFMul(lead, m[i]);
+        a.pop_back();
+    }
+    return q;
+}
+
+/**
+ * Find the roots of a monic polynomial known to split into distinct linear
+ * factors (Berlekamp's trace algorithm). Tr(a*x) takes the values 0 and 1 on
+ * the roots, so gcd(f, Tr(a*x)) splits them in two; trying a = 2^i for every
+ * bit i is guaranteed to separate any two distinct roots.
+ */
+bool FindRoots(const Poly& f, int nBasis, std::vector<uint32_t>& vRoots)
+{
+    int deg = Degree(f);
+    if (deg == 0)
+        return true;
+    if (deg == 1) {
+        vRoots.push_back(f[0]);
+        return true;
+    }
+    for (; nBasis < 32; nBasis++) {
+        Poly t(2, 0);
+        t[1] = (uint32_t)1 << nBasis;
+        ModMonic(t, f);
+        Poly trace = t;
+        for (int i = 1; i < 32; i++) {
+            t = SqrMod(t, f);
+            if (trace.size() < t.size())
+                trace.resize(t.size(), 0);
+            for (size_t j = 0; j < t.size(); j++)
+                trace[j] ^= t[j];
+        }
+        Trim(trace);
+        Poly g = Gcd(f, trace);
+        if (Degree(g) > 0 && Degree(g) < deg) {
+            Poly h = DivExact(f, g);
+            return FindRoots(g, nBasis + 1, vRoots) && FindRoots(h, nBasis + 1, vRoots);
+        }
+    }
+    return false;
+}
+
+} // anon namespace
+
+void PinSketch::Add(uint32_t nElement)
+{
+    if (nElement == 0)
+        return;
+    uint32_t nSquare = GFSqr(nElement);
+    uint32_t nPower = nElement;
+    for (size_t i = 0; i < vSyndromes.size(); i++) {
+        vSyndromes[i] ^= nPower;
+        nPower = GFMul(nPower, nSquare);
+    }
+}
+
+bool PinSketch::Merge(const PinSketch& other)
+{
+    if (other.vSyndromes.size() != vSyndromes.size())
+        return false;
+    for (size_t i = 0; i < vSyndromes.size(); i++)
+        vSyndromes[i] ^= other.vSyndromes[i];
+    return true;
+}
+
+bool PinSketch::Decode(size_t nMaxElements, std::vector<uint32_t>& vElements) const
+{
+    vElements.clear();
+    size_t c = vSyndromes.size();
+
+    // Power sums 1..2c; the even ones follow from the odd ones in characteristic 2: S(2k) = S(k)^2.
+    std::vector<uint32_t> vSums(2 * c);
+    bool fEmpty = true;
+    for (size_t p = 1; p <= 2 * c; p++) {
+        vSums[p - 1] = (p & 1) ? vSyndromes[p / 2] : GFSqr(vSums[p / 2 - 1]);
+        fEmpty &= (vSums[p - 1] == 0);
+    }
+    if (fEmpty)
+        return true;
+
+    // Berlekamp-Massey: the shortest recurrence over the power sums is the error locator polynomial.
+    Poly locator(1, 1), prev(1, 1);
+    size_t nLength = 0, nShift = 1;
+    uint32_t nPrevDiscrepancy = 1;
+    for (size_t n = 0; n < 2 * c; n++) {
+        uint32_t d = vSums[n];
+        for (size_t i = 1; i <= nLength && i < locator.size(); i++)
+            d ^= GFMul(locator[i], vSums[n - i]);
+        if (d == 0) {
+            nShift++;
+            continue;
+        }
+        uint32_t coef = GFMul(d, GFInv(nPrevDiscrepancy));
+        Poly old = locator;
+        if (locator.size() < prev.size() + nShift)
+            locator.resize(prev.size() + nShift, 0);
+        for (size_t i = 0; i < prev.size(); i++)
+            locator[i + nShift] ^= GFMul(coef, prev[i]);
+        if (2 * nLength <= n) {
+            nLength = n + 1 - nLength;
+            prev = old;
+            nPrevDiscrepancy = d;
+            nShift = 1;
+        } else {
+            nShift++;
+        }
+    }
+    Trim(locator);
+    if (nLength > std::min(nMaxElements, c) || Degree(locator) != (int)nLength)
+        return false;
+
+    // The elements are the roots of the reversed locator polynomial.
+    Poly f(nLength + 1);
+    for (size_t i = 0; i <= nLength; i++)
+        f[i] = locator[nLength - i];
+
+    // It must divide x^(2^32) - x, i.e. have nLength distinct roots in the field.
+    Poly x(2, 0);
+    x[1] = 1;
+    ModMonic(x, f);
+    Poly t = x;
+    for (int i = 0; i < 32; i++)
+        t = SqrMod(t, f);
+    if (t != x)
+        return false;
+
+    if (!FindRoots(f, 0, vElements) || vElements.size() != nLength) {
+        vElements.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<unsigned char> PinSketch::Serialize() const
+{
+    std::vector<unsigned char> vData(vSyndromes.size() * 4);
+    for (size_t i = 0; i < vSyndromes.size(); i++)
+        WriteLE32(&vData[i * 4], vSyndromes[i]);
+    return vData;
+}
+
+bool PinSketch::Deserialize(const std::vector<unsigned char>& vData)
+{
+    if (vData.size() % 4 != 0)
+        return false;
+    vSyndromes.resize(vData.size() / 4);
+    for (size_t i = 0; i < vSyndromes.size(); i++)
+        vSyndromes[i] = ReadLE32(&vData[i * 4]);
+    return true;
+}
@@ -0,0 +1,51 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PINSKETCH_H
+#define BITCOIN_PINSKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A PinSketch over GF(2^32), the set reconciliation sketch used by BIP 330
+ * (and the minisketch library).
+ *
+ * A sketch of capacity c holds the odd power sums x, x^3, ..., x^(2c-1) of
+ * the (non-zero, 32-bit) elements added to it, so it takes 4*c bytes however
+ * many elements it covers. Merging two sketches gives the sketch of the
+ * symmetric difference of their sets, which Decode() recovers as long as it
+ * has no more than c elements.
+ */
+class PinSketch
+{
+private:
+    std::vector<uint32_t> vSyndromes;
+
+public:
+    explicit PinSketch(size_t nCapacity = 0) : vSyndromes(nCapacity, 0) {}
+
+    size_t GetCapacity() const { return vSyndromes.size(); }
+
+    /** Add an element (must be non-zero). Adding the same element twice removes it. */
+    void Add(uint32_t nElement);
+
+    /** Combine with a sketch of the same capacity; the result is the sketch of the symmetric difference. */
+    bool Merge(const PinSketch& other);
+
+    /**
+     * Recover the elements of the sketch. Returns false if there are more
+     * than nMaxElements (or than the capacity) of them.
+     */
+    bool Decode(size_t nMaxElements, std::vector<uint32_t>& vElements) const;
+
+    /** Serialized form: the power sums as little endian 32 bit words. */
+    std::vector<unsigned char> Serialize() const;
+    bool Deserialize(const std::vector<unsigned char>& vData);
+
+    bool operator==(const PinSketch& other) const { return vSyndromes == other.vSyndromes; }
+};
+
+#endif // BITCOIN_PINSKETCH_H
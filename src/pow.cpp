@@ -27,6 +27,7 @@
 #include "crypto/equihash.h"
 #include "primitives/block.h"
 #include "streams.h"
+#include "sync.h"
 #include "uint256.h"
 #include "util.h"
 #include "komodo.h"
@@ -42,6 +43,9 @@
 
 #include "komodo_defs.h"
 
+#include <atomic>
+#include <set>
+
 /* from zawy repo
  Preliminary code for super-fast increases in difficulty.
  Requires the ability to change the difficulty during the current block,
@@ -550,10 +554,37 @@ unsigned int CalculateNextWorkRequired(arith_uint256 bnAvg,
     return bnNew.GetCompact();
 }
 
-bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
+/** Header hashes whose Equihash solution has already been checked. */
+static CCriticalSection cs_verifiedSolutions;
+static std::set<uint256> setVerifiedSolutions;
+/** Size of setVerifiedSolutions, so the usual empty cache costs neither a lock nor a header hash */
+static std::atomic<size_t> nVerifiedSolutions(0);
+
+void AddVerifiedEquihashSolution(const uint256& hash)
+{
+    LOCK(cs_verifiedSolutions);
+    setVerifiedSolutions.insert(hash);
+    nVerifiedSolutions = setVerifiedSolutions.size();
+}
+
+void ForgetVerifiedEquihashSolution(const uint256& hash)
+{
+    LOCK(cs_verifiedSolutions);
+    setVerifiedSolutions.erase(hash);
+    nVerifiedSolutions = setVerifiedSolutions.size();
+}
+
+bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params, bool fCached)
 {
     if (ASSETCHAINS_ALGO != ASSETCHAINS_EQUIHASH)
         return true;
+
+    if (fCached && nVerifiedSolutions > 0) {
+        const uint256 hash = pblock->GetHash();
+        LOCK(cs_verifiedSolutions);
+        if (setVerifiedSolutions.count(hash))
+            return true;
+    }
     
     if ( ASSETCHAINS_NK[0] != 0 && ASSETCHAINS_NK[1] != 0 && pblock->GetHash().ToString() == "027e3758c3a65b12aa1046462b486d0a63bfa1beae327897f56c5cfb7daaae71" )
         return true;
@@ -563,9 +594,6 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
 
     if ( Params().NetworkIDString() == "regtest" )
         return(true);
-    // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state);
 
     // I = the block header minus nonce and solution.
     CEquihashInput I{*pblock};
@@ -575,10 +603,8 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     ss << pblock->nNonce;
 
     // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-
     bool isValid;
-    EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
+    EhIsValidSolutionForInput(n, k, (unsigned char*)&ss[0], ss.size(), pblock->nSolution, isValid);
 
     if (!isValid)
         return error("CheckEquihashSolution(): invalid solution");
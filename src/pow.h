@@ -37,8 +37,20 @@ unsigned int CalculateNextWorkRequired(arith_uint256 bnAvg,
                                        int64_t nLastBlockTime, int64_t nFirstBlockTime,
                                        const Consensus::Params&);
 
-/** Check whether the Equihash solution in a block header is valid */
-bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams&);
+/**
+ * Check whether the Equihash solution in a block header is valid. Without
+ * fCached the solution is always verified, which is what the threads filling
+ * the verified-solution cache want.
+ */
+bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams&, bool fCached = true);
+
+/**
+ * Remember headers whose Equihash solution was verified ahead of validation
+ * (by the -reindex file scanners), so CheckEquihashSolution can skip them.
+ * Callers are responsible for forgetting entries once they are consumed.
+ */
+void AddVerifiedEquihashSolution(const uint256& hash);
+void ForgetVerifiedEquihashSolution(const uint256& hash);
 
 /**
  * @brief Check if given notaryid is allowed to mine a mindiff block in case of GAP
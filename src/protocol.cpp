@@ -33,7 +33,8 @@ static const char* ppszTypeName[] =
     "ERROR",
     "tx",
     "block",
-    "filtered block"
+    "filtered block",
+    "compact block"
 };
 
 namespace NetMsgType {
@@ -71,6 +72,10 @@ const char *CFHEADERS="cfheaders";
 const char *GETCFCHECKPT="getcfcheckpt";
 const char *CFCHECKPT="cfcheckpt";
 const char *WTXIDRELAY="wtxidrelay";
+const char *SENDTXRCNCL="sendtxrcncl";
+const char *REQTXRCNCL="reqtxrcncl";
+const char *SKETCH="sketch";
+const char *RECONCILDIFF="reconcildiff";
 const char *EVENTS="events"; //used
 const char *GETNSPV="getnSPV"; //used
 const char *NSPV="nSPV"; //used
@@ -116,6 +121,10 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::GETCFCHECKPT,
     NetMsgType::CFCHECKPT,
     NetMsgType::WTXIDRELAY,
+    NetMsgType::SENDTXRCNCL,
+    NetMsgType::REQTXRCNCL,
+    NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF,
     NetMsgType::EVENTS,
     NetMsgType::GETNSPV,
     NetMsgType::NSPV,
@@ -286,6 +286,27 @@ extern const char* CFCHECKPT;
  * @since protocol version 70016 as described by BIP 339.
  */
 extern const char* WTXIDRELAY;
+/**
+ * Contains a 4-byte version and an 8-byte salt. Indicates that a node supports
+ * transaction reconciliation; sent before verack.
+ * Only available with service bit NODE_TXRECONCILIATION as described by BIP 330.
+ */
+extern const char* SENDTXRCNCL;
+/**
+ * Contains the 2-byte size of the sender's reconciliation set and the 2-byte
+ * q coefficient of the difference estimate. Peer should respond with "sketch".
+ */
+extern const char* REQTXRCNCL;
+/**
+ * Contains a PinSketch of the sender's reconciliation set, or nothing to ask
+ * for a plain exchange of the sets.
+ */
+extern const char* SKETCH;
+/**
+ * Contains a 1-byte success flag and the short ids of the transactions the
+ * sender is missing. Peer should respond with "inv".
+ */
+extern const char* RECONCILDIFF;
 
 extern const char* EVENTS;
 extern const char* GETNSPV;
@@ -311,6 +332,8 @@ enum ServiceFlags : uint64_t {
     NODE_NSPV = (1 << 30),
     NODE_ADDRINDEX = (1 << 29),
     NODE_SPENTINDEX = (1 << 28),
+    // NODE_TXRECONCILIATION means the node relays transactions by set reconciliation (BIP 330, -txreconciliation).
+    NODE_TXRECONCILIATION = (1 << 27),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -456,6 +479,8 @@ enum {
     // Nodes may always request a MSG_FILTERED_BLOCK in a getdata, however,
     // MSG_FILTERED_BLOCK should not appear in any invs except as a part of getdata.
     MSG_FILTERED_BLOCK,
+    // Defined in BIP152; only valid in a getdata, answered with a cmpctblock
+    MSG_CMPCT_BLOCK,
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -19,6 +19,8 @@
  *                                                                            *
  ******************************************************************************/
 
+#include "compactsapling.h"
+#include "crypto/common.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
@@ -31,6 +33,7 @@
 #include "version.h"
 #include "rpc/rawtransaction.h"
 #include "rpc/blockchain.h"
+#include "rpc/jsonstream.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/dynamic_bitset.hpp>
@@ -40,6 +43,8 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_REST_SAPLING_BLOCKS = 10000; //allow a max of 10000 compact blocks per request
+static const size_t REST_STREAM_CHUNK = 64 * 1024; //binary replies are streamed in chunks of about this size
 
 enum RetFormat {
     RF_UNDEF,
@@ -206,6 +211,41 @@ static bool rest_headers(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * Send a JSON reply written by write, with chunked encoding once it outgrows
+ * one chunk so that large documents are not held in memory whole.
+ */
+static bool RESTWriteJSON(HTTPRequest* req, const boost::function<void(JSONStreamWriter&)>& write)
+{
+    bool fStarted = false;
+    JSONStreamWriter writer([req, &fStarted](const std::string& strChunk) {
+        if (!fStarted) {
+            req->WriteHeader("Content-Type", "application/json");
+            fStarted = true;
+        }
+        return req->WriteReplyChunk(HTTP_OK, strChunk);
+    });
+    try {
+        write(writer);
+        writer.Raw("\n");
+        if (writer.HasFlushed())
+            writer.Flush();
+    } catch (const std::exception& e) {
+        if (!writer.HasFlushed())
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, e.what());
+        LogPrintf("REST reply cut short: %s\n", e.what());
+        req->EndReply();
+        return false;
+    }
+    if (writer.HasFlushed()) {
+        req->EndReply();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, writer.GetBuffer());
+    }
+    return true;
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -254,11 +294,9 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
+        return RESTWriteJSON(req, [&block, pblockindex, showTxDetails](JSONStreamWriter& writer) {
+            blockToJSONStream(writer, block, pblockindex, showTxDetails);
+        });
     }
 
     default: {
@@ -280,6 +318,179 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+/**
+ * Compact Sapling blocks for light wallets: /rest/saplingblocks/<height>/<count>.<bin|hex>
+ *
+ * Each block in the height range is sent as its serialized size (4 bytes,
+ * little endian) followed by a serialized CCompactSaplingBlock. The range
+ * ends early at the tip. cs_main is only held to find the blocks, which are
+ * then read and reduced without it, and the reply is streamed as it is built.
+ */
+static bool rest_saplingblocks(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block count specified. Use /rest/saplingblocks/<height>/<count>.<ext>.");
+
+    long nHeight = -1, nCount = 0;
+    if (!ParseInt64(path[0], NULL) || (nHeight = atol(path[0].c_str())) < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[0]);
+    if (!ParseInt64(path[1], NULL) || (nCount = atol(path[1].c_str())) < 1 || nCount > MAX_REST_SAPLING_BLOCKS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+
+    std::vector<const CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        if (nHeight > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[0]);
+        long nEnd = std::min<long>(nHeight + nCount - 1, chainActive.Height());
+        vIndex.reserve(nEnd - nHeight + 1);
+        for (long n = nHeight; n <= nEnd; n++) {
+            const CBlockIndex* pindex = chainActive[n];
+            if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0)
+                return RESTERR(req, HTTP_NOT_FOUND, strprintf("Block %d not available (pruned data)", n));
+            vIndex.push_back(pindex);
+        }
+    }
+
+    const std::string strContentType = rf == RF_BINARY ? "application/octet-stream" : "text/plain";
+    bool fStarted = false;
+    std::string strOut;
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    CCompactSaplingBlock compact;
+    for (const CBlockIndex* pindex : vIndex) {
+        // The proof of work was checked when the block was connected
+        if (!ReadBlockFromDisk(block, pindex, false)) {
+            if (!fStarted)
+                return RESTERR(req, HTTP_NOT_FOUND, strprintf("Block %d not found", pindex->nHeight));
+            LogPrintf("%s: failed to read block %d, reply cut short\n", __func__, pindex->nHeight);
+            req->EndReply();
+            return false;
+        }
+        BuildCompactSaplingBlock(block, pindex, compact);
+
+        ssBlock.clear();
+        ssBlock << compact;
+        unsigned char vSize[4];
+        WriteLE32(vSize, ssBlock.size());
+        if (rf == RF_BINARY) {
+            strOut.append((const char*)vSize, sizeof(vSize));
+            strOut.append(ssBlock.begin(), ssBlock.end());
+        } else {
+            strOut += HexStr(vSize, vSize + sizeof(vSize));
+            strOut += HexStr(ssBlock.begin(), ssBlock.end());
+        }
+
+        if (strOut.size() >= REST_STREAM_CHUNK) {
+            if (!fStarted) {
+                req->WriteHeader("Content-Type", strContentType);
+                fStarted = true;
+            }
+            if (!req->WriteReplyChunk(HTTP_OK, strOut)) {
+                req->EndReply();
+                return false;
+            }
+            strOut.clear();
+        }
+    }
+
+    if (rf == RF_HEX)
+        strOut += "\n";
+    if (!fStarted) {
+        req->WriteHeader("Content-Type", strContentType);
+        req->WriteReply(HTTP_OK, strOut);
+        return true;
+    }
+    req->WriteReplyChunk(HTTP_OK, strOut);
+    req->EndReply();
+    return true;
+}
+
+/**
+ * Sapling note commitment tree after a block: /rest/saplingtreestate/<height>.<bin|hex|json>
+ *
+ * The binary form is the block height (4 bytes), hash, time (4 bytes) and
+ * final Sapling root followed by the serialized tree, which is what a light
+ * wallet starts from to sync from that height on.
+ */
+static bool rest_saplingtreestate(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+
+    int32_t nHeight = -1;
+    if (!ParseInt32(params[0], &nHeight) || nHeight < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + params[0]);
+
+    uint256 hash, hashFinalSaplingRoot;
+    uint32_t nTime;
+    SaplingMerkleTree tree;
+    {
+        LOCK(cs_main);
+        if (nHeight > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + params[0]);
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (!pcoinsTip->GetSaplingAnchorAt(pindex->hashFinalSaplingRoot, tree))
+            return RESTERR(req, HTTP_NOT_FOUND, "Sapling tree state not available at height " + params[0]);
+        hash = pindex->GetBlockHash();
+        nTime = pindex->nTime;
+        hashFinalSaplingRoot = pindex->hashFinalSaplingRoot;
+    }
+
+    CDataStream ssTree(SER_NETWORK, PROTOCOL_VERSION);
+    ssTree << tree;
+    CDataStream ssState(SER_NETWORK, PROTOCOL_VERSION);
+    ssState << nHeight << hash << nTime << hashFinalSaplingRoot;
+    ssState.write(&ssTree[0], ssTree.size());
+
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryState = ssState.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryState);
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(ssState.begin(), ssState.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue objState(UniValue::VOBJ);
+        objState.push_back(Pair("height", nHeight));
+        objState.push_back(Pair("hash", hash.GetHex()));
+        objState.push_back(Pair("time", (int64_t)nTime));
+        objState.push_back(Pair("finalsaplingroot", hashFinalSaplingRoot.GetHex()));
+        objState.push_back(Pair("finalstate", HexStr(ssTree.begin(), ssTree.end())));
+        string strJSON = objState.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 
@@ -342,12 +553,9 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
+        return RESTWriteJSON(req, [](JSONStreamWriter& writer) {
+            mempoolToJSONStream(writer, true);
+        });
     }
     default: {
         return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
@@ -610,21 +818,27 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
+    HTTPWorkClass workClass;
 } uri_prefixes[] = {
-      {"/rest/tx/", rest_tx},
-      {"/rest/block/notxdetails/", rest_block_notxdetails},
-      {"/rest/block/", rest_block_extended},
-      {"/rest/chaininfo", rest_chaininfo},
-      {"/rest/mempool/info", rest_mempool_info},
-      {"/rest/mempool/contents", rest_mempool_contents},
-      {"/rest/headers/", rest_headers},
-      {"/rest/getutxos", rest_getutxos},
+      {"/rest/tx/", rest_tx, HTTP_WORK_QUICK},
+      {"/rest/block/notxdetails/", rest_block_notxdetails, HTTP_WORK_QUICK},
+      {"/rest/block/", rest_block_extended, HTTP_WORK_QUICK},
+      {"/rest/chaininfo", rest_chaininfo, HTTP_WORK_QUICK},
+      {"/rest/mempool/info", rest_mempool_info, HTTP_WORK_QUICK},
+      {"/rest/mempool/contents", rest_mempool_contents, HTTP_WORK_QUICK},
+      {"/rest/headers/", rest_headers, HTTP_WORK_QUICK},
+      {"/rest/getutxos", rest_getutxos, HTTP_WORK_QUICK},
+      {"/rest/saplingblocks/", rest_saplingblocks, HTTP_WORK_HEAVY},
+      {"/rest/saplingtreestate/", rest_saplingtreestate, HTTP_WORK_QUICK},
 };
 
 bool StartREST()
 {
-    for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+    for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++) {
+        const HTTPWorkClass workClass = uri_prefixes[i].workClass;
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler,
+                            [workClass](HTTPRequest*, const std::string&) { return workClass; });
+    }
     return true;
 }
 
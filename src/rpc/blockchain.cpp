@@ -28,7 +28,9 @@
 #include "consensus/validation.h"
 #include "cc/eval.h"
 #include "main.h"
+#include "txdb.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -353,6 +355,48 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+/** Transactions converted per cs_main lock while streaming a block. */
+static const size_t BLOCK_STREAM_TX_BATCH = 64;
+
+/**
+ * Write blockToJSON(block, blockindex, txDetails) to a stream. cs_main is only
+ * held while a batch of transactions is converted, not while it is written, so
+ * call this without holding it: a slow client must not hold up the node.
+ */
+void blockToJSONStream(JSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    UniValue header;
+    {
+        LOCK(cs_main);
+        header = blockToJSON(block, blockindex, false);
+    }
+
+    const std::vector<std::string>& keys = header.getKeys();
+    const std::vector<UniValue>& values = header.getValues();
+    writer.BeginObject();
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] != "tx" || !txDetails) {
+            writer.PushKV(keys[i], values[i]);
+            continue;
+        }
+        writer.Key("tx");
+        writer.BeginArray();
+        for (size_t nBegin = 0; nBegin < block.vtx.size(); nBegin += BLOCK_STREAM_TX_BATCH) {
+            size_t nEnd = std::min(block.vtx.size(), nBegin + BLOCK_STREAM_TX_BATCH);
+            std::vector<UniValue> vTx(nEnd - nBegin, UniValue(UniValue::VOBJ));
+            {
+                LOCK(cs_main);
+                for (size_t n = nBegin; n < nEnd; n++)
+                    TxToJSON(block.vtx[n], uint256(), vTx[n - nBegin]);
+            }
+            for (size_t n = 0; n < vTx.size(); n++)
+                writer.Value(vTx[n]);
+        }
+        writer.EndArray();
+    }
+    writer.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() != 0)
@@ -448,6 +492,34 @@ bool mytxid_inmempool(uint256 txid)
     return(false);
 }
 
+/** Verbose getrawmempool entry. Requires mempool.cs. */
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    BOOST_FOREACH(const string& dep, setDepends)
+    {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
@@ -457,29 +529,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
         BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
         {
             const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends)
-            {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
+            o.push_back(Pair(hash.ToString(), mempoolEntryToJSON(e)));
         }
         return o;
     }
@@ -496,6 +546,42 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/** Mempool entries converted per mempool.cs lock while streaming. */
+static const size_t MEMPOOL_STREAM_BATCH = 1000;
+
+/** Write mempoolToJSON(fVerbose) to a stream, without holding mempool.cs while writing. */
+void mempoolToJSONStream(JSONStreamWriter& writer, bool fVerbose)
+{
+    vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
+
+    if (!fVerbose) {
+        writer.BeginArray();
+        BOOST_FOREACH(const uint256& hash, vtxid)
+            writer.Value(hash.ToString());
+        writer.EndArray();
+        return;
+    }
+
+    writer.BeginObject();
+    for (size_t nBegin = 0; nBegin < vtxid.size(); nBegin += MEMPOOL_STREAM_BATCH) {
+        size_t nEnd = std::min(vtxid.size(), nBegin + MEMPOOL_STREAM_BATCH);
+        std::vector<std::pair<std::string, UniValue> > vEntries;
+        {
+            LOCK(mempool.cs);
+            for (size_t n = nBegin; n < nEnd; n++) {
+                CTxMemPool::indexed_transaction_set::const_iterator it = mempool.mapTx.find(vtxid[n]);
+                // Skip transactions that left the mempool since the snapshot
+                if (it != mempool.mapTx.end())
+                    vEntries.push_back(std::make_pair(vtxid[n].ToString(), mempoolEntryToJSON(*it)));
+            }
+        }
+        for (size_t n = 0; n < vEntries.size(); n++)
+            writer.PushKV(vEntries[n].first, vEntries[n].second);
+    }
+    writer.EndObject();
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() > 1)
@@ -537,6 +623,15 @@ UniValue getrawmempool(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return mempoolToJSON(fVerbose);
 }
 
+/** getrawmempool writing its verbose result piecewise. */
+bool getrawmempool_stream(const UniValue& params, JSONStreamWriter& writer)
+{
+    if (params.size() != 1 || !params[0].isBool() || !params[0].get_bool())
+        return false;
+    mempoolToJSONStream(writer, true);
+    return true;
+}
+
 UniValue getblockdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() != 1)
@@ -826,6 +921,67 @@ UniValue getblockheader(const UniValue& params, bool fHelp, const CPubKey& mypk)
     }
 }
 
+/** The verbosity argument of getblock. */
+static int GetBlockVerbosity(const UniValue& params)
+{
+    int verbosity = 1;
+    if (params.size() > 1) {
+        if(params[1].isNum()) {
+            verbosity = params[1].get_int();
+        } else {
+            verbosity = params[1].get_bool() ? 1 : 0;
+        }
+    }
+
+    if (verbosity < 0 || verbosity > 2) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
+    }
+    return verbosity;
+}
+
+/** Find and read the block given by hash or height as the first getblock argument. Requires cs_main. */
+static CBlockIndex* ReadBlockFromParams(const UniValue& params, CBlock& block)
+{
+    std::string strHash = params[0].get_str();
+
+    // If height is supplied, find the hash
+    if (strHash.size() < (2 * sizeof(uint256))) {
+        // std::stoi allows characters, whereas we want to be strict
+        regex r("[[:digit:]]+");
+        if (!regex_match(strHash, r)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
+        }
+
+        int nHeight = -1;
+        try {
+            nHeight = std::stoi(strHash);
+        }
+        catch (const std::exception &e) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
+        }
+
+        if (nHeight < 0 || nHeight > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        }
+        strHash = chainActive[nHeight]->GetBlockHash().GetHex();
+    }
+
+    uint256 hash(uint256S(strHash));
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if(!ReadBlockFromDisk(block, pblockindex,1))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -894,56 +1050,9 @@ UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk)
 
     LOCK(cs_main);
 
-    std::string strHash = params[0].get_str();
-
-    // If height is supplied, find the hash
-    if (strHash.size() < (2 * sizeof(uint256))) {
-        // std::stoi allows characters, whereas we want to be strict
-        regex r("[[:digit:]]+");
-        if (!regex_match(strHash, r)) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
-        }
-
-        int nHeight = -1;
-        try {
-            nHeight = std::stoi(strHash);
-        }
-        catch (const std::exception &e) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
-        }
-
-        if (nHeight < 0 || nHeight > chainActive.Height()) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
-        }
-        strHash = chainActive[nHeight]->GetBlockHash().GetHex();
-    }
-
-    uint256 hash(uint256S(strHash));
-
-    int verbosity = 1;
-    if (params.size() > 1) {
-        if(params[1].isNum()) {
-            verbosity = params[1].get_int();
-        } else {
-            verbosity = params[1].get_bool() ? 1 : 0;
-        }
-    }
-
-    if (verbosity < 0 || verbosity > 2) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
-    }
-
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
+    int verbosity = GetBlockVerbosity(params);
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex,1))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockIndex* pblockindex = ReadBlockFromParams(params, block);
 
     if (verbosity == 0)
     {
@@ -956,40 +1065,168 @@ UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
+/** getblock writing its result piecewise, for verbosity 2. */
+bool getblock_stream(const UniValue& params, JSONStreamWriter& writer)
+{
+    if (params.size() != 2 || GetBlockVerbosity(params) != 2)
+        return false;
+
+    CBlock block;
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        pblockindex = ReadBlockFromParams(params, block);
+    }
+    blockToJSONStream(writer, block, pblockindex, true);
+    return true;
+}
+
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 2)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" use_index )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time unless it can be answered from the utxo stats index (-utxostatsindex).\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"    (string, optional) \"muhash\", \"hash_serialized\" or \"none\" (default: \"muhash\" with -utxostatsindex, otherwise \"hash_serialized\")\n"
+            "2. use_index      (boolean, optional, default=true) Answer from the utxo stats index if it is enabled. With \"muhash\" and\n"
+            "                  false, a parallel scan of the whole set is done instead, which can be used to verify the index\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bogosize\": n,          (numeric) A database-independent metric for UTXO set size (not for hash_serialized)\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size (full scans only)\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (only for hash_serialized)\n"
+            "  \"muhash\": \"hash\",   (string) The rolling MuHash of the set (only for muhash)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\" false")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
-    UniValue ret(UniValue::VOBJ);
+    std::string strHashType = fUTXOStatsIndex ? "muhash" : "hash_serialized";
+    if (params.size() > 0 && !params[0].isNull())
+        strHashType = params[0].get_str();
+    if (strHashType != "muhash" && strHashType != "hash_serialized" && strHashType != "none")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+    bool fUseIndex = true;
+    if (params.size() > 1)
+        fUseIndex = params[1].get_bool();
 
+    UniValue ret(UniValue::VOBJ);
     CCoinsStats stats;
+
+    if (fUTXOStatsIndex && fUseIndex && strHashType != "hash_serialized") {
+        CUTXOStats utxostats;
+        {
+            LOCK(cs_main);
+            stats.hashBlock = chainActive.Tip()->GetBlockHash();
+            stats.nHeight = chainActive.Height();
+        }
+        if (!pblocktree->ReadUTXOStats(stats.hashBlock, utxostats))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read utxo stats index entry, reindex to rebuild the index");
+        ret.push_back(Pair("height", (int64_t)stats.nHeight));
+        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+        ret.push_back(Pair("transactions", (int64_t)utxostats.nTransactions));
+        ret.push_back(Pair("txouts", (int64_t)utxostats.nTransactionOutputs));
+        ret.push_back(Pair("bogosize", (int64_t)utxostats.nBogoSize));
+        if (strHashType == "muhash") {
+            utxostats.muhash.Finalize(stats.hashMuHash.begin());
+            ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
+        }
+        ret.push_back(Pair("total_amount", ValueFromAmount(utxostats.nTotalAmount)));
+        return ret;
+    }
+
     FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    if (strHashType == "hash_serialized") {
+        if (pcoinsTip->GetStats(stats)) {
+            ret.push_back(Pair("height", (int64_t)stats.nHeight));
+            ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+            ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+            ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+            ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        }
+    } else if (pcoinsTip->GetStatsParallel(stats, GetNumCores())) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+        ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        if (strHashType == "muhash")
+            ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    } else {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to scan the UTXO set at the best block");
+    }
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns LevelDB statistics for each open database.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",            (string) The database profile (chainstate, blockindex, notarisations)\n"
+            "    \"path\": \"path\",            (string) The database directory\n"
+            "    \"profile\": {...},          (object) The tuning in use, see -dbprofile\n"
+            "    \"files\": n,                (numeric) The number of table files\n"
+            "    \"files_per_level\": [n,...], (array) The number of table files at each level\n"
+            "    \"memory_usage\": n,         (numeric) The approximate memory used by memtables and caches, in bytes\n"
+            "    \"cache_hits\": n,           (numeric) Block cache lookups that hit since startup\n"
+            "    \"cache_misses\": n,         (numeric) Block cache lookups that missed since startup\n"
+            "    \"cache_hit_rate\": x.xxx,   (numeric) cache_hits / (cache_hits + cache_misses)\n"
+            "    \"compactions\": \"text\"      (string) The per level compaction stats reported by LevelDB\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    for (const CDBStats& stats : GetAllDBStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.strName));
+        obj.push_back(Pair("path", stats.strPath));
+
+        UniValue profile(UniValue::VOBJ);
+        profile.push_back(Pair("blocksize", (int64_t)stats.profile.nBlockSize));
+        profile.push_back(Pair("bloombits", stats.profile.nBloomBits));
+        profile.push_back(Pair("maxfilesize", (int64_t)stats.profile.nMaxFileSize));
+        profile.push_back(Pair("cachepercent", stats.profile.nCachePercent));
+        profile.push_back(Pair("scanfillcache", stats.profile.fScanFillCache));
+        obj.push_back(Pair("profile", profile));
+
+        UniValue levels(UniValue::VARR);
+        int64_t nFiles = 0;
+        for (int n : stats.vFilesPerLevel) {
+            levels.push_back(n);
+            nFiles += n;
+        }
+        obj.push_back(Pair("files", nFiles));
+        obj.push_back(Pair("files_per_level", levels));
+        obj.push_back(Pair("memory_usage", (int64_t)stats.nApproximateMemory));
+        obj.push_back(Pair("cache_hits", (int64_t)stats.nCacheHits));
+        obj.push_back(Pair("cache_misses", (int64_t)stats.nCacheMisses));
+        uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+        obj.push_back(Pair("cache_hit_rate", nLookups > 0 ? (double)stats.nCacheHits / nLookups : 0.0));
+        obj.push_back(Pair("compactions", stats.strCompactionStats));
+        ret.push_back(obj);
     }
     return ret;
 }
@@ -1944,6 +2181,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
 
     /* Not shown in help */
@@ -14,7 +14,11 @@
  *                                                                            *
  ******************************************************************************/
 
+class JSONStreamWriter;
+
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+void blockToJSONStream(JSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails);
 UniValue mempoolInfoToJSON();
 UniValue mempoolToJSON(bool fVerbose = false);
+void mempoolToJSONStream(JSONStreamWriter& writer, bool fVerbose);
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
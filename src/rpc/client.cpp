@@ -39,6 +39,7 @@ public:
 static const CRPCConvertParam vRPCConvertParams[] =
 {
     { "stop", 0 },
+    { "gettxoutsetinfo", 1 },
     { "setmocktime", 0 },
     { "getaddednodeinfo", 0 },
     { "setgenerate", 0 },
@@ -0,0 +1,113 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+#include <stdexcept>
+
+#include <univalue.h>
+
+JSONStreamWriter::JSONStreamWriter(const ChunkHandler& handlerIn, size_t nChunkSizeIn) :
+    handler(handlerIn), nChunkSize(nChunkSizeIn), fFlushed(false), fAfterKey(false)
+{
+    strBuffer.reserve(nChunkSize);
+}
+
+void JSONStreamWriter::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            strBuffer += ',';
+        vEmpty.back() = false;
+    }
+}
+
+void JSONStreamWriter::Write(const std::string& str)
+{
+    strBuffer += str;
+    if (strBuffer.size() >= nChunkSize)
+        Flush();
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    Write("{");
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    Write("}");
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    Write("[");
+    vEmpty.push_back(true);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    Write("]");
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    BeginValue();
+    Write(UniValue(key).write() + ":");
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    if (value.isObject()) {
+        BeginObject();
+        const std::vector<std::string>& keys = value.getKeys();
+        const std::vector<UniValue>& values = value.getValues();
+        for (size_t i = 0; i < keys.size(); i++)
+            PushKV(keys[i], values[i]);
+        EndObject();
+    } else if (value.isArray()) {
+        BeginArray();
+        for (size_t i = 0; i < value.size(); i++)
+            Value(value[i]);
+        EndArray();
+    } else {
+        BeginValue();
+        Write(value.write());
+    }
+}
+
+void JSONStreamWriter::PushKV(const std::string& key, const UniValue& value)
+{
+    Key(key);
+    Value(value);
+}
+
+void JSONStreamWriter::Raw(const std::string& str)
+{
+    Write(str);
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    fFlushed = true;
+    if (!handler(strBuffer))
+        throw std::runtime_error("JSON stream aborted");
+    strBuffer.clear();
+}
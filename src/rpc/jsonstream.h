@@ -0,0 +1,66 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+class UniValue;
+
+/** Output is handed on in chunks of about this many bytes. */
+static const size_t DEFAULT_JSON_STREAM_CHUNK = 64 * 1024;
+
+/**
+ * Writes a JSON document piecewise, handing it on in chunks as it grows, so
+ * that large RPC and REST replies need neither the whole UniValue tree nor
+ * the whole serialized string in memory. Commas are inserted as needed.
+ *
+ * Output is buffered until a chunk is full: a document shorter than one chunk
+ * is never handed on and can be taken with GetBuffer() to be sent as usual.
+ */
+class JSONStreamWriter
+{
+public:
+    /** Receives the next chunk of output; returns false to abort (e.g. the client went away). */
+    typedef boost::function<bool(const std::string&)> ChunkHandler;
+
+    explicit JSONStreamWriter(const ChunkHandler& handler, size_t nChunkSize = DEFAULT_JSON_STREAM_CHUNK);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Start a member of the current object; follow with its value. */
+    void Key(const std::string& key);
+    /** Write a value. Objects and arrays are walked, not serialized whole. */
+    void Value(const UniValue& value);
+    void PushKV(const std::string& key, const UniValue& value);
+    /** Write text that is not part of the document, such as the trailing newline. */
+    void Raw(const std::string& str);
+
+    /** Hand on everything buffered. Throws std::runtime_error if the handler aborts. */
+    void Flush();
+    /** Whether any output has been handed on yet. */
+    bool HasFlushed() const { return fFlushed; }
+    const std::string& GetBuffer() const { return strBuffer; }
+
+private:
+    ChunkHandler handler;
+    size_t nChunkSize;
+    std::string strBuffer;
+    bool fFlushed;
+    //! For each open object or array, whether it is still empty
+    std::vector<bool> vEmpty;
+    //! A key was written and its value is next
+    bool fAfterKey;
+
+    void BeginValue();
+    void Write(const std::string& str);
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -491,6 +491,8 @@ UniValue getmininginfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
             "  \"genproclimit\": n          (numeric) The processor limit for generation. -1 if no generation. (see getgenerate or setgenerate calls)\n"
             "  \"localsolps\": xxx.xxxxx    (numeric) The average local solution rate in Sol/s since this node was started\n"
+            "  \"localsolpsperthread\": xxx.xxxxx (numeric) The local solution rate in Sol/s of each mining thread\n"
+            "  \"equihashsolver\": \"xxxx\"  (string) The Equihash solver the mining threads run (tromp, default)\n"
             "  \"networksolps\": x          (numeric) The estimated network solution rate in Sol/s\n"
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
@@ -514,6 +516,7 @@ UniValue getmininginfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     if (ASSETCHAINS_ALGO == ASSETCHAINS_EQUIHASH)
     {
         obj.push_back(Pair("localsolps"  , getlocalsolps(params, false, mypk)));
+        obj.push_back(Pair("localsolpsperthread", GetLocalSolPSPerThread()));
         obj.push_back(Pair("networksolps", getnetworksolps(params, false, mypk)));
     }
     else
@@ -531,6 +534,8 @@ UniValue getmininginfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     obj.push_back(Pair("staking",          staking));
     obj.push_back(Pair("generate",         GetBoolArg("-gen", false) && GetBoolArg("-genproclimit", -1) != 0 ));
     obj.push_back(Pair("numthreads",       (int64_t)KOMODO_MININGTHREADS));
+    if (ASSETCHAINS_ALGO == ASSETCHAINS_EQUIHASH)
+        obj.push_back(Pair("equihashsolver", GetEquihashSolverName()));
 #endif
     return obj;
 }
@@ -24,6 +24,7 @@
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "txmempool.h"
 #include "util.h"
@@ -926,6 +927,87 @@ bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
     return a.second.time < b.second.time;
 }
 
+/** A continuation cursor is the position in the address list and the last index key returned, hex encoded. */
+template <typename Key>
+static std::string encodeAddressCursor(size_t position, const Key &key)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << (uint32_t)position << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+/**
+ * Read the "limit" and "cursor" paging options of an address query.
+ * Returns false when the caller asked for everything at once.
+ */
+template <typename Key>
+static bool getPageFromParams(const UniValue& params, const std::vector<std::pair<uint160, int> > &addresses,
+                              size_t &limit, size_t &first, Key &after, bool &fAfter)
+{
+    limit = 0;
+    first = 0;
+    fAfter = false;
+    if (!params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (limitValue.isNull()) {
+        if (!cursorValue.isNull())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor requires a limit");
+        return false;
+    }
+    if (!limitValue.isNum() || limitValue.get_int() <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+    limit = limitValue.get_int();
+
+    if (!cursorValue.isNull()) {
+        if (!cursorValue.isStr() || !IsHex(cursorValue.get_str()))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        try {
+            std::vector<unsigned char> data(ParseHex(cursorValue.get_str()));
+            CDataStream ss(data, SER_NETWORK, PROTOCOL_VERSION);
+            uint32_t position;
+            ss >> position >> after;
+            first = position;
+        } catch (const std::exception&) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        // a cursor is only valid for the address list it was issued for
+        if (first >= addresses.size() || addresses[first].first != after.hashBytes || addresses[first].second != (int)after.type)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not match the addresses");
+        fAfter = true;
+    }
+    return true;
+}
+
+/**
+ * Fill entries with at most limit records, walking the addresses in order from the cursor.
+ * Returns the cursor of the next page, or an empty string once everything has been returned.
+ */
+template <typename Key, typename Value, typename Read>
+static std::string getAddressPage(const std::vector<std::pair<uint160, int> > &addresses, size_t limit, size_t first, const Key *after,
+                                  std::vector<std::pair<Key, Value> > &entries, Read read)
+{
+    size_t i;
+    for (i = first; i < addresses.size(); i++) {
+        // one record more than asked for tells whether another page follows
+        if (!read(addresses[i].first, addresses[i].second, entries, limit + 1 - entries.size(), i == first ? after : NULL))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        if (entries.size() > limit)
+            break;
+    }
+    if (entries.size() <= limit)
+        return "";
+
+    entries.resize(limit);
+    // the lookahead record may have come from a later address than the last one returned
+    const Key &last = entries.back().first;
+    while (addresses[i].first != last.hashBytes || addresses[i].second != (int)last.type)
+        i--;
+    return encodeAddressCursor(i, last);
+}
+
 UniValue getaddressmempool(const UniValue& params, bool fHelp, const CPubKey& mypk)
 {
     if (fHelp || params.size() > 2 || params.size() == 0)
@@ -1012,6 +1094,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return at most this many outputs, in index order, with a cursor for the rest\n"
+            "  \"cursor\"  (string, optional) The cursor returned by the previous page\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult\n"
@@ -1025,6 +1109,7 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nWith a limit the outputs are returned as \"utxos\" in an object, along with \"cursor\" (string) when more remain.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
@@ -1046,13 +1131,26 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    size_t limit, first;
+    CAddressUnspentKey after;
+    bool fAfter;
+    bool fPaged = getPageFromParams(params, addresses, limit, first, after, fAfter);
+    std::string cursor;
+
+    if (fPaged) {
+        cursor = getAddressPage(addresses, limit, first, fAfter ? &after : NULL, unspentOutputs,
+            [](uint160 hash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect, size_t n, const CAddressUnspentKey *pafter) {
+                return GetAddressUnspent(hash, type, vect, n, pafter);
+            });
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
-    }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    }
 
     UniValue utxos(UniValue::VARR);
 
@@ -1072,60 +1170,43 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || fPaged) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
+        if (!cursor.empty())
+            result.push_back(Pair("cursor", cursor));
 
-        LOCK(cs_main);
-        result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
-        result.push_back(Pair("height", (int)chainActive.Height()));
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
+            result.push_back(Pair("height", (int)chainActive.Height()));
+        }
         return result;
     } else {
         return utxos;
     }
 }
 
-UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk)
+/** The query of a getaddressdeltas call: its deltas, and the chain range and page they are for. */
+struct CAddressDeltasQuery
 {
-    if (fHelp || params.size() > 2 || params.size() == 0 || !params[0].isObject())
-        throw runtime_error(
-            "getaddressdeltas\n"
-            "\nReturns all changes for an address (requires addressindex to be enabled).\n"
-            "\nArguments:\n"
-            "{\n"
-            "  \"addresses\"\n"
-            "    [\n"
-            "      \"address\"  (string) The base58check encoded address\n"
-            "      ,...\n"
-            "    ]\n"
-            "  \"start\" (number) The start block height\n"
-            "  \"end\" (number) The end block height\n"
-            "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
-            "}\n"
-            "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
-            "\nResult:\n"
-            "[\n"
-            "  {\n"
-            "    \"satoshis\"  (number) The difference of satoshis\n"
-            "    \"txid\"  (string) The related txid\n"
-            "    \"index\"  (number) The related input or output index\n"
-            "    \"height\"  (number) The block height\n"
-            "    \"address\"  (string) The base58check encoded address\n"
-            "  }\n"
-            "]\n"
-            "\nExamples:\n"
-            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
-            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
-        );
-
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    int start;
+    int end;
+    bool includeChainInfo;
+    bool fPaged;
+    std::string cursor;
+};
 
+static void getAddressDeltas(const UniValue& params, CAddressDeltasQuery& query)
+{
     UniValue startValue = find_value(params[0].get_obj(), "start");
     UniValue endValue = find_value(params[0].get_obj(), "end");
 
     UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
-    bool includeChainInfo = false;
+    query.includeChainInfo = false;
     if (chainInfo.isBool()) {
-        includeChainInfo = chainInfo.get_bool();
+        query.includeChainInfo = chainInfo.get_bool();
     }
 
     int start = 0;
@@ -1141,6 +1222,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "End value is expected to be greater than start");
         }
     }
+    query.start = start;
+    query.end = end;
 
     std::vector<std::pair<uint160, int> > addresses;
 
@@ -1148,69 +1231,176 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& myp
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex = query.addressIndex;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    size_t limit, first;
+    CAddressIndexKey after;
+    bool fAfter;
+    query.fPaged = getPageFromParams(params, addresses, limit, first, after, fAfter);
+
+    if (query.fPaged) {
+        query.cursor = getAddressPage(addresses, limit, first, fAfter ? &after : NULL, addressIndex,
+            [start, end](uint160 hash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, size_t n, const CAddressIndexKey *pafter) {
+                return GetAddressIndex(hash, type, vect, start, end, n, pafter);
+            });
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
             }
         }
     }
+}
 
-    UniValue deltas(UniValue::VARR);
+static UniValue addressDeltaToJSON(const std::pair<CAddressIndexKey, CAmount>& entry)
+{
+    std::string address;
+    if (!getAddressFromIndex(entry.first.type, entry.first.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
-        }
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", entry.second));
+    delta.push_back(Pair("txid", entry.first.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)entry.first.index));
+    delta.push_back(Pair("blockindex", (int)entry.first.txindex));
+    delta.push_back(Pair("height", entry.first.blockHeight));
+    delta.push_back(Pair("address", address));
+    return delta;
+}
 
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        deltas.push_back(delta);
+/** The "start" and "end" blocks of a getaddressdeltas result with chain info. */
+static void getAddressDeltasRange(const CAddressDeltasQuery& query, UniValue& startInfo, UniValue& endInfo)
+{
+    LOCK(cs_main);
+
+    if (query.start > chainActive.Height() || query.end > chainActive.Height()) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Start or end is outside chain range");
     }
 
-    UniValue result(UniValue::VOBJ);
+    CBlockIndex* startIndex = chainActive[query.start];
+    CBlockIndex* endIndex = chainActive[query.end];
 
-    if (includeChainInfo && start > 0 && end > 0) {
-        LOCK(cs_main);
+    startInfo = UniValue(UniValue::VOBJ);
+    endInfo = UniValue(UniValue::VOBJ);
 
-        if (start > chainActive.Height() || end > chainActive.Height()) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Start or end is outside chain range");
-        }
+    startInfo.push_back(Pair("hash", startIndex->GetBlockHash().GetHex()));
+    startInfo.push_back(Pair("height", query.start));
+
+    endInfo.push_back(Pair("hash", endIndex->GetBlockHash().GetHex()));
+    endInfo.push_back(Pair("height", query.end));
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() > 2 || params.size() == 0 || !params[0].isObject())
+        throw runtime_error(
+            "getaddressdeltas\n"
+            "\nReturns all changes for an address (requires addressindex to be enabled).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"\n"
+            "    [\n"
+            "      \"address\"  (string) The base58check encoded address\n"
+            "      ,...\n"
+            "    ]\n"
+            "  \"start\" (number) The start block height\n"
+            "  \"end\" (number) The end block height\n"
+            "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number, optional) Return at most this many deltas, with a cursor for the rest\n"
+            "  \"cursor\" (string, optional) The cursor returned by the previous page\n"
+            "}\n"
+            "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\"  (number) The difference of satoshis\n"
+            "    \"txid\"  (string) The related txid\n"
+            "    \"index\"  (number) The related input or output index\n"
+            "    \"height\"  (number) The block height\n"
+            "    \"address\"  (string) The base58check encoded address\n"
+            "  }\n"
+            "]\n"
+            "\nWith a limit the deltas are returned as \"deltas\" in an object, along with \"cursor\" (string) when more remain.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
+            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
+        );
 
-        CBlockIndex* startIndex = chainActive[start];
-        CBlockIndex* endIndex = chainActive[end];
+    CAddressDeltasQuery query;
+    getAddressDeltas(params, query);
 
-        UniValue startInfo(UniValue::VOBJ);
-        UniValue endInfo(UniValue::VOBJ);
+    UniValue deltas(UniValue::VARR);
+
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=query.addressIndex.begin(); it!=query.addressIndex.end(); it++) {
+        deltas.push_back(addressDeltaToJSON(*it));
+    }
 
-        startInfo.push_back(Pair("hash", startIndex->GetBlockHash().GetHex()));
-        startInfo.push_back(Pair("height", start));
+    UniValue result(UniValue::VOBJ);
 
-        endInfo.push_back(Pair("hash", endIndex->GetBlockHash().GetHex()));
-        endInfo.push_back(Pair("height", end));
+    if (query.includeChainInfo && query.start > 0 && query.end > 0) {
+        UniValue startInfo, endInfo;
+        getAddressDeltasRange(query, startInfo, endInfo);
 
         result.push_back(Pair("deltas", deltas));
+        if (!query.cursor.empty())
+            result.push_back(Pair("cursor", query.cursor));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
 
         return result;
+    } else if (query.fPaged) {
+        result.push_back(Pair("deltas", deltas));
+        if (!query.cursor.empty())
+            result.push_back(Pair("cursor", query.cursor));
+        return result;
     } else {
         return deltas;
     }
 }
 
+/** getaddressdeltas writing each delta as it is converted, see CRPCTable::executeStreamed. */
+bool getaddressdeltas_stream(const UniValue& params, JSONStreamWriter& writer)
+{
+    if (params.size() > 2 || params.size() == 0 || !params[0].isObject())
+        return false;
+
+    CAddressDeltasQuery query;
+    getAddressDeltas(params, query);
+
+    bool fChainInfo = query.includeChainInfo && query.start > 0 && query.end > 0;
+    UniValue startInfo, endInfo;
+    if (fChainInfo)
+        getAddressDeltasRange(query, startInfo, endInfo);
+
+    bool fObject = fChainInfo || query.fPaged;
+    if (fObject) {
+        writer.BeginObject();
+        writer.Key("deltas");
+    }
+    writer.BeginArray();
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=query.addressIndex.begin(); it!=query.addressIndex.end(); it++) {
+        writer.Value(addressDeltaToJSON(*it));
+    }
+    writer.EndArray();
+    if (fObject) {
+        if (!query.cursor.empty())
+            writer.PushKV("cursor", query.cursor);
+        if (fChainInfo) {
+            writer.PushKV("start", startInfo);
+            writer.PushKV("end", endInfo);
+        }
+        writer.EndObject();
+    }
+    return true;
+}
+
 CAmount checkburnaddress(CAmount &received, int64_t &nNotaryPay, int32_t &height, std::string sAddress)
 {
     CBitcoinAddress address(sAddress);
@@ -1442,6 +1632,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Read at most this many index entries, address by address, with a cursor for the rest\n"
+            "  \"cursor\" (string, optional) The cursor returned by the previous page\n"
             "}\n"
             "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
             "\nResult:\n"
@@ -1449,6 +1641,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nWith a limit the txids are returned as \"txids\" in an object, along with \"cursor\" (string) when more remain.\n"
+            "A txid with several entries may be repeated on the next page.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
@@ -1473,14 +1667,27 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    size_t limit, first;
+    CAddressIndexKey after;
+    bool fAfter;
+    bool fPaged = getPageFromParams(params, addresses, limit, first, after, fAfter);
+    std::string cursor;
+
+    if (fPaged) {
+        cursor = getAddressPage(addresses, limit, first, fAfter ? &after : NULL, addressIndex,
+            [start, end](uint160 hash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, size_t n, const CAddressIndexKey *pafter) {
+                return GetAddressIndex(hash, type, vect, start, end, n, pafter);
+            });
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
             }
         }
     }
@@ -1492,7 +1699,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
         int height = it->first.blockHeight;
         std::string txid = it->first.txhash.GetHex();
 
-        if (addresses.size() > 1) {
+        // pages are in index order already, so keep that order rather than re-sorting across addresses
+        if (addresses.size() > 1 && !fPaged) {
             txids.insert(std::make_pair(height, txid));
         } else {
             if (txids.insert(std::make_pair(height, txid)).second) {
@@ -1501,12 +1709,20 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk
         }
     }
 
-    if (addresses.size() > 1) {
+    if (addresses.size() > 1 && !fPaged) {
         for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
             result.push_back(it->second);
         }
     }
 
+    if (fPaged) {
+        UniValue page(UniValue::VOBJ);
+        page.push_back(Pair("txids", result));
+        if (!cursor.empty())
+            page.push_back(Pair("cursor", cursor));
+        return page;
+    }
+
     return result;
 
 }
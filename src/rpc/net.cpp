@@ -124,6 +124,14 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
             "    \"services\":\"xxxxxxxxxxxxxxxx\",   (string) The services offered\n"
             "    \"tls_established\": true|false,        (boolean) status of TLS connection\n"
             "    \"tls_verified\": true|false,           (boolean) status of peer certificate. True if the chain of trust of a peer certificate can be verified using the OS certificate store\n"
+            "    \"tls_version\": \"xxx\",                (string, optional) negotiated TLS protocol version\n"
+            "    \"tls_cipher\": \"xxx\",                 (string, optional) negotiated TLS cipher suite\n"
+            "    \"tls_handshake_us\": n,                (numeric, optional) time spent in the TLS handshake, in microseconds\n"
+            "    \"tls_resumed\": true|false,            (boolean, optional) true if the handshake resumed a previous session ticket\n"
+            "    \"tls_ktls_send\": true|false,          (boolean, optional) outgoing records are encrypted by the kernel (-tlsktls)\n"
+            "    \"tls_ktls_recv\": true|false,          (boolean, optional) incoming records are decrypted by the kernel (-tlsktls)\n"
+            "    \"tls_writes\": n,                      (numeric, optional) number of successful SSL_write calls\n"
+            "    \"tls_reads\": n,                       (numeric, optional) number of successful SSL_read calls\n"
             "    \"lastsend\": ttt,           (numeric) The time in seconds since epoch (Jan 1 1970 GMT) of the last send\n"
             "    \"lastrecv\": ttt,           (numeric) The time in seconds since epoch (Jan 1 1970 GMT) of the last receive\n"
             "    \"bytessent\": n,            (numeric) The total bytes sent\n"
@@ -174,6 +182,16 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
         obj.push_back(Pair("services", strprintf("%016x", stats.nServices)));
         obj.push_back(Pair("tls_established", stats.fTLSEstablished));
         obj.push_back(Pair("tls_verified", stats.fTLSVerified));
+        if (stats.fTLSEstablished) {
+            obj.push_back(Pair("tls_version", stats.strTLSVersion));
+            obj.push_back(Pair("tls_cipher", stats.strTLSCipher));
+            obj.push_back(Pair("tls_handshake_us", stats.nTLSHandshakeTime));
+            obj.push_back(Pair("tls_resumed", stats.fTLSResumed));
+            obj.push_back(Pair("tls_ktls_send", stats.fTLSKernelSend));
+            obj.push_back(Pair("tls_ktls_recv", stats.fTLSKernelRecv));
+            obj.push_back(Pair("tls_writes", stats.nTLSWrites));
+            obj.push_back(Pair("tls_reads", stats.nTLSReads));
+        }
         obj.push_back(Pair("lastsend", stats.nLastSend));
         obj.push_back(Pair("lastrecv", stats.nLastRecv));
         obj.push_back(Pair("bytessent", stats.nSendBytes));
@@ -211,6 +229,73 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return ret;
 }
 
+UniValue getblockdownloadinfo(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getblockdownloadinfo\n"
+            "\nReturns the state of the block download scheduler: the blocks in flight and, for each peer\n"
+            "we download blocks from, its adaptive request window and measured delivery speed.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks_in_flight\": n,           (numeric) Blocks requested and not received yet\n"
+            "  \"duplicate_requests\": n,         (numeric) Window-blocking blocks also requested from a faster peer\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,                     (numeric) Peer index\n"
+            "      \"addr\": \"host:port\",        (string) The ip address and port of the peer\n"
+            "      \"window\": n,                 (numeric) Number of blocks we allow in flight from this peer\n"
+            "      \"inflight\": n,               (numeric) Number of blocks in flight from this peer\n"
+            "      \"blocks_received\": n,        (numeric) Requested blocks this peer delivered\n"
+            "      \"block_time_ms\": n,          (numeric) Average time per delivered block, in milliseconds\n"
+            "      \"block_latency_ms\": n,       (numeric) Average time from request to arrival, in milliseconds\n"
+            "      \"throughput\": n,             (numeric) Average block throughput, in bytes per second\n"
+            "      \"duplicates_won\": n,         (numeric) Duplicate requests this peer answered first\n"
+            "      \"stalling\": true|false       (boolean) Whether this peer holds back the download window\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockdownloadinfo", "")
+            + HelpExampleRpc("getblockdownloadinfo", "")
+        );
+
+    vector<CNodeStats> vstats;
+    CopyNodeStats(vstats);
+
+    int nInFlight = 0, nDuplicates = 0;
+    GetBlockDownloadStats(nInFlight, nDuplicates);
+
+    UniValue peers(UniValue::VARR);
+    BOOST_FOREACH(const CNodeStats& stats, vstats) {
+        CNodeStateStats statestats;
+        if (!GetNodeStateStats(stats.nodeid, statestats))
+            continue;
+        if (statestats.nBlocksReceived == 0 && statestats.vHeightInFlight.empty())
+            continue;
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("id", stats.nodeid));
+        obj.push_back(Pair("addr", stats.addrName));
+        obj.push_back(Pair("window", statestats.nBlockWindow));
+        obj.push_back(Pair("inflight", (int)statestats.vHeightInFlight.size()));
+        obj.push_back(Pair("blocks_received", statestats.nBlocksReceived));
+        obj.push_back(Pair("block_time_ms", statestats.nAvgBlockServiceTime / 1000));
+        obj.push_back(Pair("block_latency_ms", statestats.nAvgBlockLatency / 1000));
+        obj.push_back(Pair("throughput", statestats.nAvgBlockBytesPerSec));
+        obj.push_back(Pair("duplicates_won", statestats.nDuplicatesWon));
+        obj.push_back(Pair("stalling", statestats.fStalling));
+        peers.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blocks_in_flight", nInFlight));
+    ret.push_back(Pair("duplicate_requests", nDuplicates));
+    ret.push_back(Pair("peers", peers));
+    return ret;
+}
+
 int32_t KOMODO_LONGESTCHAIN;
 int32_t komodo_longestchain()
 {
@@ -720,6 +805,7 @@ static const CRPCCommand commands[] =
     { "network",            "ping",                   &ping,                   true  },
     { "network",            "getpeerlist",            &getpeerlist,            true  },
     { "network",            "getpeerinfo",            &getpeerinfo,            true  },
+    { "network",            "getblockdownloadinfo",   &getblockdownloadinfo,   true  },
     { "network",            "addnode",                &addnode,                true  },
     { "network",            "disconnectnode",         &disconnectnode,         true  },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
@@ -19,6 +19,7 @@
  ******************************************************************************/
 
 #include "rpc/server.h"
+#include "rpc/jsonstream.h"
 
 #include "init.h"
 #include "key_io.h"
@@ -30,6 +31,7 @@
 #include "asyncrpcqueue.h"
 #include "assetchain.h"
 
+#include <atomic>
 #include <memory>
 
 #include <univalue.h>
@@ -288,6 +290,120 @@ UniValue stop(const UniValue& params, bool fHelp, const CPubKey& mypk)
     return buf;
 }
 
+/** Upper bounds (in microseconds) of the RPC latency histogram buckets; the last bucket counts slower calls. */
+static const int64_t RPC_LATENCY_BOUNDS[] = {100, 300, 1000, 3000, 10000, 30000, 100000, 300000, 1000000, 3000000, 10000000};
+static const size_t RPC_LATENCY_BUCKETS = sizeof(RPC_LATENCY_BOUNDS) / sizeof(RPC_LATENCY_BOUNDS[0]) + 1;
+
+struct CRPCMethodStats
+{
+    uint64_t nCalls;
+    uint64_t nErrors;
+    int64_t nTotalTime;
+    int64_t nMaxTime;
+    uint64_t vBuckets[RPC_LATENCY_BUCKETS];
+
+    CRPCMethodStats() : nCalls(0), nErrors(0), nTotalTime(0), nMaxTime(0)
+    {
+        std::fill(vBuckets, vBuckets + RPC_LATENCY_BUCKETS, 0);
+    }
+};
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+
+/** Records the latency of a call in its method's histogram when it goes out of scope. */
+class CRPCCallTimer
+{
+private:
+    std::string strMethod;
+    int64_t nStart;
+    bool fDiscard;
+
+public:
+    bool fSuccess;
+
+    CRPCCallTimer(const std::string& strMethodIn) : strMethod(strMethodIn), nStart(GetTimeMicros()), fDiscard(false), fSuccess(false) {}
+
+    /** Do not record this call, e.g. because it is handed on to another path that records it. */
+    void Discard() { fDiscard = true; }
+
+    ~CRPCCallTimer()
+    {
+        if (fDiscard)
+            return;
+        int64_t nTime = GetTimeMicros() - nStart;
+        size_t nBucket = std::upper_bound(RPC_LATENCY_BOUNDS, RPC_LATENCY_BOUNDS + RPC_LATENCY_BUCKETS - 1, nTime - 1) - RPC_LATENCY_BOUNDS;
+        LOCK(cs_rpcStats);
+        CRPCMethodStats& stats = mapRPCStats[strMethod];
+        stats.nCalls++;
+        if (!fSuccess)
+            stats.nErrors++;
+        stats.nTotalTime += nTime;
+        stats.nMaxTime = std::max(stats.nMaxTime, nTime);
+        stats.vBuckets[nBucket]++;
+    }
+};
+
+UniValue getrpcstats(const UniValue& params, bool fHelp, const CPubKey& mypk)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcstats\n"
+            "\nReturns call counts and latency histograms of the RPC methods called since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"histogram_bounds_us\": [ n, ... ],  (array) upper bounds of the histogram buckets in microseconds; the last bucket counts slower calls\n"
+            "  \"methods\": {\n"
+            "    \"method\": {\n"
+            "      \"pool\": \"quick|heavy|admin\",   (string) the worker pool the method runs on\n"
+            "      \"concurrent\": true|false,        (boolean) whether batch entries calling it run concurrently\n"
+            "      \"calls\": n,                      (numeric) number of calls\n"
+            "      \"errors\": n,                     (numeric) number of calls that returned an error\n"
+            "      \"avg_us\": n,                     (numeric) average latency in microseconds\n"
+            "      \"max_us\": n,                     (numeric) highest latency in microseconds\n"
+            "      \"histogram\": [ n, ... ]          (array) number of calls per latency bucket\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleRpc("getrpcstats", "")
+        );
+
+    static const char* const poolNames[] = {"quick", "heavy", "admin"};
+
+    UniValue bounds(UniValue::VARR);
+    for (size_t i = 0; i < RPC_LATENCY_BUCKETS - 1; i++)
+        bounds.push_back(RPC_LATENCY_BOUNDS[i]);
+
+    std::map<std::string, CRPCMethodStats> mapStats;
+    {
+        LOCK(cs_rpcStats);
+        mapStats = mapRPCStats;
+    }
+    UniValue methods(UniValue::VOBJ);
+    for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CRPCMethodStats& stats = it->second;
+        UniValue method(UniValue::VOBJ);
+        method.push_back(Pair("pool", poolNames[tableRPC.workClass(it->first)]));
+        method.push_back(Pair("concurrent", tableRPC.isConcurrent(it->first)));
+        method.push_back(Pair("calls", (uint64_t)stats.nCalls));
+        method.push_back(Pair("errors", (uint64_t)stats.nErrors));
+        method.push_back(Pair("avg_us", stats.nCalls ? stats.nTotalTime / (int64_t)stats.nCalls : 0));
+        method.push_back(Pair("max_us", stats.nMaxTime));
+        UniValue histogram(UniValue::VARR);
+        for (size_t i = 0; i < RPC_LATENCY_BUCKETS; i++)
+            histogram.push_back((uint64_t)stats.vBuckets[i]);
+        method.push_back(Pair("histogram", histogram));
+        methods.push_back(Pair(it->first, method));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("histogram_bounds_us", bounds));
+    ret.push_back(Pair("methods", methods));
+    return ret;
+}
+
 /**
  * Call Table
  */
@@ -300,6 +416,7 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "getnotarysendmany",      &getnotarysendmany,      true  },
     { "control",            "geterablockheights",     &geterablockheights,     true  },
     { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getrpcstats",            &getrpcstats,            true  },
 
     /* P2P networking */
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
@@ -311,6 +428,7 @@ static const CRPCCommand vRPCCommands[] =
     { "network",            "getnettotals",           &getnettotals,           true  },
     { "network",            "getpeerlist",            &getpeerlist,            true  },
     { "network",            "getpeerinfo",            &getpeerinfo,            true  },
+    { "network",            "getblockdownloadinfo",   &getblockdownloadinfo,   true  },
     { "network",            "ping",                   &ping,                   true  },
     { "network",            "setban",                 &setban,                 true  },
     { "network",            "listbanned",             &listbanned,             true  },
@@ -335,6 +453,7 @@ static const CRPCCommand vRPCCommands[] =
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
     { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
     { "blockchain",         "getspentinfo",           &getspentinfo,           false },
     { "blockchain",         "notaries",               &notaries,               true  },
@@ -806,12 +925,59 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+static bool IsConcurrentRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    return method.isStr() && tableRPC.isConcurrent(method.get_str());
+}
+
+/** Execute batch entries [nBegin, nEnd) on up to nThreads threads. */
+static void JSONRPCExecConcurrently(const UniValue& vReq, size_t nBegin, size_t nEnd, int nThreads, std::vector<UniValue>& vReply)
+{
+    std::atomic<size_t> nNext(nBegin);
+    auto worker = [&]() {
+        for (size_t i = nNext++; i < nEnd; i = nNext++) {
+            try {
+                vReply[i] = JSONRPCExecOne(vReq[i]);
+            } catch (...) {
+                vReply[i] = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_MISC_ERROR, "Unexpected error"), find_value(vReq[i], "id"));
+            }
+        }
+    };
+
+    boost::thread_group threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.create_thread(worker);
+    worker();
+    threads.join_all();
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
-    UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    int nThreads = std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1);
+
+    // Runs of read only entries are executed concurrently; any other entry
+    // waits for the entries before it and blocks the ones after it.
+    std::vector<UniValue> vReply(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsConcurrentRequest(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx > 1 && nThreads > 1) {
+            JSONRPCExecConcurrently(vReq, reqIdx, nEnd, std::min<size_t>(nThreads, nEnd - reqIdx), vReply);
+            reqIdx = nEnd;
+        } else {
+            vReply[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+        }
+    }
 
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < vReply.size(); i++)
+        ret.push_back(vReply[i]);
     return ret.write() + "\n";
 }
 
@@ -862,7 +1028,8 @@ UniValue get_async_result(std::string sOpID)
     return oResult;
 }
 
-UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+/** Look up a method and check it may be called now. Throws the JSON-RPC error otherwise. */
+static const CRPCCommand* FindAllowedCommand(const std::string& strMethod)
 {
     const CRPCCommand *pcmd = tableRPC[strMethod];
     if (fRPCNeedUnlocked) {
@@ -899,10 +1066,16 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
               throw JSONRPCError(RPC_BUILDING_WITNESS_CACHE, "RPC Interface disabled while builing witness cache. Check the debug.log for progress.");
 
     }
+    return pcmd;
+}
 
+UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+{
+    const CRPCCommand *pcmd = FindAllowedCommand(strMethod);
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    CRPCCallTimer timer(pcmd->name);
     try
     {
         // Execute
@@ -921,6 +1094,7 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
           }
         }
 
+        timer.fSuccess = true;
         return oResult;
     }
     catch (const std::exception& e)
@@ -931,6 +1105,169 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+namespace {
+
+struct CRPCStreamCommand
+{
+    const char* name;
+    rpcstreamfn_type actor;
+};
+
+/**
+ * Methods that can write their result piecewise, for replies too large to be
+ * built whole. The streaming variant may decline a call (e.g. for the short
+ * forms of getblock), which then runs as usual.
+ */
+const CRPCStreamCommand vRPCStreamCommands[] =
+{ //  name                        actor
+    { "getaddressdeltas",         &getaddressdeltas_stream  },
+    { "getblock",                 &getblock_stream          },
+    { "getrawmempool",            &getrawmempool_stream     },
+};
+
+} // anon namespace
+
+void CRPCTable::executeStreamed(const std::string &strMethod, const UniValue &params, JSONStreamWriter& writer) const
+{
+    for (size_t i = 0; i < sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0]); i++) {
+        if (strMethod != vRPCStreamCommands[i].name)
+            continue;
+
+        const CRPCCommand *pcmd = FindAllowedCommand(strMethod);
+        g_rpcSignals.PreCommand(*pcmd);
+
+        CRPCCallTimer timer(pcmd->name);
+        try
+        {
+            if (vRPCStreamCommands[i].actor(params, writer)) {
+                timer.fSuccess = true;
+                return;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            throw JSONRPCError(RPC_MISC_ERROR, e.what());
+        }
+        timer.Discard();
+        break;
+    }
+
+    // Everything else is built whole, but still written out piecewise
+    writer.Value(execute(strMethod, params));
+}
+
+namespace {
+
+struct CRPCSchedule
+{
+    const char* name;
+    RPCWorkClass workClass;
+    bool fConcurrent;
+};
+
+/**
+ * Methods scheduled differently from the rest of their category. By default
+ * wallet methods run on the heavy pool, control methods on the admin pool and
+ * everything else on the quick pool; the blockchain, address index, network,
+ * mining, raw transaction, utility and disclosure methods are taken to only
+ * read state.
+ */
+const CRPCSchedule vRPCScheduleOverrides[] =
+{ //  name                        pool             concurrent
+    /* Scans of the whole chain state or address index */
+    { "coinsupply",               RPC_WORK_HEAVY,  true  },
+    { "getaddressbalance",        RPC_WORK_HEAVY,  true  },
+    { "getaddressdeltas",         RPC_WORK_HEAVY,  true  },
+    { "getaddresstxids",          RPC_WORK_HEAVY,  true  },
+    { "getaddressutxos",          RPC_WORK_HEAVY,  true  },
+    { "getsnapshot",              RPC_WORK_HEAVY,  true  },
+    { "gettxoutsetinfo",          RPC_WORK_HEAVY,  true  },
+    { "verifychain",              RPC_WORK_HEAVY,  true  },
+
+    /* Methods of read only categories that change state */
+    { "addnode",                  RPC_WORK_QUICK,  false },
+    { "clearbanned",              RPC_WORK_QUICK,  false },
+    { "disconnectnode",           RPC_WORK_QUICK,  false },
+    { "genminingCSV",             RPC_WORK_QUICK,  false },
+    { "getblocktemplate",         RPC_WORK_QUICK,  false },
+    { "invalidateblock",          RPC_WORK_ADMIN,  false },
+    { "kvupdate",                 RPC_WORK_QUICK,  false },
+    { "ping",                     RPC_WORK_QUICK,  false },
+    { "prioritisetransaction",    RPC_WORK_QUICK,  false },
+    { "reconsiderblock",          RPC_WORK_ADMIN,  false },
+    { "sendrawtransaction",       RPC_WORK_QUICK,  false },
+    { "setban",                   RPC_WORK_QUICK,  false },
+    { "submitblock",              RPC_WORK_QUICK,  false },
+
+    /* Status queries filed under control */
+    { "getinfo",                  RPC_WORK_QUICK,  true  },
+    { "getrpcstats",              RPC_WORK_QUICK,  true  },
+
+    /* Wallet methods that only read */
+    { "getbalance",               RPC_WORK_HEAVY,  true  },
+    { "getbalance64",             RPC_WORK_HEAVY,  true  },
+    { "getreceivedbyaddress",     RPC_WORK_HEAVY,  true  },
+    { "gettransaction",           RPC_WORK_HEAVY,  true  },
+    { "getunconfirmedbalance",    RPC_WORK_HEAVY,  true  },
+    { "getwalletinfo",            RPC_WORK_HEAVY,  true  },
+    { "listaddressgroupings",     RPC_WORK_HEAVY,  true  },
+    { "listreceivedbyaddress",    RPC_WORK_HEAVY,  true  },
+    { "listsinceblock",           RPC_WORK_HEAVY,  true  },
+    { "listtransactions",         RPC_WORK_HEAVY,  true  },
+    { "listunspent",              RPC_WORK_HEAVY,  true  },
+    { "z_getbalance",             RPC_WORK_HEAVY,  true  },
+    { "z_getbalances",            RPC_WORK_HEAVY,  true  },
+    { "z_getoperationstatus",     RPC_WORK_HEAVY,  true  },
+    { "z_gettotalbalance",        RPC_WORK_HEAVY,  true  },
+    { "z_listaddresses",          RPC_WORK_HEAVY,  true  },
+    { "z_listoperationids",       RPC_WORK_HEAVY,  true  },
+    { "z_listreceivedbyaddress",  RPC_WORK_HEAVY,  true  },
+};
+
+const CRPCSchedule* FindScheduleOverride(const std::string& name)
+{
+    for (size_t i = 0; i < sizeof(vRPCScheduleOverrides) / sizeof(vRPCScheduleOverrides[0]); i++) {
+        if (name == vRPCScheduleOverrides[i].name)
+            return &vRPCScheduleOverrides[i];
+    }
+    return NULL;
+}
+
+} // anon namespace
+
+RPCWorkClass CRPCTable::workClass(const std::string& name) const
+{
+    const CRPCSchedule* pschedule = FindScheduleOverride(name);
+    if (pschedule)
+        return pschedule->workClass;
+    const CRPCCommand* pcmd = (*this)[name];
+    if (!pcmd)
+        return RPC_WORK_QUICK;
+    if (pcmd->category == "wallet")
+        return RPC_WORK_HEAVY;
+    if (pcmd->category == "control" || pcmd->category == "hidden")
+        return RPC_WORK_ADMIN;
+    return RPC_WORK_QUICK;
+}
+
+bool CRPCTable::isConcurrent(const std::string& name) const
+{
+    const CRPCSchedule* pschedule = FindScheduleOverride(name);
+    if (pschedule)
+        return pschedule->fConcurrent;
+    const CRPCCommand* pcmd = (*this)[name];
+    if (!pcmd)
+        return false;
+    static const char* const readOnlyCategories[] = {
+        "addressindex", "blockchain", "disclosure", "mining", "network", "rawtransactions", "util"
+    };
+    for (size_t i = 0; i < sizeof(readOnlyCategories) / sizeof(readOnlyCategories[0]); i++) {
+        if (pcmd->category == readOnlyCategories[i])
+            return true;
+    }
+    return false;
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
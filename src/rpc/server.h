@@ -139,7 +139,21 @@ void RPCUnregisterTimerInterface(RPCTimerInterface *iface);
  */
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
+class JSONStreamWriter;
+
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp, const CPubKey& mypk);
+/** Writes the result of a method to a stream; returns false to have the call run by the plain method instead. */
+typedef bool(*rpcstreamfn_type)(const UniValue& params, JSONStreamWriter& writer);
+
+/** Worker pool a method runs on, see HTTPWorkClass. */
+enum RPCWorkClass {
+    RPC_WORK_QUICK,
+    RPC_WORK_HEAVY,
+    RPC_WORK_ADMIN,
+};
+
+/** -rpcbatchthreads default: threads running the read-only entries of one batch concurrently */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
 
 class CRPCCommand
 {
@@ -171,6 +185,13 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method, writing its result to a stream. Methods able to
+     * produce their result piecewise do so; others are executed as usual.
+     * @throws an exception (UniValue) when an error happens; output may
+     *         already have been written by then.
+     */
+    void executeStreamed(const std::string &method, const UniValue &params, JSONStreamWriter& writer) const;
 
     /**
      * Appends a CRPCCommand to the dispatch table.
@@ -184,6 +205,12 @@ public:
     * @returns List of registered commands.
     */
     std::vector<std::string> listCommands() const;
+
+    /** Worker pool a method is scheduled on: wallet and whole chain state scans, node control, or quick. */
+    RPCWorkClass workClass(const std::string& name) const;
+
+    /** Whether a method only reads state, so that batch entries calling it may run concurrently. */
+    bool isConcurrent(const std::string& name) const;
 };
 
 extern CRPCTable tableRPC;
@@ -221,11 +248,13 @@ extern UniValue getconnectioncount(const UniValue& params, bool fHelp, const CPu
 extern UniValue getaddressmempool(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getaddressutxos(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getaddressdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern bool getaddressdeltas_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue getaddresstxids(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getsnapshot(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getaddressbalance(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getpeerlist(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getpeerinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getblockdownloadinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue checknotarization(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getnotarypayinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue ping(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -424,13 +453,16 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp, const CPubKey&
 extern UniValue settxfee(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern bool getrawmempool_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockdeltas(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockhash(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblockheader(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getlastsegidstakes(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getblock(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern bool getblock_stream(const UniValue& params, JSONStreamWriter& writer);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp, const CPubKey& mypk);
+extern UniValue getdbstats(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue gettxout(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue verifychain(const UniValue& params, bool fHelp, const CPubKey& mypk);
 extern UniValue getchaintips(const UniValue& params, bool fHelp, const CPubKey& mypk);
@@ -0,0 +1,126 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "saltedhashindex.h"
+
+#include "hash.h"
+#include "memusage.h"
+#include "primitives/transaction.h"
+#include "random.h"
+
+#include <algorithm>
+#include <assert.h>
+
+/** Smallest table allocated; it grows past half full and shrinks below an eighth */
+static const size_t MIN_SLOTS = 16;
+
+static void XorInto(uint256& digest, const uint256& pairHash)
+{
+    unsigned char* p = digest.begin();
+    const unsigned char* q = pairHash.begin();
+    for (size_t i = 0; i < digest.size(); i++)
+        p[i] ^= q[i];
+}
+
+void CSaltedHashIndex::Summary::Add(const uint256& key, const uint256& txid)
+{
+    XorInto(digest, Hash(key.begin(), key.end(), txid.begin(), txid.end()));
+    nCount++;
+}
+
+void CSaltedHashIndex::Summary::Remove(const uint256& key, const uint256& txid)
+{
+    XorInto(digest, Hash(key.begin(), key.end(), txid.begin(), txid.end()));
+    nCount--;
+}
+
+CSaltedHashIndex::CSaltedHashIndex() : nSize(0), salt(GetRandHash()) {}
+
+size_t CSaltedHashIndex::FindSlot(const uint256& key) const
+{
+    size_t mask = vSlots.size() - 1;
+    size_t i = Bucket(key);
+    while (vSlots[i].ptx != NULL && vSlots[i].key != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+void CSaltedHashIndex::Resize(size_t nSlots)
+{
+    std::vector<Slot> vOld(nSlots);
+    vOld.swap(vSlots);
+    for (const Slot& slot : vOld) {
+        if (slot.ptx != NULL)
+            vSlots[FindSlot(slot.key)] = slot;
+    }
+}
+
+const CTransaction* CSaltedHashIndex::find(const uint256& key) const
+{
+    if (vSlots.empty())
+        return NULL;
+    return vSlots[FindSlot(key)].ptx;
+}
+
+void CSaltedHashIndex::insert(const uint256& key, const CTransaction* ptx)
+{
+    assert(ptx != NULL);
+    if ((nSize + 1) * 2 > vSlots.size())
+        Resize(std::max(MIN_SLOTS, vSlots.size() * 2));
+
+    Slot& slot = vSlots[FindSlot(key)];
+    if (slot.ptx == NULL) {
+        slot.key = key;
+        nSize++;
+    } else {
+        summary.Remove(key, slot.ptx->GetHash());
+    }
+    slot.ptx = ptx;
+    summary.Add(key, ptx->GetHash());
+}
+
+bool CSaltedHashIndex::erase(const uint256& key)
+{
+    if (vSlots.empty())
+        return false;
+    size_t i = FindSlot(key);
+    if (vSlots[i].ptx == NULL)
+        return false;
+    summary.Remove(key, vSlots[i].ptx->GetHash());
+
+    // Close the hole at i: walk the rest of the cluster and move back every
+    // entry whose home bucket is not cyclically within (i, j], since a
+    // lookup for it would otherwise stop at the hole.
+    size_t mask = vSlots.size() - 1;
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (vSlots[j].ptx == NULL)
+            break;
+        size_t k = Bucket(vSlots[j].key);
+        bool fReachable = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!fReachable) {
+            vSlots[i] = vSlots[j];
+            i = j;
+        }
+    }
+    vSlots[i] = Slot();
+    nSize--;
+
+    if (vSlots.size() > MIN_SLOTS && nSize * 8 < vSlots.size())
+        Resize(vSlots.size() / 2);
+    return true;
+}
+
+void CSaltedHashIndex::clear()
+{
+    std::vector<Slot>().swap(vSlots);
+    nSize = 0;
+    summary = Summary();
+}
+
+size_t CSaltedHashIndex::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vSlots);
+}
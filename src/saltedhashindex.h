@@ -0,0 +1,78 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SALTEDHASHINDEX_H
+#define BITCOIN_SALTEDHASHINDEX_H
+
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+class CTransaction;
+
+/**
+ * A hash table from uint256 keys (nullifiers, proof hashes) to the mempool
+ * transaction holding them. Open addressing with linear probing keeps the
+ * entries in one flat array, and keys are hashed with a random salt per
+ * index so peers cannot line up collisions. Removal shifts the rest of the
+ * probe sequence back instead of leaving tombstones, so lookups stay short
+ * however much the pool churns.
+ */
+class CSaltedHashIndex
+{
+public:
+    /**
+     * Number of (key, txid) pairs and an order-independent digest of them,
+     * so two indexes, or an index and what it should hold, can be compared
+     * without walking either.
+     */
+    struct Summary {
+        uint64_t nCount;
+        uint256 digest;
+
+        Summary() : nCount(0) {}
+        void Add(const uint256& key, const uint256& txid);
+        void Remove(const uint256& key, const uint256& txid);
+        bool operator==(const Summary& other) const { return nCount == other.nCount && digest == other.digest; }
+    };
+
+private:
+    struct Slot {
+        uint256 key;
+        const CTransaction* ptx; //! NULL for an empty slot
+
+        Slot() : ptx(NULL) {}
+    };
+
+    std::vector<Slot> vSlots; //! empty, or a power of two in size
+    size_t nSize;
+    uint256 salt;
+    Summary summary;
+
+    size_t Bucket(const uint256& key) const { return key.GetHash(salt) & (vSlots.size() - 1); }
+    /** The slot holding key, or the empty slot where its probe sequence ends */
+    size_t FindSlot(const uint256& key) const;
+    void Resize(size_t nSlots);
+
+public:
+    CSaltedHashIndex();
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    size_t count(const uint256& key) const { return find(key) != NULL; }
+
+    /** The transaction holding key, or NULL */
+    const CTransaction* find(const uint256& key) const;
+    /** Map key to ptx, replacing any transaction it was mapped to */
+    void insert(const uint256& key, const CTransaction* ptx);
+    /** Remove key, returning whether it was present */
+    bool erase(const uint256& key);
+    void clear();
+
+    const Summary& GetSummary() const { return summary; }
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif // BITCOIN_SALTEDHASHINDEX_H
@@ -0,0 +1,848 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stratum.h"
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "crypto/common.h"
+#include "crypto/equihash.h"
+#include "init.h"
+#include "komodo_globals.h"
+#include "main.h"
+#include "miner.h"
+#include "netbase.h"
+#include "pow.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "util/strencodings.h"
+#include "utilmoneystr.h"
+#include "validationinterface.h"
+#include "version.h"
+#ifdef ENABLE_WALLET
+#include "wallet/wallet.h"
+#endif
+
+#include <deque>
+#include <map>
+#include <memory>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+
+#include <boost/thread.hpp>
+
+/** Jobs kept for late shares while the tip does not change; ids sort by age */
+static const size_t MAX_STRATUM_JOBS = 16;
+/** Longest request line accepted from a miner */
+static const size_t MAX_STRATUM_LINE = 16 * 1024;
+/** Shares waiting for a validation thread before new ones are turned away */
+static const size_t MAX_STRATUM_QUEUE = 1024;
+/** Unsent bytes a client may leave in its output buffer before it is disconnected */
+static const size_t MAX_STRATUM_SEND_BUFFER = 1024 * 1024;
+
+/** Stratum error codes, as used by the pools miners are written against */
+enum StratumErrorCode {
+    STRATUM_OTHER = 20,
+    STRATUM_JOB_NOT_FOUND = 21,
+    STRATUM_DUPLICATE_SHARE = 22,
+    STRATUM_LOW_DIFFICULTY = 23,
+    STRATUM_UNAUTHORIZED = 24,
+    STRATUM_NOT_SUBSCRIBED = 25,
+};
+
+static std::string HexLE32(uint32_t n)
+{
+    unsigned char buf[4];
+    WriteLE32(buf, n);
+    return HexStr(buf, buf + sizeof(buf));
+}
+
+CStratumJob::CStratumJob(const std::string& strIdIn, const CBlock& blockIn, int nHeightIn, CAmount nFeesIn) :
+    strId(strIdIn), block(blockIn), nHeight(nHeightIn), nFees(nFeesIn),
+    hashTarget(arith_uint256().SetCompact(blockIn.nBits)), notifyParams(UniValue::VARR)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block.nVersion << block.hashPrevBlock << block.hashMerkleRoot << block.hashFinalSaplingRoot;
+    vInputPrefix.assign(ss.begin(), ss.end());
+
+    // Header fields go out in their serialized byte order
+    notifyParams.push_back(strId);
+    notifyParams.push_back(HexLE32(block.nVersion));
+    notifyParams.push_back(HexStr(block.hashPrevBlock.begin(), block.hashPrevBlock.end()));
+    notifyParams.push_back(HexStr(block.hashMerkleRoot.begin(), block.hashMerkleRoot.end()));
+    notifyParams.push_back(HexStr(block.hashFinalSaplingRoot.begin(), block.hashFinalSaplingRoot.end()));
+    notifyParams.push_back(HexLE32(block.nTime));
+    notifyParams.push_back(HexLE32(block.nBits));
+}
+
+UniValue CStratumJob::GetNotifyParams(bool fCleanJobs) const
+{
+    UniValue params = notifyParams;
+    params.push_back(fCleanJobs);
+    return params;
+}
+
+bool CStratumJob::GetSubmittedHeader(const std::vector<unsigned char>& vNonce1, const UniValue& params,
+                                     CBlockHeader& header, std::string& strError) const
+{
+    if (params.size() < 5 || !params[2].isStr() || !params[3].isStr() || !params[4].isStr()) {
+        strError = "Invalid parameters";
+        return false;
+    }
+    const std::string& strTime = params[2].get_str();
+    const std::string& strNonce2 = params[3].get_str();
+    const std::string& strSolution = params[4].get_str();
+
+    if (strTime.size() != 8 || !IsHex(strTime)) {
+        strError = "Invalid time";
+        return false;
+    }
+    if (vNonce1.size() > header.nNonce.size() ||
+        strNonce2.size() != 2 * (header.nNonce.size() - vNonce1.size()) || !IsHex(strNonce2)) {
+        strError = "Invalid nonce2 length";
+        return false;
+    }
+    if (!IsHex(strSolution)) {
+        strError = "Invalid solution";
+        return false;
+    }
+
+    header = block.GetBlockHeader();
+    std::vector<unsigned char> vTime = ParseHex(strTime);
+    header.nTime = ReadLE32(vTime.data());
+    std::vector<unsigned char> vNonce2 = ParseHex(strNonce2);
+    std::copy(vNonce1.begin(), vNonce1.end(), header.nNonce.begin());
+    std::copy(vNonce2.begin(), vNonce2.end(), header.nNonce.begin() + vNonce1.size());
+
+    // The solution is sent with its compact size prefix, as serialized
+    try {
+        CDataStream ss(ParseHex(strSolution), SER_NETWORK, PROTOCOL_VERSION);
+        ss >> header.nSolution;
+        if (!ss.empty()) {
+            strError = "Invalid solution";
+            return false;
+        }
+    } catch (const std::exception&) {
+        strError = "Invalid solution";
+        return false;
+    }
+    return true;
+}
+
+bool CStratumJob::CheckSolution(const CBlockHeader& header) const
+{
+    // I = the block header minus nonce and solution, then V = the nonce
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.write((const char*)vInputPrefix.data(), vInputPrefix.size());
+    ss << header.nTime << header.nBits << header.nNonce;
+
+    unsigned int n = Params().EquihashN();
+    unsigned int k = Params().EquihashK();
+    bool isValid = false;
+    EhIsValidSolutionForInput(n, k, (unsigned char*)&ss[0], ss.size(), header.nSolution, isValid);
+    return isValid;
+}
+
+bool CStratumJob::AddShare(const uint256& hash)
+{
+    LOCK(cs);
+    if (setShares.size() >= MAX_STRATUM_JOB_SHARES)
+        return false;
+    return setShares.insert(hash).second;
+}
+
+size_t CStratumJob::GetShareCount() const
+{
+    LOCK(cs);
+    return setShares.size();
+}
+
+CBlock CStratumJob::GetBlock(const CBlockHeader& header) const
+{
+    CBlock blockOut = block;
+    blockOut.nTime = header.nTime;
+    blockOut.nNonce = header.nNonce;
+    blockOut.nSolution = header.nSolution;
+    return blockOut;
+}
+
+/** A miner connected to the stratum server; only touched on the event thread */
+struct StratumClient
+{
+    int64_t nId;
+    struct bufferevent* bev;
+    CService addr;
+    std::vector<unsigned char> vNonce1;
+    bool fSubscribed;
+    bool fAuthorized;
+    //! Set once the client stopped reading; it is closed by the callback that wrote to it
+    bool fDisconnect;
+};
+
+/** A submitted share waiting for a validation thread */
+struct StratumShare
+{
+    int64_t nClientId;
+    UniValue id;
+    std::shared_ptr<CStratumJob> job;
+    CBlockHeader header;
+};
+
+/** Stratum server state */
+
+//! libevent event loop, run by threadStratum
+static struct event_base* eventBase = 0;
+//! Fired to write out lines queued by the other threads
+static struct event* eventSend = 0;
+static std::vector<struct evconnlistener*> vListeners;
+static std::vector<CSubNet> vAllowedSubnets;
+static boost::thread threadStratum;
+static boost::thread threadStratumJobs;
+static boost::thread_group threadsStratumShares;
+
+//! Event thread only
+static std::map<int64_t, StratumClient*> mapClients;
+static int64_t nLastClientId = 0;
+
+/** Guards the jobs and the lines waiting for the event thread */
+static CCriticalSection cs_stratum;
+static std::map<std::string, std::shared_ptr<CStratumJob> > mapJobs;
+static std::shared_ptr<CStratumJob> currentJob;
+static uint64_t nLastJobId = 0;
+//! Lines to write, by client id; 0 sends to every subscribed client
+static std::vector<std::pair<int64_t, std::string> > vPendingSends;
+
+/** Wakes the job thread on a new tip */
+static CWaitableCriticalSection csJobSignal;
+static CConditionVariable cvJobSignal;
+static bool fJobsRunning = false;
+static bool fNewTip = false;
+static boost::signals2::connection connNotifyBlockTip;
+
+/** Shares waiting for validation */
+static CWaitableCriticalSection csShares;
+static CConditionVariable cvShares;
+static std::deque<StratumShare> queueShares;
+static bool fSharesRunning = false;
+
+#ifdef ENABLE_WALLET
+/** Key the coinbase pays to, kept once a block using it is accepted */
+static CCriticalSection cs_stratumKey;
+static CReserveKey* pStratumReserveKey = NULL;
+#endif
+
+static bool ClientAllowed(const CNetAddr& netaddr)
+{
+    if (!netaddr.IsValid())
+        return false;
+    for (const CSubNet& subnet : vAllowedSubnets)
+        if (subnet.Match(netaddr))
+            return true;
+    return false;
+}
+
+/** Initialize ACL list for the stratum server, like the one for RPC */
+static bool InitStratumAllowList()
+{
+    vAllowedSubnets.clear();
+    CNetAddr localv4;
+    CNetAddr localv6;
+    LookupHost("127.0.0.1", localv4, false);
+    LookupHost("::1", localv6, false);
+    vAllowedSubnets.push_back(CSubNet(localv4, 8));      // always allow IPv4 local subnet
+    vAllowedSubnets.push_back(CSubNet(localv6));         // always allow IPv6 localhost
+    for (const std::string& strAllow : mapMultiArgs["-stratumallowip"]) {
+        CSubNet subnet;
+        LookupSubNet(strAllow.c_str(), subnet);
+        if (!subnet.IsValid()) {
+            LogPrintf("Invalid -stratumallowip subnet specification: %s\n", strAllow);
+            return false;
+        }
+        vAllowedSubnets.push_back(subnet);
+    }
+    return true;
+}
+
+static std::string JSONLine(const UniValue& obj)
+{
+    return obj.write() + "\n";
+}
+
+static std::string StratumReply(const UniValue& id, const UniValue& result, const UniValue& error)
+{
+    UniValue reply(UniValue::VOBJ);
+    reply.push_back(Pair("id", id));
+    reply.push_back(Pair("result", result));
+    reply.push_back(Pair("error", error));
+    return JSONLine(reply);
+}
+
+static std::string StratumError(const UniValue& id, StratumErrorCode code, const std::string& strMessage)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back((int)code);
+    error.push_back(strMessage);
+    error.push_back(NullUniValue);
+    return StratumReply(id, NullUniValue, error);
+}
+
+static std::string StratumNotification(const std::string& strMethod, const UniValue& params)
+{
+    UniValue notification(UniValue::VOBJ);
+    notification.push_back(Pair("id", NullUniValue));
+    notification.push_back(Pair("method", strMethod));
+    notification.push_back(Pair("params", params));
+    return JSONLine(notification);
+}
+
+static std::string SetTargetNotification(const CStratumJob& job)
+{
+    UniValue params(UniValue::VARR);
+    params.push_back(job.hashTarget.GetHex());
+    return StratumNotification("mining.set_target", params);
+}
+
+/** Hand a line to the event thread for writing; nClientId 0 sends it to every subscribed client */
+static void QueueSend(int64_t nClientId, const std::string& strLine)
+{
+    LOCK(cs_stratum);
+    if (!eventSend)
+        return;
+    vPendingSends.push_back(std::make_pair(nClientId, strLine));
+    event_active(eventSend, 0, 0);
+}
+
+static void ClientWrite(StratumClient* client, const std::string& strLine)
+{
+    if (client->fDisconnect)
+        return;
+    if (evbuffer_get_length(bufferevent_get_output(client->bev)) + strLine.size() > MAX_STRATUM_SEND_BUFFER) {
+        LogPrint("stratum", "stratum: %s is not reading its replies\n", client->addr.ToString());
+        client->fDisconnect = true;
+        return;
+    }
+    bufferevent_write(client->bev, strLine.data(), strLine.size());
+}
+
+static void CloseClient(StratumClient* client)
+{
+    LogPrint("stratum", "stratum: %s disconnected\n", client->addr.ToString());
+    mapClients.erase(client->nId);
+    bufferevent_free(client->bev);
+    delete client;
+}
+
+static void stratum_send_cb(evutil_socket_t, short, void*)
+{
+    std::vector<std::pair<int64_t, std::string> > vSends;
+    {
+        LOCK(cs_stratum);
+        vSends.swap(vPendingSends);
+    }
+    for (const std::pair<int64_t, std::string>& send : vSends) {
+        if (send.first == 0) {
+            for (const std::pair<const int64_t, StratumClient*>& item : mapClients)
+                if (item.second->fSubscribed)
+                    ClientWrite(item.second, send.second);
+        } else {
+            std::map<int64_t, StratumClient*>::iterator it = mapClients.find(send.first);
+            if (it != mapClients.end())
+                ClientWrite(it->second, send.second);
+        }
+    }
+    std::vector<StratumClient*> vClose;
+    for (const std::pair<const int64_t, StratumClient*>& item : mapClients)
+        if (item.second->fDisconnect)
+            vClose.push_back(item.second);
+    for (StratumClient* client : vClose)
+        CloseClient(client);
+}
+
+static void HandleSubmit(StratumClient* client, const UniValue& id, const UniValue& params)
+{
+    if (!client->fSubscribed) {
+        ClientWrite(client, StratumError(id, STRATUM_NOT_SUBSCRIBED, "Not subscribed"));
+        return;
+    }
+    if (!client->fAuthorized) {
+        ClientWrite(client, StratumError(id, STRATUM_UNAUTHORIZED, "Unauthorized worker"));
+        return;
+    }
+    if (params.size() < 2 || !params[1].isStr()) {
+        ClientWrite(client, StratumError(id, STRATUM_OTHER, "Invalid parameters"));
+        return;
+    }
+
+    std::shared_ptr<CStratumJob> job;
+    {
+        LOCK(cs_stratum);
+        std::map<std::string, std::shared_ptr<CStratumJob> >::iterator it = mapJobs.find(params[1].get_str());
+        if (it != mapJobs.end())
+            job = it->second;
+    }
+    if (!job) {
+        ClientWrite(client, StratumError(id, STRATUM_JOB_NOT_FOUND, "Job not found"));
+        return;
+    }
+
+    StratumShare share;
+    std::string strError;
+    if (!job->GetSubmittedHeader(client->vNonce1, params, share.header, strError)) {
+        ClientWrite(client, StratumError(id, STRATUM_OTHER, strError));
+        return;
+    }
+    if (!job->AddShare(share.header.GetHash())) {
+        if (job->GetShareCount() >= MAX_STRATUM_JOB_SHARES)
+            ClientWrite(client, StratumError(id, STRATUM_OTHER, "Too many shares for job"));
+        else
+            ClientWrite(client, StratumError(id, STRATUM_DUPLICATE_SHARE, "Duplicate share"));
+        return;
+    }
+
+    share.nClientId = client->nId;
+    share.id = id;
+    share.job = job;
+    {
+        boost::unique_lock<boost::mutex> lock(csShares);
+        if (queueShares.size() >= MAX_STRATUM_QUEUE) {
+            ClientWrite(client, StratumError(id, STRATUM_OTHER, "Server busy"));
+            return;
+        }
+        queueShares.push_back(share);
+    }
+    cvShares.notify_one();
+}
+
+static void HandleLine(StratumClient* client, const std::string& strLine)
+{
+    UniValue request;
+    if (!request.read(strLine) || !request.isObject()) {
+        LogPrint("stratum", "stratum: malformed request from %s\n", client->addr.ToString());
+        return;
+    }
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+    if (!method.isStr()) {
+        ClientWrite(client, StratumError(id, STRATUM_OTHER, "Invalid request"));
+        return;
+    }
+    const std::string& strMethod = method.get_str();
+    UniValue emptyParams(UniValue::VARR);
+    const UniValue& vParams = params.isArray() ? params : emptyParams;
+
+    if (strMethod == "mining.subscribe") {
+        UniValue result(UniValue::VARR);
+        result.push_back(strprintf("%x", client->nId));
+        result.push_back(HexStr(client->vNonce1));
+        ClientWrite(client, StratumReply(id, result, NullUniValue));
+        client->fSubscribed = true;
+
+        std::shared_ptr<CStratumJob> job;
+        {
+            LOCK(cs_stratum);
+            job = currentJob;
+        }
+        if (job) {
+            ClientWrite(client, SetTargetNotification(*job));
+            ClientWrite(client, StratumNotification("mining.notify", job->GetNotifyParams(true)));
+        }
+    } else if (strMethod == "mining.authorize") {
+        // Who may mine is decided by -stratumallowip, any worker name is fine
+        client->fAuthorized = true;
+        ClientWrite(client, StratumReply(id, true, NullUniValue));
+    } else if (strMethod == "mining.submit") {
+        HandleSubmit(client, id, vParams);
+    } else if (strMethod == "mining.extranonce.subscribe") {
+        ClientWrite(client, StratumReply(id, false, NullUniValue));
+    } else {
+        ClientWrite(client, StratumError(id, STRATUM_OTHER, "Method not found"));
+    }
+}
+
+static void stratum_read_cb(struct bufferevent* bev, void* ctx)
+{
+    StratumClient* client = static_cast<StratumClient*>(ctx);
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t len;
+    char* line;
+    while (!client->fDisconnect && (line = evbuffer_readln(input, &len, EVBUFFER_EOL_CRLF)) != NULL) {
+        std::string strLine(line, len);
+        free(line);
+        if (!strLine.empty())
+            HandleLine(client, strLine);
+    }
+    if (client->fDisconnect) {
+        CloseClient(client);
+    } else if (evbuffer_get_length(input) > MAX_STRATUM_LINE) {
+        LogPrint("stratum", "stratum: request line from %s too long\n", client->addr.ToString());
+        CloseClient(client);
+    }
+}
+
+static void stratum_event_cb(struct bufferevent* bev, short events, void* ctx)
+{
+    if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+        CloseClient(static_cast<StratumClient*>(ctx));
+}
+
+static void stratum_accept_cb(struct evconnlistener* listener, evutil_socket_t fd,
+                              struct sockaddr* address, int socklen, void*)
+{
+    CService addr;
+    if (!addr.SetSockAddr(address) || !ClientAllowed(addr)) {
+        LogPrint("stratum", "stratum: rejected connection from %s\n", addr.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+
+    StratumClient* client = new StratumClient();
+    client->nId = ++nLastClientId;
+    client->addr = addr;
+    client->fSubscribed = false;
+    client->fAuthorized = false;
+    client->fDisconnect = false;
+    // Sessions get distinct nonce prefixes so their search spaces never overlap
+    client->vNonce1.resize(STRATUM_NONCE1_SIZE);
+    WriteLE32(client->vNonce1.data(), (uint32_t)client->nId);
+    client->bev = bufferevent_socket_new(evconnlistener_get_base(listener), fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!client->bev) {
+        evutil_closesocket(fd);
+        delete client;
+        return;
+    }
+    bufferevent_setcb(client->bev, stratum_read_cb, NULL, stratum_event_cb, client);
+    bufferevent_enable(client->bev, EV_READ | EV_WRITE);
+    mapClients[client->nId] = client;
+    LogPrint("stratum", "stratum: %s connected\n", addr.ToString());
+}
+
+/** Validate shares off the event thread, submitting the ones that solve a block */
+static void ThreadStratumShares()
+{
+    RenameThread("zcash-stratumshare");
+    while (true) {
+        StratumShare share;
+        {
+            boost::unique_lock<boost::mutex> lock(csShares);
+            while (fSharesRunning && queueShares.empty())
+                cvShares.wait(lock);
+            if (!fSharesRunning)
+                break;
+            share = queueShares.front();
+            queueShares.pop_front();
+        }
+
+        // The target check is a hash compare, so only shares that pass it
+        // pay for the Equihash check
+        uint256 hash = share.header.GetHash();
+        if (UintToArith256(hash) > share.job->hashTarget) {
+            QueueSend(share.nClientId, StratumError(share.id, STRATUM_LOW_DIFFICULTY, "Low difficulty share"));
+            continue;
+        }
+        if (!share.job->CheckSolution(share.header)) {
+            QueueSend(share.nClientId, StratumError(share.id, STRATUM_OTHER, "Invalid solution"));
+            continue;
+        }
+
+        CBlock block = share.job->GetBlock(share.header);
+        LogPrintf("stratum: block %s found for job %s at height %d\n", hash.GetHex(), share.job->strId, share.job->nHeight);
+        CValidationState state;
+        AddVerifiedEquihashSolution(hash);
+        bool fAccepted = ProcessNewBlock(1, share.job->nHeight, state, NULL, &block, true, NULL);
+        ForgetVerifiedEquihashSolution(hash);
+        if (!fAccepted) {
+            LogPrintf("stratum: block %s rejected: %s\n", hash.GetHex(), state.GetRejectReason());
+            QueueSend(share.nClientId, StratumError(share.id, STRATUM_OTHER, "Block rejected: " + state.GetRejectReason()));
+            continue;
+        }
+#ifdef ENABLE_WALLET
+        {
+            LOCK(cs_stratumKey);
+            if (pStratumReserveKey)
+                pStratumReserveKey->KeepKey();
+        }
+#endif
+        QueueSend(share.nClientId, StratumReply(share.id, true, NullUniValue));
+    }
+}
+
+static std::shared_ptr<CStratumJob> CreateStratumJob(int nHeight)
+{
+#ifdef ENABLE_WALLET
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    {
+        LOCK(cs_stratumKey);
+        pblocktemplate.reset(CreateNewBlockWithKey(*pStratumReserveKey, nHeight, KOMODO_MAXGPUCOUNT, false));
+    }
+#else
+    std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey());
+#endif
+    if (!pblocktemplate)
+        return std::shared_ptr<CStratumJob>();
+
+    CBlock& block = pblocktemplate->block;
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    block.nNonce = uint256();
+    block.nSolution.clear();
+
+    LOCK(cs_stratum);
+    std::string strId = strprintf("%08x", ++nLastJobId);
+    return std::make_shared<CStratumJob>(strId, block, nHeight, -pblocktemplate->vTxFees[0]);
+}
+
+static void StratumNotifyBlockTip(bool fInitialDownload, const CBlockIndex* pindexNew)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csJobSignal);
+        fNewTip = true;
+    }
+    cvJobSignal.notify_all();
+}
+
+/**
+ * Build jobs and push them to the miners: at once on a new tip, and when
+ * the mempool has changed since the last job and a new template collects
+ * more fees.
+ */
+static void ThreadStratumJobs()
+{
+    RenameThread("zcash-stratumjobs");
+    const int64_t nInterval = std::max((int64_t)GetArg("-stratumjobinterval", DEFAULT_STRATUM_JOB_INTERVAL), (int64_t)1);
+    uint256 hashLastTip;
+    unsigned int nTransactionsUpdatedLast = 0;
+
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(csJobSignal);
+            if (fJobsRunning && !fNewTip)
+                cvJobSignal.timed_wait(lock, boost::posix_time::seconds(nInterval));
+            if (!fJobsRunning)
+                break;
+            fNewTip = false;
+        }
+
+        if (IsInitialBlockDownload())
+            continue;
+        uint256 hashTip;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            hashTip = chainActive.Tip()->GetBlockHash();
+            nHeight = chainActive.Height() + 1;
+        }
+        bool fClean = hashTip != hashLastTip;
+        if (!fClean && mempool.GetTransactionsUpdated() == nTransactionsUpdatedLast)
+            continue;
+
+        unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+        std::shared_ptr<CStratumJob> job = CreateStratumJob(nHeight);
+        if (!job) {
+            LogPrintf("stratum: could not create a block template\n");
+            continue;
+        }
+        if (job->block.hashPrevBlock != hashTip) {
+            // The tip moved while building; the signal for it is pending
+            continue;
+        }
+        nTransactionsUpdatedLast = nTransactionsUpdated;
+
+        {
+            LOCK(cs_stratum);
+            if (!fClean && currentJob && job->nFees <= currentJob->nFees)
+                continue;
+            if (fClean)
+                mapJobs.clear();
+            while (mapJobs.size() >= MAX_STRATUM_JOBS)
+                mapJobs.erase(mapJobs.begin());
+            mapJobs[job->strId] = job;
+            bool fNewTarget = !currentJob || currentJob->hashTarget != job->hashTarget;
+            currentJob = job;
+            if (fNewTarget)
+                vPendingSends.push_back(std::make_pair((int64_t)0, SetTargetNotification(*job)));
+            vPendingSends.push_back(std::make_pair((int64_t)0, StratumNotification("mining.notify", job->GetNotifyParams(fClean))));
+            if (eventSend)
+                event_active(eventSend, 0, 0);
+        }
+        hashLastTip = hashTip;
+        LogPrint("stratum", "stratum: job %s at height %d with %s fees%s\n", job->strId, nHeight,
+                 FormatMoney(job->nFees), fClean ? ", new tip" : "");
+    }
+}
+
+/** Event dispatcher thread */
+static void ThreadStratum(struct event_base* base)
+{
+    RenameThread("zcash-stratum");
+    LogPrint("stratum", "Entering stratum event loop\n");
+    event_base_dispatch(base);
+    // Event loop will be interrupted by StopStratumServer()
+    LogPrint("stratum", "Exited stratum event loop\n");
+}
+
+/** Bind the stratum server to the -stratumbind addresses, or loopback */
+static bool StratumBindAddresses(struct event_base* base)
+{
+    int defaultPort = GetArg("-stratumport", DEFAULT_STRATUM_PORT);
+    std::vector<std::pair<std::string, int> > endpoints;
+
+    if (!mapArgs.count("-stratumallowip")) { // Default to loopback if not allowing external IPs
+        endpoints.push_back(std::make_pair("::1", defaultPort));
+        endpoints.push_back(std::make_pair("127.0.0.1", defaultPort));
+        if (mapArgs.count("-stratumbind")) {
+            LogPrintf("WARNING: option -stratumbind was ignored because -stratumallowip was not specified, refusing to allow everyone to connect\n");
+        }
+    } else if (mapArgs.count("-stratumbind")) {
+        for (const std::string& strBind : mapMultiArgs["-stratumbind"]) {
+            int port = defaultPort;
+            std::string host;
+            SplitHostPort(strBind, port, host);
+            endpoints.push_back(std::make_pair(host, port));
+        }
+    } else {
+        endpoints.push_back(std::make_pair("::", defaultPort));
+        endpoints.push_back(std::make_pair("0.0.0.0", defaultPort));
+    }
+
+    for (const std::pair<std::string, int>& endpoint : endpoints) {
+        CService addrBind;
+        if (!Lookup(endpoint.first.c_str(), addrBind, endpoint.second, false)) {
+            LogPrintf("Could not resolve stratum bind address %s\n", endpoint.first);
+            continue;
+        }
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!addrBind.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+            continue;
+        LogPrint("stratum", "Binding stratum on address %s\n", addrBind.ToString());
+        struct evconnlistener* listener = evconnlistener_new_bind(base, stratum_accept_cb, NULL,
+            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sockaddr, len);
+        if (listener) {
+            vListeners.push_back(listener);
+        } else {
+            LogPrintf("Binding stratum on address %s failed.\n", addrBind.ToString());
+        }
+    }
+    return !vListeners.empty();
+}
+
+bool StartStratumServer()
+{
+    if (!GetBoolArg("-stratum", false))
+        return true;
+    if (ASSETCHAINS_ALGO != ASSETCHAINS_EQUIHASH) {
+        LogPrintf("The stratum server only serves Equihash chains\n");
+        return false;
+    }
+#ifdef ENABLE_WALLET
+    if (!pwalletMain && GetArg("-mineraddress", "").empty()) {
+        LogPrintf("The stratum server needs a wallet or -mineraddress to pay the coinbase to\n");
+        return false;
+    }
+#endif
+    if (!InitStratumAllowList())
+        return false;
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    struct event_base* base = event_base_new();
+    if (!base) {
+        LogPrintf("Couldn't create an event_base for the stratum server\n");
+        return false;
+    }
+    if (!StratumBindAddresses(base)) {
+        LogPrintf("Unable to bind any endpoint for the stratum server\n");
+        event_base_free(base);
+        return false;
+    }
+
+#ifdef ENABLE_WALLET
+    pStratumReserveKey = new CReserveKey(pwalletMain);
+#endif
+    {
+        LOCK(cs_stratum);
+        eventBase = base;
+        eventSend = event_new(base, -1, 0, stratum_send_cb, NULL);
+    }
+    threadStratum = boost::thread(boost::bind(&ThreadStratum, base));
+
+    fSharesRunning = true;
+    int nThreads = std::max((int)GetArg("-stratumthreads", DEFAULT_STRATUM_THREADS), 1);
+    for (int i = 0; i < nThreads; i++)
+        threadsStratumShares.create_thread(&ThreadStratumShares);
+
+    fJobsRunning = true;
+    fNewTip = true;
+    connNotifyBlockTip = uiInterface.NotifyBlockTip.connect(&StratumNotifyBlockTip);
+    threadStratumJobs = boost::thread(&ThreadStratumJobs);
+
+    LogPrintf("Stratum server started with %d share validation threads\n", nThreads);
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (!eventBase)
+        return;
+    LogPrint("stratum", "Interrupting stratum server\n");
+    for (struct evconnlistener* listener : vListeners)
+        evconnlistener_disable(listener);
+    {
+        boost::unique_lock<boost::mutex> lock(csJobSignal);
+        fJobsRunning = false;
+    }
+    cvJobSignal.notify_all();
+    {
+        boost::unique_lock<boost::mutex> lock(csShares);
+        fSharesRunning = false;
+    }
+    cvShares.notify_all();
+}
+
+void StopStratumServer()
+{
+    if (!eventBase)
+        return;
+    InterruptStratumServer();
+    LogPrint("stratum", "Stopping stratum server\n");
+    connNotifyBlockTip.disconnect();
+    threadStratumJobs.join();
+    threadsStratumShares.join_all();
+    queueShares.clear();
+
+    event_base_loopbreak(eventBase);
+    threadStratum.join();
+    for (struct evconnlistener* listener : vListeners)
+        evconnlistener_free(listener);
+    vListeners.clear();
+    while (!mapClients.empty())
+        CloseClient(mapClients.begin()->second);
+    {
+        LOCK(cs_stratum);
+        event_free(eventSend);
+        eventSend = 0;
+        vPendingSends.clear();
+        mapJobs.clear();
+        currentJob.reset();
+    }
+    event_base_free(eventBase);
+    eventBase = 0;
+#ifdef ENABLE_WALLET
+    {
+        LOCK(cs_stratumKey);
+        delete pStratumReserveKey;
+        pStratumReserveKey = NULL;
+    }
+#endif
+    LogPrint("stratum", "Stopped stratum server\n");
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_STRATUM_H
+#define BITCOIN_STRATUM_H
+
+#include "amount.h"
+#include "arith_uint256.h"
+#include "primitives/block.h"
+#include "sync.h"
+
+#include <univalue.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+static const int DEFAULT_STRATUM_PORT = 3333;
+static const int DEFAULT_STRATUM_THREADS = 2;
+static const int DEFAULT_STRATUM_JOB_INTERVAL = 5;
+/** Bytes of the 32 byte header nonce the server assigns to each session (NONCE_1) */
+static const size_t STRATUM_NONCE1_SIZE = 4;
+/** Shares a job records for duplicate detection before it turns further ones away */
+static const size_t MAX_STRATUM_JOB_SHARES = 16384;
+
+/**
+ * A block template handed out to stratum miners as a mining.notify job.
+ * Everything a miner cannot change is serialized once when the job is
+ * built, so checking a share only appends the time, bits and nonce the
+ * miner sent to that prefix.
+ */
+class CStratumJob
+{
+public:
+    const std::string strId;
+    //! Template with the coinbase and merkle root set; nonce and solution empty
+    const CBlock block;
+    const int nHeight;
+    //! Transaction fees the template collects
+    const CAmount nFees;
+    const arith_uint256 hashTarget;
+
+    CStratumJob(const std::string& strIdIn, const CBlock& blockIn, int nHeightIn, CAmount nFeesIn);
+
+    /** The mining.notify params of this job */
+    UniValue GetNotifyParams(bool fCleanJobs) const;
+
+    /**
+     * Fill in the template header from the [WORKER_NAME, JOB_ID, TIME,
+     * NONCE_2, EQUIHASH_SOLUTION] params of a mining.submit request for the
+     * session with nonce1. Returns false with strError set if they are
+     * malformed.
+     */
+    bool GetSubmittedHeader(const std::vector<unsigned char>& vNonce1, const UniValue& params,
+                            CBlockHeader& header, std::string& strError) const;
+
+    /** Whether the Equihash solution of a header filled in from this job is valid */
+    bool CheckSolution(const CBlockHeader& header) const;
+
+    /**
+     * Record a share by header hash; false if it was submitted before or
+     * the job already holds MAX_STRATUM_JOB_SHARES
+     */
+    bool AddShare(const uint256& hash);
+    size_t GetShareCount() const;
+
+    /** The template with the nonce and solution of header filled in */
+    CBlock GetBlock(const CBlockHeader& header) const;
+
+private:
+    //! Serialized nVersion, hashPrevBlock, hashMerkleRoot and hashFinalSaplingRoot
+    std::vector<unsigned char> vInputPrefix;
+    //! mining.notify params up to, not including, CLEAN_JOBS
+    UniValue notifyParams;
+
+    mutable CCriticalSection cs;
+    std::set<uint256> setShares;
+};
+
+/** Start the stratum server, if -stratum is set */
+bool StartStratumServer();
+/** Stop accepting connections and shares */
+void InterruptStratumServer();
+/** Stop the stratum server threads and close all sessions */
+void StopStratumServer();
+
+#endif // BITCOIN_STRATUM_H
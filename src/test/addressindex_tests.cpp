@@ -0,0 +1,209 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+static uint160 TestAddressHash(unsigned char c)
+{
+    std::vector<unsigned char> v(20, c);
+    return uint160(v);
+}
+
+BOOST_AUTO_TEST_CASE(address_balance_index)
+{
+    uint160 hashA = TestAddressHash(0xaa), hashB = TestAddressHash(0xbb);
+    uint256 txid1 = uint256S("01"), txid2 = uint256S("02");
+    CAddressBalanceValue value;
+
+    // block 1 pays A twice (one of them a zero-value output) and B once
+    std::vector<std::pair<CAddressIndexKey, CAmount> > block1;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent1;
+    block1.push_back(std::make_pair(CAddressIndexKey(1, hashA, 1, 0, txid1, 0, false), 5 * COIN));
+    block1.push_back(std::make_pair(CAddressIndexKey(1, hashA, 1, 0, txid1, 1, false), 0));
+    block1.push_back(std::make_pair(CAddressIndexKey(2, hashB, 1, 0, txid1, 2, false), 3 * COIN));
+    unspent1.push_back(std::make_pair(CAddressUnspentKey(1, hashA, txid1, 0), CAddressUnspentValue(5 * COIN, CScript(), 1)));
+    unspent1.push_back(std::make_pair(CAddressUnspentKey(1, hashA, txid1, 1), CAddressUnspentValue(0, CScript(), 1)));
+    unspent1.push_back(std::make_pair(CAddressUnspentKey(2, hashB, txid1, 2), CAddressUnspentValue(3 * COIN, CScript(), 1)));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(unspent1));
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block1, false));
+
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashA, 1, value));
+    BOOST_CHECK_EQUAL(value.balance, 5 * COIN);
+    BOOST_CHECK_EQUAL(value.utxos, 1);
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashB, 2, value));
+    BOOST_CHECK_EQUAL(value.balance, 3 * COIN);
+    BOOST_CHECK(!pblocktree->ReadAddressBalance(hashB, 1, value));
+
+    // block 2 moves B's coins to A
+    std::vector<std::pair<CAddressIndexKey, CAmount> > block2;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent2;
+    block2.push_back(std::make_pair(CAddressIndexKey(2, hashB, 2, 1, txid2, 0, true), -3 * COIN));
+    block2.push_back(std::make_pair(CAddressIndexKey(1, hashA, 2, 1, txid2, 0, false), 3 * COIN));
+    unspent2.push_back(std::make_pair(CAddressUnspentKey(2, hashB, txid1, 2), CAddressUnspentValue()));
+    unspent2.push_back(std::make_pair(CAddressUnspentKey(1, hashA, txid2, 0), CAddressUnspentValue(3 * COIN, CScript(), 2)));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(unspent2));
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block2, false));
+
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashA, 1, value));
+    BOOST_CHECK_EQUAL(value.balance, 8 * COIN);
+    BOOST_CHECK_EQUAL(value.utxos, 2);
+    BOOST_CHECK(!pblocktree->ReadAddressBalance(hashB, 2, value));
+
+    // rebuilding from the unspent index gives the same table
+    BOOST_CHECK(pblocktree->RebuildAddressBalanceIndex());
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashA, 1, value));
+    BOOST_CHECK_EQUAL(value.balance, 8 * COIN);
+    BOOST_CHECK_EQUAL(value.utxos, 2);
+    BOOST_CHECK(!pblocktree->ReadAddressBalance(hashB, 2, value));
+
+    // disconnecting block 2 restores B
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block2, true));
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashB, 2, value));
+    BOOST_CHECK_EQUAL(value.balance, 3 * COIN);
+    BOOST_CHECK_EQUAL(value.utxos, 1);
+
+    std::vector<std::pair<CAmount, std::string> > vTop;
+    BOOST_CHECK(pblocktree->Snapshot2(vTop, 1, NULL));
+    BOOST_CHECK_EQUAL(vTop.size(), 1);
+    BOOST_CHECK_EQUAL(vTop[0].first, 5 * COIN);
+    BOOST_CHECK(pblocktree->Snapshot2(vTop, 0, NULL));
+    BOOST_CHECK_EQUAL(vTop.size(), 2);
+    BOOST_CHECK_EQUAL(vTop[1].first, 3 * COIN);
+}
+
+/** A block index entry in mapBlockIndex, freed with the rest of it by UnloadBlockIndex */
+static CBlockIndex* AddTestBlockIndex(CBlockIndex* pprev)
+{
+    CBlockIndex* pindex = new CBlockIndex();
+    pindex->pprev = pprev;
+    pindex->nHeight = pprev ? pprev->nHeight + 1 : 0;
+    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(GetRandHash(), pindex)).first;
+    pindex->phashBlock = &mi->first;
+    pindex->BuildSkip();
+    return pindex;
+}
+
+BOOST_AUTO_TEST_CASE(address_balance_replay)
+{
+    uint160 hashA = TestAddressHash(0xaa), hashB = TestAddressHash(0xbb);
+    uint256 txid1 = uint256S("01"), txid2 = uint256S("02"), txid3 = uint256S("03"), txid4 = uint256S("04");
+    CBlockIndex* pindex0 = AddTestBlockIndex(NULL);
+    CBlockIndex* pindex1 = AddTestBlockIndex(pindex0);
+    CBlockIndex* pindex2 = AddTestBlockIndex(pindex1);
+    CBlockIndex* pindex3 = AddTestBlockIndex(pindex2);
+    CBlockIndex* pindex2b = AddTestBlockIndex(pindex1);
+    CAddressBalanceValue value;
+    uint256 hashTip;
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > block1, block2, block3, block2b;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent1, unspent2, unspent3, undo3, undo2, unspent2b;
+    block1.push_back(std::make_pair(CAddressIndexKey(1, hashA, 1, 0, txid1, 0, false), 5 * COIN));
+    unspent1.push_back(std::make_pair(CAddressUnspentKey(1, hashA, txid1, 0), CAddressUnspentValue(5 * COIN, CScript(), 1)));
+    block2.push_back(std::make_pair(CAddressIndexKey(1, hashA, 2, 0, txid2, 0, false), 3 * COIN));
+    unspent2.push_back(std::make_pair(CAddressUnspentKey(1, hashA, txid2, 0), CAddressUnspentValue(3 * COIN, CScript(), 2)));
+    undo2.push_back(std::make_pair(CAddressUnspentKey(1, hashA, txid2, 0), CAddressUnspentValue()));
+    block3.push_back(std::make_pair(CAddressIndexKey(2, hashB, 3, 0, txid3, 0, false), 2 * COIN));
+    unspent3.push_back(std::make_pair(CAddressUnspentKey(2, hashB, txid3, 0), CAddressUnspentValue(2 * COIN, CScript(), 3)));
+    undo3.push_back(std::make_pair(CAddressUnspentKey(2, hashB, txid3, 0), CAddressUnspentValue()));
+    block2b.push_back(std::make_pair(CAddressIndexKey(2, hashB, 2, 0, txid4, 0, false), 4 * COIN));
+    unspent2b.push_back(std::make_pair(CAddressUnspentKey(2, hashB, txid4, 0), CAddressUnspentValue(4 * COIN, CScript(), 2)));
+
+    BOOST_CHECK(!pblocktree->ReadAddressBalanceTip(hashTip));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(unspent1));
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block1, false, pindex1));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(unspent2));
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block2, false, pindex2));
+    BOOST_CHECK(pblocktree->ReadAddressBalanceTip(hashTip));
+    BOOST_CHECK(hashTip == pindex2->GetBlockHash());
+
+    // after a crash the chainstate was flushed at genesis, so both blocks are connected again
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(unspent1));
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block1, false, pindex1));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(unspent2));
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block2, false, pindex2));
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashA, 1, value));
+    BOOST_CHECK_EQUAL(value.balance, 8 * COIN);
+    BOOST_CHECK_EQUAL(value.utxos, 2);
+    BOOST_CHECK(pblocktree->ReadAddressBalanceTip(hashTip));
+    BOOST_CHECK(hashTip == pindex2->GetBlockHash());
+
+    // the next block applies again, and disconnecting it twice undoes it once
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(unspent3));
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block3, false, pindex3));
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashB, 2, value));
+    BOOST_CHECK_EQUAL(value.balance, 2 * COIN);
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(undo3));
+        BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block3, true, pindex3));
+        BOOST_CHECK(!pblocktree->ReadAddressBalance(hashB, 2, value));
+        BOOST_CHECK(pblocktree->ReadAddressBalance(hashA, 1, value));
+        BOOST_CHECK_EQUAL(value.balance, 8 * COIN);
+        BOOST_CHECK(pblocktree->ReadAddressBalanceTip(hashTip));
+        BOOST_CHECK(hashTip == pindex2->GetBlockHash());
+    }
+
+    // a crash after block 2's unspent outputs were disconnected leaves the balances on the
+    // old branch; connecting the fork rebuilds them from the unspent index
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(undo2));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(unspent2b));
+    BOOST_CHECK(pblocktree->UpdateAddressBalanceIndex(block2b, false, pindex2b));
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashA, 1, value));
+    BOOST_CHECK_EQUAL(value.balance, 5 * COIN);
+    BOOST_CHECK_EQUAL(value.utxos, 1);
+    BOOST_CHECK(pblocktree->ReadAddressBalance(hashB, 2, value));
+    BOOST_CHECK_EQUAL(value.balance, 4 * COIN);
+    BOOST_CHECK(pblocktree->ReadAddressBalanceTip(hashTip));
+    BOOST_CHECK(hashTip == pindex2b->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_CASE(address_index_pages)
+{
+    uint160 hashA = TestAddressHash(0xaa), hashB = TestAddressHash(0xbb);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > records;
+    for (int height = 1; height <= 10; height++) {
+        records.push_back(std::make_pair(CAddressIndexKey(1, hashA, height, 0, ArithToUint256(arith_uint256(height)), 0, false), height * COIN));
+    }
+    records.push_back(std::make_pair(CAddressIndexKey(1, hashB, 5, 0, uint256S("ff"), 0, false), COIN));
+    BOOST_CHECK(pblocktree->WriteAddressIndex(records));
+
+    // walking A four entries at a time returns every entry once, in height order
+    std::vector<std::pair<CAddressIndexKey, CAmount> > page, all;
+    const CAddressIndexKey *after = NULL;
+    CAddressIndexKey last;
+    do {
+        page.clear();
+        BOOST_CHECK(pblocktree->ReadAddressIndex(hashA, 1, page, 0, 0, 4, after));
+        BOOST_CHECK(page.size() <= 4);
+        all.insert(all.end(), page.begin(), page.end());
+        if (!page.empty()) {
+            last = page.back().first;
+            after = &last;
+        }
+    } while (page.size() == 4);
+    BOOST_CHECK_EQUAL(all.size(), 10);
+    for (size_t i = 0; i < all.size(); i++) {
+        BOOST_CHECK_EQUAL(all[i].first.blockHeight, (int)i + 1);
+    }
+
+    // a height range still bounds a limited read
+    page.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(hashA, 1, page, 3, 8, 2));
+    BOOST_CHECK_EQUAL(page.size(), 2);
+    BOOST_CHECK_EQUAL(page[0].first.blockHeight, 3);
+    last = page.back().first;
+    page.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(hashA, 1, page, 3, 8, 0, &last));
+    BOOST_CHECK_EQUAL(page.size(), 4);
+    BOOST_CHECK_EQUAL(page.back().first.blockHeight, 8);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "compactsapling.h"
+
+#include "chain.h"
+#include "primitives/transaction.h"
+#include "streams.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(compactsapling_tests, BasicTestingSetup)
+
+static CMutableTransaction SaplingTransaction(unsigned char seed, size_t nSpends, size_t nOutputs)
+{
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    for (size_t i = 0; i < nSpends; i++) {
+        SpendDescription spend;
+        spend.nullifier = ArithToUint256(arith_uint256(seed * 100 + i));
+        mtx.vShieldedSpend.push_back(spend);
+    }
+    for (size_t i = 0; i < nOutputs; i++) {
+        OutputDescription output;
+        output.cmu = ArithToUint256(arith_uint256(seed * 1000 + i));
+        output.ephemeralKey = ArithToUint256(arith_uint256(seed * 10000 + i));
+        for (size_t j = 0; j < output.encCiphertext.size(); j++)
+            output.encCiphertext[j] = (unsigned char)(seed + i + j);
+        mtx.vShieldedOutput.push_back(output);
+    }
+    return mtx;
+}
+
+BOOST_AUTO_TEST_CASE(compact_sapling_block)
+{
+    CBlock block;
+    block.nTime = 1600000000;
+    block.hashPrevBlock = ArithToUint256(arith_uint256(42));
+    block.hashFinalSaplingRoot = ArithToUint256(arith_uint256(43));
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(SaplingTransaction(1, 2, 1));
+    block.vtx.push_back(CMutableTransaction());
+    block.vtx.push_back(SaplingTransaction(2, 0, 3));
+
+    CBlockIndex index(block);
+    index.nHeight = 1234;
+    uint256 hash = block.GetHash();
+    index.phashBlock = &hash;
+
+    CCompactSaplingBlock compact;
+    BuildCompactSaplingBlock(block, &index, compact);
+
+    BOOST_CHECK_EQUAL(compact.nHeight, 1234);
+    BOOST_CHECK(compact.hash == hash);
+    BOOST_CHECK(compact.hashPrevBlock == block.hashPrevBlock);
+    BOOST_CHECK_EQUAL(compact.nTime, block.nTime);
+    BOOST_CHECK(compact.hashFinalSaplingRoot == block.hashFinalSaplingRoot);
+    BOOST_CHECK_EQUAL(compact.nTx, 4);
+
+    // Only the transactions with Sapling spends or outputs are kept
+    BOOST_REQUIRE_EQUAL(compact.vtx.size(), 2);
+    BOOST_CHECK_EQUAL(compact.vtx[0].nIndex, 1);
+    BOOST_CHECK(compact.vtx[0].txid == block.vtx[1].GetHash());
+    BOOST_REQUIRE_EQUAL(compact.vtx[0].vNullifiers.size(), 2);
+    BOOST_CHECK(compact.vtx[0].vNullifiers[1] == block.vtx[1].vShieldedSpend[1].nullifier);
+    BOOST_CHECK_EQUAL(compact.vtx[1].nIndex, 3);
+    BOOST_CHECK(compact.vtx[1].vNullifiers.empty());
+    BOOST_REQUIRE_EQUAL(compact.vtx[1].vOutputs.size(), 3);
+
+    const OutputDescription& output = block.vtx[3].vShieldedOutput[2];
+    const CCompactSaplingOutput& coutput = compact.vtx[1].vOutputs[2];
+    BOOST_CHECK(coutput.cmu == output.cmu);
+    BOOST_CHECK(coutput.ephemeralKey == output.ephemeralKey);
+    BOOST_CHECK(std::equal(coutput.ciphertext.begin(), coutput.ciphertext.end(), output.encCiphertext.begin()));
+
+    // Round trip, and the size a light client can expect per output
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << compact;
+    size_t nSize = ss.size();
+    CCompactSaplingBlock compact2;
+    ss >> compact2;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK_EQUAL(compact2.vtx.size(), 2);
+    BOOST_CHECK(compact2.vtx[1].vOutputs[2].ciphertext == coutput.ciphertext);
+
+    CCompactSaplingBlock empty;
+    CDataStream ssEmpty(SER_NETWORK, PROTOCOL_VERSION);
+    ssEmpty << empty;
+    BOOST_CHECK_EQUAL(nSize - ssEmpty.size(),
+                      2 * (4 + 32 + 2) + 2 * 32 + 4 * (32 + 32 + COMPACT_SAPLING_CIPHERTEXT_SIZE));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,12 +2,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/blake2b.h"
+#include "crypto/common.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
 #include "random.h"
 #include "util/strencodings.h"
 #include "test/test_bitcoin.h"
@@ -51,6 +54,7 @@ void TestVector(const Hasher &h, const In &in, const Out &out) {
 void TestSHA1(const std::string &in, const std::string &hexout) { TestVector(CSHA1(), in, ParseHex(hexout));}
 void TestSHA256(const std::string &in, const std::string &hexout) { TestVector(CSHA256(), in, ParseHex(hexout));}
 void TestSHA512(const std::string &in, const std::string &hexout) { TestVector(CSHA512(), in, ParseHex(hexout));}
+void TestBlake2b(const std::string &in, const std::string &hexout) { TestVector(CBlake2b(), in, ParseHex(hexout));}
 void TestRIPEMD160(const std::string &in, const std::string &hexout) { TestVector(CRIPEMD160(), in, ParseHex(hexout));}
 
 void TestHMACSHA256(const std::string &hexkey, const std::string &hexin, const std::string &hexout) {
@@ -168,6 +172,56 @@ BOOST_AUTO_TEST_CASE(sha512_testvectors) {
                "37de8c3ef5459d76a52cedc02dc499a3c9ed9dedbfb3281afd9653b8a112fafc");
 }
 
+BOOST_AUTO_TEST_CASE(blake2b_testvectors) {
+    TestBlake2b("",
+                "786a02f742015903c6c6fd852552d272912f4740e15847618a86e217f71f5419"
+                "d25e1031afee585313896444934eb04b903a685b1448b755d56f701afe9be2ce");
+    TestBlake2b("abc",
+                "ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d1"
+                "7d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923");
+    TestBlake2b("The quick brown fox jumps over the lazy dog",
+                "a8add4bdddfd93e4877d2746e62817b116364a1fa7bc148d95090bc7333b3673"
+                "f82401cf7aa2e4cb1ecd90296e3f14cb5413f8ed77be73045b13914cdcd6a918");
+    TestBlake2b(std::string(128, 'a'),
+                "fc6c71f688f43ea7d60817478808f3cac753e61571865c95adbc2d9122c943a7"
+                "6b92c2cb1047ef3fe7bf6e436ec1d0a99a9e5b216780bf7fed9d7ca91d3a8f3b");
+    TestBlake2b(std::string(129, 'a'),
+                "55e6e0eb418149a8af92fd9ddc99254781b2f522a131b4f4d984404b71a00e11"
+                "67b8124d5dcddd4c6977b299392335d6edd303da6d344d74bbef2d38101b232b");
+
+    // Shortened digest with the Equihash 200,9 personalization
+    const unsigned char personal[CBlake2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's', 'h', 'P', 'o', 'W', 200, 0, 0, 0, 9, 0, 0, 0};
+    std::string in = "Equihash is an asymmetric PoW based on the Generalised Birthday problem.";
+    std::vector<unsigned char> hash(50);
+    CBlake2b(50, personal).Write((unsigned char*)&in[0], in.size()).Finalize(&hash[0]);
+    BOOST_CHECK(hash == ParseHex("d60c3f2203ebb35b4a1e4a5d954a905025ebd9164117666371e03d981f8b28cb"
+                                 "c85defb7fe535463c4b9fa3fe9f53efb1b86"));
+}
+
+BOOST_AUTO_TEST_CASE(blake2b_finalize_indices) {
+    const unsigned char personal[CBlake2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's', 'h', 'P', 'o', 'W', 200, 0, 0, 0, 9, 0, 0, 0};
+    std::vector<unsigned char> prefix(300);
+    for (size_t i = 0; i < prefix.size(); i++)
+        prefix[i] = insecure_rand();
+    std::vector<uint32_t> indices(21);
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = insecure_rand();
+
+    // Every prefix length, including those where the index spills into another block
+    for (size_t len = 0; len <= prefix.size(); len++) {
+        CBlake2b hasher(50, personal);
+        hasher.Write(&prefix[0], len);
+        std::vector<unsigned char> batched(indices.size() * 50), single(50);
+        hasher.FinalizeIndices(&indices[0], indices.size(), &batched[0]);
+        for (size_t i = 0; i < indices.size(); i++) {
+            unsigned char le[4];
+            WriteLE32(le, indices[i]);
+            CBlake2b(hasher).Write(le, 4).Finalize(&single[0]);
+            BOOST_CHECK(std::equal(single.begin(), single.end(), batched.begin() + i * 50));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(hmac_sha256_testvectors) {
     // test cases 1, 2, 3, 4, 6 and 7 of RFC 4231
     TestHMACSHA256("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
@@ -248,4 +302,48 @@ BOOST_AUTO_TEST_CASE(hmac_sha512_testvectors) {
                    "b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58");
 }
 
+static uint256 MuHashDigest(MuHash3072 muhash) {
+    uint256 out;
+    muhash.Finalize(out.begin());
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests) {
+    unsigned char a = 'a', b = 'b', c = 'c';
+
+    MuHash3072 abc;
+    abc.Insert(&a, 1).Insert(&b, 1).Insert(&c, 1);
+
+    // order independent
+    MuHash3072 cba;
+    cba.Insert(&c, 1).Insert(&b, 1).Insert(&a, 1);
+    BOOST_CHECK(MuHashDigest(abc) == MuHashDigest(cba));
+
+    // removal cancels insertion
+    MuHash3072 ac(abc);
+    ac.Remove(&b, 1);
+    MuHash3072 ac2;
+    ac2.Insert(&a, 1).Insert(&c, 1);
+    BOOST_CHECK(MuHashDigest(ac) == MuHashDigest(ac2));
+    BOOST_CHECK(MuHashDigest(ac) != MuHashDigest(abc));
+
+    // partial sets combine
+    MuHash3072 ab, cOnly(&c, 1);
+    ab.Insert(&a, 1).Insert(&b, 1);
+    ab *= cOnly;
+    BOOST_CHECK(MuHashDigest(ab) == MuHashDigest(abc));
+    ab /= cOnly;
+    MuHash3072 ab2;
+    ab2.Insert(&a, 1).Insert(&b, 1);
+    BOOST_CHECK(MuHashDigest(ab) == MuHashDigest(ab2));
+
+    // the state survives a round trip through its serialization
+    unsigned char serialized[MuHash3072::SERIALIZED_SIZE];
+    ac.ToBytes(serialized);
+    MuHash3072 restored;
+    restored.FromBytes(serialized);
+    BOOST_CHECK(MuHashDigest(restored) == MuHashDigest(ac2));
+    BOOST_CHECK(MuHashDigest(MuHash3072()) != MuHashDigest(ac2));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
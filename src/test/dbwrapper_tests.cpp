@@ -229,6 +229,35 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
-
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    CDBProfile profile;
+    std::string strError;
+    BOOST_CHECK(ParseDBProfileOptions("blocksize=16384,bloombits=0,cachepercent=75,scanfillcache=1", profile, strError));
+    BOOST_CHECK_EQUAL(profile.nBlockSize, 16384);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 0);
+    BOOST_CHECK_EQUAL(profile.nCachePercent, 75);
+    BOOST_CHECK(profile.fScanFillCache);
+    BOOST_CHECK(!ParseDBProfileOptions("blocksize", profile, strError));
+    BOOST_CHECK(!ParseDBProfileOptions("cachepercent=100", profile, strError));
+    BOOST_CHECK(!ParseDBProfileOptions("readahead=1", profile, strError));
+
+    mapMultiArgs["-dbprofile"].push_back("chainstate:bloombits=12");
+    BOOST_CHECK(CheckDBProfileArgs(strError));
+    BOOST_CHECK_EQUAL(GetDBProfile("chainstate").nBloomBits, 12);
+    BOOST_CHECK_EQUAL(GetDBProfile("blockindex").nBloomBits, 10);
+    mapMultiArgs["-dbprofile"].push_back("wallet:bloombits=12");
+    BOOST_CHECK(!CheckDBProfileArgs(strError));
+    mapMultiArgs.erase("-dbprofile");
+
+    // an open database reports the profile it was opened with
+    path ph = temp_directory_path() / unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, false, 64, "blockindex");
+    BOOST_CHECK(dbw.Write('k', uint256()));
+    CDBStats stats = dbw.GetStats();
+    BOOST_CHECK_EQUAL(stats.strName, "blockindex");
+    BOOST_CHECK_EQUAL(stats.profile.nBlockSize, 16 * 1024);
+    BOOST_CHECK_EQUAL(stats.vFilesPerLevel.size(), 7);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
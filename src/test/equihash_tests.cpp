@@ -99,6 +99,13 @@ void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I,
     bool isValid;
     EhIsValidSolution(n, k, state, GetMinimalFromIndices(soln, cBitLen), isValid);
     BOOST_CHECK(isValid == expected);
+
+    // Hashing I||V into a midstate and batching the leaves gives the same answer
+    std::vector<unsigned char> input(I.begin(), I.end());
+    input.insert(input.end(), V.begin(), V.end());
+    bool isValidForInput;
+    EhIsValidSolutionForInput(n, k, &input[0], input.size(), GetMinimalFromIndices(soln, cBitLen), isValidForInput);
+    BOOST_CHECK(isValidForInput == expected);
 }
 
 #ifdef ENABLE_MINING
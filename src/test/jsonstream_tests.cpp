@@ -0,0 +1,109 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+BOOST_FIXTURE_TEST_SUITE(jsonstream_tests, BasicTestingSetup)
+
+static UniValue SampleDocument()
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("txid", "00ff"));
+    inner.push_back(Pair("value", 1.5));
+    inner.push_back(Pair("empty", UniValue(UniValue::VARR)));
+    inner.push_back(Pair("none", UniValue(UniValue::VOBJ)));
+
+    UniValue list(UniValue::VARR);
+    for (int i = 0; i < 50; i++) {
+        list.push_back(i);
+        list.push_back(inner);
+    }
+    list.push_back("quote\" and \\ backslash\n");
+
+    UniValue doc(UniValue::VOBJ);
+    doc.push_back(Pair("list", list));
+    doc.push_back(Pair("flag", true));
+    doc.push_back(Pair("null", NullUniValue));
+    return doc;
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_matches_write)
+{
+    UniValue doc = SampleDocument();
+    std::string strExpected = doc.write();
+
+    // Chunk sizes from one byte to larger than the document
+    const size_t vChunkSizes[] = {1, 7, 64, 1000, 1 << 20};
+    for (size_t i = 0; i < sizeof(vChunkSizes) / sizeof(vChunkSizes[0]); i++) {
+        std::string strOut;
+        size_t nChunks = 0;
+        JSONStreamWriter writer([&strOut, &nChunks](const std::string& strChunk) {
+            strOut += strChunk;
+            nChunks++;
+            return true;
+        }, vChunkSizes[i]);
+        writer.Value(doc);
+        writer.Flush();
+        BOOST_CHECK_EQUAL(strOut, strExpected);
+        BOOST_CHECK_EQUAL(writer.HasFlushed(), true);
+        if (vChunkSizes[i] < strExpected.size())
+            BOOST_CHECK(nChunks > 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_piecewise)
+{
+    std::string strOut;
+    JSONStreamWriter writer([&strOut](const std::string& strChunk) {
+        strOut += strChunk;
+        return true;
+    }, 16);
+
+    writer.BeginObject();
+    writer.Key("result");
+    writer.BeginArray();
+    writer.Value(1);
+    writer.BeginObject();
+    writer.PushKV("a", "b");
+    writer.EndObject();
+    writer.BeginArray();
+    writer.EndArray();
+    writer.EndArray();
+    writer.PushKV("error", NullUniValue);
+    writer.PushKV("id", 7);
+    writer.EndObject();
+    writer.Raw("\n");
+    writer.Flush();
+
+    BOOST_CHECK_EQUAL(strOut, "{\"result\":[1,{\"a\":\"b\"},[]],\"error\":null,\"id\":7}\n");
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_small_documents_stay_buffered)
+{
+    JSONStreamWriter writer([](const std::string&) {
+        BOOST_ERROR("small document handed on");
+        return true;
+    });
+    writer.Value(SampleDocument());
+    BOOST_CHECK(!writer.HasFlushed());
+    BOOST_CHECK_EQUAL(writer.GetBuffer(), SampleDocument().write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_abort)
+{
+    size_t nChunks = 0;
+    JSONStreamWriter writer([&nChunks](const std::string&) {
+        return ++nChunks < 3;
+    }, 8);
+    BOOST_CHECK_THROW(writer.Value(SampleDocument()), std::runtime_error);
+    BOOST_CHECK_EQUAL(nChunks, 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
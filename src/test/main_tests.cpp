@@ -7,6 +7,9 @@
 
 #include "test/test_bitcoin.h"
 
+#include <atomic>
+#include <thread>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -84,6 +87,78 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, 2099999990760000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(block_download_window)
+{
+    // Unmeasured peers keep their window
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(0, MAX_BLOCKS_IN_TRANSIT_PER_PEER), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // The window holds BLOCK_WINDOW_TARGET_TIME worth of blocks
+    const int64_t nTarget = 1000000 * (int64_t)BLOCK_WINDOW_TARGET_TIME;
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(nTarget / 16, MIN_BLOCK_WINDOW_PER_PEER), 16);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(nTarget / 5, MAX_BLOCK_WINDOW_PER_PEER), 5);
+
+    // and stays within its bounds for very fast and very slow peers
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1, MIN_BLOCK_WINDOW_PER_PEER), MAX_BLOCK_WINDOW_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(nTarget * 10, MAX_BLOCK_WINDOW_PER_PEER), MIN_BLOCK_WINDOW_PER_PEER);
+
+    // A slower peer never gets a deeper window
+    int nLast = MAX_BLOCK_WINDOW_PER_PEER;
+    for (int64_t nServiceTime = 1000; nServiceTime <= nTarget; nServiceTime *= 2) {
+        int nWindow = GetBlockDownloadWindow(nServiceTime, MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+        BOOST_CHECK(nWindow <= nLast);
+        nLast = nWindow;
+    }
+}
+
+static bool TryLockMain()
+{
+    TRY_LOCK(cs_main, lockMain);
+    return lockMain;
+}
+
+BOOST_AUTO_TEST_CASE(block_to_serve)
+{
+    const CBlockIndex* pindexGenesis;
+    {
+        LOCK(cs_main);
+        pindexGenesis = chainActive.Genesis();
+    }
+    BOOST_REQUIRE(pindexGenesis != NULL);
+
+    // Unknown blocks are not served
+    CDiskBlockPos blockPos;
+    bool fRecent = false;
+    BOOST_CHECK(!GetBlockToServe(GetRandHash(), 0, blockPos, fRecent));
+
+    // Blocks on the active chain are, from where the index has them
+    BOOST_CHECK(GetBlockToServe(pindexGenesis->GetBlockHash(), 0, blockPos, fRecent));
+    BOOST_CHECK(blockPos == pindexGenesis->GetBlockPos());
+    BOOST_CHECK(fRecent);
+
+    // cs_main is released before the block is read
+    bool fLocked = false;
+    std::thread other([&fLocked] { fLocked = TryLockMain(); });
+    other.join();
+    BOOST_CHECK(fLocked);
+
+    // so the read goes ahead while another thread holds it
+    std::atomic<bool> fHeld(false), fRelease(false);
+    std::thread holder([&fHeld, &fRelease] {
+        LOCK(cs_main);
+        fHeld = true;
+        while (!fRelease)
+            MilliSleep(1);
+    });
+    while (!fHeld)
+        MilliSleep(1);
+    CBlock block;
+    bool fRead = ReadBlockFromDisk(0, block, blockPos, 1);
+    fRelease = true;
+    holder.join();
+    BOOST_CHECK(fRead);
+    BOOST_CHECK(block.GetHash() == pindexGenesis->GetBlockHash());
+}
+
 bool ReturnFalse() { return false; }
 bool ReturnTrue() { return true; }
 
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "arith_uint256.h"
 #include "consensus/upgrades.h"
 #include "main.h"
 #include "txmempool.h"
@@ -9,7 +10,9 @@
 
 #include "test/test_bitcoin.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <list>
 
 BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
@@ -157,6 +160,229 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK(it == pool.mapTx.get<1>().end());
 }
 
+BOOST_AUTO_TEST_CASE(MempoolEntrySequenceTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+
+    std::vector<CMutableTransaction> vtx(3);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        vtx[i].vout.resize(1);
+        vtx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vtx[i].vout[0].nValue = (i + 1) * COIN;
+    }
+    pool.addUnchecked(vtx[0].GetHash(), entry.Fee(10000LL).FromTx(vtx[0]));
+    pool.addUnchecked(vtx[1].GetHash(), entry.Fee(30000LL).FromTx(vtx[1]));
+    uint64_t nSequence = pool.GetEntrySequence();
+    uint64_t nOrderChanges = pool.GetOrderChanges();
+
+    // Additions only move the sequence on; the entries after a sequence are the newer ones
+    pool.addUnchecked(vtx[2].GetHash(), entry.Fee(20000LL).FromTx(vtx[2]));
+    BOOST_CHECK_EQUAL(pool.GetEntrySequence(), nSequence + 1);
+    BOOST_CHECK_EQUAL(pool.GetOrderChanges(), nOrderChanges);
+    CTxMemPool::indexed_transaction_set::nth_index<2>::type::iterator it = pool.mapTx.get<2>().upper_bound(nSequence);
+    BOOST_CHECK_EQUAL(it++->GetTx().GetHash().ToString(), vtx[2].GetHash().ToString());
+    BOOST_CHECK(it == pool.mapTx.get<2>().end());
+
+    // Anything else changes the order
+    pool.PrioritiseTransaction(vtx[0].GetHash(), vtx[0].GetHash().ToString(), 0, 5000);
+    BOOST_CHECK(pool.GetOrderChanges() != nOrderChanges);
+    nOrderChanges = pool.GetOrderChanges();
+
+    std::list<CTransaction> removed;
+    pool.remove(vtx[1], removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK(pool.GetOrderChanges() != nOrderChanges);
+    BOOST_CHECK_EQUAL(pool.GetEntrySequence(), nSequence + 1);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPackageStateTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // A cheap parent with a generous child and grandchild
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 8 * COIN;
+    // An unrelated transaction paying more than the parent alone
+    CMutableTransaction txOther;
+    txOther.vin.resize(1);
+    txOther.vin[0].prevout = COutPoint(uint256S("02"), 0);
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txOther.vout[0].nValue = 10 * COIN;
+
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(100000LL).FromTx(txChild));
+    pool.addUnchecked(txGrandChild.GetHash(), entry.Fee(10000LL).FromTx(txGrandChild));
+    pool.addUnchecked(txOther.GetHash(), entry.Fee(5000LL).FromTx(txOther));
+
+    CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter itChild = pool.mapTx.find(txChild.GetHash());
+    CTxMemPool::txiter itGrandChild = pool.mapTx.find(txGrandChild.GetHash());
+    size_t nSize = itParent->GetTxSize();
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(itParent->GetSizeWithDescendants(), nSize + itChild->GetTxSize() + itGrandChild->GetTxSize());
+    BOOST_CHECK_EQUAL(itParent->GetFeesWithDescendants(), 111000);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetFeesWithAncestors(), 111000);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithDescendants(), 2);
+    BOOST_CHECK(pool.GetMemPoolParents(itChild) == CTxMemPool::setEntries({itParent}));
+    BOOST_CHECK(pool.GetMemPoolChildren(itChild) == CTxMemPool::setEntries({itGrandChild}));
+
+    // Its children pay for the parent, so the other transaction goes first
+    BOOST_CHECK_EQUAL(pool.mapTx.get<3>().begin()->GetTx().GetHash().ToString(), txOther.GetHash().ToString());
+
+    // Ancestor limits
+    CTxMemPool::setEntries setAncestors;
+    std::string errString;
+    CMutableTransaction txNext;
+    txNext.vin.resize(1);
+    txNext.vin[0].prevout = COutPoint(txGrandChild.GetHash(), 0);
+    txNext.vout.resize(1);
+    CTxMemPoolEntry entryNext = entry.Fee(1000LL).FromTx(txNext);
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryNext, setAncestors, 3, 1000000, 25, 1000000, errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryNext, setAncestors, 25, 1000000, 3, 1000000, errString));
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryNext, setAncestors, 4, 1000000, 4, 1000000, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3);
+
+    // A block confirms the parent: the descendants stay and lose it from their ancestors
+    std::list<CTransaction> removed;
+    pool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetFeesWithAncestors(), 110000);
+    BOOST_CHECK(pool.GetMemPoolParents(itChild).empty());
+
+    // Removing the child takes the grandchild with it
+    removed.clear();
+    pool.remove(txChild, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolReaddEntriesTest)
+{
+    // CheckBlock on CC chains moves the transparent transactions out of the
+    // pool and back, in txid order rather than parent first
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txFunding;
+    txFunding.vin.resize(1);
+    txFunding.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    txFunding.vout.resize(1);
+    txFunding.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txFunding.vout[0].nValue = 10 * COIN;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].prevout = COutPoint(txFunding.GetHash(), 0);
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 9 * COIN;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 8 * COIN;
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(COIN).FromTx(txParent));
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(COIN).FromTx(txChild));
+
+    // Copies keep their package state from the first pool
+    std::vector<CTxMemPoolEntry> vEntries;
+    vEntries.push_back(*pool.mapTx.find(txChild.GetHash()));
+    vEntries.push_back(*pool.mapTx.find(txParent.GetHash()));
+    CTxMemPool tmppool(CFeeRate(0));
+    tmppool.addUncheckedEntries(vEntries);
+    std::list<CTransaction> removed;
+    pool.remove(txParent, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+
+    vEntries.assign(tmppool.mapTx.begin(), tmppool.mapTx.end());
+    if (vEntries[0].GetTx().GetHash() == txParent.GetHash())
+        std::swap(vEntries[0], vEntries[1]);
+    pool.setSanityCheck(1.0);
+    pool.addUncheckedEntries(vEntries);
+
+    CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter itChild = pool.mapTx.find(txChild.GetHash());
+    BOOST_CHECK_EQUAL(itParent->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(itParent->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(itParent->GetFeesWithDescendants(), 2 * COIN);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithDescendants(), 1);
+    BOOST_CHECK(pool.GetMemPoolChildren(itParent) == CTxMemPool::setEntries({itChild}));
+
+    // -checkmempool passes with the parent's input in the coins view
+    CCoinsViewCache view(pcoinsTip);
+    view.ModifyCoins(txFunding.GetHash())->FromTx(txFunding, 1);
+    pool.check(&view);
+
+    // and removing the parent takes the child with it
+    removed.clear();
+    pool.remove(txParent, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    SetMockTime(42);
+
+    std::vector<CMutableTransaction> vtx(4);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        vtx[i].vin.resize(1);
+        vtx[i].vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i + 1)), 0);
+        vtx[i].vout.resize(1);
+        vtx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vtx[i].vout[0].nValue = COIN;
+        pool.addUnchecked(vtx[i].GetHash(), entry.Fee(10000LL * (i + 1)).FromTx(vtx[i]));
+    }
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    // Trimming evicts the cheapest and raises the minimum fee above what it paid
+    CFeeRate evicted(10000LL, pool.mapTx.find(vtx[0].GetHash())->GetTxSize());
+    size_t nLimit = pool.DynamicMemoryUsage() - 1;
+    BOOST_CHECK_EQUAL(pool.TrimToSize(nLimit), 1);
+    BOOST_CHECK(!pool.exists(vtx[0].GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    CAmount nMinFee = evicted.GetFeePerK() + ::minRelayTxFee.GetFeePerK();
+    BOOST_CHECK_EQUAL(pool.GetMinFee(nLimit).GetFeePerK(), nMinFee);
+
+    // It only decays once a block is found; with the pool far below its
+    // limit the half-life is a quarter of the usual one
+    SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(nLimit * 100).GetFeePerK(), nMinFee);
+    std::vector<CTransaction> vtxBlock;
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtxBlock, 1, conflicts);
+    SetMockTime(42 + 2 * CTxMemPool::ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(nLimit * 100).GetFeePerK(), std::max((CAmount)llround(nMinFee / 16.0), ::minRelayTxFee.GetFeePerK()));
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_CASE(RemoveWithoutBranchId) {
     CTxMemPool pool(CFeeRate(0));
     TestMemPoolEntryHelper entry;
@@ -212,6 +438,143 @@ BOOST_AUTO_TEST_CASE(RemoveWithoutBranchId) {
     BOOST_CHECK_EQUAL(pool.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolVerifiedTxsTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    const uint32_t nBranchId = NetworkUpgradeInfo[Consensus::UPGRADE_SAPLING].nBranchId;
+
+    // A transparent transaction, then Sapling ones whose entries had their
+    // proofs checked for this branch, were admitted without the proof checks,
+    // and were checked for an older branch
+    CBlock block;
+    block.vtx.resize(4);
+    const bool fVerified[4] = {true, true, false, true};
+    for (int i = 0; i < 4; i++) {
+        CMutableTransaction tx;
+        tx.fOverwintered = true;
+        tx.nVersion = SAPLING_TX_VERSION;
+        tx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        if (i > 0) {
+            tx.vShieldedOutput.resize(1);
+            tx.vShieldedOutput[0].zkproof[0] = i;
+        }
+        CTxMemPoolEntry e = entry.BranchId(i == 3 ? NetworkUpgradeInfo[Consensus::UPGRADE_OVERWINTER].nBranchId : nBranchId).FromTx(tx);
+        e.SetProofsVerified(fVerified[i]);
+        pool.addUnchecked(tx.GetHash(), e);
+        block.vtx[i] = tx;
+    }
+
+    // Only the entries verified for the block's branch are trusted, so the
+    // proofs of the other two are checked
+    std::set<uint256> setVerified;
+    BOOST_CHECK(!GetMempoolVerifiedTxs(pool, block, nBranchId, setVerified));
+    BOOST_CHECK_EQUAL(setVerified.size(), 2);
+    BOOST_CHECK(setVerified.count(block.vtx[0].GetHash()));
+    BOOST_CHECK(setVerified.count(block.vtx[1].GetHash()));
+
+    // A block of trusted transactions skips the proof checks until one of
+    // them leaves the pool
+    CBlock blockVerified;
+    blockVerified.vtx.push_back(block.vtx[1]);
+    setVerified.clear();
+    BOOST_CHECK(GetMempoolVerifiedTxs(pool, blockVerified, nBranchId, setVerified));
+    std::list<CTransaction> removed;
+    pool.remove(block.vtx[1], removed);
+    setVerified.clear();
+    BOOST_CHECK(!GetMempoolVerifiedTxs(pool, blockVerified, nBranchId, setVerified));
+    BOOST_CHECK(setVerified.empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolDumpDigestTest)
+{
+    TestMemPoolEntryHelper entry;
+    const uint32_t nBranchId = NetworkUpgradeInfo[Consensus::UPGRADE_SAPLING].nBranchId;
+
+    // A Sapling transaction whose proofs were checked on the way in, and one
+    // admitted without the checks
+    uint256 hashVerified;
+    for (int i = 0; i < 2; i++) {
+        CMutableTransaction tx;
+        tx.fOverwintered = true;
+        tx.nVersion = SAPLING_TX_VERSION;
+        tx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        tx.vShieldedOutput.resize(1);
+        tx.vShieldedOutput[0].zkproof[0] = i;
+        CTxMemPoolEntry e = entry.BranchId(nBranchId).FromTx(tx);
+        e.SetProofsVerified(i == 0);
+        mempool.addUnchecked(tx.GetHash(), e);
+        if (i == 0)
+            hashVerified = tx.GetHash();
+    }
+    mempool.PrioritiseTransaction(hashVerified, hashVerified.ToString(), 0, 1000);
+    BOOST_REQUIRE(DumpMempool());
+    mempool.clear();
+    mempool.ClearPrioritisation(hashVerified);
+
+    // Read back with our key, only the checked entry keeps its flag
+    std::vector<CTransaction> vtx;
+    std::vector<bool> vProofsVerified;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    BOOST_REQUIRE(ReadMempoolFile(nBranchId, vtx, vProofsVerified, mapDeltas));
+    BOOST_REQUIRE_EQUAL(vtx.size(), 2);
+    BOOST_REQUIRE_EQUAL(vProofsVerified.size(), 2);
+    for (size_t i = 0; i < vtx.size(); i++)
+        BOOST_CHECK_EQUAL((bool)vProofsVerified[i], vtx[i].GetHash() == hashVerified);
+    BOOST_CHECK_EQUAL(mapDeltas.size(), 1);
+    BOOST_CHECK_EQUAL(mapDeltas[hashVerified].second, 1000);
+
+    // Nothing checked against another branch is trusted
+    vtx.clear(); vProofsVerified.clear(); mapDeltas.clear();
+    BOOST_REQUIRE(ReadMempoolFile(NetworkUpgradeInfo[Consensus::UPGRADE_OVERWINTER].nBranchId, vtx, vProofsVerified, mapDeltas));
+    BOOST_CHECK_EQUAL(std::count(vProofsVerified.begin(), vProofsVerified.end(), true), 0);
+
+    // nor when the file was written with a key other than ours, or we lost ours
+    boost::filesystem::path pathKey = GetDataDir() / "mempool.key";
+    boost::filesystem::path pathKeySaved = GetDataDir() / "mempool.key.saved";
+    boost::filesystem::copy_file(pathKey, pathKeySaved);
+    uint256 keyOther = GetRandHash();
+    FILE *file = fopen(pathKey.string().c_str(), "wb");
+    BOOST_REQUIRE(file != NULL);
+    fwrite(keyOther.begin(), 1, keyOther.size(), file);
+    fclose(file);
+    vtx.clear(); vProofsVerified.clear(); mapDeltas.clear();
+    BOOST_REQUIRE(ReadMempoolFile(nBranchId, vtx, vProofsVerified, mapDeltas));
+    BOOST_CHECK_EQUAL(vtx.size(), 2);
+    BOOST_CHECK_EQUAL(std::count(vProofsVerified.begin(), vProofsVerified.end(), true), 0);
+
+    boost::filesystem::remove(pathKey);
+    vtx.clear(); vProofsVerified.clear(); mapDeltas.clear();
+    BOOST_REQUIRE(ReadMempoolFile(nBranchId, vtx, vProofsVerified, mapDeltas));
+    BOOST_CHECK_EQUAL(std::count(vProofsVerified.begin(), vProofsVerified.end(), true), 0);
+    boost::filesystem::rename(pathKeySaved, pathKey);
+
+    // nor when the digest does not match the contents
+    boost::filesystem::path pathMempool = GetDataDir() / "mempool.dat";
+    file = fopen(pathMempool.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    BOOST_REQUIRE(fseek(file, -1, SEEK_END) == 0);
+    int ch = fgetc(file);
+    BOOST_REQUIRE(fseek(file, -1, SEEK_END) == 0);
+    fputc(ch ^ 1, file);
+    fclose(file);
+    vtx.clear(); vProofsVerified.clear(); mapDeltas.clear();
+    BOOST_REQUIRE(ReadMempoolFile(nBranchId, vtx, vProofsVerified, mapDeltas));
+    BOOST_CHECK_EQUAL(vtx.size(), 2);
+    BOOST_CHECK_EQUAL(std::count(vProofsVerified.begin(), vProofsVerified.end(), true), 0);
+    boost::filesystem::remove(pathMempool);
+}
+
 // Test that nCheckFrequency is set correctly when calling setSanityCheck().
 // https://github.com/zcash/zcash/issues/3134
 BOOST_AUTO_TEST_CASE(SetSanityCheck) {
@@ -453,4 +453,27 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCoinbaseEnforcedProtectionEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(equihash_solver_choice)
+{
+    // Default n, k without -ac_nk: either solver can run
+    BOOST_CHECK_EQUAL(GetEquihashSolverChoice("auto", 200, 9), "auto");
+    BOOST_CHECK_EQUAL(GetEquihashSolverChoice("tromp", 200, 9), "tromp");
+    BOOST_CHECK_EQUAL(GetEquihashSolverChoice("default", 200, 9), "default");
+    BOOST_CHECK_EQUAL(GetEquihashSolverChoice("fastest", 200, 9), "auto");
+
+    // Other parameters only have the default solver
+    BOOST_CHECK_EQUAL(GetEquihashSolverChoice("auto", 144, 5), "default");
+    BOOST_CHECK_EQUAL(GetEquihashSolverChoice("tromp", 144, 5), "default");
+
+    // -ac_nk=200,9 keeps n, k but not the hash tromp solves for
+    uint64_t nk[2] = {ASSETCHAINS_NK[0], ASSETCHAINS_NK[1]};
+    ASSETCHAINS_NK[0] = 200;
+    ASSETCHAINS_NK[1] = 9;
+    BOOST_CHECK_EQUAL(GetEquihashSolverChoice("auto", 200, 9), "default");
+    BOOST_CHECK_EQUAL(GetEquihashSolverChoice("tromp", 200, 9), "default");
+    BOOST_CHECK_THROW(TimeEquihashSolve("tromp", 200, 9), std::runtime_error);
+    ASSETCHAINS_NK[0] = nk[0];
+    ASSETCHAINS_NK[1] = nk[1];
+}
+
 BOOST_AUTO_TEST_SUITE_END()
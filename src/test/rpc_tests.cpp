@@ -346,4 +346,47 @@ BOOST_AUTO_TEST_CASE(rpc_getnetworksolps)
     BOOST_CHECK_NO_THROW(CallRPC("getnetworksolps 120 -1"));
 }
 
+BOOST_AUTO_TEST_CASE(rpc_schedule)
+{
+    // Pools
+    BOOST_CHECK_EQUAL(tableRPC.workClass("getblockcount"), RPC_WORK_QUICK);
+    BOOST_CHECK_EQUAL(tableRPC.workClass("getsnapshot"), RPC_WORK_HEAVY);
+    BOOST_CHECK_EQUAL(tableRPC.workClass("z_listreceivedbyaddress"), RPC_WORK_HEAVY);
+    BOOST_CHECK_EQUAL(tableRPC.workClass("z_sendmany"), RPC_WORK_HEAVY);
+    BOOST_CHECK_EQUAL(tableRPC.workClass("stop"), RPC_WORK_ADMIN);
+    BOOST_CHECK_EQUAL(tableRPC.workClass("nosuchmethod"), RPC_WORK_QUICK);
+
+    // Only methods that read state run concurrently in a batch
+    BOOST_CHECK(tableRPC.isConcurrent("getblockcount"));
+    BOOST_CHECK(tableRPC.isConcurrent("getrawtransaction"));
+    BOOST_CHECK(tableRPC.isConcurrent("z_getbalance"));
+    BOOST_CHECK(!tableRPC.isConcurrent("sendrawtransaction"));
+    BOOST_CHECK(!tableRPC.isConcurrent("setban"));
+    BOOST_CHECK(!tableRPC.isConcurrent("z_sendmany"));
+    BOOST_CHECK(!tableRPC.isConcurrent("stop"));
+    BOOST_CHECK(!tableRPC.isConcurrent("nosuchmethod"));
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    // Replies keep the order of the requests, whichever entries ran concurrently
+    UniValue batch(UniValue::VARR);
+    for (int i = 0; i < 20; i++) {
+        UniValue req(UniValue::VOBJ);
+        req.push_back(Pair("id", i));
+        req.push_back(Pair("method", i % 7 == 3 ? "setban" : "getblockcount"));
+        req.push_back(Pair("params", UniValue(UniValue::VARR)));
+        batch.push_back(req);
+    }
+    batch.push_back(UniValue(42));
+
+    UniValue reply;
+    BOOST_CHECK(reply.read(JSONRPCExecBatch(batch)));
+    BOOST_CHECK(reply.isArray());
+    BOOST_CHECK_EQUAL(reply.size(), batch.size());
+    for (int i = 0; i < 20; i++)
+        BOOST_CHECK_EQUAL(find_value(reply[i].get_obj(), "id").get_int(), i);
+    BOOST_CHECK(!find_value(reply[20].get_obj(), "error").isNull());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "saltedhashindex.h"
+
+#include "arith_uint256.h"
+#include "primitives/transaction.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+
+BOOST_FIXTURE_TEST_SUITE(saltedhashindex_tests, BasicTestingSetup)
+
+static std::vector<CTransaction> MakeTransactions(size_t n)
+{
+    std::vector<CTransaction> vtx;
+    for (size_t i = 0; i < n; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i + 1)), 0);
+        vtx.push_back(mtx);
+    }
+    return vtx;
+}
+
+BOOST_AUTO_TEST_CASE(saltedhashindex_matches_map)
+{
+    std::vector<CTransaction> vtx = MakeTransactions(8);
+    CSaltedHashIndex index;
+    std::map<uint256, const CTransaction*> mapExpected;
+    CSaltedHashIndex::Summary expected;
+
+    BOOST_CHECK(index.empty());
+    BOOST_CHECK(index.find(uint256()) == NULL);
+    BOOST_CHECK(!index.erase(uint256()));
+
+    // Random inserts, overwrites and erases over a small key space, so
+    // clusters form and the table grows and shrinks
+    std::vector<uint256> vKeys;
+    for (int i = 0; i < 300; i++)
+        vKeys.push_back(GetRandHash());
+    for (int i = 0; i < 20000; i++) {
+        const uint256& key = vKeys[insecure_rand() % vKeys.size()];
+        if (insecure_rand() % 3 != 0) {
+            const CTransaction* ptx = &vtx[insecure_rand() % vtx.size()];
+            if (mapExpected.count(key))
+                expected.Remove(key, mapExpected[key]->GetHash());
+            mapExpected[key] = ptx;
+            expected.Add(key, ptx->GetHash());
+            index.insert(key, ptx);
+        } else {
+            bool fPresent = mapExpected.count(key);
+            if (fPresent) {
+                expected.Remove(key, mapExpected[key]->GetHash());
+                mapExpected.erase(key);
+            }
+            BOOST_CHECK_EQUAL(index.erase(key), fPresent);
+        }
+        BOOST_CHECK_EQUAL(index.size(), mapExpected.size());
+    }
+
+    for (const uint256& key : vKeys) {
+        std::map<uint256, const CTransaction*>::const_iterator it = mapExpected.find(key);
+        BOOST_CHECK(index.find(key) == (it == mapExpected.end() ? NULL : it->second));
+    }
+    BOOST_CHECK(index.GetSummary() == expected);
+
+    // Emptying it key by key shrinks the table back down
+    size_t nUsage = index.DynamicMemoryUsage();
+    for (const uint256& key : vKeys)
+        index.erase(key);
+    BOOST_CHECK(index.empty());
+    BOOST_CHECK(index.DynamicMemoryUsage() < nUsage);
+    BOOST_CHECK(index.GetSummary() == CSaltedHashIndex::Summary());
+}
+
+BOOST_AUTO_TEST_CASE(saltedhashindex_summary)
+{
+    std::vector<CTransaction> vtx = MakeTransactions(2);
+    uint256 key1 = GetRandHash(), key2 = GetRandHash();
+
+    // Order does not matter, the transaction a key maps to does
+    CSaltedHashIndex index1, index2;
+    index1.insert(key1, &vtx[0]);
+    index1.insert(key2, &vtx[1]);
+    index2.insert(key2, &vtx[1]);
+    index2.insert(key1, &vtx[0]);
+    BOOST_CHECK(index1.GetSummary() == index2.GetSummary());
+
+    index2.insert(key1, &vtx[1]);
+    BOOST_CHECK_EQUAL(index2.size(), 2);
+    BOOST_CHECK(!(index1.GetSummary() == index2.GetSummary()));
+
+    index2.insert(key1, &vtx[0]);
+    BOOST_CHECK(index1.GetSummary() == index2.GetSummary());
+
+    index1.clear();
+    BOOST_CHECK(index1.empty());
+    BOOST_CHECK(index1.find(key1) == NULL);
+    BOOST_CHECK(index1.GetSummary() == CSaltedHashIndex::Summary());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "net.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#endif
+
+BOOST_FIXTURE_TEST_SUITE(socketsend_tests, TestingSetup)
+
+#ifndef WIN32
+/** Read whatever the peer end has buffered, without blocking */
+static void DrainSocket(int fd, std::vector<unsigned char>& vReceived)
+{
+    unsigned char buf[65536];
+    ssize_t nRead;
+    while ((nRead = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        vReceived.insert(vReceived.end(), buf, buf + nRead);
+}
+
+BOOST_AUTO_TEST_CASE(socketsend_partial_retire)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    // Small kernel buffers so one sendmsg cannot take the whole queue
+    int nBufSize = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &nBufSize, sizeof(nBufSize));
+    setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &nBufSize, sizeof(nBufSize));
+
+    struct in_addr loopback;
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    CAddress addr(CService(loopback, Params().GetDefaultPort()));
+    CNode node(fds[0], addr, "", true);
+
+    // Two small messages ahead of a large one, then more of both
+    const size_t vSizes[] = {100, 200, 50000, 300, 70000, 10};
+    std::vector<unsigned char> vExpected;
+    {
+        LOCK(node.cs_vSend);
+        for (size_t i = 0; i < sizeof(vSizes) / sizeof(vSizes[0]); i++) {
+            CSerializeData data(vSizes[i]);
+            for (size_t j = 0; j < data.size(); j++)
+                data[j] = (char)(i * 31 + j);
+            vExpected.insert(vExpected.end(), data.begin(), data.end());
+            node.vSendMsg.push_back(std::make_shared<const CSerializeData>(data));
+            node.nSendSize += data.size();
+        }
+    }
+
+    std::vector<unsigned char> vReceived;
+    bool fRetiredIntoPartial = false;
+    for (int nRound = 0; nRound < 10000; nRound++) {
+        LOCK(node.cs_vSend);
+        if (node.vSendMsg.empty())
+            break;
+        size_t nQueued = node.vSendMsg.size();
+        SocketSendData(&node);
+
+        // What is still queued is exactly what the peer has not been handed
+        size_t nQueuedSize = 0;
+        for (size_t i = 0; i < node.vSendMsg.size(); i++)
+            nQueuedSize += node.vSendMsg[i]->size();
+        BOOST_CHECK_EQUAL(node.nSendSize, nQueuedSize);
+        BOOST_CHECK_EQUAL(node.nSendBytes + nQueuedSize - node.nSendOffset, vExpected.size());
+        if (!node.vSendMsg.empty())
+            BOOST_CHECK(node.nSendOffset < node.vSendMsg.front()->size());
+        if (node.vSendMsg.size() + 1 < nQueued && node.nSendOffset > 0)
+            fRetiredIntoPartial = true;
+
+        DrainSocket(fds[1], vReceived);
+    }
+    DrainSocket(fds[1], vReceived);
+
+    // One write completed several messages and stopped inside the next
+    BOOST_CHECK(fRetiredIntoPartial);
+    {
+        LOCK(node.cs_vSend);
+        BOOST_CHECK(node.vSendMsg.empty());
+        BOOST_CHECK_EQUAL(node.nSendSize, 0);
+        BOOST_CHECK_EQUAL(node.nSendOffset, 0);
+    }
+    BOOST_CHECK(vReceived == vExpected);
+    close(fds[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,169 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stratum.h"
+
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "streams.h"
+#include "util/strencodings.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stratum_tests, BasicTestingSetup)
+
+/**
+ * A miner stub that rebuilds the header from mining.notify params, the way
+ * stratum miners do, and "solves" it with a known nonce and solution.
+ */
+struct StratumMinerStub
+{
+    std::vector<unsigned char> vNonce1;
+    CBlockHeader header;
+
+    static uint32_t ParseLE32(const UniValue& value)
+    {
+        std::vector<unsigned char> v = ParseHex(value.get_str());
+        BOOST_REQUIRE_EQUAL(v.size(), 4);
+        return ReadLE32(v.data());
+    }
+
+    static uint256 ParseHash(const UniValue& value)
+    {
+        std::vector<unsigned char> v = ParseHex(value.get_str());
+        BOOST_REQUIRE_EQUAL(v.size(), 32);
+        uint256 hash;
+        std::copy(v.begin(), v.end(), hash.begin());
+        return hash;
+    }
+
+    void Notify(const UniValue& params)
+    {
+        BOOST_REQUIRE_EQUAL(params.size(), 8);
+        header.SetNull();
+        header.nVersion = ParseLE32(params[1]);
+        header.hashPrevBlock = ParseHash(params[2]);
+        header.hashMerkleRoot = ParseHash(params[3]);
+        header.hashFinalSaplingRoot = ParseHash(params[4]);
+        header.nTime = ParseLE32(params[5]);
+        header.nBits = ParseLE32(params[6]);
+    }
+
+    UniValue Submit(const std::string& strJobId, const uint256& nonce, const std::vector<unsigned char>& solution)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << solution;
+        UniValue params(UniValue::VARR);
+        params.push_back("stub");
+        params.push_back(strJobId);
+        params.push_back(HexStr(BEGIN(header.nTime), END(header.nTime)));
+        params.push_back(HexStr(nonce.begin() + vNonce1.size(), nonce.end()));
+        params.push_back(HexStr(ss.begin(), ss.end()));
+        return params;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(stratum_job_roundtrip)
+{
+    const CBlock& genesis = Params().GenesisBlock();
+    CBlock block = genesis;
+    block.nNonce.SetNull();
+    block.nSolution.clear();
+    CStratumJob job("00000001", block, 0, 0);
+
+    // The notified header is the template header
+    StratumMinerStub miner;
+    miner.vNonce1.assign(genesis.nNonce.begin(), genesis.nNonce.begin() + STRATUM_NONCE1_SIZE);
+    UniValue notify = job.GetNotifyParams(true);
+    BOOST_CHECK_EQUAL(notify[0].get_str(), "00000001");
+    BOOST_CHECK(notify[7].get_bool());
+    BOOST_CHECK(!job.GetNotifyParams(false)[7].get_bool());
+    miner.Notify(notify);
+    BOOST_CHECK(miner.header.GetHash() == block.GetHash());
+
+    // The submitted share rebuilds the genesis header, whose solution is valid
+    UniValue submit = miner.Submit(job.strId, genesis.nNonce, genesis.nSolution);
+    CBlockHeader header;
+    std::string strError;
+    BOOST_REQUIRE(job.GetSubmittedHeader(miner.vNonce1, submit, header, strError));
+    BOOST_CHECK(header.GetHash() == genesis.GetHash());
+    BOOST_CHECK(UintToArith256(header.GetHash()) <= job.hashTarget);
+    BOOST_CHECK(job.CheckSolution(header));
+    BOOST_CHECK(job.GetBlock(header).GetHash() == genesis.GetHash());
+
+    // The same share again is a duplicate
+    BOOST_CHECK(job.AddShare(header.GetHash()));
+    BOOST_CHECK(!job.AddShare(header.GetHash()));
+
+    // Another session's nonce prefix does not solve it
+    std::vector<unsigned char> vOtherNonce1 = miner.vNonce1;
+    vOtherNonce1[0] ^= 1;
+    BOOST_REQUIRE(job.GetSubmittedHeader(vOtherNonce1, submit, header, strError));
+    BOOST_CHECK(!job.CheckSolution(header));
+
+    // Neither does a changed solution
+    std::vector<unsigned char> solution = genesis.nSolution;
+    solution[10] ^= 1;
+    BOOST_REQUIRE(job.GetSubmittedHeader(miner.vNonce1, miner.Submit(job.strId, genesis.nNonce, solution), header, strError));
+    BOOST_CHECK(!job.CheckSolution(header));
+}
+
+static UniValue WithParam(const UniValue& params, size_t i, const std::string& value)
+{
+    UniValue result(UniValue::VARR);
+    for (size_t j = 0; j < params.size(); j++)
+        result.push_back(j == i ? UniValue(value) : params[j]);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(stratum_job_malformed_submit)
+{
+    CBlock block = Params().GenesisBlock();
+    block.nNonce.SetNull();
+    block.nSolution.clear();
+    CStratumJob job("00000002", block, 0, 0);
+    std::vector<unsigned char> vNonce1(STRATUM_NONCE1_SIZE, 0);
+
+    StratumMinerStub miner;
+    miner.vNonce1 = vNonce1;
+    miner.Notify(job.GetNotifyParams(false));
+    UniValue good = miner.Submit(job.strId, uint256(), std::vector<unsigned char>(1344));
+    CBlockHeader header;
+    std::string strError;
+    BOOST_CHECK(job.GetSubmittedHeader(vNonce1, good, header, strError));
+
+    BOOST_CHECK(!job.GetSubmittedHeader(vNonce1, UniValue(UniValue::VARR), header, strError));
+
+    BOOST_CHECK(!job.GetSubmittedHeader(vNonce1, WithParam(good, 2, "0102"), header, strError));
+    BOOST_CHECK_EQUAL(strError, "Invalid time");
+
+    BOOST_CHECK(!job.GetSubmittedHeader(vNonce1, WithParam(good, 3, good[3].get_str() + "00"), header, strError));
+    BOOST_CHECK_EQUAL(strError, "Invalid nonce2 length");
+
+    // The solution must carry exactly the length its prefix declares
+    const std::string& strSolution = good[4].get_str();
+    BOOST_CHECK(!job.GetSubmittedHeader(vNonce1, WithParam(good, 4, strSolution + "00"), header, strError));
+    BOOST_CHECK_EQUAL(strError, "Invalid solution");
+    BOOST_CHECK(!job.GetSubmittedHeader(vNonce1, WithParam(good, 4, strSolution.substr(0, 100)), header, strError));
+    BOOST_CHECK(!job.GetSubmittedHeader(vNonce1, WithParam(good, 4, "zz"), header, strError));
+}
+
+BOOST_AUTO_TEST_CASE(stratum_job_share_limit)
+{
+    CBlock block = Params().GenesisBlock();
+    CStratumJob job("00000003", block, 0, 0);
+
+    // A job records distinct shares up to its limit, then turns new ones away
+    for (size_t i = 0; i < MAX_STRATUM_JOB_SHARES; i++)
+        BOOST_REQUIRE(job.AddShare(ArithToUint256(arith_uint256(i + 1))));
+    BOOST_CHECK_EQUAL(job.GetShareCount(), MAX_STRATUM_JOB_SHARES);
+    BOOST_CHECK(!job.AddShare(ArithToUint256(arith_uint256(MAX_STRATUM_JOB_SHARES + 1))));
+    BOOST_CHECK(!job.AddShare(ArithToUint256(arith_uint256(1))));
+    BOOST_CHECK_EQUAL(job.GetShareCount(), MAX_STRATUM_JOB_SHARES);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
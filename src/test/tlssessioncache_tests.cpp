@@ -0,0 +1,86 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "tls/tlssessioncache.h"
+
+#include "tinyformat.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace tls;
+
+BOOST_FIXTURE_TEST_SUITE(tlssessioncache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(tlssessioncache_take_once)
+{
+    TLSSessionCache cache(10);
+    SSL_SESSION* session = SSL_SESSION_new();
+    BOOST_REQUIRE(session != NULL);
+    BOOST_CHECK(cache.store("1.2.3.4:8333", session));
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+
+    // A ticket is offered once; the caller owns it afterwards
+    BOOST_CHECK(cache.take("5.6.7.8:8333") == NULL);
+    BOOST_CHECK(cache.take("1.2.3.4:8333") == session);
+    BOOST_CHECK(cache.take("1.2.3.4:8333") == NULL);
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+    SSL_SESSION_free(session);
+
+    // A peer's replacement ticket frees the one it had
+    BOOST_CHECK(cache.store("1.2.3.4:8333", SSL_SESSION_new()));
+    session = SSL_SESSION_new();
+    BOOST_CHECK(cache.store("1.2.3.4:8333", session));
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+    BOOST_CHECK(cache.take("1.2.3.4:8333") == session);
+    SSL_SESSION_free(session);
+
+    // Sessions without a peer are not kept
+    session = SSL_SESSION_new();
+    BOOST_CHECK(!cache.store("", session));
+    SSL_SESSION_free(session);
+}
+
+BOOST_AUTO_TEST_CASE(tlssessioncache_lru)
+{
+    TLSSessionCache cache(3);
+    std::vector<SSL_SESSION*> vSessions;
+    for (int i = 0; i < 4; i++) {
+        vSessions.push_back(SSL_SESSION_new());
+        BOOST_CHECK(cache.store(strprintf("peer%d", i), vSessions.back()));
+    }
+
+    // The least recently stored session went to make room
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+    BOOST_CHECK(cache.take("peer0") == NULL);
+
+    // Storing again makes a peer the most recent one
+    SSL_SESSION* session = cache.take("peer1");
+    BOOST_CHECK(session == vSessions[1]);
+    BOOST_CHECK(cache.store("peer1", session));
+    BOOST_CHECK(cache.store("peer4", SSL_SESSION_new()));
+    BOOST_CHECK(cache.take("peer2") == NULL);
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+
+    // Shrinking evicts from the oldest, a size of 0 disables the cache
+    cache.setMaxSize(1);
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+    BOOST_CHECK(cache.take("peer3") == NULL);
+    BOOST_CHECK(cache.take("peer1") == NULL);
+    cache.setMaxSize(0);
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+    session = SSL_SESSION_new();
+    BOOST_CHECK(!cache.store("peer5", session));
+    SSL_SESSION_free(session);
+
+    // Whatever is left is freed by clear
+    cache.setMaxSize(3);
+    BOOST_CHECK(cache.store("peer6", SSL_SESSION_new()));
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,430 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "pinsketch.h"
+#include "random.h"
+#include "txreconciliation.h"
+#include "tinyformat.h"
+#include "test/test_bitcoin.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+static uint32_t RandElement()
+{
+    uint32_t n;
+    do {
+        n = insecure_rand();
+    } while (n == 0);
+    return n;
+}
+
+BOOST_AUTO_TEST_CASE(pinsketch_roundtrip)
+{
+    seed_insecure_rand(true);
+    for (int nTrial = 0; nTrial < 50; nTrial++) {
+        size_t nCapacity = 1 + insecure_rand() % 40;
+        size_t nDiff = insecure_rand() % (nCapacity + 1);
+
+        // Shared elements cancel out, only the symmetric difference is decoded
+        PinSketch a(nCapacity), b(nCapacity);
+        for (int i = 0; i < 100; i++) {
+            uint32_t n = RandElement();
+            a.Add(n);
+            b.Add(n);
+        }
+        std::set<uint32_t> setDiff;
+        while (setDiff.size() < nDiff)
+            setDiff.insert(RandElement());
+        int i = 0;
+        for (std::set<uint32_t>::const_iterator it = setDiff.begin(); it != setDiff.end(); ++it, ++i)
+            (i % 2 ? a : b).Add(*it);
+
+        BOOST_CHECK(a.Merge(b));
+        std::vector<uint32_t> vDecoded;
+        BOOST_CHECK(a.Decode(nCapacity, vDecoded));
+        BOOST_CHECK(std::set<uint32_t>(vDecoded.begin(), vDecoded.end()) == setDiff);
+        BOOST_CHECK_EQUAL(vDecoded.size(), setDiff.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pinsketch_overfull)
+{
+    seed_insecure_rand(true);
+    PinSketch sketch(10);
+    for (int i = 0; i < 20; i++)
+        sketch.Add(RandElement());
+    std::vector<uint32_t> vDecoded;
+    BOOST_CHECK(!sketch.Decode(10, vDecoded));
+    BOOST_CHECK(vDecoded.empty());
+
+    // Decodable, but more elements than the caller allows
+    PinSketch small(10);
+    for (int i = 0; i < 5; i++)
+        small.Add(RandElement());
+    BOOST_CHECK(!small.Decode(4, vDecoded));
+    BOOST_CHECK(small.Decode(5, vDecoded));
+
+    // Capacities must match to merge
+    PinSketch other(9);
+    BOOST_CHECK(!small.Merge(other));
+}
+
+BOOST_AUTO_TEST_CASE(pinsketch_serialization)
+{
+    seed_insecure_rand(true);
+    PinSketch sketch(7);
+    for (int i = 0; i < 5; i++)
+        sketch.Add(RandElement());
+    std::vector<unsigned char> vData = sketch.Serialize();
+    BOOST_CHECK_EQUAL(vData.size(), 28U);
+
+    PinSketch sketch2;
+    BOOST_CHECK(sketch2.Deserialize(vData));
+    BOOST_CHECK(sketch == sketch2);
+    BOOST_CHECK_EQUAL(sketch2.GetCapacity(), 7U);
+
+    vData.pop_back();
+    BOOST_CHECK(!sketch2.Deserialize(vData));
+}
+
+BOOST_AUTO_TEST_CASE(tracker_registration)
+{
+    TxReconciliationTracker tracker;
+
+    // sendtxrcncl without having sent ours first
+    BOOST_CHECK(!tracker.RegisterPeer(0, false, TXRECONCILIATION_VERSION, 1));
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    BOOST_CHECK(tracker.ShouldFloodTo(0));
+
+    // Incompatible version
+    tracker.PreRegisterPeer(0);
+    BOOST_CHECK(!tracker.RegisterPeer(0, false, 0, 1));
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+
+    // sendtxrcncl after the peer's verack
+    tracker.PreRegisterPeer(0);
+    tracker.PeerVerack(0);
+    BOOST_CHECK(!tracker.RegisterPeer(0, false, TXRECONCILIATION_VERSION, 1));
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    BOOST_CHECK(tracker.ShouldFloodTo(0));
+
+    // Only the first outbound peers are flooded to
+    for (NodeId id = 1; id <= MAX_OUTBOUND_FLOOD_TO + 2; id++) {
+        tracker.PreRegisterPeer(id);
+        BOOST_CHECK(tracker.RegisterPeer(id, false, TXRECONCILIATION_VERSION, id));
+        BOOST_CHECK(tracker.IsPeerRegistered(id));
+        BOOST_CHECK_EQUAL(tracker.ShouldFloodTo(id), id <= MAX_OUTBOUND_FLOOD_TO);
+    }
+    // Registering twice is refused, and a verack after registering changes nothing
+    BOOST_CHECK(!tracker.RegisterPeer(1, false, TXRECONCILIATION_VERSION, 1));
+    tracker.PeerVerack(1);
+    BOOST_CHECK(tracker.IsPeerRegistered(1));
+
+    tracker.PreRegisterPeer(10);
+    BOOST_CHECK(tracker.RegisterPeer(10, true, TXRECONCILIATION_VERSION, 10));
+    BOOST_CHECK(!tracker.ShouldFloodTo(10));
+
+    // A flood slot frees up when a flooding peer goes away
+    tracker.ForgetPeer(1);
+    BOOST_CHECK(!tracker.IsPeerRegistered(1));
+    tracker.PreRegisterPeer(11);
+    BOOST_CHECK(tracker.RegisterPeer(11, false, TXRECONCILIATION_VERSION, 11));
+    BOOST_CHECK(tracker.ShouldFloodTo(11));
+
+    // Unregistered peers cannot queue transactions
+    BOOST_CHECK(!tracker.AddToSet(1, GetRandHash()));
+    BOOST_CHECK(tracker.AddToSet(10, GetRandHash()));
+}
+
+/** Register a connection opened by the owner of from to the owner of to in both trackers. */
+static void Connect(TxReconciliationTracker& from, NodeId idTo, TxReconciliationTracker& to, NodeId idFrom)
+{
+    uint64_t nSaltFrom = from.PreRegisterPeer(idTo);
+    uint64_t nSaltTo = to.PreRegisterPeer(idFrom);
+    BOOST_CHECK(from.RegisterPeer(idTo, false, TXRECONCILIATION_VERSION, nSaltTo));
+    BOOST_CHECK(to.RegisterPeer(idFrom, true, TXRECONCILIATION_VERSION, nSaltFrom));
+}
+
+BOOST_AUTO_TEST_CASE(tracker_reconciliation)
+{
+    // Use up the flood slots so the peer under test is reconciled with
+    TxReconciliationTracker initiator, responder;
+    for (NodeId id = 100; id < 100 + MAX_OUTBOUND_FLOOD_TO; id++) {
+        initiator.PreRegisterPeer(id);
+        initiator.RegisterPeer(id, false, TXRECONCILIATION_VERSION, id);
+    }
+    Connect(initiator, 1, responder, 0);
+    BOOST_CHECK_EQUAL(initiator.GetShortID(1, uint256()), responder.GetShortID(0, uint256()));
+
+    std::set<uint256> setShared, setInitiatorOnly, setResponderOnly;
+    for (int i = 0; i < 20; i++)
+        setShared.insert(GetRandHash());
+    for (int i = 0; i < 4; i++)
+        setInitiatorOnly.insert(GetRandHash());
+    for (int i = 0; i < 3; i++)
+        setResponderOnly.insert(GetRandHash());
+    BOOST_FOREACH(const uint256& txid, setShared) {
+        BOOST_CHECK(initiator.AddToSet(1, txid));
+        BOOST_CHECK(responder.AddToSet(0, txid));
+    }
+    BOOST_FOREACH(const uint256& txid, setInitiatorOnly)
+        BOOST_CHECK(initiator.AddToSet(1, txid));
+    BOOST_FOREACH(const uint256& txid, setResponderOnly)
+        BOOST_CHECK(responder.AddToSet(0, txid));
+
+    // Only the connecting side initiates, and not again before the interval
+    uint16_t nSetSize, nQ;
+    BOOST_CHECK(!responder.InitiateReconciliation(0, 0, nSetSize, nQ));
+    BOOST_CHECK(initiator.InitiateReconciliation(1, 0, nSetSize, nQ));
+    BOOST_CHECK_EQUAL(nSetSize, 24);
+    BOOST_CHECK(!initiator.InitiateReconciliation(1, RECON_REQUEST_INTERVAL, nSetSize, nQ));
+
+    std::vector<unsigned char> vSketch;
+    BOOST_CHECK(responder.RespondToRequest(0, nSetSize, nQ, vSketch));
+    BOOST_CHECK(!vSketch.empty());
+
+    bool fSuccess;
+    std::vector<uint256> vAnnounce;
+    std::vector<uint32_t> vAskShortIds;
+    BOOST_CHECK(initiator.HandleSketch(1, vSketch, fSuccess, vAnnounce, vAskShortIds));
+    BOOST_CHECK(fSuccess);
+    BOOST_CHECK(std::set<uint256>(vAnnounce.begin(), vAnnounce.end()) == setInitiatorOnly);
+    BOOST_CHECK_EQUAL(vAskShortIds.size(), setResponderOnly.size());
+
+    std::vector<uint256> vResponderAnnounce;
+    BOOST_CHECK(responder.HandleReconcilDiff(0, true, vAskShortIds, vResponderAnnounce));
+    BOOST_CHECK(std::set<uint256>(vResponderAnnounce.begin(), vResponderAnnounce.end()) == setResponderOnly);
+
+    // Neither message is accepted twice
+    BOOST_CHECK(!initiator.HandleSketch(1, vSketch, fSuccess, vAnnounce, vAskShortIds));
+    BOOST_CHECK(!responder.HandleReconcilDiff(0, true, vAskShortIds, vResponderAnnounce));
+
+    // Both sets were cleared: the next round is empty on both sides
+    BOOST_CHECK(initiator.InitiateReconciliation(1, RECON_REQUEST_INTERVAL + 1, nSetSize, nQ));
+    BOOST_CHECK_EQUAL(nSetSize, 0);
+    BOOST_CHECK(responder.RespondToRequest(0, nSetSize, nQ, vSketch));
+    BOOST_CHECK(initiator.HandleSketch(1, vSketch, fSuccess, vAnnounce, vAskShortIds));
+    BOOST_CHECK(fSuccess);
+    BOOST_CHECK(vAnnounce.empty() && vAskShortIds.empty());
+}
+
+BOOST_AUTO_TEST_CASE(tracker_fallback)
+{
+    TxReconciliationTracker initiator, responder;
+    for (NodeId id = 100; id < 100 + MAX_OUTBOUND_FLOOD_TO; id++) {
+        initiator.PreRegisterPeer(id);
+        initiator.RegisterPeer(id, false, TXRECONCILIATION_VERSION, id);
+    }
+    Connect(initiator, 1, responder, 0);
+
+    // A difference larger than the largest sketch: the responder sends an empty one
+    std::set<uint256> setInitiator, setResponder;
+    for (size_t i = 0; i < MAX_SKETCH_CAPACITY; i++) {
+        uint256 txid = GetRandHash();
+        setInitiator.insert(txid);
+        BOOST_CHECK(initiator.AddToSet(1, txid));
+        txid = GetRandHash();
+        setResponder.insert(txid);
+        BOOST_CHECK(responder.AddToSet(0, txid));
+    }
+    uint16_t nSetSize, nQ;
+    BOOST_CHECK(initiator.InitiateReconciliation(1, 0, nSetSize, nQ));
+    std::vector<unsigned char> vSketch;
+    BOOST_CHECK(responder.RespondToRequest(0, nSetSize, nQ, vSketch));
+
+    bool fSuccess;
+    std::vector<uint256> vAnnounce;
+    std::vector<uint32_t> vAskShortIds;
+    BOOST_CHECK(initiator.HandleSketch(1, vSketch, fSuccess, vAnnounce, vAskShortIds));
+    BOOST_CHECK(!fSuccess);
+    BOOST_CHECK(std::set<uint256>(vAnnounce.begin(), vAnnounce.end()) == setInitiator);
+
+    std::vector<uint256> vResponderAnnounce;
+    BOOST_CHECK(responder.HandleReconcilDiff(0, false, vAskShortIds, vResponderAnnounce));
+    BOOST_CHECK(std::set<uint256>(vResponderAnnounce.begin(), vResponderAnnounce.end()) == setResponder);
+}
+
+/**
+ * Simulated network for comparing the bandwidth spent on announcing
+ * transactions by flooding and by reconciliation. Nodes send one inv per peer
+ * per step with everything they learnt in the previous one; transactions
+ * themselves cost the same either way and are not counted.
+ */
+class RelaySimulation
+{
+public:
+    static const size_t MESSAGE_HEADER_SIZE = 24;
+    static const size_t INV_ENTRY_SIZE = 36;
+
+    struct Node {
+        TxReconciliationTracker tracker;
+        std::vector<NodeId> vPeers;
+        std::set<uint256> setHave;
+        std::map<NodeId, std::set<uint256> > mapKnown;      //!< what each peer is known to have
+        std::map<NodeId, std::vector<uint256> > mapPending; //!< to announce to each peer next step
+        std::vector<uint256> vNew;                          //!< learnt this step
+    };
+
+    std::vector<Node> vNodes;
+    bool fReconcile;
+    int64_t nTime;
+    uint64_t nBytes;
+
+    RelaySimulation(int nNodes, int nOutbound, bool fReconcileIn) : vNodes(nNodes), fReconcile(fReconcileIn), nTime(0), nBytes(0)
+    {
+        for (int i = 0; i < nNodes; i++) {
+            std::set<NodeId> setOut;
+            while ((int)setOut.size() < nOutbound) {
+                NodeId j = insecure_rand() % nNodes;
+                if (j != i && !std::count(vNodes[i].vPeers.begin(), vNodes[i].vPeers.end(), j))
+                    setOut.insert(j);
+            }
+            BOOST_FOREACH(NodeId j, setOut) {
+                vNodes[i].vPeers.push_back(j);
+                vNodes[j].vPeers.push_back(i);
+                if (fReconcile)
+                    Connect(vNodes[i].tracker, j, vNodes[j].tracker, i);
+            }
+        }
+    }
+
+    void Inject(const uint256& txid)
+    {
+        Learn(insecure_rand() % vNodes.size(), txid);
+    }
+
+    void Learn(NodeId id, const uint256& txid)
+    {
+        if (vNodes[id].setHave.insert(txid).second)
+            vNodes[id].vNew.push_back(txid);
+    }
+
+    /** Deliver an inv, as the INV handler does. */
+    void ReceiveInv(NodeId id, NodeId from, const std::vector<uint256>& vTxid)
+    {
+        if (vTxid.empty())
+            return;
+        nBytes += MESSAGE_HEADER_SIZE + 3 + INV_ENTRY_SIZE * vTxid.size();
+        BOOST_FOREACH(const uint256& txid, vTxid) {
+            vNodes[id].mapKnown[from].insert(txid);
+            vNodes[from].mapKnown[id].insert(txid);
+            if (fReconcile)
+                vNodes[id].tracker.RemoveFromSet(from, txid);
+            Learn(id, txid);
+        }
+    }
+
+    void Step()
+    {
+        // Queue what was learnt last step, as SendMessages does
+        for (size_t i = 0; i < vNodes.size(); i++) {
+            Node& node = vNodes[i];
+            BOOST_FOREACH(const uint256& txid, node.vNew) {
+                BOOST_FOREACH(NodeId peer, node.vPeers) {
+                    if (node.mapKnown[peer].count(txid))
+                        continue;
+                    if (fReconcile && !node.tracker.ShouldFloodTo(peer) && node.tracker.AddToSet(peer, txid))
+                        continue;
+                    node.mapPending[peer].push_back(txid);
+                }
+            }
+            node.vNew.clear();
+        }
+        for (size_t i = 0; i < vNodes.size(); i++) {
+            Node& node = vNodes[i];
+            BOOST_FOREACH(NodeId peer, node.vPeers) {
+                std::vector<uint256> vInv;
+                BOOST_FOREACH(const uint256& txid, node.mapPending[peer]) {
+                    if (!node.mapKnown[peer].count(txid))
+                        vInv.push_back(txid);
+                }
+                node.mapPending[peer].clear();
+                ReceiveInv(peer, i, vInv);
+                if (fReconcile)
+                    Reconcile(i, peer);
+            }
+        }
+        nTime += 1000000;
+    }
+
+    void Reconcile(NodeId idInit, NodeId idResp)
+    {
+        Node& init = vNodes[idInit];
+        Node& resp = vNodes[idResp];
+        uint16_t nSetSize, nQ;
+        if (!init.tracker.InitiateReconciliation(idResp, nTime, nSetSize, nQ))
+            return;
+        nBytes += MESSAGE_HEADER_SIZE + 4;
+
+        std::vector<unsigned char> vSketch;
+        BOOST_CHECK(resp.tracker.RespondToRequest(idInit, nSetSize, nQ, vSketch));
+        nBytes += MESSAGE_HEADER_SIZE + 1 + vSketch.size();
+
+        bool fSuccess;
+        std::vector<uint256> vAnnounce, vRespAnnounce;
+        std::vector<uint32_t> vAskShortIds;
+        BOOST_CHECK(init.tracker.HandleSketch(idResp, vSketch, fSuccess, vAnnounce, vAskShortIds));
+        nBytes += MESSAGE_HEADER_SIZE + 2 + 4 * vAskShortIds.size();
+        BOOST_CHECK(resp.tracker.HandleReconcilDiff(idInit, fSuccess, vAskShortIds, vRespAnnounce));
+
+        ReceiveInv(idResp, idInit, Filter(idInit, idResp, vAnnounce));
+        ReceiveInv(idInit, idResp, Filter(idResp, idInit, vRespAnnounce));
+    }
+
+    /** Skip what the peer is already known to have, as AnnounceReconciledTransactions does. */
+    std::vector<uint256> Filter(NodeId id, NodeId peer, const std::vector<uint256>& vTxid)
+    {
+        std::vector<uint256> vRet;
+        BOOST_FOREACH(const uint256& txid, vTxid) {
+            if (!vNodes[id].mapKnown[peer].count(txid))
+                vRet.push_back(txid);
+        }
+        return vRet;
+    }
+
+    bool AllHave(size_t nTx) const
+    {
+        for (size_t i = 0; i < vNodes.size(); i++) {
+            if (vNodes[i].setHave.size() != nTx)
+                return false;
+        }
+        return true;
+    }
+};
+
+static uint64_t SimulateRelay(bool fReconcile)
+{
+    seed_insecure_rand(true);
+    RelaySimulation sim(24, 6, fReconcile);
+    std::vector<uint256> vTx;
+    for (int nStep = 0; nStep < 20; nStep++) {
+        for (int i = 0; i < 5; i++) {
+            vTx.push_back(ArithToUint256(arith_uint256(vTx.size() + 1)));
+            sim.Inject(vTx.back());
+        }
+        sim.Step();
+    }
+    // Drain: at least two full reconciliation intervals
+    for (int nStep = 0; nStep < 3 * RECON_REQUEST_INTERVAL / 1000000; nStep++)
+        sim.Step();
+    BOOST_CHECK(sim.AllHave(vTx.size()));
+    return sim.nBytes;
+}
+
+BOOST_AUTO_TEST_CASE(relay_simulation)
+{
+    uint64_t nFloodBytes = SimulateRelay(false);
+    uint64_t nReconBytes = SimulateRelay(true);
+    BOOST_TEST_MESSAGE(strprintf("announcement bytes: flooding %u, reconciliation %u (%.2f)",
+                                 nFloodBytes, nReconBytes, (double)nReconBytes / nFloodBytes));
+    BOOST_CHECK(nReconBytes < nFloodBytes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
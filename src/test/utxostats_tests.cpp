@@ -0,0 +1,184 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "coins.h"
+#include "key.h"
+#include "main.h"
+#include "txdb.h"
+#include "undo.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxostats_tests, TestingSetup)
+
+static CScript PayToNewKey()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return CScript() << OP_DUP << OP_HASH160 << ToByteVector(key.GetPubKey().GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+static CBlock MakeBlock(const uint256& hashPrev, int nHeight, int nCoinbaseOutputs, const std::vector<CMutableTransaction>& vtx)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    for (int i = 0; i < nCoinbaseOutputs; i++)
+        coinbase.vout.push_back(CTxOut((i + 1) * COIN, PayToNewKey()));
+
+    CBlock block;
+    block.hashPrevBlock = hashPrev;
+    block.vtx.push_back(coinbase);
+    for (size_t i = 0; i < vtx.size(); i++)
+        block.vtx.push_back(vtx[i]);
+    return block;
+}
+
+static CMutableTransaction Spend(const std::vector<COutPoint>& vPrevouts, int nOutputs, bool fDataOutput = false)
+{
+    CMutableTransaction tx;
+    for (size_t i = 0; i < vPrevouts.size(); i++)
+        tx.vin.push_back(CTxIn(vPrevouts[i]));
+    for (int i = 0; i < nOutputs; i++)
+        tx.vout.push_back(CTxOut(COIN / 2 + i, PayToNewKey()));
+    // never enters the coins database
+    if (fDataOutput)
+        tx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << ToByteVector(GetRandHash())));
+    return tx;
+}
+
+/** Connect a block to view the way ConnectBlock does, returning its undo data */
+static CBlockUndo ConnectToView(const CBlock& block, int nHeight, CCoinsViewCache& view)
+{
+    CBlockUndo blockundo;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        CTxUndo undoDummy;
+        if (i > 0)
+            blockundo.vtxundo.push_back(CTxUndo());
+        UpdateCoins(block.vtx[i], view, i == 0 ? undoDummy : blockundo.vtxundo.back(), nHeight);
+    }
+    return blockundo;
+}
+
+/** Index entry of a block, applied to its parent's entry like ConnectBlock does */
+static CUTXOStats ConnectIndexed(const CBlock& block, int nHeight, CCoinsViewCache& view, std::map<uint256, CUTXOStats>& mapIndex)
+{
+    CBlockUndo blockundo = ConnectToView(block, nHeight, view);
+    CUTXOStats stats;
+    if (nHeight > 1)
+        stats = mapIndex.at(block.hashPrevBlock);
+    BOOST_REQUIRE(stats.ApplyBlock(block, blockundo, nHeight));
+    mapIndex[block.GetHash()] = stats;
+    return stats;
+}
+
+/** Compare an index entry with a full parallel scan of the chain's UTXO set */
+static void CheckAgainstScan(const std::vector<CBlock>& vChain, const CUTXOStats& indexed)
+{
+    CCoinsViewDB db(1 << 20, true);
+    {
+        CCoinsViewCache view(&db);
+        for (size_t i = 0; i < vChain.size(); i++)
+            ConnectToView(vChain[i], i + 1, view);
+        // the scan looks up the height of the best block
+        view.SetBestBlock(Params().GenesisBlock().GetHash());
+        BOOST_REQUIRE(view.Flush());
+    }
+
+    CCoinsStats scanned;
+    BOOST_REQUIRE(db.GetStatsParallel(scanned, 3));
+    BOOST_CHECK_EQUAL(indexed.nTransactions, scanned.nTransactions);
+    BOOST_CHECK_EQUAL(indexed.nTransactionOutputs, scanned.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(indexed.nBogoSize, scanned.nBogoSize);
+    BOOST_CHECK_EQUAL(indexed.nTotalAmount, scanned.nTotalAmount);
+    MuHash3072 muhash = indexed.muhash;
+    uint256 hashMuHash;
+    muhash.Finalize(hashMuHash.begin());
+    BOOST_CHECK(hashMuHash == scanned.hashMuHash);
+}
+
+BOOST_AUTO_TEST_CASE(utxostats_reorg_matches_scan)
+{
+    std::map<uint256, CUTXOStats> mapIndex;
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewCache viewCommon(&db);
+
+    // Common chain
+    std::vector<CBlock> vCommon;
+    vCommon.push_back(MakeBlock(uint256(), 1, 3, std::vector<CMutableTransaction>()));
+    const uint256 hash1 = vCommon[0].vtx[0].GetHash();
+    CUTXOStats stats = ConnectIndexed(vCommon.back(), 1, viewCommon, mapIndex);
+    CheckAgainstScan(vCommon, stats);
+
+    CMutableTransaction tx2 = Spend({COutPoint(hash1, 0)}, 2, true);
+    vCommon.push_back(MakeBlock(vCommon.back().GetHash(), 2, 1, {tx2}));
+    stats = ConnectIndexed(vCommon.back(), 2, viewCommon, mapIndex);
+    CheckAgainstScan(vCommon, stats);
+
+    // Branch A spends the rest of the first coinbase and one output of tx2
+    std::vector<CBlock> vChainA = vCommon;
+    {
+        CCoinsViewCache viewA(&viewCommon);
+        CMutableTransaction txA3 = Spend({COutPoint(hash1, 1), COutPoint(hash1, 2), COutPoint(tx2.GetHash(), 0)}, 3);
+        vChainA.push_back(MakeBlock(vChainA.back().GetHash(), 3, 2, {txA3}));
+        stats = ConnectIndexed(vChainA.back(), 3, viewA, mapIndex);
+        CheckAgainstScan(vChainA, stats);
+
+        CMutableTransaction txA4 = Spend({COutPoint(txA3.GetHash(), 0), COutPoint(txA3.GetHash(), 1), COutPoint(txA3.GetHash(), 2)}, 1);
+        vChainA.push_back(MakeBlock(vChainA.back().GetHash(), 4, 1, {txA4}));
+        stats = ConnectIndexed(vChainA.back(), 4, viewA, mapIndex);
+        CheckAgainstScan(vChainA, stats);
+    }
+
+    // Reorg to branch B, which double spends branch A from the common tip's entry
+    std::vector<CBlock> vChainB = vCommon;
+    CCoinsViewCache viewB(&viewCommon);
+    CMutableTransaction txB3 = Spend({COutPoint(hash1, 1), COutPoint(tx2.GetHash(), 1)}, 1, true);
+    vChainB.push_back(MakeBlock(vChainB.back().GetHash(), 3, 1, {txB3}));
+    stats = ConnectIndexed(vChainB.back(), 3, viewB, mapIndex);
+    CheckAgainstScan(vChainB, stats);
+
+    CMutableTransaction txB4a = Spend({COutPoint(hash1, 2), COutPoint(tx2.GetHash(), 0)}, 2);
+    CMutableTransaction txB4b = Spend({COutPoint(txB4a.GetHash(), 1)}, 1);
+    vChainB.push_back(MakeBlock(vChainB.back().GetHash(), 4, 2, {txB4a, txB4b}));
+    stats = ConnectIndexed(vChainB.back(), 4, viewB, mapIndex);
+    CheckAgainstScan(vChainB, stats);
+
+    CMutableTransaction txB5 = Spend({COutPoint(vChainB[2].vtx[0].GetHash(), 0), COutPoint(txB3.GetHash(), 0)}, 1);
+    vChainB.push_back(MakeBlock(vChainB.back().GetHash(), 5, 1, {txB5}));
+    stats = ConnectIndexed(vChainB.back(), 5, viewB, mapIndex);
+    CheckAgainstScan(vChainB, stats);
+
+    // Both branches' entries stay keyed by their own block hashes
+    BOOST_CHECK(mapIndex.at(vChainA.back().GetHash()).nTotalAmount != stats.nTotalAmount);
+}
+
+BOOST_AUTO_TEST_CASE(utxostats_missing_undo)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewCache view(&db);
+    CBlock block1 = MakeBlock(uint256(), 1, 2, std::vector<CMutableTransaction>());
+    ConnectToView(block1, 1, view);
+    CMutableTransaction tx = Spend({COutPoint(block1.vtx[0].GetHash(), 0), COutPoint(block1.vtx[0].GetHash(), 1)}, 1);
+    CBlock block2 = MakeBlock(block1.GetHash(), 2, 1, {tx});
+    CBlockUndo blockundo = ConnectToView(block2, 2, view);
+
+    // Undo data that does not cover every spend is rejected without touching the entry
+    CUTXOStats stats;
+    stats.AddOutput(block1.vtx[0].GetHash(), 0, block1.vtx[0].vout[0]);
+    const CAmount nTotalAmount = stats.nTotalAmount;
+    CBlockUndo truncated = blockundo;
+    truncated.vtxundo[0].vprevout.pop_back();
+    BOOST_CHECK(!stats.ApplyBlock(block2, truncated, 2));
+    BOOST_CHECK(!stats.ApplyBlock(block2, CBlockUndo(), 2));
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, nTotalAmount);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 1);
+    BOOST_CHECK(stats.ApplyBlock(block2, blockundo, 2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
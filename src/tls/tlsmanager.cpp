@@ -10,6 +10,7 @@
 #include <boost/thread.hpp>
 
 #include "tlsmanager.h"
+#include "tlssessioncache.h"
 #include "utiltls.h"
 #include "random.h"
 
@@ -178,6 +179,53 @@ int tlsCertVerificationCallback(int preverify_ok, X509_STORE_CTX* chainContext)
      */
     return 1;
 }
+
+/** Session id context for the server cache; OpenSSL refuses to resume a SSL_VERIFY_PEER session without one. */
+static const unsigned char TLS_SESSION_ID_CONTEXT[] = "pirate-p2p";
+/** Lifetime of a cached session or ticket, in seconds. */
+static const long TLS_SESSION_TIMEOUT = 2 * 60 * 60;
+
+/**
+ * @brief Per connection data attached to every SSL object created by the TLSManager (freed by SSL_free).
+ */
+struct TLSConnectionInfo
+{
+    std::string strSessionKey; // client side: peer address the session cache is keyed by
+    int64_t nHandshakeTime;    // microseconds spent in SSL_connect/SSL_accept
+
+    TLSConnectionInfo(const std::string& strSessionKeyIn = "") : strSessionKey(strSessionKeyIn), nHandshakeTime(0) {}
+};
+
+static int nConnectionInfoIndex = -1;
+
+static void freeConnectionInfo(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp)
+{
+    delete static_cast<TLSConnectionInfo*>(ptr);
+}
+
+static TLSConnectionInfo* getConnectionInfo(const SSL* ssl)
+{
+    if (nConnectionInfoIndex < 0)
+        return NULL;
+    return static_cast<TLSConnectionInfo*>(SSL_get_ex_data(ssl, nConnectionInfoIndex));
+}
+
+/** Client sessions by peer address, see TLSSessionCache */
+static size_t nMaxClientSessions = DEFAULT_TLS_SESSION_CACHE;
+static TLSSessionCache clientSessions(DEFAULT_TLS_SESSION_CACHE);
+
+/**
+ * @brief OpenSSL new session callback of the client context.
+ *
+ * @return int 1 if the cache took ownership of the session, 0 otherwise.
+ */
+static int newClientSession(SSL* ssl, SSL_SESSION* session)
+{
+    TLSConnectionInfo* info = getConnectionInfo(ssl);
+    if (info == NULL)
+        return 0;
+    return clientSessions.store(info->strSessionKey, session) ? 1 : 0;
+}
 /**
  * @brief Wait for a given SSL connection event.
  *
@@ -287,14 +335,8 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
             break;
         }
 
-        fd_set socketSet;
-        FD_ZERO(&socketSet);
-        FD_SET(hSocket, &socketSet);
-
-        struct timeval timeout = {timeoutSec, 0};
-
         if (sslErr == SSL_ERROR_WANT_READ) {
-            int result = select(hSocket + 1, &socketSet, NULL, NULL, &timeout);
+            int result = WaitForSocket(hSocket, false, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("tls", "TLS: ERROR: %s: %s():%d - WANT_READ timeout on %s\n", __FILE__, __func__, __LINE__,
                     (eRoutine == SSL_CONNECT ? "SSL_CONNECT" :
@@ -309,7 +351,7 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
                 break;
             }
         } else {
-            int result = select(hSocket + 1, NULL, &socketSet, NULL, &timeout);
+            int result = WaitForSocket(hSocket, true, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("tls", "TLS: ERROR: %s: %s():%d - WANT_WRITE timeout on %s\n", __FILE__, __func__, __LINE__,
                     (eRoutine == SSL_CONNECT ? "SSL_CONNECT" :
@@ -346,10 +388,22 @@ SSL* TLSManager::connect(SOCKET hSocket, const CAddress& addrConnect, unsigned l
     bool bConnectedTLS = false;
 
     if ((ssl = SSL_new(tls_ctx_client))) {
+        TLSConnectionInfo* info = new TLSConnectionInfo(addrConnect.ToStringIPPort());
+        SSL_set_ex_data(ssl, nConnectionInfoIndex, info);
+
+        // Offer the ticket from the last connection to this peer, if there is one
+        SSL_SESSION* session = clientSessions.take(info->strSessionKey);
+        if (session) {
+            SSL_set_session(ssl, session);
+            SSL_SESSION_free(session);
+        }
+
         if (SSL_set_fd(ssl, hSocket)) {
+            int64_t nStart = GetTimeMicros();
             int ret = TLSManager::waitFor(SSL_CONNECT, hSocket, ssl, (DEFAULT_CONNECT_TIMEOUT / 1000), err_code);
             if (ret == 1)
             {
+                info->nHandshakeTime = GetTimeMicros() - nStart;
                 bConnectedTLS = true;
             }
         }
@@ -366,6 +420,8 @@ SSL* TLSManager::connect(SOCKET hSocket, const CAddress& addrConnect, unsigned l
     if (bConnectedTLS) {
         LogPrintf("TLS: connection to %s has been established (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s\n",
             addrConnect.ToString(), SSL_get_version(ssl), SSL_version(ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(ssl));
+        LogPrint("tls", "TLS: %s handshake with %s took %dus\n",
+            SSL_session_reused(ssl) ? "resumed" : "full", addrConnect.ToString(), getConnectionInfo(ssl)->nHandshakeTime);
     } else {
         LogPrint("tls","TLS: %s: %s():%d - TLS connection to %s failed (err_code 0x%X)\n",
             __FILE__, __func__, __LINE__, addrConnect.ToString(), err_code);
@@ -450,6 +506,32 @@ SSL_CTX* TLSManager::initCtx(
         // Fix for Secure Client-Initiated Renegotiation DoS threat
         SSL_CTX_set_options(tlsCtx, SSL_OP_NO_RENEGOTIATION);
 
+        // Session resumption: the server issues one TLS 1.3 ticket per handshake and the
+        // client keeps it (see newClientSession) to skip the key exchange and certificate
+        // exchange the next time it connects to the same peer.
+        SSL_CTX_set_timeout(tlsCtx, TLS_SESSION_TIMEOUT);
+        if (nMaxClientSessions == 0) {
+            SSL_CTX_set_session_cache_mode(tlsCtx, SSL_SESS_CACHE_OFF);
+            SSL_CTX_set_num_tickets(tlsCtx, 0);
+        } else if (ctxType == SERVER_CONTEXT) {
+            SSL_CTX_set_session_cache_mode(tlsCtx, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_sess_set_cache_size(tlsCtx, nMaxClientSessions);
+            SSL_CTX_set_session_id_context(tlsCtx, TLS_SESSION_ID_CONTEXT, sizeof(TLS_SESSION_ID_CONTEXT) - 1);
+            SSL_CTX_set_num_tickets(tlsCtx, 1);
+        } else {
+            SSL_CTX_set_session_cache_mode(tlsCtx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(tlsCtx, newClientSession);
+        }
+
+        if (GetBoolArg("-tlsktls", DEFAULT_TLS_KTLS)) {
+#ifdef SSL_OP_ENABLE_KTLS
+            // OpenSSL falls back to user space records when the kernel or the cipher does not support it
+            SSL_CTX_set_options(tlsCtx, SSL_OP_ENABLE_KTLS);
+#else
+            LogPrintf("TLS: WARNING: %s: %s():%d - -tlsktls is set but OpenSSL was built without kernel TLS support\n", __FILE__, __func__, __LINE__);
+#endif
+        }
+
         int min_ver = SSL_CTX_get_min_proto_version(tlsCtx);
         int max_ver = SSL_CTX_get_max_proto_version(tlsCtx); // 0x0 means auto
         int opt_mask = SSL_CTX_get_options(tlsCtx);
@@ -547,10 +629,15 @@ SSL* TLSManager::accept(SOCKET hSocket, const CAddress& addr, unsigned long& err
     bool bAcceptedTLS = false;
 
     if ((ssl = SSL_new(tls_ctx_server))) {
+        TLSConnectionInfo* info = new TLSConnectionInfo();
+        SSL_set_ex_data(ssl, nConnectionInfoIndex, info);
+
         if (SSL_set_fd(ssl, hSocket)) {
+            int64_t nStart = GetTimeMicros();
             int ret = TLSManager::waitFor(SSL_ACCEPT, hSocket, ssl, (DEFAULT_CONNECT_TIMEOUT / 1000), err_code);
             if (ret == 1)
             {
+                info->nHandshakeTime = GetTimeMicros() - nStart;
                 bAcceptedTLS = true;
             }
         }
@@ -566,6 +653,8 @@ SSL* TLSManager::accept(SOCKET hSocket, const CAddress& addr, unsigned long& err
     if (bAcceptedTLS) {
         LogPrintf("TLS: connection from %s has been accepted (tlsv = %s 0x%04x / ssl = %s 0x%x ). Using cipher: %s\n",
             addr.ToString(), SSL_get_version(ssl), SSL_version(ssl), OpenSSL_version(OPENSSL_VERSION), OpenSSL_version_num(), SSL_get_cipher(ssl));
+        LogPrint("tls", "TLS: %s handshake with %s took %dus\n",
+            SSL_session_reused(ssl) ? "resumed" : "full", addr.ToString(), getConnectionInfo(ssl)->nHandshakeTime);
 
         STACK_OF(SSL_CIPHER) *sk = SSL_get_ciphers(ssl);
         for (int i = 0; i < sk_SSL_CIPHER_num(sk); i++) {
@@ -584,6 +673,35 @@ SSL* TLSManager::accept(SOCKET hSocket, const CAddress& addr, unsigned long& err
 
     return ssl;
 }
+/**
+ * @brief Fill in the TLS details of a connection reported by getpeerinfo.
+ *
+ * @param ssl the connection, may be NULL.
+ * @param stats the peer statistics to fill in.
+ */
+void TLSManager::getConnectionStats(SSL* ssl, CNodeStats& stats)
+{
+    stats.strTLSVersion = "";
+    stats.strTLSCipher = "";
+    stats.nTLSHandshakeTime = 0;
+    stats.fTLSResumed = false;
+    stats.fTLSKernelSend = false;
+    stats.fTLSKernelRecv = false;
+
+    if (ssl == NULL)
+        return;
+
+    stats.strTLSVersion = SSL_get_version(ssl);
+    stats.strTLSCipher = SSL_get_cipher(ssl);
+    stats.fTLSResumed = SSL_session_reused(ssl);
+    TLSConnectionInfo* info = getConnectionInfo(ssl);
+    if (info)
+        stats.nTLSHandshakeTime = info->nHandshakeTime;
+#if defined(SSL_OP_ENABLE_KTLS) && defined(BIO_get_ktls_send)
+    stats.fTLSKernelSend = BIO_get_ktls_send(SSL_get_wbio(ssl));
+    stats.fTLSKernelRecv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+#endif
+}
 /**
  * @brief Determines whether a string exists in the non-TLS address pool.
  *
@@ -627,6 +745,118 @@ void TLSManager::cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection
     }
 }
 
+/**
+ * @brief Reads once from a TLS or plain socket into the node's receive buffer.
+ * The caller must hold pnode->cs_vRecvMsg.
+ *
+ * @param pnode reference to the CNode object.
+ * @param fBackoff sleep briefly when an SSL read has to be repeated.
+ * @return int returns -1 when socket is invalid, the number of bytes received,
+ * or 0 if nothing was received (the socket would block or was closed).
+ */
+int TLSManager::socketRecvData(CNode* pnode, bool fBackoff)
+{
+    // typical socket buffer is 8K-64K
+    // maximum record size is 16kB for SSL/TLS (still valid as of 1.1.1 version)
+    char pchBuf[0x10000];
+    bool bIsSSL = false;
+    int nBytes = 0, nRet = 0;
+
+    {
+        LOCK(pnode->cs_hSocket);
+
+        if (pnode->hSocket == INVALID_SOCKET) {
+            LogPrint("tls", "Receive: connection with %s is already closed\n", pnode->addr.ToString());
+            return -1;
+        }
+
+        bIsSSL = (pnode->ssl != NULL);
+
+        if (bIsSSL) {
+            ERR_clear_error(); // clear the error queue, otherwise we may be reading an old error that occurred previously in the current thread
+            nBytes = SSL_read(pnode->ssl, pchBuf, sizeof(pchBuf));
+            nRet = SSL_get_error(pnode->ssl, nBytes);
+        } else {
+            nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+            nRet = WSAGetLastError();
+        }
+    }
+
+    if (nBytes > 0) {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes)) {
+            if (nRet == SSL_ERROR_SYSCALL || nRet == SSL_ERROR_SSL) {
+                pnode->CloseSocketDisconnect(false);
+            } else {
+                pnode->CloseSocketDisconnect(true);
+            }
+        }
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        if (bIsSSL)
+            pnode->nTLSReads++;
+        pnode->RecordBytesRecv(nBytes);
+        return nBytes;
+    } else if (nBytes == 0) {
+
+        if (bIsSSL) {
+            unsigned long error = ERR_get_error();
+            const char* error_str = ERR_error_string(error, NULL);
+            LogPrint("tls", "TLS: WARNING: %s: %s():%d - SSL_read err: %s\n",
+                __FILE__, __func__, __LINE__, error_str);
+        }
+        // socket closed gracefully (peer disconnected)
+        //
+        if (!pnode->fDisconnect)
+            LogPrint("tls", "socket closed (%s)\n", pnode->addr.ToString());
+
+        if (nRet == SSL_ERROR_SYSCALL || nRet == SSL_ERROR_SSL) {
+            pnode->CloseSocketDisconnect(false);
+        } else {
+            pnode->CloseSocketDisconnect(true);
+        }
+
+
+    } else if (nBytes < 0) {
+        // error
+        //
+        if (bIsSSL) {
+            if (nRet != SSL_ERROR_WANT_READ && nRet != SSL_ERROR_WANT_WRITE) // SSL_read() operation has to be repeated because of SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE (https://wiki.openssl.org/index.php/Manual:SSL_read(3)#NOTES)
+            {
+                if (!pnode->fDisconnect)
+                    LogPrintf("TSL: ERROR: SSL_read %s\n", ERR_error_string(nRet, NULL));
+
+                if (nRet == SSL_ERROR_SYSCALL || nRet == SSL_ERROR_SSL) {
+                    pnode->CloseSocketDisconnect(false);
+                } else {
+                    pnode->CloseSocketDisconnect(true);
+                }
+
+                unsigned long error = ERR_get_error();
+                const char* error_str = ERR_error_string(error, NULL);
+                LogPrint("tls", "TLS: WARNING: %s: %s():%d - SSL_read - code[0x%x], err: %s\n",
+                    __FILE__, __func__, __LINE__, nRet, error_str);
+
+            } else if (fBackoff) {
+                // preventive measure from exhausting CPU usage
+                //
+                MilliSleep(1); // 1 msec
+            }
+        } else {
+            if (nRet != WSAEWOULDBLOCK && nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS) {
+                if (!pnode->fDisconnect)
+                    LogPrint("tls","TSL: ERROR: socket recv %s\n", NetworkErrorString(nRet));
+
+                if (nRet == SSL_ERROR_SYSCALL || nRet == SSL_ERROR_SSL) {
+                    pnode->CloseSocketDisconnect(false);
+                } else {
+                    pnode->CloseSocketDisconnect(true);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
 /**
  * @brief Handles send and recieve functionality in TLS Sockets.
  *
@@ -657,103 +887,8 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
     if (recvSet || errorSet) {
         TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
         if (lockRecv) {
-            {
-                // typical socket buffer is 8K-64K
-                // maximum record size is 16kB for SSL/TLS (still valid as of 1.1.1 version)
-                char pchBuf[0x10000];
-                bool bIsSSL = false;
-                int nBytes = 0, nRet = 0;
-
-                {
-                    LOCK(pnode->cs_hSocket);
-
-                    if (pnode->hSocket == INVALID_SOCKET) {
-                        LogPrint("tls", "Receive: connection with %s is already closed\n", pnode->addr.ToString());
-                        return -1;
-                    }
-
-                    bIsSSL = (pnode->ssl != NULL);
-
-                    if (bIsSSL) {
-                        ERR_clear_error(); // clear the error queue, otherwise we may be reading an old error that occurred previously in the current thread
-                        nBytes = SSL_read(pnode->ssl, pchBuf, sizeof(pchBuf));
-                        nRet = SSL_get_error(pnode->ssl, nBytes);
-                    } else {
-                        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        nRet = WSAGetLastError();
-                    }
-                }
-
-                if (nBytes > 0) {
-                    if (!pnode->ReceiveMsgBytes(pchBuf, nBytes)) {
-                        if (nRet == SSL_ERROR_SYSCALL || nRet == SSL_ERROR_SSL) {
-                            pnode->CloseSocketDisconnect(false);
-                        } else {
-                            pnode->CloseSocketDisconnect(true);
-                        }
-                    }
-                    pnode->nLastRecv = GetTime();
-                    pnode->nRecvBytes += nBytes;
-                    pnode->RecordBytesRecv(nBytes);
-                } else if (nBytes == 0) {
-
-                    if (bIsSSL) {
-                        unsigned long error = ERR_get_error();
-                        const char* error_str = ERR_error_string(error, NULL);
-                        LogPrint("tls", "TLS: WARNING: %s: %s():%d - SSL_read err: %s\n",
-                            __FILE__, __func__, __LINE__, error_str);
-                    }
-                    // socket closed gracefully (peer disconnected)
-                    //
-                    if (!pnode->fDisconnect)
-                        LogPrint("tls", "socket closed (%s)\n", pnode->addr.ToString());
-
-                    if (nRet == SSL_ERROR_SYSCALL || nRet == SSL_ERROR_SSL) {
-                        pnode->CloseSocketDisconnect(false);
-                    } else {
-                        pnode->CloseSocketDisconnect(true);
-                    }
-
-
-                } else if (nBytes < 0) {
-                    // error
-                    //
-                    if (bIsSSL) {
-                        if (nRet != SSL_ERROR_WANT_READ && nRet != SSL_ERROR_WANT_WRITE) // SSL_read() operation has to be repeated because of SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE (https://wiki.openssl.org/index.php/Manual:SSL_read(3)#NOTES)
-                        {
-                            if (!pnode->fDisconnect)
-                                LogPrintf("TSL: ERROR: SSL_read %s\n", ERR_error_string(nRet, NULL));
-
-                            if (nRet == SSL_ERROR_SYSCALL || nRet == SSL_ERROR_SSL) {
-                                pnode->CloseSocketDisconnect(false);
-                            } else {
-                                pnode->CloseSocketDisconnect(true);
-                            }
-
-                            unsigned long error = ERR_get_error();
-                            const char* error_str = ERR_error_string(error, NULL);
-                            LogPrint("tls", "TLS: WARNING: %s: %s():%d - SSL_read - code[0x%x], err: %s\n",
-                                __FILE__, __func__, __LINE__, nRet, error_str);
-
-                        } else {
-                            // preventive measure from exhausting CPU usage
-                            //
-                            MilliSleep(1); // 1 msec
-                        }
-                    } else {
-                        if (nRet != WSAEWOULDBLOCK && nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS) {
-                            if (!pnode->fDisconnect)
-                                LogPrint("tls","TSL: ERROR: socket recv %s\n", NetworkErrorString(nRet));
-
-                            if (nRet == SSL_ERROR_SYSCALL || nRet == SSL_ERROR_SSL) {
-                                pnode->CloseSocketDisconnect(false);
-                            } else {
-                                pnode->CloseSocketDisconnect(true);
-                            }
-                        }
-                    }
-                }
-            }
+            if (socketRecvData(pnode, true) == -1)
+                return -1;
         }
     }
 
@@ -804,6 +939,10 @@ bool TLSManager::initialize()
     for (fs::path dir : trustedDirs)
         LogPrintf("TLS: trusted directory '%s' will be used\n", dir.string().c_str());
 
+    nConnectionInfoIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, freeConnectionInfo);
+    nMaxClientSessions = std::max((int64_t)0, GetArg("-tlssessioncache", DEFAULT_TLS_SESSION_CACHE));
+    clientSessions.setMaxSize(nMaxClientSessions);
+
     // Initialization of the server and client contexts
     //
     if ((tls_ctx_server = TLSManager::initCtx(SERVER_CONTEXT, privKeyFile, certFile, trustedDirs)))
@@ -817,6 +956,7 @@ bool TLSManager::initialize()
         {
             LogPrintf("TLS: ERROR: %s: %s: failed to initialize TLS client context\n", __FILE__, __func__);
             SSL_CTX_free (tls_ctx_server);
+            clientSessions.clear();
         }
     }
     else
@@ -824,4 +964,12 @@ bool TLSManager::initialize()
 
     return bInitializationStatus;
 }
+
+/**
+ * @brief Free the client sessions kept for resumption, at shutdown.
+ */
+void TLSManager::cleanup()
+{
+    clientSessions.clear();
+}
 }
@@ -56,7 +56,10 @@ public:
      SSL* accept(SOCKET hSocket, const CAddress& addr, unsigned long& err_code);
      bool isNonTLSAddr(const string& strAddr, const vector<NODE_ADDR>& vPool, CCriticalSection& cs);
      void cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection& cs);
+     static void getConnectionStats(SSL* ssl, CNodeStats& stats);
+     int socketRecvData(CNode* pnode, bool fBackoff);
      int threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError);
      bool initialize();
+     void cleanup();
 };
 }
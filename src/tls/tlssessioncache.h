@@ -0,0 +1,116 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TLSSESSIONCACHE_H
+#define TLSSESSIONCACHE_H
+
+#include <openssl/ssl.h>
+
+#include <iterator>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "sync.h"
+
+namespace tls {
+
+/**
+ * @brief Client TLS sessions, keyed by peer address and evicted least recently stored first.
+ *
+ * TLS 1.3 tickets are single use, so a session is taken out of the cache when it is
+ * offered and the server's replacement ticket is stored once the handshake is done.
+ * The cache owns the sessions it holds and frees them when they are evicted, replaced
+ * or cleared.
+ */
+class TLSSessionCache
+{
+public:
+    explicit TLSSessionCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+    ~TLSSessionCache() { clear(); }
+
+    void setMaxSize(size_t nMaxSizeIn)
+    {
+        LOCK(cs);
+        nMaxSize = nMaxSizeIn;
+        while (mapSessions.size() > nMaxSize)
+            evictOldest();
+    }
+
+    /**
+     * @brief Store the session for a peer, replacing the one it had.
+     *
+     * @return bool true if the cache took ownership of the session, false if it is disabled.
+     */
+    bool store(const std::string& strKey, SSL_SESSION* session)
+    {
+        LOCK(cs);
+        if (nMaxSize == 0 || strKey.empty())
+            return false;
+        auto it = mapSessions.find(strKey);
+        if (it != mapSessions.end()) {
+            SSL_SESSION_free(it->second.first);
+            lruSessions.erase(it->second.second);
+            mapSessions.erase(it);
+        }
+        while (mapSessions.size() >= nMaxSize)
+            evictOldest();
+        lruSessions.push_back(strKey);
+        mapSessions[strKey] = std::make_pair(session, std::prev(lruSessions.end()));
+        return true;
+    }
+
+    /**
+     * @brief Remove the session for a peer from the cache.
+     *
+     * @return SSL_SESSION* the session (owned by the caller) or NULL if there is none.
+     */
+    SSL_SESSION* take(const std::string& strKey)
+    {
+        LOCK(cs);
+        auto it = mapSessions.find(strKey);
+        if (it == mapSessions.end())
+            return NULL;
+        SSL_SESSION* session = it->second.first;
+        lruSessions.erase(it->second.second);
+        mapSessions.erase(it);
+        return session;
+    }
+
+    /** Free every cached session. */
+    void clear()
+    {
+        LOCK(cs);
+        for (auto& item : mapSessions)
+            SSL_SESSION_free(item.second.first);
+        mapSessions.clear();
+        lruSessions.clear();
+    }
+
+    size_t size() const
+    {
+        LOCK(cs);
+        return mapSessions.size();
+    }
+
+private:
+    typedef std::list<std::string> SessionLRU;
+
+    mutable CCriticalSection cs;
+    size_t nMaxSize;
+    std::map<std::string, std::pair<SSL_SESSION*, SessionLRU::iterator> > mapSessions;
+    SessionLRU lruSessions;
+
+    void evictOldest()
+    {
+        auto it = mapSessions.find(lruSessions.front());
+        SSL_SESSION_free(it->second.first);
+        mapSessions.erase(it);
+        lruSessions.pop_front();
+    }
+};
+}
+
+#endif // TLSSESSIONCACHE_H
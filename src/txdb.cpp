@@ -31,8 +31,10 @@
 
 #include "ui_interface.h"
 #include "init.h"
+#include "undo.h"
 
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -50,10 +52,13 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'd';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCEINDEX = 'L';
+static const char DB_ADDRESSBALANCETIP = 'K';
 static const char DB_TIMESTAMPINDEX = 'H';
 static const char DB_BLOCKHASHINDEX = 'h';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_UTXOSTATS = 'U';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_BEST_SPROUT_ANCHOR = 'a';
@@ -68,10 +73,10 @@ static const char OUTPUT_PROOF_HASH = 'E';
 
 static const char DB_VERSION = 'V';
 
-CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe, false, 64, "chainstate") {
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, false, 64, "chainstate")
 {
 }
 
@@ -284,7 +289,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles)
-        : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles) {
+        : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, compression, maxOpenFiles, "blockindex") {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) const {
@@ -371,6 +376,163 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     return true;
 }
 
+static uint64_t GetBogoSize(const CScript &scriptPubKey)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+}
+
+static void HashTxOut(MuHash3072 &muhash, const uint256 &txid, uint32_t n, const CTxOut &out, bool fInsert)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << COutPoint(txid, n) << out;
+    if (fInsert)
+        muhash.Insert((const unsigned char*)ss.data(), ss.size());
+    else
+        muhash.Remove((const unsigned char*)ss.data(), ss.size());
+}
+
+void CUTXOStats::AddOutput(const uint256 &txid, uint32_t n, const CTxOut &out)
+{
+    nTransactionOutputs++;
+    nTotalAmount += out.nValue;
+    nBogoSize += GetBogoSize(out.scriptPubKey);
+    HashTxOut(muhash, txid, n, out, true);
+}
+
+void CUTXOStats::RemoveOutput(const uint256 &txid, uint32_t n, const CTxOut &out)
+{
+    nTransactionOutputs--;
+    nTotalAmount -= out.nValue;
+    nBogoSize -= GetBogoSize(out.scriptPubKey);
+    HashTxOut(muhash, txid, n, out, false);
+}
+
+bool CUTXOStats::ApplyBlock(const CBlock &block, const CBlockUndo &blockundo, int nHeight)
+{
+    // check the undo data covers every spend before touching anything
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block %s has %u transactions but undo data for %u", __func__, block.GetHash().ToString(), block.vtx.size(), blockundo.vtxundo.size());
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        if (!tx.IsMint() && blockundo.vtxundo[i-1].vprevout.size() != tx.vin.size())
+            return error("%s: block %s tx %u has %u inputs but undo data for %u", __func__, block.GetHash().ToString(), i, tx.vin.size(), blockundo.vtxundo[i-1].vprevout.size());
+    }
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        if (!tx.IsMint()) {
+            const CTxUndo &txundo = blockundo.vtxundo[i-1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxInUndo &undo = txundo.vprevout[j];
+                RemoveOutput(tx.vin[j].prevout.hash, tx.vin[j].prevout.n, undo.txout);
+                // the undo record only carries metadata when the last unspent output of a transaction is spent
+                if (undo.nHeight != 0)
+                    nTransactions--;
+            }
+        }
+
+        const uint256 hash = tx.GetHash();
+        bool fAdded = false;
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            // unspendable outputs never enter the coins database, see CCoins::ClearUnspendable()
+            if (tx.vout[k].scriptPubKey.IsUnspendable())
+                continue;
+            AddOutput(hash, k, tx.vout[k]);
+            fAdded = true;
+        }
+        if (fAdded)
+            nTransactions++;
+
+        // mirror AddImportTombstone()
+        if (tx.IsCoinImport()) {
+            AddOutput(tx.vin[0].prevout.hash, 0, CTxOut(0, CScript() << OP_0));
+            nTransactions++;
+        }
+    }
+
+    int64_t zfunds = 0, sproutfunds = 0;
+    nChainSupply += komodo_newcoins(&zfunds, &sproutfunds, nHeight, (CBlock *)&block, &blockundo);
+    nChainZFunds += zfunds;
+    nChainSproutFunds += sproutfunds;
+    return true;
+}
+
+bool CCoinsViewDB::GetStatsParallel(CCoinsStats &stats, int nThreads) const {
+    nThreads = std::max(1, std::min(nThreads, 256));
+
+    // Chainstate writes only happen under cs_main, so iterators created while
+    // holding it all observe the same implicit snapshot of the database.
+    std::vector<std::unique_ptr<CDBIterator>> cursors;
+    {
+        LOCK(cs_main);
+        stats.hashBlock = GetBestBlock();
+        BlockMap::const_iterator it = mapBlockIndex.find(stats.hashBlock);
+        if (it == mapBlockIndex.end() || it->second == NULL)
+            return error("CCoinsViewDB::GetStatsParallel() : best block %s not in the block index", stats.hashBlock.ToString());
+        stats.nHeight = it->second->nHeight;
+        for (int i = 0; i < nThreads; i++)
+            cursors.emplace_back(const_cast<CDBWrapper*>(&db)->NewIterator());
+    }
+
+    // Each thread scans the txids whose first byte falls in its range.
+    std::vector<CUTXOStats> results(nThreads);
+    std::vector<uint64_t> vSerializedSize(nThreads, 0);
+    std::vector<char> vOk(nThreads, 1);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&, t]() {
+            const unsigned int nBegin = t * 256 / nThreads;
+            const unsigned int nEnd = (t + 1) * 256 / nThreads;
+            CDBIterator *pcursor = cursors[t].get();
+            CUTXOStats &result = results[t];
+            uint256 start;
+            *start.begin() = (unsigned char)nBegin;
+            try {
+                for (pcursor->Seek(make_pair(DB_COINS, start)); pcursor->Valid(); pcursor->Next()) {
+                    std::pair<char, uint256> key;
+                    if (!pcursor->GetKey(key) || key.first != DB_COINS || *key.second.begin() >= nEnd)
+                        break;
+                    if (ShutdownRequested()) {
+                        vOk[t] = 0;
+                        return;
+                    }
+                    CCoins coins;
+                    if (!pcursor->GetValue(coins)) {
+                        vOk[t] = 0;
+                        return;
+                    }
+                    result.nTransactions++;
+                    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                        if (!coins.vout[i].IsNull())
+                            result.AddOutput(key.second, i, coins.vout[i]);
+                    }
+                    vSerializedSize[t] += 32 + pcursor->GetValueSize();
+                }
+            } catch (const std::exception &e) {
+                LogPrintf("CCoinsViewDB::GetStatsParallel() : range %u-%u failed: %s\n", nBegin, nEnd, e.what());
+                vOk[t] = 0;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    MuHash3072 muhash;
+    for (int t = 0; t < nThreads; t++) {
+        if (!vOk[t])
+            return error("CCoinsViewDB::GetStatsParallel() : unable to scan range %d", t);
+        stats.nTransactions += results[t].nTransactions;
+        stats.nTransactionOutputs += results[t].nTransactionOutputs;
+        stats.nBogoSize += results[t].nBogoSize;
+        stats.nSerializedSize += vSerializedSize[t];
+        stats.nTotalAmount += results[t].nTotalAmount;
+        muhash *= results[t].muhash;
+    }
+    muhash.Finalize(stats.hashMuHash.begin());
+    return true;
+}
+
 /***
  * Write a batch of records and sync
  * @param fileInfo the records to write
@@ -457,13 +619,19 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
 }
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                           size_t limit, const CAddressUnspentKey *after) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    size_t count = 0;
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (after != NULL) {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, *after));
+    } else {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
-    while (pcursor->Valid()) {
+    while (pcursor->Valid() && (limit == 0 || count < limit)) {
         boost::this_thread::interruption_point();
         try {
             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
@@ -472,11 +640,17 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
             char chType = keyObj.first;
             CAddressUnspentKey indexKey = keyObj.second;
 
-            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.hashBytes == addressHash) {
+            if (chType == DB_ADDRESSUNSPENTINDEX && indexKey.type == type && indexKey.hashBytes == addressHash) {
+                // the cursor entry itself was returned by the previous page
+                if (after != NULL && indexKey.txhash == after->txhash && indexKey.index == after->index) {
+                    pcursor->Next();
+                    continue;
+                }
                 try {
                     CAddressUnspentValue nValue;
                     pcursor->GetValue(nValue);
                     unspentOutputs.push_back(make_pair(indexKey, nValue));
+                    count++;
                     pcursor->Next();
                 } catch (const std::exception& e) {
                     return error("failed to get address unspent value");
@@ -507,17 +681,21 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
 
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+                                    int start, int end, size_t limit, const CAddressIndexKey *after) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    size_t count = 0;
 
-    if (start > 0 && end > 0) {
+    // keys are ordered by height within an address, so a range or a cursor is a single seek
+    if (after != NULL) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, *after));
+    } else if (start > 0 && end > 0) {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
 
-    while (pcursor->Valid()) {
+    while (pcursor->Valid() && (limit == 0 || count < limit)) {
         boost::this_thread::interruption_point();
         try {
             pair<char, CAddressIndexKey> keyObj;
@@ -525,15 +703,22 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
             char chType = keyObj.first;
             CAddressIndexKey indexKey = keyObj.second;
 
-            if (chType == DB_ADDRESSINDEX && indexKey.hashBytes == addressHash) {
+            if (chType == DB_ADDRESSINDEX && indexKey.type == type && indexKey.hashBytes == addressHash) {
                 if (end > 0 && indexKey.blockHeight > end) {
                     break;
                 }
+                // the cursor entry itself was returned by the previous page
+                if (after != NULL && indexKey.blockHeight == after->blockHeight && indexKey.txindex == after->txindex &&
+                    indexKey.txhash == after->txhash && indexKey.index == after->index && indexKey.spending == after->spending) {
+                    pcursor->Next();
+                    continue;
+                }
                 try {
                     CAmount nValue;
                     pcursor->GetValue(nValue);
 
                     addressIndex.push_back(make_pair(indexKey, nValue));
+                    count++;
                     pcursor->Next();
                 } catch (const std::exception& e) {
                     return error("failed to get address index value");
@@ -549,6 +734,159 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressBalanceTip(uint256 &hashTip) const {
+    return Read(DB_ADDRESSBALANCETIP, hashTip);
+}
+
+bool CBlockTreeDB::UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fUndo, const CBlockIndex *pindex) {
+    // the balances are deltas written ahead of the lazily flushed chainstate, so a block
+    // replayed after a crash (or reconnected by -checklevel=4) must not be applied twice
+    const CBlockIndex *pindexTip = NULL;
+    uint256 hashApplied;
+    if (pindex != NULL) {
+        pindexTip = fUndo ? pindex->pprev : pindex;
+        if (ReadAddressBalanceTip(hashApplied)) {
+            BlockMap::const_iterator mi = mapBlockIndex.find(hashApplied);
+            const CBlockIndex *pindexApplied = mi != mapBlockIndex.end() ? mi->second : NULL;
+            if (pindexApplied != (fUndo ? pindex : pindex->pprev)) {
+                bool fIncluded = pindexApplied != NULL && pindexApplied->GetAncestor(pindex->nHeight) == pindex;
+                if (fIncluded != fUndo) {
+                    LogPrint("addressindex", "%s: balances at %s already %s block %s\n", __func__,
+                             hashApplied.ToString(), fUndo ? "exclude" : "include", pindex->GetBlockHash().ToString());
+                    return true;
+                }
+                // the balances are on another branch; the unspent index is already at the new tip
+                LogPrintf("%s: balances at %s do not connect to block %s, rebuilding\n", __func__,
+                          hashApplied.ToString(), pindex->GetBlockHash().ToString());
+                return RebuildAddressBalanceIndex(pindexTip != NULL ? pindexTip->GetBlockHash() : uint256());
+            }
+        }
+    }
+
+    // net the records out per address so each balance is read and written once per block
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> mapDelta;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        CAddressBalanceValue &delta = mapDelta[make_pair(it->first.type, it->first.hashBytes)];
+        delta.balance += it->second;
+        if (it->second != 0)
+            delta.utxos += it->first.spending ? -1 : 1;
+    }
+
+    CDBBatch batch(*this);
+    for (std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::const_iterator it=mapDelta.begin(); it!=mapDelta.end(); it++) {
+        std::pair<char, CAddressIndexIteratorKey> key = make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(it->first.first, it->first.second));
+        CAddressBalanceValue value;
+        Read(key, value);
+        if (fUndo) {
+            value.balance -= it->second.balance;
+            value.utxos -= it->second.utxos;
+        } else {
+            value.balance += it->second.balance;
+            value.utxos += it->second.utxos;
+        }
+        if (value.IsNull()) {
+            batch.Erase(key);
+        } else {
+            batch.Write(key, value);
+        }
+    }
+    if (pindexTip != NULL)
+        batch.Write(DB_ADDRESSBALANCETIP, pindexTip->GetBlockHash());
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) const {
+    return Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value);
+}
+
+bool CBlockTreeDB::ForEachAddressBalance(const std::function<void(unsigned int, const uint160&, const CAddressBalanceValue&)> &func) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    for (pcursor->Seek(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey())); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        pair<char, CAddressIndexIteratorKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        CAddressBalanceValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get address balance value");
+        func(keyObj.second.type, keyObj.second.hashBytes, value);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::RebuildAddressBalanceIndex(const uint256 &hashTip) {
+    static const size_t nBatchEntries = 10000;
+    std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > vPending;
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    // half rebuilt balances must not claim to be at any block
+    if (!Erase(DB_ADDRESSBALANCETIP))
+        return false;
+
+    // drop whatever an interrupted rebuild left behind
+    for (pcursor->Seek(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey())); pcursor->Valid(); pcursor->Next()) {
+        pair<char, CAddressIndexIteratorKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        vPending.push_back(make_pair(keyObj.second, CAddressBalanceValue()));
+        if (vPending.size() >= nBatchEntries) {
+            CDBBatch batch(*this);
+            for (const auto& it : vPending)
+                batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, it.first));
+            if (!WriteBatch(batch))
+                return false;
+            vPending.clear();
+        }
+    }
+    if (!vPending.empty()) {
+        CDBBatch batch(*this);
+        for (const auto& it : vPending)
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, it.first));
+        if (!WriteBatch(batch))
+            return false;
+        vPending.clear();
+    }
+
+    // unspent outputs are keyed by address first, so every balance is a contiguous run
+    int64_t nAddresses = 0;
+    CAddressIndexIteratorKey current;
+    CAddressBalanceValue total;
+    for (pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey())); ; pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        pair<char, CAddressUnspentKey> keyObj;
+        bool fDone = !pcursor->Valid() || !pcursor->GetKey(keyObj) || keyObj.first != DB_ADDRESSUNSPENTINDEX;
+        if (fDone || keyObj.second.type != current.type || keyObj.second.hashBytes != current.hashBytes) {
+            if (!total.IsNull()) {
+                vPending.push_back(make_pair(current, total));
+                nAddresses++;
+            }
+            if (fDone || vPending.size() >= nBatchEntries) {
+                CDBBatch batch(*this);
+                for (const auto& it : vPending)
+                    batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, it.first), it.second);
+                if (fDone && !hashTip.IsNull())
+                    batch.Write(DB_ADDRESSBALANCETIP, hashTip);
+                if (!WriteBatch(batch))
+                    return false;
+                vPending.clear();
+            }
+            if (fDone)
+                break;
+            current = CAddressIndexIteratorKey(keyObj.second.type, keyObj.second.hashBytes);
+            total.SetNull();
+        }
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get address unspent value");
+        total.balance += value.satoshis;
+        if (value.satoshis != 0)
+            total.utxos++;
+    }
+    LogPrintf("%s: rebuilt balances of %d addresses\n", __func__, nAddresses);
+    return true;
+}
+
 bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &address);
 
 #define DECLARE_IGNORELIST std::map <std::string,int> ignoredMap = { \
@@ -571,75 +909,85 @@ bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &addr
     {"RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY", 1} \
 };
 
-bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret)
+/** The ignore list as address index keys, so snapshots can skip entries without encoding them. */
+static const std::set<std::pair<unsigned int, uint160> > &GetSnapshotIgnoreSet()
+{
+    static const std::set<std::pair<unsigned int, uint160> > ignoredKeys = []() {
+        std::set<std::pair<unsigned int, uint160> > keys;
+        DECLARE_IGNORELIST
+        for (const auto& it : ignoredMap)
+        {
+            uint160 hashBytes; int type = 0;
+            if ( CBitcoinAddress(it.first).GetIndexKey(hashBytes, type, false) )
+                keys.insert(make_pair((unsigned int)type, hashBytes));
+        }
+        return keys;
+    }();
+    return ignoredKeys;
+}
+
+static bool GetSnapshotDestination(unsigned int type, const uint160 &hashBytes, CTxDestination &dest)
+{
+    if ( type == 1 )
+        dest = CKeyID(hashBytes);
+    else if ( type == 2 )
+        dest = CScriptID(hashBytes);
+    else return false;
+    return true;
+}
+
+bool CBlockTreeDB::Snapshot2(std::vector<std::pair<CAmount, std::string> > &vTop, size_t nTop, UniValue *ret)
 {
     int64_t total = 0; int64_t totalAddresses = 0; std::string address;
     int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
-    DECLARE_IGNORELIST
-    boost::scoped_ptr<CDBIterator> iter(NewIterator());
+    const std::set<std::pair<unsigned int, uint160> > &ignoredKeys = GetSnapshotIgnoreSet();
+    // min-heap on (amount, address) holding the best nTop entries seen so far
+    std::greater<std::pair<CAmount, std::string> > heapOrder;
 
-    for (iter->SeekToLast(); iter->Valid(); iter->Prev())
-    {
-        boost::this_thread::interruption_point();
-        try
+    vTop.clear();
+    bool fOk = ForEachAddressBalance([&](unsigned int type, const uint160 &hashBytes, const CAddressBalanceValue &value) {
+        if ( type == 3 )
         {
-            std::vector<unsigned char> slKey = std::vector<unsigned char>();
-            pair<char, CAddressIndexIteratorKey> keyObj;
-            iter->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressIndexIteratorKey indexKey = keyObj.second;
-
-            if (chType == DB_ADDRESSUNSPENTINDEX)
-            {
-                try {
-                    CAmount nValue;
-                    iter->GetValue(nValue);
-                    if ( nValue == 0 )
-                        continue;
-                    getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
-                    if ( indexKey.type == 3 )
-                    {
-                        cryptoConditionsUTXOs++;
-                        cryptoConditionsTotals += nValue;
-                        total += nValue;
-                        continue;
-                    }
-                    std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
-                    if (ignored != ignoredMap.end())
-                    {
-                        fprintf(stderr,"ignoring %s\n", address.c_str());
-                        ignoredAddresses++;
-                        continue;
-                    }
-                    std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
-                    if ( pos == addressAmounts.end() )
-                    {
-                        // insert new address + utxo amount
-                        addressAmounts[address] = nValue;
-                        totalAddresses++;
-                    }
-                    else
-                    {
-                        // update unspent tally for this address
-                        addressAmounts[address] += nValue;
-                    }
-                    utxos++;
-                    total += nValue;
-                }
-                catch (const std::exception& e)
-                {
-                    fprintf(stderr, "DONE %s: LevelDB addressindex exception! - %s\n", __func__, e.what());
-                    return false; //break; this means failiure of DB? we need to exit here if so for consensus code!
-                }
-            }
+            cryptoConditionsUTXOs += value.utxos;
+            cryptoConditionsTotals += value.balance;
+            total += value.balance;
+            return;
         }
-        catch (const std::exception& e)
+        if ( ignoredKeys.count(make_pair(type, hashBytes)) != 0 )
         {
-            fprintf(stderr, "DONE reading index entries\n");
-            break;
+            ignoredAddresses += value.utxos;
+            return;
+        }
+        totalAddresses++;
+        utxos += value.utxos;
+        total += value.balance;
+
+        // only encode addresses that can still make the cut
+        if ( nTop > 0 && vTop.size() == nTop && value.balance < vTop.front().first )
+            return;
+        if ( !getAddressFromIndex(type, hashBytes, address) )
+            return;
+        std::pair<CAmount, std::string> entry = make_pair(value.balance, address);
+        if ( nTop == 0 )
+            vTop.push_back(entry);
+        else if ( vTop.size() < nTop )
+        {
+            vTop.push_back(entry);
+            std::push_heap(vTop.begin(), vTop.end(), heapOrder);
         }
+        else if ( vTop.front() < entry )
+        {
+            std::pop_heap(vTop.begin(), vTop.end(), heapOrder);
+            vTop.back() = entry;
+            std::push_heap(vTop.begin(), vTop.end(), heapOrder);
+        }
+    });
+    if ( !fOk )
+    {
+        fprintf(stderr, "DONE %s: LevelDB address balance exception!\n", __func__);
+        return false;
     }
-    //fprintf(stderr, "total=%f, totalAddresses=%li, utxos=%li, ignored=%li\n", (double) total / COIN, totalAddresses, utxos, ignoredAddresses);
+    std::sort(vTop.rbegin(), vTop.rend());
 
     // this is for the snapshot RPC, you can skip this by passing a 0 as the last argument.
     if (ret)
@@ -666,25 +1014,67 @@ bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, Un
     return true;
 }
 
+bool CBlockTreeDB::SnapshotDestinations(std::vector<std::pair<CAmount, CTxDestination> > &vTop, size_t nTop, const std::set<CTxDestination> &setExclude)
+{
+    const std::set<std::pair<unsigned int, uint160> > &ignoredKeys = GetSnapshotIgnoreSet();
+    // boost::variant has no operator>, so spell out the min-heap order
+    auto heapOrder = [](const std::pair<CAmount, CTxDestination> &a, const std::pair<CAmount, CTxDestination> &b) { return b < a; };
+
+    vTop.clear();
+    if ( nTop == 0 )
+        return true;
+    bool fOk = ForEachAddressBalance([&](unsigned int type, const uint160 &hashBytes, const CAddressBalanceValue &value) {
+        CTxDestination dest;
+        if ( !GetSnapshotDestination(type, hashBytes, dest) || ignoredKeys.count(make_pair(type, hashBytes)) != 0 )
+            return;
+        if ( vTop.size() == nTop && value.balance < vTop.front().first )
+            return;
+        if ( setExclude.count(dest) != 0 )
+            return;
+        std::pair<CAmount, CTxDestination> entry = make_pair(value.balance, dest);
+        if ( vTop.size() < nTop )
+        {
+            vTop.push_back(entry);
+            std::push_heap(vTop.begin(), vTop.end(), heapOrder);
+        }
+        else if ( vTop.front() < entry )
+        {
+            std::pop_heap(vTop.begin(), vTop.end(), heapOrder);
+            vTop.back() = entry;
+            std::push_heap(vTop.begin(), vTop.end(), heapOrder);
+        }
+    });
+    if ( !fOk )
+        return false;
+    std::sort(vTop.rbegin(), vTop.rend());
+    return true;
+}
+
+bool CBlockTreeDB::ReadSnapshotBalance(const CTxDestination &dest, CAmount &amount)
+{
+    CBitcoinAddress address(dest);
+    uint160 hashBytes; int type = 0;
+    CAddressBalanceValue value;
+    if ( !address.GetIndexKey(hashBytes, type, false) || GetSnapshotIgnoreSet().count(make_pair((unsigned int)type, hashBytes)) != 0 )
+        return false;
+    if ( !ReadAddressBalance(hashBytes, type, value) || value.balance == 0 )
+        return false;
+    amount = value.balance;
+    return true;
+}
+
 extern std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot; // daily snapshot
 
 UniValue CBlockTreeDB::Snapshot(int top)
 {
     std::vector <std::pair<CAmount, std::string>> vaddr;
-    std::map <std::string, CAmount> addressAmounts;
     UniValue result(UniValue::VOBJ);
     UniValue addressesSorted(UniValue::VARR);
     result.push_back(Pair("start_time", (int) time(NULL)));
 
-    if ( (vAddressSnapshot.size() > 0 && top < 0) || (Snapshot2(addressAmounts,&result) && top >= 0) )
+    if ( (vAddressSnapshot.size() > 0 && top < 0) || (top >= 0 && Snapshot2(vaddr, top, &result)) )
     {
-        if ( top > -1 )
-        {
-            for (std::pair<std::string, CAmount> element : addressAmounts)
-                vaddr.push_back( make_pair(element.second, element.first) );
-            std::sort(vaddr.rbegin(), vaddr.rend());
-        }
-        else
+        if ( top < 0 )
         {
             for ( auto address : vAddressSnapshot )
                 vaddr.push_back(make_pair(address.first, CBitcoinAddress(address.second).ToString()));
@@ -711,6 +1101,18 @@ UniValue CBlockTreeDB::Snapshot(int top)
     return(result);
 }
 
+bool CBlockTreeDB::ReadUTXOStats(const uint256 &hash, CUTXOStats &stats) const {
+    return Read(make_pair(DB_UTXOSTATS, hash), stats);
+}
+
+bool CBlockTreeDB::WriteUTXOStats(const uint256 &hash, const CUTXOStats &stats) {
+    return Write(make_pair(DB_UTXOSTATS, hash), stats);
+}
+
+bool CBlockTreeDB::EraseUTXOStats(const uint256 &hash) {
+    return Erase(make_pair(DB_UTXOSTATS, hash));
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
@@ -23,9 +23,13 @@
 #define BITCOIN_TXDB_H
 
 #include "coins.h"
+#include "crypto/muhash.h"
 #include "dbwrapper.h"
+#include "script/standard.h"
 
+#include <functional>
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -39,6 +43,7 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressBalanceValue;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
@@ -47,6 +52,8 @@ struct CSpentIndexKey;
 struct CSpentIndexValue;
 class uint256;
 class CDiskBlockIndex;
+class CBlock;
+class CBlockUndo;
 
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
@@ -55,6 +62,61 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
+/**
+ * Statistics of the UTXO set as of a particular block, maintained by the
+ * UTXO stats index (-utxostatsindex). One entry is stored per connected
+ * block, keyed by block hash, so a reorg only has to drop the entries of the
+ * disconnected blocks.
+ */
+struct CUTXOStats
+{
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+    //! komodo_newcoins() summed from height 1, as reported by coinsupply
+    CAmount nChainSupply;
+    CAmount nChainZFunds;
+    CAmount nChainSproutFunds;
+    //! rolling hash of all (outpoint, txout) pairs in the set
+    MuHash3072 muhash;
+
+    CUTXOStats() : nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0),
+                   nChainSupply(0), nChainZFunds(0), nChainSproutFunds(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nTransactions));
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nBogoSize));
+        READWRITE(nTotalAmount);
+        READWRITE(nChainSupply);
+        READWRITE(nChainZFunds);
+        READWRITE(nChainSproutFunds);
+        unsigned char muhashBytes[MuHash3072::SERIALIZED_SIZE];
+        if (!ser_action.ForRead())
+            muhash.ToBytes(muhashBytes);
+        READWRITE(FLATDATA(muhashBytes));
+        if (ser_action.ForRead())
+            muhash.FromBytes(muhashBytes);
+    }
+
+    /** Add a single unspent output to the statistics */
+    void AddOutput(const uint256 &txid, uint32_t n, const CTxOut &out);
+    /** Remove a single spent output from the statistics */
+    void RemoveOutput(const uint256 &txid, uint32_t n, const CTxOut &out);
+    /****
+     * Apply the effect of connecting a block
+     * @param block the block being connected
+     * @param blockundo the undo data produced while connecting it
+     * @param nHeight the height of the block
+     * @returns false, leaving the statistics untouched, if the undo data does not match the block
+     */
+    bool ApplyBlock(const CBlock &block, const CBlockUndo &blockundo, int nHeight);
+};
+
 /**
  * CCoinsView backed by the coin database (chainstate/)
 */
@@ -98,6 +160,15 @@ public:
                     CProofHashMap &mapZkOutputProofHash,
                     CProofHashMap &mapZkSpendProofHash);
     bool GetStats(CCoinsStats &stats) const;
+    /****
+     * Compute the UTXO set statistics with a full scan split into key ranges
+     * that are hashed concurrently and combined with MuHash. Only the iterator
+     * creation happens under cs_main.
+     * @param stats the results (hashMuHash and nBogoSize are filled in, hashSerialized is not)
+     * @param nThreads number of ranges scanned in parallel
+     * @returns true on success
+     */
+    bool GetStatsParallel(CCoinsStats &stats, int nThreads) const;
 };
 
 /**
@@ -213,11 +284,14 @@ public:
      * Read the unspent key/value pairs for a particular address
      * @param addressHash the address
      * @param type the address type
-     * @param vect the results
+     * @param vect the results are appended here
+     * @param limit max number of results to append (0 for all)
+     * @param after resume after this key, as returned last by a previous call
      * @returns true on success
      */
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 size_t limit = 0, const CAddressUnspentKey *after = NULL);
     /*****
      * Write a batch of address index / amount records
      * @param vect a collection of address index/amount records
@@ -237,11 +311,48 @@ public:
      * @param addressIndex the address index / amount records found
      * @param start the starting index
      * @param end the end
+     * @param limit max number of records to append (0 for all)
+     * @param after resume after this key, as returned last by a previous call
      * @returns true on success
      */
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
+                          int start = 0, int end = 0, size_t limit = 0, const CAddressIndexKey *after = NULL);
+    /****
+     * Apply the address index records of a connected or disconnected block to the address balances
+     * @param vect the address index / amount records of the block
+     * @param fUndo true when the records are being erased
+     * @param pindex the block; the balances then record it (or its parent when undoing) as their tip,
+     *        skip blocks they already reflect and are rebuilt if they are on another branch
+     * @returns true on success
+     */
+    bool UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fUndo, const CBlockIndex *pindex = NULL);
+    /****
+     * Read the block the address balances were last brought to
+     * @param hashTip the result
+     * @returns false if no block was recorded (databases built before the tip was kept)
+     */
+    bool ReadAddressBalanceTip(uint256 &hashTip) const;
+    /****
+     * Read the balance of a particular address
+     * @param addressHash the address
+     * @param type the address type
+     * @param value the result
+     * @returns true if the address has unspent outputs
+     */
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) const;
+    /****
+     * Recompute every address balance from the unspent index
+     * @param hashTip the block the unspent index is at, recorded as the balances' tip if not null
+     * @returns true on success
+     */
+    bool RebuildAddressBalanceIndex(const uint256 &hashTip = uint256());
+    /****
+     * Walk all address balances in key order
+     * @param func called with the address type, hash and balance of each entry
+     * @returns true on success
+     */
+    bool ForEachAddressBalance(const std::function<void(unsigned int, const uint160&, const CAddressBalanceValue&)> &func);
     /****
      * Write a timestamp entry to the db
      * @param timestampIndex the record to write
@@ -306,11 +417,47 @@ public:
     UniValue Snapshot(int top);
     /****
      * Get a snapshot
-     * @param addressAmounts the results
+     * @param vTop the richest addresses, sorted by amount descending
+     * @param nTop max number of results (0 returns every address)
      * @param ret results summary (passing nullptr skips compiling this summary)
      * @returns true on success
      */
-    bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret);
+    bool Snapshot2(std::vector<std::pair<CAmount, std::string> > &vTop, size_t nTop, UniValue *ret);
+    /****
+     * Get a snapshot keyed by destination, as used by the daily snapshot
+     * @param vTop the richest destinations, sorted by amount descending
+     * @param nTop max number of results
+     * @param setExclude destinations to leave out of the results
+     * @returns true on success
+     */
+    bool SnapshotDestinations(std::vector<std::pair<CAmount, CTxDestination> > &vTop, size_t nTop, const std::set<CTxDestination> &setExclude);
+    /****
+     * Read the balance an address contributes to a snapshot
+     * @param dest the address
+     * @param amount the result
+     * @returns true if the address is part of the snapshot
+     */
+    bool ReadSnapshotBalance(const CTxDestination &dest, CAmount &amount);
+    /****
+     * Read the UTXO stats index entry of a block
+     * @param hash the block hash
+     * @param stats the results
+     * @returns true on success
+     */
+    bool ReadUTXOStats(const uint256 &hash, CUTXOStats &stats) const;
+    /****
+     * Write the UTXO stats index entry of a block
+     * @param hash the block hash
+     * @param stats the entry
+     * @returns true on success
+     */
+    bool WriteUTXOStats(const uint256 &hash, const CUTXOStats &stats);
+    /****
+     * Remove the UTXO stats index entry of a disconnected block
+     * @param hash the block hash
+     * @returns true on success
+     */
+    bool EraseUTXOStats(const uint256 &hash);
 };
 
 #endif // BITCOIN_TXDB_H
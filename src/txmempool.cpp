@@ -35,11 +35,16 @@
 #include "komodo_utils.h"
 #include "komodo_bitcoind.h"
 
+#include <cmath>
+#include <limits>
+
 using namespace std;
 
 CTxMemPoolEntry::CTxMemPoolEntry():
     nFee(0), nTxSize(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0),
-    hadNoDependencies(false), spendsCoinbase(false)
+    hadNoDependencies(false), spendsCoinbase(false), nEntrySequence(0), fProofsVerified(false),
+    nCountWithDescendants(1), nSizeWithDescendants(0), nFeesWithDescendants(0),
+    nCountWithAncestors(1), nSizeWithAncestors(0), nFeesWithAncestors(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
@@ -50,9 +55,12 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
                                  bool _spendsCoinbase, uint32_t _nBranchId):
     tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight),
     hadNoDependencies(poolHasNoInputsOf),
-    spendsCoinbase(_spendsCoinbase), nBranchId(_nBranchId)
+    spendsCoinbase(_spendsCoinbase), nBranchId(_nBranchId), nEntrySequence(0), fProofsVerified(false)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    nCountWithDescendants = nCountWithAncestors = 1;
+    nSizeWithDescendants = nSizeWithAncestors = nTxSize;
+    nFeesWithDescendants = nFeesWithAncestors = nFee;
     nModSize = tx.CalculateModifiedSize(nTxSize);
     nUsageSize = RecursiveDynamicUsage(tx);
     feeRate = CFeeRate(nFee, nTxSize);
@@ -72,8 +80,34 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
+void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+{
+    nSizeWithDescendants += modifySize;
+    assert(int64_t(nSizeWithDescendants) > 0);
+    nFeesWithDescendants += modifyFee;
+    nCountWithDescendants += modifyCount;
+    assert(int64_t(nCountWithDescendants) > 0);
+}
+
+void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+{
+    nSizeWithAncestors += modifySize;
+    assert(int64_t(nSizeWithAncestors) > 0);
+    nFeesWithAncestors += modifyFee;
+    nCountWithAncestors += modifyCount;
+    assert(int64_t(nCountWithAncestors) > 0);
+}
+
+void CTxMemPoolEntry::ResetPackageState()
+{
+    nCountWithDescendants = nCountWithAncestors = 1;
+    nSizeWithDescendants = nSizeWithAncestors = nTxSize;
+    nFeesWithDescendants = nFeesWithAncestors = nFee;
+}
+
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), nEntrySequence(0), nOrderChanges(0),
+    lastRollingFeeUpdate(GetTime()), blockSinceLastRollingFeeBump(false), rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -113,35 +147,333 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+uint64_t CTxMemPool::GetEntrySequence() const
+{
+    LOCK(cs);
+    return nEntrySequence;
+}
+
+uint64_t CTxMemPool::GetOrderChanges() const
+{
+    LOCK(cs);
+    return nOrderChanges;
+}
+
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolParents(txiter entry) const
+{
+    assert(entry != mapTx.end());
+    txlinksMap::const_iterator it = mapLinks.find(entry);
+    assert(it != mapLinks.end());
+    return it->second.parents;
+}
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolChildren(txiter entry) const
+{
+    assert(entry != mapTx.end());
+    txlinksMap::const_iterator it = mapLinks.find(entry);
+    assert(it != mapLinks.end());
+    return it->second.children;
+}
+
+void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
+{
+    setEntries s;
+    if (add && mapLinks[entry].parents.insert(parent).second) {
+        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
+    } else if (!add && mapLinks[entry].parents.erase(parent)) {
+        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    }
+}
+
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+{
+    setEntries s;
+    if (add && mapLinks[entry].children.insert(child).second) {
+        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
+    } else if (!add && mapLinks[entry].children.erase(child)) {
+        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    }
+}
+
+bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors,
+                                           uint64_t limitAncestorCount, uint64_t limitAncestorSize,
+                                           uint64_t limitDescendantCount, uint64_t limitDescendantSize,
+                                           std::string &errString, bool fSearchForParents) const
+{
+    LOCK(cs);
+    setEntries parentHashes;
+    const CTransaction &tx = entry.GetTx();
+
+    if (fSearchForParents) {
+        // Get parents of this transaction that are in the mempool
+        if (!tx.IsCoinImport()) {
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                txiter piter = mapTx.find(tx.vin[i].prevout.hash);
+                if (piter != mapTx.end()) {
+                    parentHashes.insert(piter);
+                    if (parentHashes.size() + 1 > limitAncestorCount) {
+                        errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
+                        return false;
+                    }
+                }
+            }
+        }
+    } else {
+        // If we're not searching for parents, we require this to be an
+        // entry in the mempool already.
+        txiter it = mapTx.iterator_to(entry);
+        parentHashes = GetMemPoolParents(it);
+    }
+
+    size_t totalSizeWithAncestors = entry.GetTxSize();
+
+    while (!parentHashes.empty()) {
+        txiter stageit = *parentHashes.begin();
+
+        setAncestors.insert(stageit);
+        parentHashes.erase(stageit);
+        totalSizeWithAncestors += stageit->GetTxSize();
+
+        if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantSize);
+            return false;
+        } else if (stageit->GetCountWithDescendants() + 1 > limitDescendantCount) {
+            errString = strprintf("too many descendants for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantCount);
+            return false;
+        } else if (totalSizeWithAncestors > limitAncestorSize) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+            return false;
+        }
+
+        const setEntries &setMemPoolParents = GetMemPoolParents(stageit);
+        BOOST_FOREACH(const txiter &phash, setMemPoolParents) {
+            // If this is a new ancestor, add it.
+            if (setAncestors.count(phash) == 0) {
+                parentHashes.insert(phash);
+            }
+            if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+                errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants) const
+{
+    setEntries stage;
+    if (setDescendants.count(entryit) == 0) {
+        stage.insert(entryit);
+    }
+    // Traverse down the children of entry, only adding children that are not
+    // accounted for in setDescendants already (because those children have either
+    // already been walked, or will be walked in this iteration).
+    while (!stage.empty()) {
+        txiter it = *stage.begin();
+        setDescendants.insert(it);
+        stage.erase(it);
+
+        const setEntries &setChildren = GetMemPoolChildren(it);
+        BOOST_FOREACH(const txiter &childiter, setChildren) {
+            if (!setDescendants.count(childiter)) {
+                stage.insert(childiter);
+            }
+        }
+    }
+}
+
+void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
+{
+    setEntries parentIters = GetMemPoolParents(it);
+    // add or remove this tx as a child of each parent
+    BOOST_FOREACH(txiter piter, parentIters) {
+        UpdateChild(piter, it, add);
+    }
+    const int64_t updateCount = (add ? 1 : -1);
+    const int64_t updateSize = updateCount * it->GetTxSize();
+    const CAmount updateFee = updateCount * it->GetFee();
+    BOOST_FOREACH(txiter ancestorIt, setAncestors) {
+        mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
+    }
+}
+
+void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncestors)
+{
+    int64_t updateCount = setAncestors.size();
+    int64_t updateSize = 0;
+    CAmount updateFee = 0;
+    BOOST_FOREACH(txiter ancestorIt, setAncestors) {
+        updateSize += ancestorIt->GetTxSize();
+        updateFee += ancestorIt->GetFee();
+    }
+    mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount));
+}
+
+void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
+{
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    if (updateDescendants) {
+        // Descendants that stay lose the removed entry from their ancestors.
+        // This is the case when a block confirms a transaction whose children
+        // are still waiting.
+        BOOST_FOREACH(txiter removeIt, entriesToRemove) {
+            setEntries setDescendants;
+            CalculateDescendants(removeIt, setDescendants);
+            setDescendants.erase(removeIt); // don't update state for self
+            int64_t modifySize = -((int64_t)removeIt->GetTxSize());
+            CAmount modifyFee = -removeIt->GetFee();
+            BOOST_FOREACH(txiter dit, setDescendants) {
+                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1));
+            }
+        }
+    }
+    BOOST_FOREACH(txiter removeIt, entriesToRemove) {
+        // The ancestors of each entry lose it, and the entries removed
+        // with it, from their descendant state.
+        setEntries setAncestors;
+        std::string dummy;
+        CalculateMemPoolAncestors(*removeIt, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        UpdateAncestorsOf(false, removeIt, setAncestors);
+    }
+    // Only now that all the package state is updated can the children of the
+    // removed entries forget their parents.
+    BOOST_FOREACH(txiter removeIt, entriesToRemove) {
+        BOOST_FOREACH(txiter childIt, GetMemPoolChildren(removeIt)) {
+            UpdateParent(childIt, removeIt, false);
+        }
+    }
+}
+
+void CTxMemPool::UpdatePackageState(txiter it)
+{
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+
+    setEntries setAncestors;
+    CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+    int64_t nSize = it->GetTxSize();
+    CAmount nFees = it->GetFee();
+    BOOST_FOREACH(txiter ancestorIt, setAncestors) {
+        nSize += ancestorIt->GetTxSize();
+        nFees += ancestorIt->GetFee();
+    }
+    mapTx.modify(it, update_ancestor_state(nSize - (int64_t)it->GetSizeWithAncestors(),
+                                           nFees - it->GetFeesWithAncestors(),
+                                           (int64_t)setAncestors.size() + 1 - (int64_t)it->GetCountWithAncestors()));
+
+    setEntries setDescendants;
+    CalculateDescendants(it, setDescendants);
+    nSize = 0;
+    nFees = 0;
+    BOOST_FOREACH(txiter descendantIt, setDescendants) {
+        nSize += descendantIt->GetTxSize();
+        nFees += descendantIt->GetFee();
+    }
+    mapTx.modify(it, update_descendant_state(nSize - (int64_t)it->GetSizeWithDescendants(),
+                                             nFees - it->GetFeesWithDescendants(),
+                                             (int64_t)setDescendants.size() - (int64_t)it->GetCountWithDescendants()));
+}
+
+void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
+{
+    LOCK(cs);
+    // Transactions returned from a disconnected block may have children that
+    // stayed in the pool; link them up.
+    setEntries setUpdated;
+    BOOST_FOREACH(const uint256 &hash, vHashesToUpdate) {
+        txiter it = mapTx.find(hash);
+        if (it == mapTx.end())
+            continue;
+        std::map<COutPoint, CInPoint>::iterator iter = mapNextTx.lower_bound(COutPoint(hash, 0));
+        for (; iter != mapNextTx.end() && iter->first.hash == hash; ++iter) {
+            txiter childit = mapTx.find(iter->second.ptx->GetHash());
+            assert(childit != mapTx.end());
+            UpdateChild(it, childit, true);
+            UpdateParent(childit, it, true);
+        }
+        setUpdated.insert(it);
+    }
+
+    // Only the descendants of the returned transactions gained ancestors, and
+    // only their ancestors gained descendants.
+    setEntries setDescendants;
+    BOOST_FOREACH(txiter it, setUpdated) {
+        CalculateDescendants(it, setDescendants);
+    }
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    setEntries setAffected = setDescendants;
+    BOOST_FOREACH(txiter it, setDescendants) {
+        setEntries setAncestors;
+        std::string dummy;
+        CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        setAffected.insert(setAncestors.begin(), setAncestors.end());
+    }
+    BOOST_FOREACH(txiter it, setAffected) {
+        UpdatePackageState(it);
+    }
+}
+
+void CTxMemPool::addUncheckedEntries(const std::vector<CTxMemPoolEntry> &vEntries)
+{
+    LOCK(cs);
+    std::vector<uint256> vHashes;
+    vHashes.reserve(vEntries.size());
+    BOOST_FOREACH(const CTxMemPoolEntry &entry, vEntries) {
+        const uint256 &hash = entry.GetTx().GetHash();
+        addUnchecked(hash, entry, true);
+        vHashes.push_back(hash);
+    }
+    UpdateTransactionsFromBlock(vHashes);
+}
 
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate)
+{
+    LOCK(cs);
+    setEntries setAncestors;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+    return addUnchecked(hash, entry, setAncestors, fCurrentEstimate);
+}
+
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate)
 {
     // Add to memory pool without checking anything.
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
-    mapTx.insert(entry);
-    const CTransaction& tx = mapTx.find(hash)->GetTx();
+    indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
+    mapTx.modify(newit, update_entry_sequence(++nEntrySequence));
+    // an entry copied from another pool still carries that pool's package
+    mapTx.modify(newit, reset_package_state());
+    mapLinks.insert(make_pair(newit, TxLinks()));
+    const CTransaction& tx = newit->GetTx();
     mapRecentlyAddedTx[tx.GetHash()] = &tx;
     nRecentlyAddedSequence += 1;
     if (!tx.IsCoinImport()) {
+        std::set<uint256> setParentTransactions;
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+            setParentTransactions.insert(tx.vin[i].prevout.hash);
         }
-    }
-    BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
-        BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
-            mapSproutNullifiers[nf] = &tx;
+        // Link to the parents that are in the pool, and add this entry to
+        // the descendant state of all its ancestors.
+        BOOST_FOREACH(const uint256 &phash, setParentTransactions) {
+            txiter pit = mapTx.find(phash);
+            if (pit != mapTx.end())
+                UpdateParent(newit, pit, true);
         }
     }
-    for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
-        mapSaplingNullifiers[spendDescription.nullifier] = &tx;
-        mapZkSpendProofHash[spendDescription.ProofHash()] = &tx;
-    }
-    for (const OutputDescription &outputDescription : tx.vShieldedOutput) {
-        mapZkOutputProofHash[outputDescription.ProofHash()] = &tx;
-    }
+    UpdateAncestorsOf(true, newit, setAncestors);
+    UpdateEntryForAncestors(newit, setAncestors);
+
+    UpdateShieldedIndexes(tx, true);
+    if (nCheckFrequency != 0 && (!tx.vjoinsplit.empty() || !tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty()))
+        vCheckAdded.push_back(hash);
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
@@ -337,14 +669,45 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
     return true;
 }
 
+void CTxMemPool::removeUnchecked(txiter it)
+{
+    const uint256 hash = it->GetTx().GetHash();
+    const CTransaction& tx = it->GetTx();
+    mapRecentlyAddedTx.erase(hash);
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        mapNextTx.erase(txin.prevout);
+    UpdateShieldedIndexes(tx, false);
+    totalTxSize -= it->GetTxSize();
+    cachedInnerUsage -= it->DynamicMemoryUsage();
+    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
+    mapLinks.erase(it);
+    mapTx.erase(it);
+    nTransactionsUpdated++;
+    nOrderChanges++;
+    minerPolicyEstimator->removeTx(hash);
+    removeAddressIndex(hash);
+    removeSpentIndex(hash);
+}
+
+void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants)
+{
+    AssertLockHeld(cs);
+    UpdateForRemoveFromMempool(stage, updateDescendants);
+    BOOST_FOREACH(const txiter& it, stage) {
+        removeUnchecked(it);
+    }
+}
+
 void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
     {
         LOCK(cs);
-        std::deque<uint256> txToRemove;
-        txToRemove.push_back(origTx.GetHash());
-        if (fRecursive && !mapTx.count(origTx.GetHash())) {
+        setEntries txToRemove;
+        txiter origit = mapTx.find(origTx.GetHash());
+        if (origit != mapTx.end()) {
+            txToRemove.insert(origit);
+        } else if (fRecursive) {
             // If recursively removing but origTx isn't in the mempool
             // be sure to remove any children that are in the pool. This can
             // happen during chain re-orgs if origTx isn't re-accepted into
@@ -353,48 +716,24 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
                 std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
-                txToRemove.push_back(it->second.ptx->GetHash());
+                txiter nextit = mapTx.find(it->second.ptx->GetHash());
+                assert(nextit != mapTx.end());
+                txToRemove.insert(nextit);
             }
         }
-        while (!txToRemove.empty())
-        {
-            uint256 hash = txToRemove.front();
-            txToRemove.pop_front();
-            if (!mapTx.count(hash))
-                continue;
-            const CTransaction& tx = mapTx.find(hash)->GetTx();
-            if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
-                    if (it == mapNextTx.end())
-                        continue;
-                    txToRemove.push_back(it->second.ptx->GetHash());
-                }
-            }
-            mapRecentlyAddedTx.erase(hash);
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-                mapNextTx.erase(txin.prevout);
-            BOOST_FOREACH(const JSDescription& joinsplit, tx.vjoinsplit) {
-                BOOST_FOREACH(const uint256& nf, joinsplit.nullifiers) {
-                    mapSproutNullifiers.erase(nf);
-                }
-            }
-            for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
-                mapSaplingNullifiers.erase(spendDescription.nullifier);
-                mapZkSpendProofHash.erase(spendDescription.ProofHash());
-            }
-            for (const OutputDescription &outputDescription : tx.vShieldedOutput) {
-                mapZkOutputProofHash.erase(outputDescription.ProofHash());
+        // The links give the descendants directly, without walking mapNextTx
+        setEntries setAllRemoves;
+        if (fRecursive) {
+            BOOST_FOREACH(txiter it, txToRemove) {
+                CalculateDescendants(it, setAllRemoves);
             }
-            removed.push_back(tx);
-            totalTxSize -= mapTx.find(hash)->GetTxSize();
-            cachedInnerUsage -= mapTx.find(hash)->DynamicMemoryUsage();
-            mapTx.erase(hash);
-            nTransactionsUpdated++;
-            minerPolicyEstimator->removeTx(hash);
-            removeAddressIndex(hash);
-            removeSpentIndex(hash);
+        } else {
+            setAllRemoves.swap(txToRemove);
+        }
+        BOOST_FOREACH(txiter it, setAllRemoves) {
+            removed.push_back(it->GetTx());
         }
+        RemoveStaged(setAllRemoves, !fRecursive);
     }
 }
 
@@ -496,38 +835,26 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
     BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
         BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
-            std::map<uint256, const CTransaction*>::iterator it = mapSproutNullifiers.find(nf);
-            if (it != mapSproutNullifiers.end()) {
-                const CTransaction &txConflict = *it->second;
-                if (txConflict != tx) {
-                    remove(txConflict, removed, true);
-                }
+            const CTransaction *ptxConflict = mapSproutNullifiers.find(nf);
+            if (ptxConflict != NULL && *ptxConflict != tx) {
+                remove(*ptxConflict, removed, true);
             }
         }
     }
     for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
-        std::map<uint256, const CTransaction*>::iterator it = mapSaplingNullifiers.find(spendDescription.nullifier);
-        if (it != mapSaplingNullifiers.end()) {
-            const CTransaction &txConflict = *it->second;
-            if (txConflict != tx) {
-                remove(txConflict, removed, true);
-            }
+        const CTransaction *ptxConflict = mapSaplingNullifiers.find(spendDescription.nullifier);
+        if (ptxConflict != NULL && *ptxConflict != tx) {
+            remove(*ptxConflict, removed, true);
         }
-        std::map<uint256, const CTransaction*>::iterator itt = mapZkSpendProofHash.find(spendDescription.ProofHash());
-        if (itt != mapZkSpendProofHash.end()) {
-            const CTransaction &txConflict = *itt->second;
-            if (txConflict != tx) {
-                remove(txConflict, removed, true);
-            }
+        ptxConflict = mapZkSpendProofHash.find(spendDescription.ProofHash());
+        if (ptxConflict != NULL && *ptxConflict != tx) {
+            remove(*ptxConflict, removed, true);
         }
     }
     for (const OutputDescription &outputDescription : tx.vShieldedOutput) {
-        std::map<uint256, const CTransaction*>::iterator it = mapZkOutputProofHash.find(outputDescription.ProofHash());
-        if (it != mapZkOutputProofHash.end()) {
-            const CTransaction &txConflict = *it->second;
-            if (txConflict != tx) {
-                remove(txConflict, removed, true);
-            }
+        const CTransaction *ptxConflict = mapZkOutputProofHash.find(outputDescription.ProofHash());
+        if (ptxConflict != NULL && *ptxConflict != tx) {
+            remove(*ptxConflict, removed, true);
         }
     }
 }
@@ -587,6 +914,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     }
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = true;
 }
 
 /**
@@ -614,11 +943,21 @@ void CTxMemPool::removeWithoutBranchId(uint32_t nMemPoolBranchId)
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapSproutNullifiers.clear();
+    mapSaplingNullifiers.clear();
+    mapZkOutputProofHash.clear();
+    mapZkSpendProofHash.clear();
+    vCheckAdded.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    lastRollingFeeUpdate = GetTime();
+    blockSinceLastRollingFeeBump = false;
+    rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    ++nOrderChanges;
 }
 
 void CTxMemPool::check(const CCoinsViewCache *pcoins) const
@@ -638,13 +977,21 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     const int64_t nSpendHeight = GetSpendHeight(mempoolDuplicate);
 
     LOCK(cs);
+    // What the shielded indexes should hold, from the pool's transactions
+    CSaltedHashIndex::Summary sproutNullifiers, saplingNullifiers, zkOutputProofHash, zkSpendProofHash;
     list<const CTxMemPoolEntry*> waitingOnDependants;
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
+        const uint256& hash = tx.GetHash();
+        txlinksMap::const_iterator linksiter = mapLinks.find(it);
+        assert(linksiter != mapLinks.end());
+        const TxLinks &links = linksiter->second;
+        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
         bool fDependsWait = false;
+        setEntries setParentCheck;
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
             indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
@@ -652,6 +999,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 const CTransaction& tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
+                setParentCheck.insert(it2);
             } else {
                 const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
                 assert(coins && coins->IsAvailable(txin.prevout.n));
@@ -663,12 +1011,41 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second.n == i);
             i++;
         }
+        assert(setParentCheck == GetMemPoolParents(it));
+
+        // Check the package state against the links
+        const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        setEntries setAncestors;
+        CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+        uint64_t nSizeCheck = it->GetTxSize();
+        CAmount nFeesCheck = it->GetFee();
+        BOOST_FOREACH(txiter ancestorIt, setAncestors) {
+            nSizeCheck += ancestorIt->GetTxSize();
+            nFeesCheck += ancestorIt->GetFee();
+        }
+        assert(it->GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->GetSizeWithAncestors() == nSizeCheck);
+        assert(it->GetFeesWithAncestors() == nFeesCheck);
+
+        setEntries setChildrenCheck;
+        uint64_t nChildSizes = 0;
+        std::map<COutPoint, CInPoint>::const_iterator iter = mapNextTx.lower_bound(COutPoint(tx.GetHash(), 0));
+        for (; iter != mapNextTx.end() && iter->first.hash == tx.GetHash(); ++iter) {
+            txiter childit = mapTx.find(iter->second.ptx->GetHash());
+            assert(childit != mapTx.end());
+            if (setChildrenCheck.insert(childit).second)
+                nChildSizes += childit->GetTxSize();
+        }
+        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(it->GetSizeWithDescendants() >= nChildSizes + it->GetTxSize());
 
         boost::unordered_map<uint256, SproutMerkleTree, CCoinsKeyHasher> intermediates;
 
         BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
             BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
                 assert(!pcoins->GetNullifier(nf, SPROUT));
+                sproutNullifiers.Add(nf, hash);
             }
 
             SproutMerkleTree tree;
@@ -697,10 +1074,13 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
             std::set<std::pair<uint256, int>> txids;
             assert(!pcoins->GetZkProofHash(spendDescription.ProofHash(), SPEND, txids));
+            saplingNullifiers.Add(spendDescription.nullifier, hash);
+            zkSpendProofHash.Add(spendDescription.ProofHash(), hash);
         }
         for (const OutputDescription &outputDescription : tx.vShieldedOutput) {
             std::set<std::pair<uint256, int>> txids;
             assert(!pcoins->GetZkProofHash(outputDescription.ProofHash(), OUTPUT, txids));
+            zkOutputProofHash.Add(outputDescription.ProofHash(), hash);
         }
         if (fDependsWait)
             waitingOnDependants.push_back(&(*it));
@@ -739,58 +1119,89 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
     }
 
-    checkNullifiers(SPROUT);
-    checkNullifiers(SAPLING);
-    checkZkProofHash(OUTPUT);
-    checkZkProofHash(SPEND);
+    checkNullifiers(SPROUT, sproutNullifiers);
+    checkNullifiers(SAPLING, saplingNullifiers);
+    checkZkProofHash(OUTPUT, zkOutputProofHash);
+    checkZkProofHash(SPEND, zkSpendProofHash);
+
+    // The summaries compare txids; transactions added since the last check
+    // must also have every key pointing at their own pool entry.
+    for (const uint256& hash : vCheckAdded) {
+        indexed_transaction_set::const_iterator it = mapTx.find(hash);
+        if (it == mapTx.end())
+            continue;
+        const CTransaction& tx = it->GetTx();
+        BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
+            BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
+                assert(mapSproutNullifiers.find(nf) == &tx);
+            }
+        }
+        for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
+            assert(mapSaplingNullifiers.find(spendDescription.nullifier) == &tx);
+            assert(mapZkSpendProofHash.find(spendDescription.ProofHash()) == &tx);
+        }
+        for (const OutputDescription &outputDescription : tx.vShieldedOutput) {
+            assert(mapZkOutputProofHash.find(outputDescription.ProofHash()) == &tx);
+        }
+    }
+    vCheckAdded.clear();
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
 }
 
-void CTxMemPool::checkNullifiers(ShieldedType type) const
+void CTxMemPool::UpdateShieldedIndexes(const CTransaction& tx, bool fAdd)
+{
+    const uint256& hash = tx.GetHash();
+    auto update = [&tx, fAdd](CSaltedHashIndex& index, const uint256& key) {
+        if (fAdd)
+            index.insert(key, &tx);
+        else
+            index.erase(key);
+    };
+    BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
+        BOOST_FOREACH(const uint256 &nf, joinsplit.nullifiers) {
+            update(mapSproutNullifiers, nf);
+        }
+    }
+    for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
+        update(mapSaplingNullifiers, spendDescription.nullifier);
+        update(mapZkSpendProofHash, spendDescription.ProofHash());
+    }
+    for (const OutputDescription &outputDescription : tx.vShieldedOutput) {
+        update(mapZkOutputProofHash, outputDescription.ProofHash());
+    }
+}
+
+// expected is derived from the transactions in mapTx. A key whose transaction
+// is no longer in the pool, or one the index maps to a different transaction,
+// makes the summaries differ, as does a key two pool transactions share.
+void CTxMemPool::checkNullifiers(ShieldedType type, const CSaltedHashIndex::Summary& expected) const
 {
-    const std::map<uint256, const CTransaction*>* mapToUse;
     switch (type) {
         case SPROUT:
-            mapToUse = &mapSproutNullifiers;
+            assert(mapSproutNullifiers.GetSummary() == expected);
             break;
         case SAPLING:
-            mapToUse = &mapSaplingNullifiers;
+            assert(mapSaplingNullifiers.GetSummary() == expected);
             break;
         default:
             throw runtime_error("Unknown nullifier type");
     }
-    for (const auto& entry : *mapToUse) {
-        uint256 hash = entry.second->GetHash();
-        CTxMemPool::indexed_transaction_set::const_iterator findTx = mapTx.find(hash);
-        const CTransaction& tx = findTx->GetTx();
-        assert(findTx != mapTx.end());
-        assert(&tx == entry.second);
-    }
 }
 
-void CTxMemPool::checkZkProofHash(ProofType type) const
+void CTxMemPool::checkZkProofHash(ProofType type, const CSaltedHashIndex::Summary& expected) const
 {
-    const std::map<uint256, const CTransaction*>* mapToUse;
     switch (type) {
         case OUTPUT:
-            mapToUse = &mapZkOutputProofHash;
+            assert(mapZkOutputProofHash.GetSummary() == expected);
             break;
         case SPEND:
-            mapToUse = &mapZkSpendProofHash;
+            assert(mapZkSpendProofHash.GetSummary() == expected);
             break;
         default:
             throw runtime_error("Unknown proof type");
     }
-
-    for (const auto& entry : *mapToUse) {
-        uint256 hash = entry.second->GetHash();
-        CTxMemPool::indexed_transaction_set::const_iterator findTx = mapTx.find(hash);
-        const CTransaction& tx = findTx->GetTx();
-        assert(findTx != mapTx.end());
-        assert(&tx == entry.second);
-    }
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -865,6 +1276,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount> &deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        ++nOrderChanges;
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -994,5 +1406,69 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 6 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 6 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) +
+           mapSproutNullifiers.DynamicMemoryUsage() + mapSaplingNullifiers.DynamicMemoryUsage() +
+           mapZkOutputProofHash.DynamicMemoryUsage() + mapZkSpendProofHash.DynamicMemoryUsage() + cachedInnerUsage;
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(llround(rollingMinimumFeeRate));
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        double halflife = ROLLING_FEE_HALFLIFE;
+        if (DynamicMemoryUsage() < sizelimit / 4)
+            halflife /= 4;
+        else if (DynamicMemoryUsage() < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < (double)::minRelayTxFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(llround(rollingMinimumFeeRate)), ::minRelayTxFee);
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    AssertLockHeld(cs);
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+unsigned int CTxMemPool::TrimToSize(size_t sizelimit)
+{
+    LOCK(cs);
+
+    unsigned int nTxnRemoved = 0;
+    CFeeRate maxFeeRateRemoved(0);
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
+        indexed_transaction_set::nth_index<3>::type::iterator it = mapTx.get<3>().begin();
+
+        // The new minimum fee is the fee rate of the package removed, plus the
+        // relay fee, so that transactions paying what the evicted ones paid
+        // cannot come straight back in before a block is found.
+        CFeeRate removed(it->GetFeesWithDescendants(), it->GetSizeWithDescendants());
+        removed = CFeeRate(removed.GetFeePerK() + ::minRelayTxFee.GetFeePerK());
+        trackPackageRemoved(removed);
+        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+        setEntries stage;
+        CalculateDescendants(mapTx.project<0>(it), stage);
+        nTxnRemoved += stage.size();
+        RemoveStaged(stage, false);
+    }
+
+    if (maxFeeRateRemoved > CFeeRate(0))
+        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+    return nTxnRemoved;
 }
@@ -22,12 +22,14 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "addressindex.h"
 #include "spentindex.h"
 #include "amount.h"
 #include "coins.h"
 #include "primitives/transaction.h"
+#include "saltedhashindex.h"
 #include "sync.h"
 
 #undef foreach
@@ -69,6 +71,21 @@ private:
     bool hadNoDependencies; //! Not dependent on any other txs when it entered the mempool
     bool spendsCoinbase; //! keep track of transactions that spend a coinbase
     uint32_t nBranchId; //! Branch ID this transaction is known to commit to, cached for efficiency
+    uint64_t nEntrySequence; //! Order of arrival in the mempool, set when added
+    bool fProofsVerified; //! Sprout and Sapling proofs were checked before the transaction entered the mempool, set by AcceptToMemoryPool
+
+    // Information about descendants of this transaction that are in the
+    // mempool; if we remove this transaction we must remove all of these
+    // descendants as well.
+    uint64_t nCountWithDescendants; //! number of descendant transactions, including this one
+    uint64_t nSizeWithDescendants; //! ... and their total size
+    CAmount nFeesWithDescendants; //! ... and their total fees
+
+    // Analogous statistics for the in-mempool ancestors this transaction
+    // needs mined before it can be.
+    uint64_t nCountWithAncestors; //! number of ancestor transactions, including this one
+    uint64_t nSizeWithAncestors; //! ... and their total size
+    CAmount nFeesWithAncestors; //! ... and their total fees
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
@@ -89,6 +106,73 @@ public:
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
     uint32_t GetValidatedBranchId() const { return nBranchId; }
+    uint64_t GetEntrySequence() const { return nEntrySequence; }
+    bool GetProofsVerified() const { return fProofsVerified; }
+    void SetProofsVerified(bool fVerified) { fProofsVerified = fVerified; }
+
+    // Adjusts the descendant or ancestor state when transactions in the
+    // package are added or removed
+    void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetFeesWithDescendants() const { return nFeesWithDescendants; }
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetFeesWithAncestors() const { return nFeesWithAncestors; }
+
+    // Forget the package this entry was in, leaving just the transaction itself
+    void ResetPackageState();
+
+    friend struct update_entry_sequence;
+};
+
+// Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
+struct update_descendant_state
+{
+    update_descendant_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) :
+        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount)
+    {}
+
+    void operator() (CTxMemPoolEntry &e)
+        { e.UpdateDescendantState(modifySize, modifyFee, modifyCount); }
+
+private:
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
+};
+
+struct update_ancestor_state
+{
+    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) :
+        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount)
+    {}
+
+    void operator() (CTxMemPoolEntry &e)
+        { e.UpdateAncestorState(modifySize, modifyFee, modifyCount); }
+
+private:
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
+};
+
+struct reset_package_state
+{
+    void operator() (CTxMemPoolEntry &e) { e.ResetPackageState(); }
+};
+
+struct update_entry_sequence
+{
+    update_entry_sequence(uint64_t _nEntrySequence) : nEntrySequence(_nEntrySequence) {}
+
+    void operator() (CTxMemPoolEntry &e) { e.nEntrySequence = nEntrySequence; }
+
+private:
+    uint64_t nEntrySequence;
 };
 
 // extracts a TxMemPoolEntry's transaction hash
@@ -101,10 +185,20 @@ struct mempoolentry_txid
     }
 };
 
+// extracts a TxMemPoolEntry's order of arrival
+struct mempoolentry_sequence
+{
+    typedef uint64_t result_type;
+    result_type operator() (const CTxMemPoolEntry &entry) const
+    {
+        return entry.GetEntrySequence();
+    }
+};
+
 class CompareTxMemPoolEntryByFee
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         if (a.GetFeeRate() == b.GetFeeRate())
             return a.GetTime() < b.GetTime();
@@ -112,6 +206,39 @@ public:
     }
 };
 
+/**
+ * Sort by the higher of a transaction's own fee rate and the fee rate of it
+ * together with its descendants, lowest first. Evicting from the front drops
+ * the packages that pay least, without dropping a parent whose children pay
+ * for it (CPFP).
+ */
+class CompareTxMemPoolEntryByDescendantScore
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        CFeeRate scoreA = std::max(a.GetFeeRate(), CFeeRate(a.GetFeesWithDescendants(), a.GetSizeWithDescendants()));
+        CFeeRate scoreB = std::max(b.GetFeeRate(), CFeeRate(b.GetFeesWithDescendants(), b.GetSizeWithDescendants()));
+        if (scoreA == scoreB)
+            return a.GetTime() > b.GetTime(); // evict newer transactions first
+        return scoreA < scoreB;
+    }
+};
+
+/** Sort by the fee rate of a transaction together with its ancestors, highest first. */
+class CompareTxMemPoolEntryByAncestorFee
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        CFeeRate scoreA(a.GetFeesWithAncestors(), a.GetSizeWithAncestors());
+        CFeeRate scoreB(b.GetFeesWithAncestors(), b.GetSizeWithAncestors());
+        if (scoreA == scoreB)
+            return a.GetTime() < b.GetTime();
+        return scoreA > scoreB;
+    }
+};
+
 class CBlockPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -140,11 +267,20 @@ public:
  */
 class CTxMemPool
 {
+public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; //! half-life of the rolling minimum fee, in seconds
+
 private:
     uint32_t nCheckFrequency; //! Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated;
+    uint64_t nEntrySequence; //! Sequence number of the last transaction added
+    uint64_t nOrderChanges; //! Removals and reprioritisations, see GetOrderChanges()
     CBlockPolicyEstimator* minerPolicyEstimator;
 
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
+
     uint64_t totalTxSize = 0; //! sum of all mempool tx' byte sizes
     uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
@@ -152,13 +288,18 @@ private:
     uint64_t nRecentlyAddedSequence = 0;
     uint64_t nNotifiedSequence = 0;
 
-    std::map<uint256, const CTransaction*> mapSproutNullifiers;
-    std::map<uint256, const CTransaction*> mapSaplingNullifiers;
-    std::map<uint256, const CTransaction*> mapZkOutputProofHash;
-    std::map<uint256, const CTransaction*> mapZkSpendProofHash;
+    CSaltedHashIndex mapSproutNullifiers;
+    CSaltedHashIndex mapSaplingNullifiers;
+    CSaltedHashIndex mapZkOutputProofHash;
+    CSaltedHashIndex mapZkSpendProofHash;
+
+    //! Transactions added since the last check(), whose index entries it verifies
+    mutable std::vector<uint256> vCheckAdded;
 
-    void checkNullifiers(ShieldedType type) const;
-    void checkZkProofHash(ProofType type) const;
+    /** Add or remove the nullifiers and proof hashes of tx */
+    void UpdateShieldedIndexes(const CTransaction& tx, bool fAdd);
+    void checkNullifiers(ShieldedType type, const CSaltedHashIndex::Summary& expected) const;
+    void checkZkProofHash(ProofType type, const CSaltedHashIndex::Summary& expected) const;
 
 public:
     typedef boost::multi_index_container<
@@ -170,6 +311,18 @@ public:
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByFee
+            >,
+            // sorted by order of arrival
+            boost::multi_index::ordered_non_unique<mempoolentry_sequence>,
+            // sorted by fee rate with descendants, lowest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByDescendantScore
+            >,
+            // sorted by fee rate with ancestors, highest first
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByAncestorFee
             >
         >
     > indexed_transaction_set;
@@ -177,6 +330,18 @@ public:
     mutable CCriticalSection cs;
     indexed_transaction_set mapTx;
 
+    typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
+    struct CompareIteratorByHash {
+        bool operator()(const txiter &a, const txiter &b) const {
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        }
+    };
+    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+
+    /** In-mempool parents and children of a transaction. */
+    const setEntries& GetMemPoolParents(txiter entry) const;
+    const setEntries& GetMemPoolChildren(txiter entry) const;
+
 private:
     typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
     addressDeltaMap mapAddress;
@@ -190,6 +355,33 @@ private:
     typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    struct TxLinks {
+        setEntries parents;
+        setEntries children;
+    };
+
+    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
+    txlinksMap mapLinks;
+
+    void UpdateParent(txiter entry, txiter parent, bool add);
+    void UpdateChild(txiter entry, txiter child, bool add);
+    /** Set the ancestor state of a new entry and add it to its ancestors' descendant state. */
+    void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors);
+    /** Update the links and descendant state of the ancestors of an entry being added or removed. */
+    void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
+    /**
+     * Take the entries about to be removed out of the package state of the
+     * entries that stay. When descendants of the removed entries stay in the
+     * pool (a block confirmed their parents), their ancestor state is updated
+     * too.
+     */
+    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants);
+    /** Recompute the ancestor and descendant state of an entry from its links. */
+    void UpdatePackageState(txiter it);
+    /** Remove a single entry and everything that refers to it, without touching package state. */
+    void removeUnchecked(txiter entry);
+    void trackPackageRemoved(const CFeeRate& rate);
+
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
@@ -207,6 +399,8 @@ public:
     void setSanityCheck(double dFrequency = 1.0) { nCheckFrequency = static_cast<uint32_t>(dFrequency * 4294967295.0); }
 
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
+    /** Add an entry whose in-mempool ancestors are already known, see CalculateMemPoolAncestors. */
+    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate = true);
     void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
@@ -224,10 +418,67 @@ public:
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void removeWithoutBranchId(uint32_t nMemPoolBranchId);
     void clear();
+
+    /**
+     * Remove a set of entries. The set must hold all the descendants of
+     * its members, unless updateDescendants is set, in which case the
+     * descendants left behind have their ancestor state updated.
+     */
+    void RemoveStaged(setEntries &stage, bool updateDescendants);
+
+    /**
+     * Called after transactions from a disconnected block were added back:
+     * links them to the children that stayed in the pool and updates the
+     * package state of everything involved.
+     */
+    void UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate);
+
+    /**
+     * Add copies of entries from another pool, such as the transparent
+     * transactions CheckBlock sets aside on CC chains. They may come in any
+     * order; a child added before its parent is linked to it afterwards.
+     */
+    void addUncheckedEntries(const std::vector<CTxMemPoolEntry> &vEntries);
+
+    /**
+     * Collect the in-mempool ancestors of entry into setAncestors, checking
+     * that adding it keeps every package within the given limits. Returns
+     * false with errString set if a limit would be exceeded.
+     * fSearchForParents looks the parents up by the entry's inputs; without
+     * it the entry must already be in the pool and its links are used.
+     */
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors,
+                                   uint64_t limitAncestorCount, uint64_t limitAncestorSize,
+                                   uint64_t limitDescendantCount, uint64_t limitDescendantSize,
+                                   std::string &errString, bool fSearchForParents = true) const;
+
+    /** Add entryit and all its in-mempool descendants to setDescendants, if not already there. */
+    void CalculateDescendants(txiter entryit, setEntries &setDescendants) const;
+
+    /**
+     * The minimum fee rate to get into the pool, which rises when packages
+     * are evicted to keep it under sizelimit and decays with a half-life of
+     * ROLLING_FEE_HALFLIFE once blocks are found again.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
+    /**
+     * Evict the packages with the lowest fee rate until the pool uses no more
+     * than sizelimit bytes. Returns the number of transactions removed.
+     */
+    unsigned int TrimToSize(size_t sizelimit);
     void queryHashes(std::vector<uint256>& vtxid);
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    /** Sequence number of the last transaction added; entries added later have higher ones. */
+    uint64_t GetEntrySequence() const;
+    /**
+     * Count of changes other than additions: removals and reprioritisations.
+     * While it stays the same, a selection of transactions made from the pool
+     * stays valid and can be extended with the entries added since.
+     */
+    uint64_t GetOrderChanges() const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
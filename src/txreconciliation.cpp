@@ -0,0 +1,270 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "pinsketch.h"
+#include "random.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+/** Domain separation for the short id key derived from both salts. */
+const std::string RECON_SALT_TAG = "Tx Relay Salting";
+
+} // anon namespace
+
+TxReconciliationTracker::TxReconciliationTracker() : nOutboundFlood(0) {}
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId nodeid)
+{
+    LOCK(cs);
+    PeerState& peer = mapPeers[nodeid];
+    peer.nLocalSalt = GetRand(std::numeric_limits<uint64_t>::max());
+    return peer.nLocalSalt;
+}
+
+bool TxReconciliationTracker::RegisterPeer(NodeId nodeid, bool fInbound, uint32_t nPeerVersion, uint64_t nPeerSalt)
+{
+    LOCK(cs);
+    std::map<NodeId, PeerState>::iterator it = mapPeers.find(nodeid);
+    if (it == mapPeers.end() || it->second.fRegistered)
+        return false;
+    if (nPeerVersion < 1) {
+        mapPeers.erase(it);
+        return false;
+    }
+
+    PeerState& peer = it->second;
+    uint64_t nSalt1 = std::min(peer.nLocalSalt, nPeerSalt), nSalt2 = std::max(peer.nLocalSalt, nPeerSalt);
+    unsigned char vSalts[16];
+    WriteLE64(vSalts, nSalt1);
+    WriteLE64(vSalts + 8, nSalt2);
+    uint256 hashKey;
+    CSHA256().Write((const unsigned char*)RECON_SALT_TAG.data(), RECON_SALT_TAG.size()).Write(vSalts, sizeof(vSalts)).Finalize(hashKey.begin());
+    peer.k0 = ReadLE64(hashKey.begin());
+    peer.k1 = ReadLE64(hashKey.begin() + 8);
+
+    peer.fRegistered = true;
+    peer.fInitiator = !fInbound;
+    if (!fInbound && nOutboundFlood < MAX_OUTBOUND_FLOOD_TO) {
+        peer.fFlood = true;
+        nOutboundFlood++;
+    }
+    return true;
+}
+
+void TxReconciliationTracker::PeerVerack(NodeId nodeid)
+{
+    LOCK(cs);
+    std::map<NodeId, PeerState>::iterator it = mapPeers.find(nodeid);
+    if (it != mapPeers.end() && !it->second.fRegistered)
+        mapPeers.erase(it);
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId nodeid)
+{
+    LOCK(cs);
+    std::map<NodeId, PeerState>::iterator it = mapPeers.find(nodeid);
+    if (it == mapPeers.end())
+        return;
+    if (it->second.fFlood)
+        nOutboundFlood--;
+    mapPeers.erase(it);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId nodeid) const
+{
+    LOCK(cs);
+    std::map<NodeId, PeerState>::const_iterator it = mapPeers.find(nodeid);
+    return it != mapPeers.end() && it->second.fRegistered;
+}
+
+bool TxReconciliationTracker::ShouldFloodTo(NodeId nodeid) const
+{
+    LOCK(cs);
+    std::map<NodeId, PeerState>::const_iterator it = mapPeers.find(nodeid);
+    return it == mapPeers.end() || !it->second.fRegistered || it->second.fFlood;
+}
+
+TxReconciliationTracker::PeerState* TxReconciliationTracker::GetRegistered(NodeId nodeid)
+{
+    std::map<NodeId, PeerState>::iterator it = mapPeers.find(nodeid);
+    if (it == mapPeers.end() || !it->second.fRegistered)
+        return NULL;
+    return &it->second;
+}
+
+uint32_t TxReconciliationTracker::ComputeShortID(const PeerState& peer, const uint256& txid) const
+{
+    // Sketch elements must be non-zero
+    return 1 + (uint32_t)(SipHashUint256(peer.k0, peer.k1, txid) % 0xFFFFFFFF);
+}
+
+uint32_t TxReconciliationTracker::GetShortID(NodeId nodeid, const uint256& txid) const
+{
+    LOCK(cs);
+    std::map<NodeId, PeerState>::const_iterator it = mapPeers.find(nodeid);
+    if (it == mapPeers.end() || !it->second.fRegistered)
+        return 0;
+    return ComputeShortID(it->second, txid);
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId nodeid, const uint256& txid)
+{
+    LOCK(cs);
+    PeerState* peer = GetRegistered(nodeid);
+    if (peer == NULL || peer->mapLocalSet.size() >= MAX_RECON_SET_SIZE)
+        return false;
+    uint32_t nShortID = ComputeShortID(*peer, txid);
+    std::pair<std::map<uint32_t, uint256>::iterator, bool> ret = peer->mapLocalSet.insert(std::make_pair(nShortID, txid));
+    // A short id collision within the set cannot be reconciled
+    return ret.second || ret.first->second == txid;
+}
+
+void TxReconciliationTracker::RemoveFromSet(NodeId nodeid, const uint256& txid)
+{
+    LOCK(cs);
+    PeerState* peer = GetRegistered(nodeid);
+    if (peer == NULL)
+        return;
+    std::map<uint32_t, uint256>::iterator it = peer->mapLocalSet.find(ComputeShortID(*peer, txid));
+    if (it != peer->mapLocalSet.end() && it->second == txid)
+        peer->mapLocalSet.erase(it);
+}
+
+bool TxReconciliationTracker::InitiateReconciliation(NodeId nodeid, int64_t nNow, uint16_t& nSetSize, uint16_t& nQ)
+{
+    LOCK(cs);
+    PeerState* peer = GetRegistered(nodeid);
+    if (peer == NULL || !peer->fInitiator)
+        return false;
+    if (peer->phase == PHASE_REQUESTED && nNow - peer->nRequestTime > RECON_RESPONSE_TIMEOUT)
+        peer->phase = PHASE_NONE;
+    if (peer->phase != PHASE_NONE || nNow < peer->nNextRequest)
+        return false;
+
+    nSetSize = (uint16_t)std::min<size_t>(peer->mapLocalSet.size(), std::numeric_limits<uint16_t>::max());
+    nQ = peer->nQ;
+    peer->phase = PHASE_REQUESTED;
+    peer->nRequestTime = nNow;
+    peer->nNextRequest = nNow + RECON_REQUEST_INTERVAL;
+    return true;
+}
+
+bool TxReconciliationTracker::RespondToRequest(NodeId nodeid, uint16_t nPeerSetSize, uint16_t nPeerQ, std::vector<unsigned char>& vSketch)
+{
+    LOCK(cs);
+    PeerState* peer = GetRegistered(nodeid);
+    if (peer == NULL || peer->fInitiator)
+        return false;
+
+    // A request without a reconcildiff for the previous one: keep those transactions for this round
+    if (peer->phase == PHASE_RESPONDED) {
+        peer->mapLocalSet.insert(peer->mapSnapshot.begin(), peer->mapSnapshot.end());
+        peer->mapSnapshot.clear();
+    }
+
+    // Expected difference (BIP 330): |s - r| + q * min(s, r), plus one to make room for an error
+    size_t nLocalSize = peer->mapLocalSet.size();
+    size_t nMin = std::min<size_t>(nLocalSize, nPeerSetSize);
+    size_t nCapacity = (nLocalSize > nPeerSetSize ? nLocalSize - nPeerSetSize : nPeerSetSize - nLocalSize) +
+                       (size_t)nPeerQ * nMin / RECON_Q_PRECISION + 1;
+
+    vSketch.clear();
+    if (nCapacity <= MAX_SKETCH_CAPACITY) {
+        PinSketch sketch(nCapacity);
+        for (std::map<uint32_t, uint256>::const_iterator it = peer->mapLocalSet.begin(); it != peer->mapLocalSet.end(); ++it)
+            sketch.Add(it->first);
+        vSketch = sketch.Serialize();
+    }
+
+    peer->mapSnapshot.swap(peer->mapLocalSet);
+    peer->mapLocalSet.clear();
+    peer->phase = PHASE_RESPONDED;
+    return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId nodeid, const std::vector<unsigned char>& vSketch, bool& fSuccess,
+                                           std::vector<uint256>& vAnnounce, std::vector<uint32_t>& vAskShortIds)
+{
+    LOCK(cs);
+    vAnnounce.clear();
+    vAskShortIds.clear();
+    fSuccess = false;
+
+    PeerState* peer = GetRegistered(nodeid);
+    if (peer == NULL || !peer->fInitiator || peer->phase != PHASE_REQUESTED)
+        return false;
+    peer->phase = PHASE_NONE;
+
+    PinSketch theirs;
+    std::vector<uint32_t> vDifference;
+    if (!vSketch.empty() && vSketch.size() <= MAX_SKETCH_CAPACITY * 4 && theirs.Deserialize(vSketch)) {
+        PinSketch ours(theirs.GetCapacity());
+        for (std::map<uint32_t, uint256>::const_iterator it = peer->mapLocalSet.begin(); it != peer->mapLocalSet.end(); ++it)
+            ours.Add(it->first);
+        ours.Merge(theirs);
+        fSuccess = ours.Decode(ours.GetCapacity(), vDifference);
+    }
+
+    if (!fSuccess) {
+        // Fall back to announcing everything; the peer does the same after our reconcildiff
+        for (std::map<uint32_t, uint256>::const_iterator it = peer->mapLocalSet.begin(); it != peer->mapLocalSet.end(); ++it)
+            vAnnounce.push_back(it->second);
+        peer->mapLocalSet.clear();
+        return true;
+    }
+
+    for (size_t i = 0; i < vDifference.size(); i++) {
+        std::map<uint32_t, uint256>::const_iterator it = peer->mapLocalSet.find(vDifference[i]);
+        if (it != peer->mapLocalSet.end())
+            vAnnounce.push_back(it->second);
+        else
+            vAskShortIds.push_back(vDifference[i]);
+    }
+
+    // Refine q from the actual difference: |D| = |s - r| + q * min(s, r)
+    size_t s = peer->mapLocalSet.size();
+    size_t r = s - vAnnounce.size() + vAskShortIds.size();
+    size_t nMin = std::min(s, r);
+    if (nMin > 0) {
+        size_t nExcess = vDifference.size() - (s > r ? s - r : r - s);
+        peer->nQ = (uint16_t)std::min<size_t>(nExcess * RECON_Q_PRECISION / nMin, std::numeric_limits<uint16_t>::max());
+    }
+
+    peer->mapLocalSet.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconcilDiff(NodeId nodeid, bool fSuccess, const std::vector<uint32_t>& vAskShortIds,
+                                                 std::vector<uint256>& vAnnounce)
+{
+    LOCK(cs);
+    vAnnounce.clear();
+
+    PeerState* peer = GetRegistered(nodeid);
+    if (peer == NULL || peer->fInitiator || peer->phase != PHASE_RESPONDED)
+        return false;
+
+    if (fSuccess) {
+        for (size_t i = 0; i < vAskShortIds.size(); i++) {
+            std::map<uint32_t, uint256>::const_iterator it = peer->mapSnapshot.find(vAskShortIds[i]);
+            if (it != peer->mapSnapshot.end())
+                vAnnounce.push_back(it->second);
+        }
+    } else {
+        for (std::map<uint32_t, uint256>::const_iterator it = peer->mapSnapshot.begin(); it != peer->mapSnapshot.end(); ++it)
+            vAnnounce.push_back(it->second);
+    }
+
+    peer->mapSnapshot.clear();
+    peer->phase = PHASE_NONE;
+    return true;
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+typedef int NodeId;
+
+/** -txreconciliation default */
+static const bool DEFAULT_TXRECONCILIATION_ENABLE = false;
+/** Version of the reconciliation protocol we speak (sent in sendtxrcncl). */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Number of outbound reconciling peers we keep flooding transactions to, for fast propagation. */
+static const int MAX_OUTBOUND_FLOOD_TO = 2;
+/** Time between reconciliations the connecting side initiates with each peer (in microseconds). */
+static const int64_t RECON_REQUEST_INTERVAL = 8 * 1000000;
+/** Time after which an unanswered reconciliation request is given up (in microseconds). */
+static const int64_t RECON_RESPONSE_TIMEOUT = 60 * 1000000;
+/** Largest set difference a sketch is built for; larger differences fall back to inv. */
+static const size_t MAX_SKETCH_CAPACITY = 128;
+/** Most transactions queued for one peer; more are announced by inv straight away. */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Fixed point scale of the q coefficient of the set difference estimate (BIP 330). */
+static const uint16_t RECON_Q_PRECISION = 32767;
+/** Initial q, refined from the outcome of every reconciliation. */
+static const uint16_t RECON_DEFAULT_Q = RECON_Q_PRECISION / 4;
+
+/**
+ * Erlay style transaction relay (BIP 330). Instead of announcing every
+ * transaction to every peer with an inv, transactions are queued per peer and
+ * periodically reconciled: the connecting side sends the size of its queue,
+ * the other side answers with a PinSketch of its own queue sized for the
+ * expected difference, and the difference decoded from both sketches is all
+ * that gets announced, in either direction. Transactions are still flooded to
+ * a few outbound peers so they spread quickly.
+ *
+ * Message flow (initiator is the side that opened the connection):
+ *   both:      sendtxrcncl(version, salt)       before verack
+ *   initiator: reqtxrcncl(set size, q)
+ *   responder: sketch(sketch)                   empty to ask for a plain exchange
+ *   initiator: reconcildiff(success, short ids) short ids it is missing, then
+ *              inv for the transactions the responder is missing
+ *   responder: inv for the requested short ids (everything on failure)
+ *
+ * This class only keeps the per-peer state and does no networking, so it can
+ * be driven by a simulation. It is thread safe.
+ */
+class TxReconciliationTracker
+{
+public:
+    TxReconciliationTracker();
+
+    /** Generate the salt we send to a peer in sendtxrcncl. */
+    uint64_t PreRegisterPeer(NodeId nodeid);
+    /** Complete registration with the peer's sendtxrcncl. Returns false if it was unexpected or incompatible. */
+    bool RegisterPeer(NodeId nodeid, bool fInbound, uint32_t nPeerVersion, uint64_t nPeerSalt);
+    /** The peer's verack arrived; sendtxrcncl must come before it, so a later one is refused. */
+    void PeerVerack(NodeId nodeid);
+    void ForgetPeer(NodeId nodeid);
+    bool IsPeerRegistered(NodeId nodeid) const;
+
+    /** Whether transactions are still announced to this registered peer by inv. */
+    bool ShouldFloodTo(NodeId nodeid) const;
+
+    /** Queue a transaction for the next reconciliation. Returns false if it has to be announced by inv instead. */
+    bool AddToSet(NodeId nodeid, const uint256& txid);
+    /** Drop a transaction the peer has told us about itself. */
+    void RemoveFromSet(NodeId nodeid, const uint256& txid);
+
+    /** Initiator: whether a reconciliation is due; fills in the reqtxrcncl fields. */
+    bool InitiateReconciliation(NodeId nodeid, int64_t nNow, uint16_t& nSetSize, uint16_t& nQ);
+    /** Responder: answer a reqtxrcncl with a sketch of our set. Returns false if the request was unexpected. */
+    bool RespondToRequest(NodeId nodeid, uint16_t nPeerSetSize, uint16_t nPeerQ, std::vector<unsigned char>& vSketch);
+    /**
+     * Initiator: decode the peer's sketch against our set. vAnnounce gets the
+     * transactions to inv to the peer, vAskShortIds the short ids to request
+     * in reconcildiff. Returns false if the sketch was unexpected.
+     */
+    bool HandleSketch(NodeId nodeid, const std::vector<unsigned char>& vSketch, bool& fSuccess,
+                      std::vector<uint256>& vAnnounce, std::vector<uint32_t>& vAskShortIds);
+    /** Responder: the transactions to inv after a reconcildiff. Returns false if it was unexpected. */
+    bool HandleReconcilDiff(NodeId nodeid, bool fSuccess, const std::vector<uint32_t>& vAskShortIds,
+                            std::vector<uint256>& vAnnounce);
+
+    /** Short id of a transaction for a registered peer (0 if not registered). */
+    uint32_t GetShortID(NodeId nodeid, const uint256& txid) const;
+
+private:
+    enum Phase {
+        PHASE_NONE,
+        PHASE_REQUESTED,  //!< initiator waiting for a sketch
+        PHASE_RESPONDED,  //!< responder waiting for reconcildiff
+    };
+
+    struct PeerState {
+        bool fRegistered;
+        bool fInitiator;
+        bool fFlood;
+        uint64_t nLocalSalt;
+        uint64_t k0, k1;
+        std::map<uint32_t, uint256> mapLocalSet;
+        std::map<uint32_t, uint256> mapSnapshot;
+        Phase phase;
+        int64_t nNextRequest;
+        int64_t nRequestTime;
+        uint16_t nQ;
+
+        PeerState() : fRegistered(false), fInitiator(false), fFlood(false), nLocalSalt(0), k0(0), k1(0),
+                      phase(PHASE_NONE), nNextRequest(0), nRequestTime(0), nQ(RECON_DEFAULT_Q) {}
+    };
+
+    uint32_t ComputeShortID(const PeerState& peer, const uint256& txid) const;
+    PeerState* GetRegistered(NodeId nodeid);
+
+    mutable CCriticalSection cs;
+    std::map<NodeId, PeerState> mapPeers;
+    int nOutboundFlood;
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -3412,11 +3412,15 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
         //     sample_times.push_back(benchmark_verify_joinsplit(samplejoinsplit));
 #ifdef ENABLE_MINING
         } else if (benchmarktype == "solveequihash") {
+            std::string solver = params.size() >= 4 ? params[3].get_str() : "default";
+            if (solver != "default" && solver != "tromp") {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown Equihash solver");
+            }
             if (params.size() < 3) {
-                sample_times.push_back(benchmark_solve_equihash());
+                sample_times.push_back(benchmark_solve_equihash(solver));
             } else {
                 int nThreads = params[2].get_int();
-                std::vector<double> vals = benchmark_solve_equihash_threaded(nThreads);
+                std::vector<double> vals = benchmark_solve_equihash_threaded(nThreads, solver);
                 sample_times.insert(sample_times.end(), vals.begin(), vals.end());
             }
 #endif
@@ -3461,6 +3465,23 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp, const CPubKey& mypk)
             sample_times.push_back(benchmark_verify_sapling_spend());
         } else if (benchmarktype == "verifysaplingoutput") {
             sample_times.push_back(benchmark_verify_sapling_output());
+        } else if (benchmarktype == "mempoolstress") {
+            int nTxs = 100000;
+            if (params.size() >= 3) {
+                nTxs = params[2].get_int();
+            }
+            sample_times.push_back(benchmark_mempool_stress(nTxs));
+        } else if (benchmarktype == "mempoolflood") {
+            // every transaction gets its own Sapling output proof up front
+            int nTxs = 200;
+            int nThreads = DEFAULT_MSGHANDLER_THREADS;
+            if (params.size() >= 3) {
+                nTxs = params[2].get_int();
+            }
+            if (params.size() >= 4) {
+                nThreads = params[3].get_int();
+            }
+            sample_times.push_back(benchmark_mempool_flood(nTxs, nThreads));
         } else {
             throw JSONRPCError(RPC_TYPE_ERROR, "Invalid benchmarktype");
         }
@@ -0,0 +1,203 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakingindex.h"
+
+#include "base58.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "main.h"
+#include "wallet/wallet.h"
+
+#include <boost/bind/bind.hpp>
+
+CStakingIndex* pstakingindex = NULL;
+
+CStakingCandidate::CStakingCandidate(const std::string& addressIn, CAmount nValueIn, uint32_t nTimeIn, const CScript& scriptPubKeyIn) :
+    address(addressIn), nValue(nValueIn), nTime(nTimeIn), scriptPubKey(scriptPubKeyIn)
+{
+    // komodo_stakehash takes the first word of the address hash
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)address.data(), address.size()).Finalize(hash);
+    segid32 = ReadLE32(hash);
+}
+
+CStakingIndex::CStakingIndex(CWallet* pwalletIn) : pwallet(pwalletIn), fRebuild(true)
+{
+    if (pwallet)
+        pwallet->NotifyTransactionChanged.connect(boost::bind(&CStakingIndex::NotifyTransactionChanged, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+CStakingIndex::~CStakingIndex()
+{
+    if (pwallet)
+        pwallet->NotifyTransactionChanged.disconnect(boost::bind(&CStakingIndex::NotifyTransactionChanged, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void CStakingIndex::Add(const COutPoint& outpoint, const CStakingCandidate& candidate)
+{
+    LOCK(cs);
+    std::map<COutPoint, CStakingCandidate>::iterator it = mapCandidates.find(outpoint);
+    if (it != mapCandidates.end()) {
+        setByTime[it->second.segid32 % STAKING_SEGIDS].erase(std::make_pair(it->second.nTime, outpoint));
+        it->second = candidate;
+    } else {
+        mapCandidates.insert(std::make_pair(outpoint, candidate));
+    }
+    setByTime[candidate.segid32 % STAKING_SEGIDS].insert(std::make_pair(candidate.nTime, outpoint));
+}
+
+void CStakingIndex::Remove(const COutPoint& outpoint)
+{
+    LOCK(cs);
+    std::map<COutPoint, CStakingCandidate>::iterator it = mapCandidates.find(outpoint);
+    if (it == mapCandidates.end())
+        return;
+    setByTime[it->second.segid32 % STAKING_SEGIDS].erase(std::make_pair(it->second.nTime, outpoint));
+    mapCandidates.erase(it);
+}
+
+void CStakingIndex::Clear()
+{
+    LOCK(cs);
+    mapCandidates.clear();
+    for (int i = 0; i < STAKING_SEGIDS; i++)
+        setByTime[i].clear();
+}
+
+size_t CStakingIndex::Size() const
+{
+    LOCK(cs);
+    return mapCandidates.size();
+}
+
+void CStakingIndex::GetCandidates(int nHeight, uint32_t nBlockTime, int nMinAge,
+                                  std::vector<std::pair<COutPoint, CStakingCandidate> >& vCandidates) const
+{
+    LOCK(cs);
+    vCandidates.clear();
+    for (int i = 0; i < STAKING_SEGIDS; i++) {
+        // komodo_stake skips every block time before nTime + minage - 2 * segid
+        int64_t segid = (nHeight + i) & (STAKING_SEGIDS - 1);
+        int64_t nLatest = (int64_t)nBlockTime + STAKING_ITERATIONS - 1 + segid * 2 - nMinAge;
+        for (std::set<std::pair<uint32_t, COutPoint> >::const_iterator it = setByTime[i].begin();
+             it != setByTime[i].end() && it->first <= nLatest; ++it) {
+            vCandidates.push_back(*mapCandidates.find(it->second));
+        }
+    }
+}
+
+void CStakingIndex::NotifyTransactionChanged(CWallet* wallet, const uint256& hashTx, ChangeType status)
+{
+    LOCK(cs);
+    setChangedTxs.insert(hashTx);
+}
+
+void CStakingIndex::RescanWallet()
+{
+    LOCK(cs);
+    fRebuild = true;
+}
+
+void CStakingIndex::ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added)
+{
+    // Coins spent by a disconnected block come back without a wallet notification
+    if (!added) {
+        LOCK(cs);
+        fRebuild = true;
+    }
+}
+
+void CStakingIndex::Update()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pwallet->cs_wallet);
+
+    std::set<uint256> setTxs;
+    bool fRebuildNow;
+    {
+        LOCK(cs);
+        fRebuildNow = fRebuild;
+        fRebuild = false;
+        setTxs.swap(setChangedTxs);
+    }
+    if (fRebuildNow) {
+        Rebuild();
+        return;
+    }
+
+    BOOST_FOREACH(const uint256& hashTx, setTxs) {
+        RemoveOutputs(hashTx);
+        const CWalletTx* wtx = pwallet->GetWalletTx(hashTx);
+        if (wtx == NULL || wtx->GetDepthInMainChain() < 1)
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, wtx->vin)
+            Remove(txin.prevout);
+        AddWalletOutputs(hashTx);
+    }
+}
+
+void CStakingIndex::Rebuild()
+{
+    std::vector<COutput> vCoins;
+    pwallet->AvailableCoins(vCoins, true);
+
+    std::set<uint256> setTxs;
+    BOOST_FOREACH(const COutput& out, vCoins) {
+        if (out.nDepth >= 1)
+            setTxs.insert(out.tx->GetHash());
+    }
+
+    Clear();
+    BOOST_FOREACH(const uint256& hashTx, setTxs)
+        AddWalletOutputs(hashTx);
+    LogPrint("staking", "%s: %u staking coins\n", __func__, Size());
+}
+
+void CStakingIndex::AddWalletOutputs(const uint256& hashTx)
+{
+    const CWalletTx* wtx = pwallet->GetWalletTx(hashTx);
+    if (wtx == NULL)
+        return;
+    const CBlockIndex* pindex = NULL;
+    if (wtx->GetDepthInMainChain(pindex) < 1 || pindex == NULL)
+        return;
+
+    for (unsigned int i = 0; i < wtx->vout.size(); i++) {
+        const CTxOut& txout = wtx->vout[i];
+        CTxDestination dest;
+        if (txout.nValue < COIN || !(pwallet->IsMine(txout) & ISMINE_SPENDABLE) || pwallet->IsSpent(hashTx, i))
+            continue;
+        if (!ExtractDestination(txout.scriptPubKey, dest) || IsMine(*pwallet, dest) == ISMINE_NO)
+            continue;
+        Add(COutPoint(hashTx, i), CStakingCandidate(CBitcoinAddress(dest).ToString(), txout.nValue, pindex->nTime, txout.scriptPubKey));
+    }
+}
+
+void CStakingIndex::RemoveOutputs(const uint256& hashTx)
+{
+    std::vector<COutPoint> vOutPoints;
+    {
+        LOCK(cs);
+        for (std::map<COutPoint, CStakingCandidate>::const_iterator it = mapCandidates.lower_bound(COutPoint(hashTx, 0));
+             it != mapCandidates.end() && it->first.hash == hashTx; ++it) {
+            vOutPoints.push_back(it->first);
+        }
+    }
+    BOOST_FOREACH(const COutPoint& outpoint, vOutPoints)
+        Remove(outpoint);
+}
+
+bool CStakingIndex::IsAvailable(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pwallet->cs_wallet);
+
+    const CWalletTx* wtx = pwallet->GetWalletTx(outpoint.hash);
+    if (wtx == NULL || outpoint.n >= wtx->vout.size())
+        return false;
+    if (wtx->IsCoinBase() && wtx->GetBlocksToMaturity() > 0)
+        return false;
+    return !pwallet->IsSpent(outpoint.hash, outpoint.n) && !pwallet->IsLockedCoin(outpoint.hash, outpoint.n);
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_STAKINGINDEX_H
+#define BITCOIN_WALLET_STAKINGINDEX_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "sync.h"
+#include "ui_interface.h"
+#include "validationinterface.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class CWallet;
+
+/** Number of segids a staking address can fall in */
+static const int STAKING_SEGIDS = 64;
+/** Number of block times komodo_stake tries from its first one */
+static const int STAKING_ITERATIONS = 600;
+
+/** A wallet coin that can stake, with what komodo_stake would look up for it */
+struct CStakingCandidate
+{
+    std::string address;
+    CAmount nValue;
+    //! Time of the block the coin was created in
+    uint32_t nTime;
+    //! First word of the address hash; the segid at height h is (h + segid32) & 63
+    uint32_t segid32;
+    CScript scriptPubKey;
+
+    CStakingCandidate() : nValue(0), nTime(0), segid32(0) {}
+    CStakingCandidate(const std::string& addressIn, CAmount nValueIn, uint32_t nTimeIn, const CScript& scriptPubKeyIn);
+};
+
+/**
+ * The wallet's staking coins, bucketed by the segid of their address and
+ * ordered by block time within a bucket. A coin cannot win before
+ * nTime + minage - 2 * segid, so a staking round only evaluates the front
+ * of each bucket instead of every coin in the wallet.
+ *
+ * Confirmed wallet transactions are applied incrementally from
+ * NotifyTransactionChanged; a disconnected block or a wallet rescan forces
+ * a rebuild from AvailableCoins.
+ */
+class CStakingIndex : public CValidationInterface
+{
+public:
+    explicit CStakingIndex(CWallet* pwalletIn);
+    ~CStakingIndex();
+
+    void Add(const COutPoint& outpoint, const CStakingCandidate& candidate);
+    void Remove(const COutPoint& outpoint);
+    void Clear();
+    size_t Size() const;
+
+    /**
+     * The coins that can win a block at nHeight in one komodo_stake round
+     * starting at nBlockTime, given the chain's minimum coin age.
+     */
+    void GetCandidates(int nHeight, uint32_t nBlockTime, int nMinAge,
+                       std::vector<std::pair<COutPoint, CStakingCandidate> >& vCandidates) const;
+
+    /**
+     * Apply the wallet transactions that changed since the last call, or
+     * rebuild the index if it was invalidated. Requires cs_main and
+     * cs_wallet.
+     */
+    void Update();
+
+    /** Whether the wallet can spend the coin now. Requires cs_main and cs_wallet. */
+    bool IsAvailable(const COutPoint& outpoint) const;
+
+protected:
+    void RescanWallet();
+    void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, SproutMerkleTree sproutTree, SaplingMerkleTree saplingTree, bool added);
+
+private:
+    CWallet* pwallet;
+
+    mutable CCriticalSection cs;
+    bool fRebuild;
+    std::set<uint256> setChangedTxs;
+    std::map<COutPoint, CStakingCandidate> mapCandidates;
+    std::set<std::pair<uint32_t, COutPoint> > setByTime[STAKING_SEGIDS];
+
+    void NotifyTransactionChanged(CWallet* wallet, const uint256& hashTx, ChangeType status);
+    void Rebuild();
+    void AddWalletOutputs(const uint256& hashTx);
+    void RemoveOutputs(const uint256& hashTx);
+};
+
+extern CStakingIndex* pstakingindex;
+
+#endif // BITCOIN_WALLET_STAKINGINDEX_H
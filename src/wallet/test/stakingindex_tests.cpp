@@ -0,0 +1,91 @@
+// Copyright (c) 2026 The Pirate developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakingindex.h"
+
+#include "komodo_bitcoind.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakingindex_tests, BasicTestingSetup)
+
+static std::set<COutPoint> GetCandidateSet(const CStakingIndex& index, int nHeight, uint32_t nBlockTime, int nMinAge)
+{
+    std::vector<std::pair<COutPoint, CStakingCandidate> > vCandidates;
+    index.GetCandidates(nHeight, nBlockTime, nMinAge, vCandidates);
+    std::set<COutPoint> setOutPoints;
+    for (size_t i = 0; i < vCandidates.size(); i++)
+        setOutPoints.insert(vCandidates[i].first);
+    BOOST_CHECK_EQUAL(setOutPoints.size(), vCandidates.size());
+    return setOutPoints;
+}
+
+BOOST_AUTO_TEST_CASE(stakingindex_segid)
+{
+    // The candidate's segid32 is the one komodo_stakehash returns
+    std::string address = "RXL3YXG2ceaB6C5hfJcN4fvmLH2C34knhA";
+    CStakingCandidate candidate(address, COIN, 0, CScript());
+    uint8_t hashbuf[256] = {0};
+    uint256 hash;
+    BOOST_CHECK_EQUAL(candidate.segid32, komodo_stakehash(&hash, (char *)address.c_str(), hashbuf, uint256(), 0));
+    BOOST_CHECK_EQUAL(candidate.segid32, komodo_segid32((char *)address.c_str()));
+}
+
+BOOST_AUTO_TEST_CASE(stakingindex_candidates)
+{
+    CStakingIndex index(NULL);
+    const int nHeight = 1000;
+    const int nMinAge = 3000;
+    const uint32_t nBlockTime = 1700000000;
+
+    // Coins from 64 addresses, one at each age around the minimum
+    std::map<COutPoint, CStakingCandidate> mapAll;
+    for (int i = 0; i < 64; i++) {
+        for (int nAge = nMinAge - STAKING_ITERATIONS - 2 * STAKING_SEGIDS; nAge <= nMinAge + 10; nAge += 7) {
+            COutPoint outpoint(GetRandHash(), i);
+            CStakingCandidate candidate(strprintf("address%d", i), COIN, nBlockTime - nAge, CScript());
+            index.Add(outpoint, candidate);
+            mapAll[outpoint] = candidate;
+        }
+    }
+    BOOST_CHECK_EQUAL(index.Size(), mapAll.size());
+
+    // Exactly the coins komodo_stake does not skip for all of its block times
+    std::set<COutPoint> setCandidates = GetCandidateSet(index, nHeight, nBlockTime, nMinAge);
+    size_t nSkipped = 0;
+    for (std::map<COutPoint, CStakingCandidate>::const_iterator it = mapAll.begin(); it != mapAll.end(); ++it) {
+        int64_t segid = (nHeight + it->second.segid32) & 0x3f;
+        bool fEligible = false;
+        for (int iter = 0; iter < STAKING_ITERATIONS && !fEligible; iter++)
+            fEligible = nBlockTime + iter + segid * 2 >= it->second.nTime + nMinAge;
+        BOOST_CHECK_EQUAL(setCandidates.count(it->first), fEligible);
+        nSkipped += !fEligible;
+    }
+    BOOST_CHECK(nSkipped > 0 && nSkipped < mapAll.size());
+
+    // Every coin is old enough a minimum age later, none of them before
+    BOOST_CHECK_EQUAL(GetCandidateSet(index, nHeight, nBlockTime + nMinAge, nMinAge).size(), mapAll.size());
+    BOOST_CHECK(GetCandidateSet(index, nHeight, nBlockTime - nMinAge, nMinAge).empty());
+
+    // Removed and replaced coins
+    COutPoint outpoint = *setCandidates.begin();
+    index.Remove(outpoint);
+    BOOST_CHECK_EQUAL(index.Size(), mapAll.size() - 1);
+    BOOST_CHECK(!GetCandidateSet(index, nHeight, nBlockTime, nMinAge).count(outpoint));
+    CStakingCandidate young = mapAll[outpoint];
+    young.nTime = nBlockTime;
+    index.Add(outpoint, young);
+    BOOST_CHECK(!GetCandidateSet(index, nHeight, nBlockTime, nMinAge).count(outpoint));
+    index.Add(outpoint, mapAll[outpoint]);
+    BOOST_CHECK(GetCandidateSet(index, nHeight, nBlockTime, nMinAge).count(outpoint));
+    BOOST_CHECK_EQUAL(index.Size(), mapAll.size());
+
+    index.Clear();
+    BOOST_CHECK_EQUAL(index.Size(), 0);
+    BOOST_CHECK(GetCandidateSet(index, nHeight, nBlockTime + nMinAge, nMinAge).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <cstdio>
 #include <future>
 #include <map>
@@ -22,6 +23,7 @@
 #include "script/sign.h"
 #include "sodium.h"
 #include "streams.h"
+#include "transaction_builder.h"
 #include "txdb.h"
 #include "utiltest.h"
 #include "wallet/wallet.h"
@@ -165,40 +167,20 @@ double benchmark_sleep()
 // }
 
 #ifdef ENABLE_MINING
-double benchmark_solve_equihash()
+double benchmark_solve_equihash(const std::string& solver)
 {
-    CBlock pblock;
-    CEquihashInput I{pblock};
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << I;
-
     unsigned int n = Params(CBaseChainParams::MAIN).EquihashN();
     unsigned int k = Params(CBaseChainParams::MAIN).EquihashK();
-    crypto_generichash_blake2b_state eh_state;
-    EhInitialiseState(n, k, eh_state);
-    crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
-
-    uint256 nonce;
-    randombytes_buf(nonce.begin(), 32);
-    crypto_generichash_blake2b_update(&eh_state,
-                                    nonce.begin(),
-                                    nonce.size());
-
-    struct timeval tv_start;
-    timer_start(tv_start);
-    std::set<std::vector<unsigned int>> solns;
-    EhOptimisedSolveUncancellable(n, k, eh_state,
-                                  [](std::vector<unsigned char> soln) { return false; });
-    return timer_stop(tv_start);
+    return TimeEquihashSolve(solver, n, k);
 }
 
-std::vector<double> benchmark_solve_equihash_threaded(int nThreads)
+std::vector<double> benchmark_solve_equihash_threaded(int nThreads, const std::string& solver)
 {
     std::vector<double> ret;
     std::vector<std::future<double>> tasks;
     std::vector<std::thread> threads;
     for (int i = 0; i < nThreads; i++) {
-        std::packaged_task<double(void)> task(&benchmark_solve_equihash);
+        std::packaged_task<double(void)> task(std::bind(&benchmark_solve_equihash, solver));
         tasks.emplace_back(task.get_future());
         threads.emplace_back(std::move(task));
     }
@@ -637,3 +619,133 @@ double benchmark_verify_sapling_output()
     }
     return timer_stop(tv_start);
 }
+
+// Injects nTxs transparent transactions into a fresh mempool, a fifth of them
+// in chains of up to five, then trims the pool to half its size and confirms
+// a full block's worth of the best packages.
+double benchmark_mempool_stress(size_t nTxs)
+{
+    CTxMemPool pool(CFeeRate(0));
+    uint32_t nBranchId = NetworkUpgradeInfo[Consensus::UPGRADE_SAPLING].nBranchId;
+    CScript scriptPubKey = CScript() << OP_TRUE;
+
+    std::vector<CTxMemPoolEntry> entries;
+    entries.reserve(nTxs);
+    for (size_t i = 0; i < nTxs; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        if (i % 5 != 0 && (insecure_rand() % 4) == 0) {
+            // Spend the previous transaction
+            mtx.vin[0].prevout = COutPoint(entries.back().GetTx().GetHash(), 0);
+        } else {
+            mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        }
+        mtx.vout.resize(1);
+        mtx.vout[0].scriptPubKey = scriptPubKey;
+        mtx.vout[0].nValue = 1000000;
+        CAmount nFee = 1000 + insecure_rand() % 100000;
+        entries.push_back(CTxMemPoolEntry(mtx, nFee, GetTime(), 0, 1, true, false, nBranchId));
+    }
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+
+    std::string errString;
+    for (size_t i = 0; i < entries.size(); i++) {
+        CTxMemPool::setEntries setAncestors;
+        if (pool.CalculateMemPoolAncestors(entries[i], setAncestors, DEFAULT_ANCESTOR_LIMIT, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+                                           DEFAULT_DESCENDANT_LIMIT, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString))
+            pool.addUnchecked(entries[i].GetTx().GetHash(), entries[i], setAncestors, false);
+    }
+
+    pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+
+    // Confirm the transactions with the best ancestor fee rate; a block
+    // takes parents before children, which the arrival order gives.
+    std::vector<CTransaction> vtx;
+    {
+        LOCK(pool.cs);
+        std::set<uint64_t> setSequences;
+        CTxMemPool::indexed_transaction_set::nth_index<4>::type::iterator it = pool.mapTx.get<4>().begin();
+        for (size_t nSize = 0; it != pool.mapTx.get<4>().end() && nSize < DEFAULT_BLOCK_MAX_SIZE; ++it) {
+            if (it->GetCountWithAncestors() != 1)
+                continue;
+            setSequences.insert(it->GetEntrySequence());
+            nSize += it->GetTxSize();
+        }
+        CTxMemPool::indexed_transaction_set::nth_index<2>::type::iterator sit = pool.mapTx.get<2>().begin();
+        for (; sit != pool.mapTx.get<2>().end(); ++sit) {
+            if (setSequences.count(sit->GetEntrySequence()))
+                vtx.push_back(sit->GetTx());
+        }
+    }
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 2, conflicts, false);
+
+    return timer_stop(tv_start);
+}
+
+// Floods a fresh mempool with nTxs Sapling transactions from nThreads threads,
+// admitting each the way the tx message handler does: the proof precheck
+// without cs_main, then AcceptToMemoryPool under it. Each transaction spends
+// its own funding transaction, which is put in the pool beforehand, and the
+// rate logged is that of accepted transactions. Building the transactions is
+// not timed, as it costs far more than admitting them.
+double benchmark_mempool_flood(size_t nTxs, int nThreads)
+{
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height() + 1;
+    }
+    uint32_t nBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+    CBasicKeyStore keyStore;
+    CKey tsk;
+    tsk.MakeNewKey(true);
+    keyStore.AddKey(tsk);
+    CScript scriptPubKey = GetScriptForDestination(tsk.GetPubKey().GetID());
+    auto sk = GetTestMasterSaplingSpendingKey();
+
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<CTransaction> vtx;
+    for (size_t i = 0; i < nTxs; i++) {
+        CMutableTransaction funding;
+        funding.vin.resize(1);
+        funding.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        funding.vout.push_back(CTxOut(COIN, scriptPubKey));
+        pool.addUnchecked(funding.GetHash(), CTxMemPoolEntry(funding, 0, GetTime(), 0, nHeight - 1, true, false, nBranchId));
+
+        auto builder = TransactionBuilder(Params().GetConsensus(), nHeight, &keyStore);
+        builder.SetFee(10000);
+        builder.AddTransparentInput(COutPoint(funding.GetHash(), 0), scriptPubKey, COIN);
+        builder.AddSaplingOutput(sk.expsk.full_viewing_key().ovk, sk.DefaultAddress(), COIN - 10000);
+        vtx.push_back(builder.Build().GetTxOrThrow());
+    }
+
+    std::atomic<size_t> nNext(0), nAccepted(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = nNext++) < nTxs) {
+            CValidationState state;
+            uint32_t nPrecheckBranchId;
+            if (!PreCheckTransactionForMempool(vtx[i], state, nPrecheckBranchId))
+                continue;
+            LOCK(cs_main);
+            bool fPrecheckValid = nPrecheckBranchId == CurrentEpochBranchId(chainActive.Height() + 1, Params().GetConsensus());
+            if (AcceptToMemoryPool(pool, state, vtx[i], true, NULL, false, -1, fPrecheckValid))
+                nAccepted++;
+        }
+    };
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++)
+        threads.emplace_back(worker);
+    for (auto it = threads.begin(); it != threads.end(); it++)
+        it->join();
+    double t = timer_stop(tv_start);
+
+    LogPrintf("%s: %u of %u transactions accepted on %d threads, %.1f accepted tx/s\n", __func__, nAccepted.load(), nTxs, nThreads, nAccepted.load() / t);
+    return t;
+}
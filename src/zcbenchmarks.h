@@ -8,8 +8,8 @@ extern double benchmark_sleep();
 // extern double benchmark_parameter_loading();
 // extern double benchmark_create_joinsplit();
 // extern std::vector<double> benchmark_create_joinsplit_threaded(int nThreads);
-extern double benchmark_solve_equihash();
-extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads);
+extern double benchmark_solve_equihash(const std::string& solver);
+extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads, const std::string& solver);
 // extern double benchmark_verify_joinsplit(const JSDescription &joinsplit);
 extern double benchmark_verify_equihash();
 extern double benchmark_large_tx(size_t nInputs);
@@ -23,5 +23,7 @@ extern double benchmark_create_sapling_spend();
 extern double benchmark_create_sapling_output();
 extern double benchmark_verify_sapling_spend();
 extern double benchmark_verify_sapling_output();
+extern double benchmark_mempool_stress(size_t nTxs);
+extern double benchmark_mempool_flood(size_t nTxs, int nThreads);
 
 #endif